@@ -0,0 +1,306 @@
+// bench/bench_kernels.c
+// Kernel microbenchmarks over the gen_corpus files.
+//
+//   bench_kernels DIR [MIN_SECONDS]
+//
+// One TSV row per (kernel, corpus), same columns as bench/run_bench.sh:
+//   kernel  NAME  CORPUS  BYTES  RECORDS  SECONDS  GB/S  RECORDS/S
+// BYTES/RECORDS/SECONDS are per pass (mean over passes). Each kernel repeats
+// until MIN_SECONDS (default 0.5) of timed work. In-place kernels get a
+// fresh copy of the corpus before every pass; the copy is not timed.
+#include "engine.h"
+#include "lineio.h"
+#include "ops.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    const char *name;
+    char   *orig;     // file contents
+    char   *work;     // scratch copy the kernels run on
+    size_t  len;
+    FpRec  *recs;     // one view per line, into work
+    size_t  n;
+} Corpus;
+
+static double min_sec = 0.5;
+static volatile size_t sink;   // keeps results live
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int corpus_load(Corpus *c, const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    memset(c, 0, sizeof *c);
+    c->name = name;
+    FILE *f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "bench_kernels: %s: %s\n", path, strerror(errno)); return -1; }
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    c->len = sz > 0 ? (size_t)sz : 0;
+    c->orig = malloc(c->len + 1);
+    c->work = malloc(c->len + 1);
+    if (!c->orig || !c->work || fread(c->orig, 1, c->len, f) != c->len) { fclose(f); return -1; }
+    fclose(f);
+    memcpy(c->work, c->orig, c->len);
+
+    size_t cap = 1 << 16, off = 0;
+    c->recs = malloc(cap * sizeof *c->recs);
+    if (!c->recs) return -1;
+    while (off < c->len) {
+        if (c->n + FP_BATCH_MAX > cap) {
+            cap *= 2;
+            FpRec *nr = realloc(c->recs, cap * sizeof *nr);
+            if (!nr) return -1;
+            c->recs = nr;
+        }
+        size_t used = 0;
+        size_t k = fp_split_lines(c->work + off, c->len - off, '\n', c->recs + c->n, FP_BATCH_MAX, &used);
+        if (k == 0) {   // unterminated last line
+            c->recs[c->n].ptr = c->work + off;
+            c->recs[c->n].len = c->len - off;
+            c->n++;
+            break;
+        }
+        c->n += k;
+        off += used;
+    }
+    return 0;
+}
+
+static void corpus_free(Corpus *c) {
+    free(c->orig); free(c->work); free(c->recs);
+}
+
+typedef size_t (*kernel_fn)(Corpus *c, void *ctx);
+
+static void bench(const char *name, Corpus *c, kernel_fn fn, void *ctx, int in_place) {
+    double spent = 0;
+    long passes = 0;
+    do {
+        if (in_place) memcpy(c->work, c->orig, c->len);
+        // views may have been shrunk by the previous pass
+        if (in_place && passes > 0) {
+            size_t off = 0;
+            for (size_t k = 0; k < c->n; k++) {
+                c->recs[k].ptr = c->work + off;
+                char *nl = memchr(c->work + off, '\n', c->len - off);
+                c->recs[k].len = nl ? (size_t)(nl - (c->work + off)) + 1 : c->len - off;
+                off += c->recs[k].len;
+            }
+        }
+        double t0 = now_sec();
+        sink += fn(c, ctx);
+        spent += now_sec() - t0;
+        passes++;
+    } while (spent < min_sec);
+
+    double per = spent / (double)passes;
+    printf("kernel\t%s\t%s\t%zu\t%zu\t%.6f\t%.3f\t%.0f\n", name, c->name, c->len, c->n,
+           per, (double)c->len / per / 1e9, (double)c->n / per);
+    fflush(stdout);
+}
+
+/* ---- kernels ---- */
+
+static size_t k_split(Corpus *c, void *ctx) {
+    (void)ctx;
+    FpRec out[FP_BATCH_MAX];
+    size_t off = 0, n = 0;
+    while (off < c->len) {
+        size_t used = 0;
+        size_t k = fp_split_lines(c->work + off, c->len - off, '\n', out, FP_BATCH_MAX, &used);
+        if (k == 0) break;
+        n += k;
+        off += used;
+    }
+    return n;
+}
+
+static size_t k_tr(Corpus *c, void *ctx) {
+    const fp_trspec *t = ctx;
+    size_t n = 0;
+    for (size_t k = 0; k < c->n; k++) {
+        char *p = c->recs[k].ptr; size_t len = c->recs[k].len;
+        fp_tr_inplace(&p, &len, t);
+        n += len;
+    }
+    return n;
+}
+
+typedef struct {
+    const OpSpec *spec;
+    void         *cfg;
+    FpBatch       b;
+} OpCtx;
+
+// MAP/FILTER op through its consume_batch hook, batch by batch like the engine
+static size_t k_op(Corpus *c, void *vctx) {
+    OpCtx *o = vctx;
+    size_t kept = 0;
+    for (size_t base = 0; base < c->n; base += o->b.cap) {
+        size_t m = c->n - base < o->b.cap ? c->n - base : o->b.cap;
+        fp_batch_reset(&o->b);
+        memcpy(o->b.recs, c->recs + base, m * sizeof *o->b.recs);
+        for (size_t k = 0; k < m; k++) o->b.sel[k] = (uint32_t)k;
+        o->b.n = o->b.nsel = m;
+        if (o->spec->consume_batch(o->cfg, &o->b) < 0) return 0;
+        kept += o->b.nsel;
+    }
+    return kept;
+}
+
+static size_t k_regex(Corpus *c, void *ctx) {
+    fp_regex *r = ctx;
+    size_t hits = 0;
+    for (size_t k = 0; k < c->n; k++) hits += fp_regex_match(r, c->recs[k].ptr, c->recs[k].len) == 1;
+    return hits;
+}
+
+// glibc regexec on the same records, the baseline for the regex_match rows
+static size_t k_regexec(Corpus *c, void *ctx) {
+    regex_t *rx = ctx;
+    size_t hits = 0;
+    for (size_t k = 0; k < c->n; k++) {
+        regmatch_t m[1] = { { 0, (regoff_t)c->recs[k].len } };
+        hits += regexec(rx, c->recs[k].ptr, 1, m, REG_STARTEND) == 0;
+    }
+    return hits;
+}
+
+static size_t k_multilit(Corpus *c, void *ctx) {
+    const fp_multilit *m = ctx;
+    size_t hits = 0;
+    for (size_t k = 0; k < c->n; k++) hits += fp_multilit_find(m, c->recs[k].ptr, c->recs[k].len) != NULL;
+    return hits;
+}
+
+// n literals "user=uNNNNN" (every 37th id), like a blocklist
+static void bench_multilit(const char *name, Corpus *c, size_t n, int icase) {
+    char **pats = calloc(n, sizeof *pats);
+    size_t *lens = calloc(n, sizeof *lens);
+    fp_multilit *m = NULL;
+    if (!pats || !lens) goto out;
+    for (size_t k = 0; k < n; k++) {
+        if (!(pats[k] = malloc(16))) goto out;
+        lens[k] = (size_t)snprintf(pats[k], 16, "user=u%05zu", (k * 37) % 100000);
+    }
+    if ((m = fp_multilit_new((const char *const *)pats, lens, n, icase)))
+        bench(name, c, k_multilit, m, 0);
+out:
+    fp_multilit_free(m);
+    for (size_t k = 0; pats && k < n; k++) free(pats[k]);
+    free(pats); free(lens);
+}
+
+static int op_ctx_init(OpCtx *o, const char *const *args, int argc) {
+    memset(o, 0, sizeof *o);
+    o->spec = lookup_op(args[0]);
+    if (!o->spec || !o->spec->consume_batch) return -1;
+    if (o->spec->parse(argc, (char **)args, 0, &o->cfg) <= 0) return -1;
+    return fp_batch_init(&o->b, FP_BATCH_MAX);
+}
+
+static void op_ctx_free(OpCtx *o) {
+    if (o->spec && o->spec->destroy && o->cfg) o->spec->destroy(o->cfg);
+    fp_batch_free(&o->b);
+}
+
+static void bench_op(const char *name, Corpus *c, const char *const *args, int argc, int in_place) {
+    OpCtx o;
+    if (op_ctx_init(&o, args, argc) < 0) {
+        fprintf(stderr, "bench_kernels: cannot set up %s\n", name);
+        op_ctx_free(&o);
+        return;
+    }
+    bench(name, c, k_op, &o, in_place);
+    op_ctx_free(&o);
+}
+
+static void bench_regex(const char *name, Corpus *c, const char *pat, int ext, int icase, int fixed) {
+    fp_regex r;
+    if (fp_regex_compile(&r, pat, ext, icase, fixed) < 0) {
+        fprintf(stderr, "bench_kernels: bad pattern %s\n", pat);
+        return;
+    }
+    bench(name, c, k_regex, &r, 0);
+    fp_regex_free(&r);
+}
+
+// An ERE through fp_regex (the in-tree DFA) and through regcomp/regexec.
+static void bench_regex_vs(const char *what, Corpus *c, const char *pat) {
+    char name[64];
+    regex_t rx;
+    snprintf(name, sizeof name, "regex_match/%s", what);
+    bench_regex(name, c, pat, 1, 0, 0);
+    if (regcomp(&rx, pat, REG_EXTENDED | REG_NOSUB | REG_NEWLINE) != 0) return;
+    snprintf(name, sizeof name, "regexec/%s", what);
+    bench(name, c, k_regexec, &rx, 0);
+    regfree(&rx);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: bench_kernels DIR [MIN_SECONDS]\n");
+        return 2;
+    }
+    if (argc > 2) min_sec = atof(argv[2]);
+
+    Corpus logs, csv, wide, lng;
+    if (corpus_load(&logs, argv[1], "logs.txt") < 0 || corpus_load(&csv, argv[1], "data.csv") < 0 ||
+        corpus_load(&wide, argv[1], "wide.tsv") < 0 || corpus_load(&lng, argv[1], "long.txt") < 0)
+        return 1;
+
+    char split_name[32];
+    snprintf(split_name, sizeof split_name, "split_lines/%s", fp_split_kernel());
+    bench(split_name, &logs, k_split, NULL, 0);
+    bench(split_name, &wide, k_split, NULL, 0);
+    bench(split_name, &lng, k_split, NULL, 0);
+
+    fp_trspec up = {0}, pad = {0}, dig = {0};
+    dig.delete_mode = 1;
+    if (fp_trspec_build(&up, "a-z", "A-Z") == 0) {
+        bench("tr_inplace/a-z:A-Z", &logs, k_tr, &up, 1);
+        bench("tr_inplace/a-z:A-Z", &lng, k_tr, &up, 1);
+    }
+    if (fp_trspec_build(&pad, "a-z", "0-9") == 0)   /* k-z pad to 9: a table */
+        bench("tr_inplace/a-z:0-9", &logs, k_tr, &pad, 1);
+    if (fp_trspec_build(&dig, "0-9", "") == 0)
+        bench("tr_inplace/-d:0-9", &logs, k_tr, &dig, 1);
+    static const char *const tr_del[] = { "tr", "-d", "0-9" };
+    bench_op("tr_batch/-d:0-9", &lng, tr_del, 3, 1);
+
+    static const char *const cut_log[]  = { "cut", "-d", " ", "-f", "3,4" };
+    static const char *const cut_csv[]  = { "cut", "-d", ",", "-f", "2,4" };
+    static const char *const cut_wide[] = { "cut", "-f", "1,100-102" };
+    static const char *const cut_head[] = { "cut", "-f", "1-3" };
+    bench_op("cut_batch/-f3,4", &logs, cut_log, 5, 1);
+    bench_op("cut_batch/-f2,4", &csv, cut_csv, 5, 1);
+    bench_op("cut_batch/-f1,100-102", &wide, cut_wide, 3, 1);
+    bench_op("cut_batch/-f1-3", &wide, cut_head, 3, 1);
+
+    bench_regex_vs("status=5xx", &logs, "status=5[0-9][0-9]");
+    bench_regex_vs("ERROR.*timeout", &logs, "ERROR.*timeout");
+    bench_regex_vs("alternation", &logs, "(alpha|bravo|delta)/(tango|miss)");
+    bench_regex_vs("latency=4digits", &logs, "latency_ms=[0-9]{4} ");
+    bench_regex("regex_match/fixed", &logs, "ERROR", 0, 0, 1);
+    bench_regex("regex_match/fixed-i", &logs, "timeout", 0, 1, 1);
+    bench_regex("regex_match/fixed", &lng, "zulu7", 0, 0, 1);
+
+    bench_multilit("multilit/16", &logs, 16, 0);
+    bench_multilit("multilit/16-i", &logs, 16, 1);
+    bench_multilit("multilit/2000", &logs, 2000, 0);
+
+    corpus_free(&logs); corpus_free(&csv); corpus_free(&wide); corpus_free(&lng);
+    return 0;
+}
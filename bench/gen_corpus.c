@@ -0,0 +1,153 @@
+// bench/gen_corpus.c
+// Deterministic benchmark corpora: same (MB, seed) => byte-identical files.
+//
+//   gen_corpus DIR [MB] [SEED]
+//
+// Writes into DIR (about MB MiB each):
+//   logs.txt  space-separated access/app log lines (~110 bytes)
+//   data.csv  8-column CSV with a header row (~60 bytes)
+//   wide.tsv  200 tab-separated numeric fields per row (~1.4 KiB)
+//   long.txt  very long lines (64 KiB - 1 MiB of words)
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static uint64_t rng_state;
+
+static uint64_t rng(void) {            // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+static unsigned rnd(unsigned n) { return (unsigned)(rng() % n); }
+
+static const char *WORDS[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey",
+    "xray", "yankee", "zulu", "cache", "miss", "timeout", "retry", "connect",
+    "reset", "queue", "flush", "commit", "rollback",
+};
+#define NWORDS (sizeof WORDS / sizeof WORDS[0])
+
+static const char *LEVELS[] = { "DEBUG", "INFO", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+static const char *COMPONENTS[] = { "api", "auth", "db", "cache", "worker", "sched", "gateway" };
+static const char *CITIES[] = {
+    "amsterdam", "berlin", "cairo", "denver", "edinburgh", "fukuoka", "geneva",
+    "helsinki", "istanbul", "jakarta", "kyoto", "lisbon", "madrid", "nairobi",
+};
+static const int STATUS[] = { 200, 200, 200, 200, 201, 204, 301, 304, 400, 403, 404, 500, 502, 503 };
+
+#define PICK(a) (a[rnd(sizeof a / sizeof a[0])])
+
+// Argument evaluation order is unspecified, so every draw goes through a
+// local in sequence; otherwise output would depend on the compiler.
+static int gen_logs(FILE *f, size_t target) {
+    size_t n = 0;
+    while (n < target) {
+        unsigned mon = 1 + rnd(12), day = 1 + rnd(28), hh = rnd(24), mm = rnd(60), ss = rnd(60);
+        unsigned ms = rnd(1000);
+        const char *lvl = PICK(LEVELS), *comp = PICK(COMPONENTS);
+        unsigned user = rnd(100000);
+        const char *p1 = WORDS[rnd(NWORDS)], *p2 = WORDS[rnd(NWORDS)];
+        int status = PICK(STATUS);
+        unsigned lat = rnd(5000);
+        const char *m1 = WORDS[rnd(NWORDS)], *m2 = WORDS[rnd(NWORDS)], *m3 = WORDS[rnd(NWORDS)];
+        int w = fprintf(f, "2024-%02u-%02u %02u:%02u:%02u.%03u %s %s user=u%05u req=/%s/%s status=%d latency_ms=%u msg=\"%s %s %s\"\n",
+                        mon, day, hh, mm, ss, ms, lvl, comp, user, p1, p2, status, lat, m1, m2, m3);
+        if (w < 0) return -1;
+        n += (size_t)w;
+    }
+    return 0;
+}
+
+static int gen_csv(FILE *f, size_t target) {
+    size_t n = (size_t)fprintf(f, "id,name,city,amount,qty,flag,code,note\n");
+    for (unsigned long id = 1; n < target; id++) {
+        const char *name = WORDS[rnd(NWORDS)];
+        unsigned num = rnd(1000);
+        const char *city = PICK(CITIES);
+        unsigned amt = rnd(100000), cents = rnd(100), qty = 1 + rnd(50);
+        char flag = "YN"[rnd(2)];
+        char c1 = (char)('A' + rnd(26)), c2 = (char)('A' + rnd(26));
+        unsigned code = rnd(10000);
+        const char *note = WORDS[rnd(NWORDS)];
+        int w = fprintf(f, "%lu,%s%u,%s,%u.%02u,%u,%c,%c%c%04u,%s\n",
+                        id, name, num, city, amt, cents, qty, flag, c1, c2, code, note);
+        if (w < 0) return -1;
+        n += (size_t)w;
+    }
+    return 0;
+}
+
+static int gen_wide(FILE *f, size_t target) {
+    size_t n = 0;
+    while (n < target) {
+        for (int k = 0; k < 200; k++) {
+            int w = fprintf(f, "%s%u", k ? "\t" : "", rnd(10000000));
+            if (w < 0) return -1;
+            n += (size_t)w;
+        }
+        if (fputc('\n', f) == EOF) return -1;
+        n++;
+    }
+    return 0;
+}
+
+static int gen_long(FILE *f, size_t target) {
+    size_t n = 0;
+    while (n < target) {
+        size_t len = ((size_t)64 << 10) + rnd((1u << 20) - (64u << 10));
+        for (size_t l = 0; l < len; ) {
+            const char *w = WORDS[rnd(NWORDS)];
+            int sep = rnd(8) ? ' ' : '0' + (int)rnd(10);
+            if (fputs(w, f) == EOF || fputc(sep, f) == EOF) return -1;
+            l += strlen(w) + 1;
+        }
+        if (fputc('\n', f) == EOF) return -1;
+        n += len + 1;
+    }
+    return 0;
+}
+
+static int gen_file(const char *dir, const char *name, int (*gen)(FILE *, size_t), size_t target) {
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "gen_corpus: %s: %s\n", path, strerror(errno)); return -1; }
+    int r = gen(f, target);
+    if (fclose(f) != 0) r = -1;
+    if (r < 0) fprintf(stderr, "gen_corpus: write %s failed\n", path);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: gen_corpus DIR [MB] [SEED]\n");
+        return 2;
+    }
+    const char *dir = argv[1];
+    size_t mb = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+    if (mb == 0) mb = 1;
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "gen_corpus: %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    size_t target = mb << 20;
+    // each file gets its own stream so sizes/order never shift the others
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    if (gen_file(dir, "logs.txt", gen_logs, target) < 0) return 1;
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 2;
+    if (gen_file(dir, "data.csv", gen_csv, target) < 0) return 1;
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 3;
+    if (gen_file(dir, "wide.tsv", gen_wide, target) < 0) return 1;
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 4;
+    if (gen_file(dir, "long.txt", gen_long, target) < 0) return 1;
+    return 0;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env bash
+# Throughput benchmarks: kernel microbenchmarks, then fx pipelines against the
+# equivalent coreutils pipelines on the same corpus.
+#
+# Machine-readable TSV on stdout (one header line starting with '#'):
+#   type  name  corpus  bytes  records  seconds  gb_s  rec_s
+# type is "kernel", "fx" or "coreutils". Kernel rows are mean per pass; fx and
+# coreutils rows are the best wall time of BENCH_REPS runs over the whole
+# file, with bytes/records counted on the input. Loop rows ("fx" and
+# "fx-nocache", corpus "-") time many one-line fx calls; records = calls.
+#
+# Knobs (env): BENCH_MB (corpus MiB per file, 64), BENCH_REPS (3),
+# BENCH_MIN_SEC (timed seconds per kernel, 0.5), BENCH_CORPUS (dir),
+# BUILD_DIR (build), FX_SO (loadable to test), BASH_BIN (bash).
+set -euo pipefail
+cd "$(dirname "$0")/.."
+
+BUILD_DIR=${BUILD_DIR:-build}
+FX_SO=${FX_SO:-$BUILD_DIR/fx_bash.so}
+BASH_BIN=${BASH_BIN:-bash}
+BENCH_MB=${BENCH_MB:-64}
+BENCH_REPS=${BENCH_REPS:-3}
+BENCH_MIN_SEC=${BENCH_MIN_SEC:-0.5}
+CORPUS=${BENCH_CORPUS:-$BUILD_DIR/corpus}
+
+# The corpus is deterministic, so only regenerate when the size changes
+if [[ ! -f $CORPUS/.mb || $(<"$CORPUS/.mb") != "$BENCH_MB" ]]; then
+  "$BUILD_DIR/gen_corpus" "$CORPUS" "$BENCH_MB"
+  echo "$BENCH_MB" > "$CORPUS/.mb"
+fi
+
+printf '# type\tname\tcorpus\tbytes\trecords\tseconds\tgb_s\trec_s\n'
+"$BUILD_DIR/bench_kernels" "$CORPUS" "$BENCH_MIN_SEC"
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+status=0
+
+# lookup table for join: about half the names in data.csv, with a value
+awk -F , 'NR % 2 { print $2 "," NR }' "$CORPUS/data.csv" > "$tmp/names.csv"
+
+# best_of OUT CMD: best wall seconds of CMD (stdout to OUT) over BENCH_REPS runs
+best_of() {
+  local out=$1 cmd=$2 best= t0 t1 ns
+  for ((r = 0; r < BENCH_REPS; r++)); do
+    t0=$(date +%s%N)
+    "$BASH_BIN" -c "$cmd" > "$out" || true   # grep-like "no match" exits 1
+    t1=$(date +%s%N)
+    ns=$((t1 - t0))
+    if [[ -z $best || $ns -lt $best ]]; then best=$ns; fi
+  done
+  echo "$best"
+}
+
+row() { # type name corpus ns
+  local f=$CORPUS/$3 bytes recs
+  bytes=$(stat -c %s "$f")
+  recs=$(wc -l < "$f")
+  awk -v t="$1" -v n="$2" -v c="$3" -v b="$bytes" -v r="$recs" -v ns="$4" 'BEGIN {
+    s = ns / 1e9; if (s <= 0) s = 1e-9
+    printf "%s\t%s\t%s\t%d\t%d\t%.6f\t%.3f\t%.0f\n", t, n, c, b, r, s, b / s / 1e9, r / s }'
+}
+
+# e2e NAME CORPUS FX_ARGS PIPELINE: same input through fx and through coreutils
+e2e() {
+  local name=$1 corpus=$2 fxargs=$3 pipeline=$4 f=$CORPUS/$2 ns
+  # leading redirection feeds the first command of the pipeline
+  ns=$(best_of "$tmp/fx.out" "enable -f '$FX_SO' fx && < '$f' fx $fxargs")
+  row fx "$name" "$corpus" "$ns"
+  ns=$(best_of "$tmp/cu.out" "< '$f' $pipeline")
+  row coreutils "$name" "$corpus" "$ns"
+  if ! cmp -s "$tmp/fx.out" "$tmp/cu.out"; then
+    echo "run_bench: $name: fx output differs from coreutils" >&2
+    status=1
+  fi
+}
+
+e2e cut-tr-grep-head     logs.txt "cut -d ' ' -f 3,4 tr a-z A-Z grep -F ERROR take 100000" \
+                                  "cut -d ' ' -f 3,4 | tr a-z A-Z | grep -F ERROR | head -n 100000"
+e2e cut-tr-grep-head-j4  logs.txt "-j 4 cut -d ' ' -f 3,4 tr a-z A-Z grep -F ERROR take 100000" \
+                                  "cut -d ' ' -f 3,4 | tr a-z A-Z | grep -F ERROR | head -n 100000"
+e2e grep-regex           logs.txt "grep -E 'status=5[0-9]{2}'"  "grep -E 'status=5[0-9]{2}'"
+e2e grep-fixed-icase     logs.txt "grep -F -i timeout"          "grep -F -i timeout"
+e2e grep-fixed-j4        logs.txt "-j 4 grep -F timeout"        "grep -F timeout"
+e2e cat                  logs.txt "cat"                         "cat"
+e2e cut-grep             data.csv "cut -d , -f 2,4 grep -E '^[a-m]'" "cut -d , -f 2,4 | grep -E '^[a-m]'"
+e2e grep-field-cut       data.csv "grep --field 3 -d , -E '^[a-m]' cut -d , -f 2,5" \
+                                  "awk -F , '\$3 ~ /^[a-m]/' | cut -d , -f 2,5"
+e2e cut-csv              data.csv "cut --csv -d , -f 2,5"        "cut -d , -f 2,5"
+e2e cut-wide             wide.tsv "cut -f 1,100-102"            "cut -f 1,100-102"
+e2e cut-wide-head        wide.tsv "cut -f 1-3"                  "cut -f 1-3"
+e2e cut-outdelim         data.csv "cut -d , -f 1-4 --output-delimiter=' | '" \
+                                  "cut -d , -f 1-4 --output-delimiter=' | '"
+e2e tr-delete-long       long.txt "tr -d 0-9"                   "tr -d 0-9"
+e2e gsub-fixed           logs.txt "gsub ERROR E"                "sed 's/ERROR/E/g'"
+e2e uniq-count-field     logs.txt "cut -d ' ' -f 3 uniq -c"     "cut -d ' ' -f 3 | LC_ALL=C sort | uniq -c"
+e2e sort-lines           logs.txt "sort"                        "LC_ALL=C sort"
+e2e sort-numeric-field   data.csv "sort -n -d , -f 4"           "LC_ALL=C sort -n -t , -k 4,4"
+e2e top-numeric-field    data.csv "top -n 100 -d , -k 4"        "LC_ALL=C sort -n -t , -k 4,4 | head -n 100"
+e2e join-field           data.csv "join -d , -f 2 '$tmp/names.csv'" \
+                                  "awk -F , 'NR == FNR { if (!(\$1 in m)) m[\$1] = \$2; next } (\$2 in m) { print \$0 \",\" m[\$2] }' '$tmp/names.csv' -"
+e2e agg-sum-by-field     data.csv "agg -d , -k 3 count sum:5"   "awk -F , '{ n[\$3]++; s[\$3] += \$5 } END { for (k in n) print k \",\" n[k] \",\" s[k] }' | LC_ALL=C sort"
+e2e sub-groups           logs.txt "sub -E 'status=([0-9]+)' 's:\\1'" "sed -E 's/status=([0-9]+)/s:\\1/'"
+
+# loop NAME N FX_ARGS: N short fx calls in one bash (startup cost per call),
+# with the compiled-spec cache and without it; records = calls
+loop() {
+  local name=$1 n=$2 fxargs=$3 ns
+  for mode in fx fx-nocache; do
+    local pre=
+    [[ $mode == fx-nocache ]] && pre='fx --cache-max 0;'
+    ns=$(best_of "$tmp/loop.out" "enable -f '$FX_SO' fx && $pre for ((i = 0; i < $n; i++)); do fx emit x $fxargs; done")
+    awk -v t="$mode" -v m="$name" -v r="$n" -v ns="$ns" 'BEGIN {
+      s = ns / 1e9; if (s <= 0) s = 1e-9
+      printf "%s\t%s\t-\t0\t%d\t%.6f\t0.000\t%.0f\n", t, m, r, s, r / s }'
+  done
+}
+
+loop loop-grep-regex 2000 "grep -E '(alpha|bravo|delta)/(tango|miss)'"
+loop loop-cut-tr     2000 "cut -d , -f 1,3-5 tr a-z A-Z"
+
+exit $status
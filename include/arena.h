@@ -0,0 +1,40 @@
+// include/arena.h
+#ifndef FP_ARENA_H
+#define FP_ARENA_H
+
+#include <stddef.h>
+
+/* ---- Bump arena ----
+   Memory handed out from large chunks and given back all at once. Unlike
+   FpBatch.data, which is realloc'ed and rebased, nothing in an arena ever
+   moves, so views into it stay valid until the next reset. Every batch
+   owns one (FpBatch.arena): a MAP whose output outgrows its record writes
+   it there and points the view at it, and the engine resets the arena
+   with the batch, keeping the chunks for the next one. */
+#ifndef FP_ARENA_CHUNK
+#define FP_ARENA_CHUNK ((size_t)256 << 10)
+#endif
+
+typedef struct fp_arena_chunk fp_arena_chunk;
+
+typedef struct {
+    fp_arena_chunk *head;   /* chunks in the order they are filled */
+    fp_arena_chunk *cur;    /* the one allocations come from */
+    size_t          held;   /* bytes of chunk storage held */
+} FpArena;
+
+/* n bytes aligned for any type, or NULL on OOM. */
+void  *fp_arena_alloc(FpArena *a, size_t n);
+/* At least need unaligned bytes at the write position, or NULL on OOM; for
+   output of unknown length: reserve the bound, write, commit what was used. */
+char  *fp_arena_reserve(FpArena *a, size_t need);
+void   fp_arena_commit(FpArena *a, size_t used);
+/* Copy of [s, s+n) */
+char  *fp_arena_dup(FpArena *a, const char *s, size_t n);
+
+/* Forget every allocation. Standard chunks are kept for reuse; oversized
+   ones (for single allocations over FP_ARENA_CHUNK) are freed. */
+void   fp_arena_reset(FpArena *a);
+void   fp_arena_free(FpArena *a);
+
+#endif /* FP_ARENA_H */
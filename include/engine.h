@@ -3,6 +3,10 @@
 #define FP_ENGINE_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
 
 typedef enum { OP_SRC, OP_MAP, OP_FILTER, OP_SINK } OpKind;
 
@@ -14,6 +18,80 @@ enum {
     ENG_ERR = -1,
 };
 
+// Batch sizing: records per batch and soft byte cap for copied record data
+#ifndef FP_BATCH_MAX
+#define FP_BATCH_MAX 2048
+#endif
+#ifndef FP_BATCH_BYTES
+#define FP_BATCH_BYTES (1<<20)
+#endif
+
+// A record view: bytes [ptr, ptr+len), normally including the trailing '\n'.
+typedef struct {
+    char  *ptr;
+    size_t len;
+} FpRec;
+
+// Field view of one record (see fp_batch_fields): its delimiter offsets
+// are fvpos[off, off+nd). Valid while gen is the batch's fvgen.
+typedef struct {
+    uint32_t gen;
+    uint32_t off, nd;
+    uint32_t all;     // nd is every delimiter the line has
+} FpFieldIdx;
+
+// A batch of record views plus a selection vector of the records still alive.
+// Sources append to recs[]; MAP/FILTER ops rewrite views and compact sel[].
+typedef struct FpBatch {
+    FpRec    *recs;   // record views, in input order
+    size_t    n;      // number of records produced
+    size_t    cap;    // capacity of recs/sel (FP_BATCH_MAX unless a block needed more)
+    uint32_t *sel;    // ascending indices into recs of live records
+    size_t    nsel;
+    int       worker; // index of the thread running MAP/FILTER ops (0 when serial)
+
+    // Byte storage owned by the batch (used when a source must copy lines)
+    char     *data;
+    size_t    dlen;
+    size_t    dcap;
+
+    // Scratch for MAP output that outgrows its record (never moved; reset
+    // with the batch). A MAP points the record's view at it instead of
+    // rewriting in place, with no malloc per line.
+    FpArena   arena;
+
+    // Unsplit input. When the engine sets blocks, a block source may hand
+    // over whole lines [blk, blk+blen) (the last maybe unterminated) with
+    // n == 0; the first op's consume_block, or fp_batch_split, makes records.
+    int       blocks;
+    char     *blk;
+    size_t    blen;
+
+    // Field views: where each record's delimiters are, found when an op
+    // first asks (fp_batch_fields) and reused by later ops asking for the
+    // same delimiter. A MAP step may rewrite records, so the engine drops
+    // them all after one runs (fp_batch_fields_invalidate).
+    FpFieldIdx *fv;       // per record (fvcap entries)
+    size_t      fvcap;
+    uint32_t   *fvpos;    // the records' delimiter offsets, back to back
+    size_t      fvlen, fvposcap;
+    uint32_t    fvgen;    // current generation, 0: no views
+    uint32_t    fvseq;    // last generation handed out
+    char        fvdelim;
+
+    // Optional: set by a source whose views point into memory it recycles;
+    // called with release_ctx when the batch is reset or freed.
+    void    (*release)(void *ctx);
+    void     *release_ctx;
+} FpBatch;
+
+// Op properties reported to the plan optimizer (OpSpec.props)
+enum {
+    FP_PROP_1TO1      = 1u << 0,  // MAP: never drops a record or changes the record count
+    FP_PROP_CASE_ONLY = 1u << 1,  // MAP: only swaps ASCII letter case (length preserving)
+    FP_PROP_CASE_BLIND= 1u << 2,  // FILTER: verdict ignores ASCII letter case
+};
+
 typedef struct OpSpec {
     const char *name;
     OpKind kind;
@@ -27,6 +105,7 @@ typedef struct OpSpec {
 
     // MAP/FILTER: consume one line. May modify *linep in place (preferred).
     // Return: 0 => emit (len may change), >0 => drop (ENG_DROP), <0 => error.
+    // Output longer than the line needs consume_batch and b->arena.
     int  (*consume)(void *cfg, char **linep, size_t *lenp);
 
     // SOURCE: produce one line into *linep/*lenp.
@@ -39,11 +118,67 @@ typedef struct OpSpec {
     // Optional end-of-stream hook.
     int  (*flush)(void *cfg);
 
+    // Optional MAP/FILTER end-of-stream producer, for ops that hold records
+    // back until the input ends (uniq -c, sort): append them to b (up to
+    // b->cap, views valid until the next call) and they run through the ops
+    // after this one to the sink. Called repeatedly after the stream ends
+    // (and fx -j workers are joined, so per-worker state can be merged here),
+    // before flush().
+    // Return: 1 => produced, 0 => nothing left, <0 => error.
+    int  (*flush_batch)(void *cfg, FpBatch *b);
+
     // Free cfg
     void (*destroy)(void *cfg);
 
     // Optional: hint engine to stop early (e.g., grep -m N). Return nonzero to stop.
     int  (*should_stop)(void *cfg);
+
+    // Optional MAP/FILTER batch kernel: process every record in b->sel, rewriting
+    // views in place (or pointing them into b->arena) and compacting b->sel to
+    // the survivors (order preserved).
+    // Return 0 on success, <0 on error. Ops without one get per-line consume().
+    int  (*consume_batch)(void *cfg, FpBatch *b);
+
+    // Optional SOURCE batch producer: append records to b (up to b->cap).
+    // Views must stay valid until b is reset or the source is destroyed, so
+    // several batches can be in flight at once (copy into b, or use stable memory).
+    // Return: 1 => produced (b->n > 0, or b->blk set), 0 => EOF, <0 => error.
+    int  (*produce_batch)(void *cfg, FpBatch *b);
+
+    // Optional: can this MAP/FILTER run concurrently in nworkers threads (fx -j)?
+    // Called once before init(). Return nonzero if so; the op then sees
+    // FpBatch.worker in [0, nworkers) and keeps any mutable state per worker.
+    // Ops without the hook (and every op after one) run in the serial tail.
+    int  (*parallel)(void *cfg, int nworkers);
+
+    // Optional SINK batch hook: take the records in b->sel, leaving selected
+    // the ones the engine should write to stdout (it batches them into writev).
+    // Return 0 => stop streaming, >0 => continue, <0 => error.
+    int  (*accept_batch)(void *cfg, FpBatch *b);
+
+    // Optional SOURCE fast path for identity plans (no MAP/FILTER/SINK): copy
+    // the rest of the input to outfd without splitting lines.
+    // Return: >0 => bytes were copied, 0 => input was empty, <0 => error.
+    int  (*passthrough)(void *cfg, int outfd);
+
+    // Optional plan-optimizer metadata: FP_PROP_* bits for this op as configured.
+    unsigned (*props)(void *cfg);
+
+    // Optional: absorb the directly following step of the same spec into this
+    // one. Return 1 if merged (the optimizer then destroys next_cfg), else 0.
+    int  (*fuse)(void *cfg, void *next_cfg);
+
+    // Optional SINK: if the sink just writes the first N records, return N.
+    long (*limit)(void *cfg);
+
+    // Optional: print the op's configuration (no newline) for fx --explain.
+    void (*explain)(void *cfg, FILE *out);
+
+    // Optional MAP/FILTER kernel for the first op after the sources: take
+    // the unsplit block b->blk and append records for the lines it keeps
+    // (fp_batch_add), selecting them all and clearing blk. Lets a filter
+    // search the block whole instead of line by line. Return as consume_batch.
+    int  (*consume_block)(void *cfg, FpBatch *b);
 } OpSpec;
 
 // A compiled plan step
@@ -52,18 +187,81 @@ typedef struct {
     void *cfg;
 } PlanStep;
 
+// fx --stats: counters for one step, summed over batches (and workers).
+// Records/bytes are the selected records before and after the step's hook;
+// ns is wall time inside the hook. Sources only count out, sinks only in.
+typedef struct {
+    uint64_t batches;
+    uint64_t rec_in, rec_out;
+    uint64_t bytes_in, bytes_out;
+    uint64_t ns;
+} FpStepStats;
+
+static inline uint64_t fp_stats_drops(const FpStepStats *s) {
+    return s->rec_in > s->rec_out ? s->rec_in - s->rec_out : 0;
+}
+
 typedef struct {
     PlanStep *steps;
     int       nsteps;
+    int       nthreads;   // fx -j N: MAP/FILTER worker threads (<=1 => single-threaded)
+    int       unordered;  // fx -u: emit parallel batches in completion order
+    long      limit;      // >0: stop sources after this many records (from take N)
+    FpStepStats *stats;   // optional: nsteps+1 entries (last = output writes), freed with the plan
 } Plan;
 
 // Public engine API
 int engine_run_plan(Plan *p); // returns exit code (0 ok, 1 no matches, >=2 errors)
 int engine_add_default_stdio_source_sink_if_needed(Plan *p);
 
+// Rewrite the plan (filter hoisting, op fusion, take => source limit).
+// Each applied rule is logged to log when non-NULL. Returns rewrites applied.
+int engine_optimize_plan(Plan *p, FILE *log);
+
+// Print the plan, one step per line, for fx --explain.
+void engine_explain_plan(const Plan *p, FILE *out);
+
+// Print p->stats as a table (one row per step plus output).
+void engine_print_stats(const Plan *p, FILE *out);
+
 // Helper to free a plan (calls destroy on cfgs).
 void engine_free_plan(Plan *p);
 
+// Batch helpers
+int  fp_batch_init(FpBatch *b, size_t cap);
+void fp_batch_reset(FpBatch *b);
+void fp_batch_free(FpBatch *b);
+// Ensure need free bytes after b->data[b->dlen] (views into data are rebased).
+// Returns the write position, or NULL on OOM. Caller advances b->dlen.
+char *fp_batch_reserve(FpBatch *b, size_t need);
+// Append a copy of line to the batch's own storage. Returns 0, or <0 on OOM.
+int  fp_batch_push_copy(FpBatch *b, const char *line, size_t len);
+// Append a view, growing recs/sel past cap if a block holds more lines.
+// Returns 0, or <0 on OOM.
+int  fp_batch_add(FpBatch *b, char *ptr, size_t len);
+// Turn an unsplit block into records, all selected. Returns 0, or <0 on OOM.
+int  fp_batch_split(FpBatch *b);
+// Offsets of the first delimiters of record i (its '\n' not counted),
+// at least upto of them unless the line has fewer, in which case *all is
+// set. Found on first use and kept for later ops until the batch is reset
+// or a MAP step runs. Returns NULL on OOM or for a line of 4 GiB or more:
+// the caller scans the line itself.
+const uint32_t *fp_batch_fields(FpBatch *b, size_t i, char delim, size_t upto,
+                                size_t *nd, int *all);
+// Has record i a field view for delim already (so reading it costs no scan)?
+static inline int fp_batch_has_fields(const FpBatch *b, size_t i, char delim) {
+    return b->fvgen && b->fvdelim == delim && i < b->fvcap && b->fv[i].gen == b->fvgen;
+}
+// Field f (1-based) of record i as [*p, *p + *n), without its '\n'.
+// Returns 1, 0 if the line has fewer fields, <0 as fp_batch_fields.
+int  fp_batch_field(FpBatch *b, size_t i, char delim, size_t f, const char **p, size_t *n);
+// Forget every field view (records were rewritten).
+static inline void fp_batch_fields_invalidate(FpBatch *b) { b->fvgen = 0; }
+// Is the batch full (record count or copied-bytes cap reached)?
+static inline int fp_batch_full(const FpBatch *b) {
+    return b->n >= b->cap || b->dlen >= FP_BATCH_BYTES;
+}
+
 // Default stdin-line source and stdout sink OpSpecs
 const OpSpec *engine_stdio_source();
 const OpSpec *engine_stdio_sink();
@@ -0,0 +1,47 @@
+// include/htab.h
+#ifndef FP_HTAB_H
+#define FP_HTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* ---- String-keyed hash table ----
+   Open addressing with linear probing over a power-of-two slot array. A
+   slot holds the entry index and the top 32 bits of the key's hash, so a
+   probe only touches an entry (and its key) when those bits agree. Keys
+   are copied into the table's arena when first inserted; entries and
+   their fixed-size values are kept in dense arrays in insertion order, so
+   walking 0..n-1 visits keys in the order they first appeared. */
+typedef struct {
+    const char *key;     /* in the table's arena */
+    size_t      klen;
+    uint64_t    hash;
+} fp_htent;
+
+typedef struct {
+    uint64_t *slots;     /* 0 empty, else hash >> 32 << 32 | (index + 1) */
+    size_t    mask;
+    fp_htent *ents;
+    char     *vals;      /* vsize bytes per entry, zeroed when inserted */
+    size_t    n, cap;
+    size_t    vsize;
+    FpArena   arena;     /* keys, and anything else the caller interns */
+} fp_htab;
+
+/* wyhash of [s, s+n) */
+uint64_t fp_hash(const void *s, size_t n, uint64_t seed);
+
+int    fp_htab_init(fp_htab *t, size_t vsize);
+/* Index of the entry for key [k, k+n), inserted (and *isnew set) if absent;
+   SIZE_MAX on OOM. */
+size_t fp_htab_get(fp_htab *t, const char *k, size_t n, int *isnew);
+/* Index of the entry for the key, or SIZE_MAX if absent */
+size_t fp_htab_find(const fp_htab *t, const char *k, size_t n);
+static inline void *fp_htab_val(const fp_htab *t, size_t i) { return t->vals + i * t->vsize; }
+/* Bytes held: slots, entries, values and the arena */
+size_t fp_htab_bytes(const fp_htab *t);
+void   fp_htab_free(fp_htab *t);
+
+#endif /* FP_HTAB_H */
@@ -0,0 +1,134 @@
+// include/lineio.h
+#ifndef FP_LINEIO_H
+#define FP_LINEIO_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "engine.h"
+
+/* Max bytes mapped at once when a whole-file mapping is refused (halved
+   down to FP_READ_MAX while the address space refuses that too) */
+#ifndef FP_MMAP_WINDOW
+#define FP_MMAP_WINDOW ((size_t)256 << 20)
+#endif
+
+/* Smallest/largest read(2) request of the block reader */
+#ifndef FP_READ_MIN
+#define FP_READ_MIN ((size_t)16 << 10)
+#endif
+#ifndef FP_READ_MAX
+#define FP_READ_MAX ((size_t)1 << 20)
+#endif
+
+/* ---- line splitting (AVX2/SSE2 with runtime dispatch, scalar fallback) ---- */
+
+/* Split [s, s+n) at every delim into at most max views written to out.
+   Each view includes its delimiter; bytes after the last delimiter found are
+   left alone. Returns the view count and sets *used to the bytes covered. */
+size_t fp_split_lines(char *s, size_t n, int delim, FpRec *out, size_t max, size_t *used);
+
+/* Name of the kernel picked at load time ("avx2", "sse2" or "scalar") */
+const char *fp_split_kernel(void);
+
+/* The *nth (>= 1) occurrence of c in [s, s+n): delimiters are counted 64
+   (AVX2) or 16 bytes at a time, so skipping to field 100 of a row costs a
+   popcount per block rather than a memchr per field. Returns NULL when
+   there are fewer, with *nth reduced by the number seen. */
+const char *fp_memchr_nth(const char *s, size_t n, int c, size_t *nth);
+
+/* ---- CSV structure (PCLMUL with AVX2/SSE2 loads, scalar fallback) ---- */
+
+/* Offsets in [s, s+n) of the delimiters outside double quotes, at most max
+   of them written to out. *inq is the quote state at s on entry and at
+   s+n on return, so the whole span is read even once max are found. Each
+   quote toggles the state, as in RFC 4180: an escaped "" inside a quoted
+   field leaves it unchanged. Returns the number of offsets written. The
+   vector kernels take the state inside each 64-byte block as a carry-less
+   product of its quote bits with all ones (a prefix XOR). */
+size_t fp_csv_delims(const char *s, size_t n, int delim, int *inq, uint32_t *out, size_t max);
+
+/* Name of the kernel picked at load time ("avx2+pclmul", "sse2+pclmul" or "scalar") */
+const char *fp_csv_kernel(void);
+
+/* ---- block line reader: large read(2) calls straight into batch storage ---- */
+typedef struct {
+    int    fd;
+    int    eof;
+    char  *carry;        /* partial last line of the previous block */
+    size_t carry_len;
+    size_t carry_cap;
+    size_t avg_len;      /* running line length estimate, sizes reads */
+} fp_linereader;
+
+void fp_linereader_init(fp_linereader *r, int fd);
+
+/* Read one block into b's storage and append its complete lines (plus the
+   unterminated tail at EOF), or with b->blocks set on an empty batch, leave
+   them unsplit in b->blk. Lines are split in place; what follows them (the
+   partial last line, and lines beyond b's record cap) is copied out to
+   carry and back into the next block. Returns 1 produced, 0 EOF, <0 error. */
+int  fp_linereader_fill(fp_linereader *r, FpBatch *b);
+
+void fp_linereader_free(fp_linereader *r);
+
+/* ---- mmap line source: zero-copy record views over a regular file ---- */
+typedef struct fp_mapwin fp_mapwin;   /* refcounted mapping window */
+
+typedef struct {
+    int        fd;
+    off_t      pos;        /* next unread file offset */
+    off_t      end;        /* file size when opened */
+    size_t     winsz;      /* window length; 0 => map the whole file */
+    fp_mapwin *win;        /* current window, NULL until first fill */
+} fp_mapsrc;
+
+/* Set up m over fd, starting at its current offset, if it is a regular file.
+   Returns 1 when mmap mode applies, 0 when fd is not a regular file. */
+int  fp_mapsrc_open(fp_mapsrc *m, int fd);
+
+/* Append line views from the mapping to b, or with b->blocks set on an
+   empty batch, point b->blk at about FP_READ_MAX bytes of whole lines.
+   Views stay valid until b is reset. Returns 1 produced, 0 EOF, <0 error. */
+int  fp_mapsrc_fill(fp_mapsrc *m, FpBatch *b);
+
+/* Drop the source's window reference. Returns the offset after the last
+   record handed out. */
+off_t fp_mapsrc_close(fp_mapsrc *m);
+
+/* ---- vectored output: batch record views into writev(2) ---- */
+
+#ifndef FP_WRITER_IOV
+#define FP_WRITER_IOV 1024            /* iovecs per writev call (<= IOV_MAX) */
+#endif
+#ifndef FP_WRITER_STAGE
+#define FP_WRITER_STAGE ((size_t)64 << 10)
+#endif
+#ifndef FP_WRITER_COPY_MAX
+#define FP_WRITER_COPY_MAX 256        /* stray records up to this size are copied */
+#endif
+
+typedef struct {
+    int          fd;
+    struct iovec iov[FP_WRITER_IOV];
+    int          niov;
+    char        *stage;     /* fixed buffer for copied records (never moves) */
+    size_t       slen;
+} fp_writer;
+
+int  fp_writer_init(fp_writer *w, int fd);
+
+/* Queue a view. Views adjacent to the previous one (unchanged slices of the
+   same input block) extend its iovec; small non-adjacent records (rewritten
+   by a MAP) are copied into the stage. Views must stay valid until flush.
+   Returns 0, or <0 on write error. */
+int  fp_writer_add(fp_writer *w, const char *p, size_t n);
+
+/* writev everything queued. Returns 0, or <0 on write error. */
+int  fp_writer_flush(fp_writer *w);
+void fp_writer_free(fp_writer *w);
+
+/* Copy in -> out until EOF with copy_file_range/splice, else read/write.
+   Returns bytes copied, or <0 on error. */
+long long fp_copy_fd(int in, int out);
+
+#endif // FP_LINEIO_H
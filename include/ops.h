@@ -13,6 +13,13 @@ const OpSpec *op_tr_spec();
 const OpSpec *op_grep_spec();
 const OpSpec *op_take_spec();
 const OpSpec *op_find_spec(); // SOURCE stub
+const OpSpec *op_sub_spec();  // MAP: sed s/PAT/REPL/
+const OpSpec *op_gsub_spec(); // MAP: sed s/PAT/REPL/g
+const OpSpec *op_uniq_spec(); // MAP: distinct keys (and counts), emitted at end of input
+const OpSpec *op_sort_spec(); // MAP: all records in key order, emitted at end of input
+const OpSpec *op_top_spec();  // MAP: the K first records in key order, emitted at end of input
+const OpSpec *op_agg_spec();  // MAP: count/sum/min/max/avg per key, emitted at end of input
+const OpSpec *op_join_spec(); // MAP: hash join (or semi/anti join) against a lookup file
 const OpSpec *op_emit_spec();  // SOURCE: emit lines from argv
 const OpSpec *op_cat_spec();  // SOURCE: cat like file reader
 
@@ -0,0 +1,43 @@
+// include/rx.h
+#ifndef FP_RX_H
+#define FP_RX_H
+
+#include <stddef.h>
+
+/* ---- In-tree regex matcher for grep (BRE/ERE subset) ----
+   The pattern is parsed into a Thompson NFA and run as a DFA whose states
+   are built the first time a line needs them and cached (states x byte
+   classes, up to FP_RX_CACHE_BYTES; a full cache is dropped and refilled).
+   grep only asks whether a line matches, so the search is unanchored and
+   stops at the first accepting state: one table step per byte, no
+   backtracking however many alternatives the pattern has.
+
+   Literals that every match must contain ("ERROR" and "timeout" in
+   ERROR.*timeout) are pulled out at compile time; the longest one is
+   searched with fp_finder before the automaton runs, or, for a top-level
+   alternation, one required literal per branch with fp_multilit.
+
+   Back-references, GNU backslash escapes (\w, \b, \<, ...), collating
+   elements and equivalence classes, and non-ASCII pattern bytes in a
+   multibyte locale are not handled: fp_rx_new returns NULL and the caller
+   uses regcomp. Matching mutates the cache, so each thread needs its own
+   fp_rx. */
+#ifndef FP_RX_CACHE_BYTES
+#define FP_RX_CACHE_BYTES (1u << 20)
+#endif
+
+typedef struct fp_rx fp_rx;
+
+/* NULL when the pattern is outside the subset (or invalid: regcomp then
+   reports the error). Flags as for regcomp with REG_NEWLINE. */
+fp_rx *fp_rx_new(const char *pat, int extended, int icase);
+int    fp_rx_match(fp_rx *r, const char *s, size_t len);   /* 1 match, 0 no */
+/* [s, s+len) may hold several lines: a pointer into the first one that
+   matches, or NULL. Lines without a required literal are not scanned. */
+const char *fp_rx_find(fp_rx *r, const char *s, size_t len);
+void   fp_rx_free(fp_rx *r);
+
+/* "dfa", plus the prefilter if any ("dfa, must 'timeout'"), for --explain */
+const char *fp_rx_describe(const fp_rx *r);
+
+#endif /* FP_RX_H */
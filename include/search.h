@@ -0,0 +1,51 @@
+// include/search.h
+#ifndef FP_SEARCH_H
+#define FP_SEARCH_H
+
+#include <stddef.h>
+
+/* ---- Fixed-string searcher (grep -F) ----
+   Candidates are positions where the needle's first and last bytes both
+   match, tested 32 (AVX2) or 16 (SSE2) positions at a time; the middle is
+   verified only there. With icase, letters are compared with 0x20 ORed in
+   on both sides, so the vector test stays two compares per anchor. */
+typedef struct {
+    char         *needle;     /* owned copy; folded to lower case with icase */
+    size_t        len;
+    int           icase;
+    unsigned char first, last;          /* anchors, ORed with their fold bit */
+    unsigned char fold_first, fold_last; /* 0x20 if that anchor is a letter under icase */
+} fp_finder;
+
+int  fp_finder_init(fp_finder *f, const char *needle, size_t len, int icase);
+/* First occurrence in [h, h+hl), or NULL. An empty needle matches at h. */
+const char *fp_finder_find(const fp_finder *f, const char *h, size_t hl);
+void fp_finder_free(fp_finder *f);
+
+/* Name of the kernel picked at load time ("avx2", "sse2" or "scalar") */
+const char *fp_finder_kernel(void);
+
+/* ---- Multi-literal matcher (grep -e/-f with many fixed strings) ----
+   Up to FP_TEDDY_MAX patterns use Teddy: a 1-3 byte window of each
+   pattern (at the offset where the set differs most) is packed into
+   nibble masks for 8 buckets, so one pshufb/AND
+   round tests 16 or 32 start positions against every pattern at once and
+   only flagged buckets are verified. Larger sets (or CPUs without SSSE3)
+   use an Aho-Corasick DFA over byte classes, one table step per input
+   byte whatever the pattern count. Patterns must be non-empty. */
+#ifndef FP_TEDDY_MAX
+#define FP_TEDDY_MAX 32
+#endif
+
+typedef struct fp_multilit fp_multilit;
+
+fp_multilit *fp_multilit_new(const char *const *pats, const size_t *lens, size_t n, int icase);
+/* Start of an occurrence of any pattern in [h, h+hl), or NULL. Teddy
+   reports the leftmost start, Aho-Corasick the earliest end. */
+const char *fp_multilit_find(const fp_multilit *m, const char *h, size_t hl);
+void fp_multilit_free(fp_multilit *m);
+
+/* "teddy" or "aho-corasick" */
+const char *fp_multilit_kind(const fp_multilit *m);
+
+#endif /* FP_SEARCH_H */
@@ -0,0 +1,53 @@
+// include/sortkey.h
+#ifndef FP_SORTKEY_H
+#define FP_SORTKEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/* ---- Sort keys (sort, top; agg groups on the same keys) ----
+   A key is the fields of a line that cut would print for -d/-f (the whole
+   line without them). Keys compare in byte order, or with -n by the
+   number they start with, read as sort -n does (leading blanks, '-',
+   digits, '.' and digits) and compared as digit strings, so there is no
+   rounding and no length limit; a -n key of several fields compares their
+   numbers field by field (sort -k1,1n -k3,3n). Equal keys fall back to the
+   whole line, as sort does without -s. */
+typedef struct {
+    char         delim;   /* -d CHAR (tab by default) */
+    fp_fieldset *fields;  /* -f LIST, NULL: the whole line */
+    int          numeric; /* -n */
+} fp_sortkey;
+
+/* A line and its key. The key is a slice of the line when at most one
+   field span is selected, else the fields copied out (see fp_sortrec_fill).
+   With -n on a single field, the number's sign and its integer digits
+   (leading zeros dropped) and fraction digits (trailing zeros dropped) as
+   offsets into the key; several fields are read at each comparison. */
+typedef struct {
+    const char *line;      /* ends in '\n' */
+    const char *key;
+    uint32_t    len, klen; /* len counts the '\n', klen does not */
+    int32_t     sign;      /* -1, 0 or 1 */
+    uint32_t    ioff, ilen, foff, flen;
+} fp_sortrec;
+
+/* Key on the fields in LIST (replacing any earlier list). Returns <0 if
+   LIST does not parse. */
+int  fp_sortkey_fields(fp_sortkey *k, const char *list);
+void fp_sortkey_free(fp_sortkey *k);
+
+/* The key of [s, s+n) (a line without its '\n'): a slice of it, or the
+   fields copied to dst, which has room for n bytes */
+const char *fp_sortkey_key(const fp_sortkey *k, const char *s, size_t n, char *dst, size_t *klen);
+/* Key the line [line, line+len) (len counting its '\n'). kdst must have
+   room for len bytes when the key selects more than one field span. */
+void fp_sortrec_fill(const fp_sortkey *k, fp_sortrec *r, const char *line, size_t len, char *kdst);
+/* The key has to be copied out of the line (more than one field span) */
+static inline int fp_sortkey_copies(const fp_sortkey *k) { return k->fields && k->fields->nspans > 1; }
+/* <0, 0, >0: a sorts before, with, after b (ascending) */
+int  fp_sortrec_cmp(const fp_sortkey *k, const fp_sortrec *a, const fp_sortrec *b);
+
+#endif /* FP_SORTKEY_H */
@@ -0,0 +1,48 @@
+// include/speccache.h
+#ifndef FP_SPECCACHE_H
+#define FP_SPECCACHE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* ---- Compiled-spec cache, shared by every fx call in the bash session ----
+   The module stays loaded between builtin calls, so a script running
+   `fx ... grep -E "$pat"` in a loop need not recompile the same pattern
+   each time. Ops look up their compiled form (grep matcher, tr table, cut
+   field set) by kind and normalized arguments and share it by reference.
+   Entries in use are pinned; idle ones beyond the cap are evicted least
+   recently used. Only the shell thread touches the cache (ops look up in
+   parse and release in destroy). */
+#ifndef FP_SPECCACHE_MAX
+#define FP_SPECCACHE_MAX 64
+#endif
+
+typedef struct fp_specent fp_specent;
+
+/* Entry for (kind, key[0..klen)) with a reference taken, or NULL on a miss
+   (always, when the cap is 0). */
+fp_specent *fp_speccache_get(const char *kind, const char *key, size_t klen);
+
+/* Add obj under (kind, key). The cache owns obj from here on and calls
+   free_obj once the entry is evicted or cleared and its last reference is
+   released. Returns the entry with a reference taken; NULL on OOM, after
+   freeing obj. */
+fp_specent *fp_speccache_put(const char *kind, const char *key, size_t klen,
+                             void *obj, void (*free_obj)(void *));
+
+/* Like fp_speccache_put, but never cached: the entry is the caller's alone
+   and obj goes with its release. For an object only one user may hold at a
+   time, when the cached one is taken. */
+fp_specent *fp_speccache_private(const char *kind, const char *key, size_t klen,
+                                 void *obj, void (*free_obj)(void *));
+
+void *fp_specent_obj(const fp_specent *e);
+int   fp_specent_refs(const fp_specent *e);   /* users holding e */
+void  fp_speccache_release(fp_specent *e);   /* NULL is a no-op */
+
+/* fx --cache, --cache-clear, --cache-max N (0 turns caching off) */
+void  fp_speccache_print(FILE *out);
+void  fp_speccache_clear(void);
+void  fp_speccache_set_max(size_t n);
+
+#endif /* FP_SPECCACHE_H */
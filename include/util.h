@@ -10,6 +10,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "search.h"
+#include "rx.h"
+#include "xlate.h"
+
 /* Large stdio buffers */
 #ifndef FP_BUF_1M
 #define FP_BUF_1M (1<<20)
@@ -34,25 +38,40 @@ static inline int ascii_toupper(int c) { return fp_ascii_toupper(c); }
 typedef struct {
     unsigned char map[256];      /* mapping for bytes when selected[c] == 1 */
     unsigned char selected[256]; /* membership of SET1 */
+    unsigned char squeeze[256];  /* -s: runs of these output bytes collapse (SET2, or SET1 alone) */
     int delete_mode;             /* -d */
     int squeeze_mode;            /* -s */
+    fp_xlate xl;                 /* vector kernel, planned by build/compose */
 } fp_trspec;
 
 
 /* ---- Fieldset API (used by cut) ---- */
 typedef struct {
-    uint8_t *bits;     /* bitmask, 1 bit per field */
-    size_t   nbits;    /* number of addressable bits */
+    size_t lo, hi;     /* 1-based, inclusive; hi == SIZE_MAX for an open "N-" */
+} fp_fieldspan;
+
+typedef struct {
+    fp_fieldspan *spans;   /* sorted, overlapping and adjacent ranges merged */
+    size_t   nspans;
+    size_t   max_field;    /* last field wanted, SIZE_MAX with to_end: cut stops reading there */
+    int      to_end;       /* the last span is open ("N-") and runs to the end of the line */
     int      has_ranges;
 } fp_fieldset;
 
 /* Build transliteration specification from SET1 and SET2 (SET2 ignored when -d) */
 int  fp_trspec_build(fp_trspec *t, const char *set1, const char *set2);
 
-/* Apply transliteration in-place to a single record buffer */
+/* Apply transliteration in-place to a single record buffer (fp_xlate_run
+   unless squeezing) */
 void fp_tr_inplace(char **linep, size_t *lenp, const fp_trspec *t);
 
-/* Parse a LIST like "1,3-5" into bitset. Returns 0 on success, <0 on error. */
+/* out = a followed by b (plan optimizer). Returns 0, or -1 if not composable (-s). */
+int  fp_trspec_compose(fp_trspec *out, const fp_trspec *a, const fp_trspec *b);
+
+/* 1 if t only changes ASCII letter case (no deletes/squeeze). */
+int  fp_trspec_case_only(const fp_trspec *t);
+
+/* Parse a LIST like "1,3-5,7-" (or "-3" for 1-3) into sorted spans. Returns 0 on success, <0 on error. */
 int  fp_fieldset_parse(const char *list, fp_fieldset *fs);
 
 /* Test if field number idx1 (1-based) is in set. Returns 1 yes, 0 no. */
@@ -77,16 +96,34 @@ void fp_free_field_list(fp_field_list *fl);
 
 /* ---- Regex / fixed wrapper (your interface) ---- */
 typedef struct {
-    regex_t rx;
+    regex_t rx;         /* only when dfa is NULL, or with subs */
+    fp_rx  *dfa;        /* in-tree matcher, if the pattern is in its subset */
+    int     subs;       /* rx keeps submatches for fp_regex_exec */
     int     is_fixed;
     int     icase;
-    char   *fixed_pat;
+    fp_finder finder;   /* fixed: needle, length and anchors precomputed */
 } fp_regex;
 
 int  fp_regex_compile(fp_regex *r, const char *pat, int extended, int icase, int fixed);
 int  fp_regex_match(fp_regex *r, const char *s, size_t len);
+/* First matching line of a multi-line span: a pointer into it, or NULL */
+const char *fp_regex_find(fp_regex *r, const char *s, size_t len);
 void fp_regex_free(fp_regex *r);
 
+/* Compile for fp_regex_exec (match offsets and groups). regcomp keeps its
+   submatches; the DFA, when the pattern is in its subset, still answers
+   whether a line matches at all, so lines without a match never reach
+   regexec. Literal
+   patterns use the finder, as they do without -F. */
+int  fp_regex_compile_subs(fp_regex *r, const char *pat, int extended, int icase, int fixed);
+/* Leftmost match at or after s+off in the subject [s, s+len) (no trailing
+   '\n'), through regexec with REG_STARTEND: m[0..nm) as regexec fills them,
+   offsets from s; ^ matches only at s. With off 0 the DFA, if there is one,
+   answers first. Returns 1 match, 0 none. */
+int  fp_regex_exec(fp_regex *r, const char *s, size_t len, size_t off, regmatch_t *m, size_t nm);
+/* Parenthesized groups in the pattern (0 for a literal) */
+size_t fp_regex_nsub(const fp_regex *r);
+
 /* ---- Grep spec shim used by op_grep.c (built atop fp_regex) ---- */
 typedef struct {
     int use_regex;     /* 1 => regex; 0 => fixed */
@@ -101,14 +138,31 @@ typedef struct {
     /* For fixed-matcher fast path we also keep the raw pattern/len */
     char  *fixed;
     size_t fixed_len;
+
+    /* Several patterns (-e/-f), any of which may match: literal sets share
+       one fp_multilit, otherwise each pattern keeps its own fp_regex. */
+    size_t       npats;
+    int          match_all;  /* an empty pattern matches every line */
+    fp_multilit *lits;
+    fp_regex    *rxs;
+    size_t       nrx;
 } fp_grepspec;
 
 int  fp_grepspec_compile(fp_grepspec *g, int extended, int fixed, int ignore_case, const char *pattern);
+/* Same for npats patterns. Patterns without regex syntax are matched as
+   literals even without -F (ASCII only with -i, to keep REG_ICASE rules). */
+int  fp_grepspec_compile_multi(fp_grepspec *g, int extended, int fixed, int ignore_case,
+                               const char *const *patterns, size_t npats);
 int  fp_grepspec_match_line(fp_grepspec *g, const char *s, size_t len); /* 1 match, 0 no */
+/* Search a block of whole lines at once (invert is not applied): a pointer
+   into the first line that matches, or NULL when none does. */
+const char *fp_grepspec_find(fp_grepspec *g, const char *s, size_t len);
 void fp_grepspec_free(fp_grepspec *g);
 
 /* ---- Misc ---- */
 char *fp_xstrdup(const char *s);
 int   fp_parse_long(const char *s, long *out);
+/* sort -S style SIZE (KiB unless suffixed b/K/M/G/T, or N%); 0 ok, -1 bad */
+int   fp_parse_size(const char *s, size_t *out);
 
 #endif /* FP_UTIL_H */
@@ -0,0 +1,42 @@
+// include/xlate.h
+#ifndef FP_XLATE_H
+#define FP_XLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ---- Byte translation kernels (tr) ----
+   A tr table is classified once, when it is built, into the bytes it
+   deletes and how the survivors are mapped:
+     - a map that shifts one contiguous range by a constant (a-z -> A-Z) is
+       a range compare plus a masked add, 32 (AVX2) or 16 bytes at a time;
+     - any other map is a pshufb lookup on the low nibble for each
+       high-nibble row the table changes, blended in by row (rot13 touches
+       4 rows, a full 256-byte table 16);
+     - deletes are a left-pack: a pshufb bitmap test flags 16 bytes at a
+       time and the survivors of each 8-byte half are gathered by one
+       shuffle from a 256-entry index table.
+   A composed delete-and-map table does both in one pass. Squeeze depends
+   on the previous output byte and stays in the scalar loop. */
+enum { FP_XL_NONE, FP_XL_RANGE, FP_XL_LUT };
+
+typedef struct {
+    int           map;            /* FP_XL_* for bytes that are kept */
+    int           del;            /* some byte is deleted */
+    unsigned char lo, span, add;  /* RANGE: c with c - lo <= span becomes c + add */
+    uint16_t      rows;           /* LUT: bit r set if some c with c >> 4 == r changes */
+    unsigned char tab[256];       /* the map; tab + 16r is the pshufb table of row r */
+    unsigned char dbits[2][16];   /* c deleted iff bit (c >> 4) & 7 of dbits[c >> 7][c & 15] */
+} fp_xlate;
+
+/* Classify map (and del[c] != 0 for deleted bytes; del may be NULL). */
+void fp_xlate_plan(fp_xlate *x, const unsigned char map[256], const unsigned char *del);
+/* Translate s[0..n) in place; returns the new length (< n after deletes). */
+size_t fp_xlate_run(const fp_xlate *x, char *s, size_t n);
+
+/* "range", "lut 4 rows", "delete+range", ... for --explain */
+const char *fp_xlate_describe(const fp_xlate *x, char *buf, size_t cap);
+/* Name of the kernel picked at load time ("avx2", "ssse3" or "scalar") */
+const char *fp_xlate_kernel(void);
+
+#endif /* FP_XLATE_H */
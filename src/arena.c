@@ -0,0 +1,86 @@
+// src/arena.c
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fp_arena_chunk {
+    fp_arena_chunk *next;
+    size_t cap, used;
+    _Alignas(max_align_t) char data[];
+};
+
+/* The first chunk at or after cur with room for need bytes past an
+   alignment of align (chunks after cur are rewound ones from before the
+   last reset), or a new one linked in after cur. */
+static fp_arena_chunk *arena_room(FpArena *a, size_t need, size_t align) {
+    for (fp_arena_chunk *c = a->cur; c; c = c->next) {
+        size_t at = (c->used + align - 1) & ~(align - 1);
+        if (at <= c->cap && c->cap - at >= need) {
+            c->used = at;
+            a->cur = c;
+            return c;
+        }
+    }
+    size_t cap = need > FP_ARENA_CHUNK ? need : FP_ARENA_CHUNK;
+    fp_arena_chunk *c = malloc(sizeof *c + cap);
+    if (!c) return NULL;
+    c->cap = cap;
+    c->used = 0;
+    if (a->cur) { c->next = a->cur->next; a->cur->next = c; }
+    else        { c->next = a->head; a->head = c; }
+    a->cur = c;
+    a->held += cap;
+    return c;
+}
+
+void *fp_arena_alloc(FpArena *a, size_t n) {
+    fp_arena_chunk *c = arena_room(a, n, _Alignof(max_align_t));
+    if (!c) return NULL;
+    void *p = c->data + c->used;
+    c->used += n;
+    return p;
+}
+
+char *fp_arena_reserve(FpArena *a, size_t need) {
+    fp_arena_chunk *c = arena_room(a, need, 1);
+    return c ? c->data + c->used : NULL;
+}
+
+void fp_arena_commit(FpArena *a, size_t used) {
+    a->cur->used += used;
+}
+
+char *fp_arena_dup(FpArena *a, const char *s, size_t n) {
+    char *p = fp_arena_reserve(a, n);
+    if (!p) return NULL;
+    memcpy(p, s, n);
+    fp_arena_commit(a, n);
+    return p;
+}
+
+void fp_arena_reset(FpArena *a) {
+    fp_arena_chunk **pp = &a->head;
+    while (*pp) {
+        fp_arena_chunk *c = *pp;
+        if (c->cap > FP_ARENA_CHUNK) {
+            *pp = c->next;
+            a->held -= c->cap;
+            free(c);
+            continue;
+        }
+        c->used = 0;
+        pp = &c->next;
+    }
+    a->cur = a->head;
+}
+
+void fp_arena_free(FpArena *a) {
+    for (fp_arena_chunk *c = a->head, *nx; c; c = nx) {
+        nx = c->next;
+        free(c);
+    }
+    a->head = a->cur = NULL;
+    a->held = 0;
+}
@@ -3,6 +3,7 @@
 #include <sys/types.h>
 
 #include "engine.h"
+#include "lineio.h"
 #include "util.h"   // defines FP_BUF_1M normally
 
 // Fallback in case an older util.h is picked up or include order breaks
@@ -13,30 +14,74 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 typedef struct {
-    FILE *in;
-    FILE *out;
-    char *buf;
-    size_t cap;
-    size_t len;
-    int emitted; // any line reached output/sink
+    Plan *p;
+    int src_end;      // steps [0, src_end) are sources
+    int par_end;      // steps [src_end, par_end) may run in worker threads
+    int ops_end;      // steps [par_end, ops_end) run serially (sink excluded)
+    int tail_is_sink;
+    int cur_src;
+    long left;        // records the sources may still produce (-1 => no limit)
+    int emitted;      // any line reached output/sink
+    int blocks;       // the first op takes unsplit blocks (consume_block)
+    int drain_from;   // steps from here on may still emit at end of stream
+    fp_writer out;    // stdout, one writev per batch
 } EngineState;
 
 /*** default stdio source/sink ***/
-typedef struct { int dummy; } StdioSrcCfg;
+typedef struct {
+    int           mode;   // 0 undecided, 1 mmap (regular file), 2 block reader
+    fp_mapsrc     map;
+    fp_linereader rd;
+
+    // per-line produce() drains a private batch
+    FpBatch       line;
+    size_t        next;
+} StdioSrcCfg;
 typedef struct { int dummy; } StdioSinkCfg;
 
-static int stdio_src_produce(void *cfg, char **linep, size_t *lenp) {
+static int stdio_src_produce_batch(void *cfg, FpBatch *b) {
+    StdioSrcCfg *c = cfg;
+    if (c->mode == 0) {
+        c->mode = fp_mapsrc_open(&c->map, STDIN_FILENO) ? 1 : 2;
+        if (c->mode == 2) fp_linereader_init(&c->rd, STDIN_FILENO);
+    }
+    if (c->mode == 1) return fp_mapsrc_fill(&c->map, b);
+    return fp_linereader_fill(&c->rd, b);
+}
+static int stdio_src_passthrough(void *cfg, int outfd) {
     (void)cfg;
-    static char *buf = NULL;
-    static size_t cap = 0;
-    ssize_t n = getline(&buf, &cap, stdin);
-    if (n < 0) return feof(stdin) ? 0 : -1;
-    *linep = buf; *lenp = (size_t)n;
+    long long n = fp_copy_fd(STDIN_FILENO, outfd);
+    return n < 0 ? -1 : (n > 0);
+}
+static int stdio_src_produce(void *cfg, char **linep, size_t *lenp) {
+    StdioSrcCfg *c = cfg;
+    if (!c->line.recs && fp_batch_init(&c->line, FP_BATCH_MAX) < 0) return -1;
+    if (c->next >= c->line.n) {
+        fp_batch_reset(&c->line);
+        c->next = 0;
+        int r = stdio_src_produce_batch(c, &c->line);
+        if (r <= 0) return r;
+    }
+    *linep = c->line.recs[c->next].ptr;
+    *lenp  = c->line.recs[c->next].len;
+    c->next++;
     return 1;
 }
-static void stdio_src_destroy(void *cfg) { (void)cfg; }
+static void stdio_src_destroy(void *cfg) {
+    StdioSrcCfg *c = cfg;
+    fp_batch_free(&c->line);
+    // leave stdin positioned after the records read from it, like head(1)
+    // does: exact when a source limit (take N) or EOF ends the stream; an op
+    // that stops it early (grep -m) leaves it past the whole batch it was in
+    if (c->mode == 1) lseek(STDIN_FILENO, fp_mapsrc_close(&c->map), SEEK_SET);
+    if (c->mode == 2) fp_linereader_free(&c->rd);
+    free(c);
+}
 
 static int stdio_sink_accept(void *cfg, const char *line, size_t len) {
     (void)cfg;
@@ -55,6 +100,8 @@ static const OpSpec STDIO_SRC = {
     .flush = NULL,
     .destroy = stdio_src_destroy,
     .should_stop = NULL,
+    .produce_batch = stdio_src_produce_batch,
+    .passthrough = stdio_src_passthrough,
 };
 static const OpSpec STDIO_SINK = {
     .name = "stdout",
@@ -70,16 +117,207 @@ static const OpSpec STDIO_SINK = {
 const OpSpec *engine_stdio_source(){ return &STDIO_SRC; }
 const OpSpec *engine_stdio_sink(){ return &STDIO_SINK; }
 
+/*** batch helpers ***/
+int fp_batch_init(FpBatch *b, size_t cap) {
+    memset(b, 0, sizeof *b);
+    if (cap == 0 || cap > FP_BATCH_MAX) cap = FP_BATCH_MAX;
+    b->recs = malloc(cap * sizeof *b->recs);
+    b->sel  = malloc(cap * sizeof *b->sel);
+    if (!b->recs || !b->sel) { fp_batch_free(b); return -1; }
+    b->cap = cap;
+    return 0;
+}
+
+void fp_batch_reset(FpBatch *b) {
+    if (b->release) { b->release(b->release_ctx); b->release = NULL; b->release_ctx = NULL; }
+    b->n = 0; b->nsel = 0; b->dlen = 0;
+    b->blk = NULL; b->blen = 0;
+    b->fvgen = 0;
+    fp_arena_reset(&b->arena);
+}
+
+void fp_batch_free(FpBatch *b) {
+    if (b->release) b->release(b->release_ctx);
+    free(b->recs); free(b->sel); free(b->data);
+    free(b->fv); free(b->fvpos);
+    fp_arena_free(&b->arena);
+    memset(b, 0, sizeof *b);
+}
+
+char *fp_batch_reserve(FpBatch *b, size_t need) {
+    if (b->dlen + need > b->dcap) {
+        size_t ncap = b->dcap ? b->dcap : FP_BATCH_BYTES;
+        while (ncap < b->dlen + need) ncap *= 2;
+        char *nd = realloc(b->data, ncap);
+        if (!nd) return NULL;
+        // rebase views that already point into the old storage
+        if (nd != b->data) {
+            for (size_t k = 0; k < b->n; k++) {
+                if (b->recs[k].ptr >= b->data && b->recs[k].ptr < b->data + b->dlen)
+                    b->recs[k].ptr = nd + (b->recs[k].ptr - b->data);
+            }
+        }
+        b->data = nd; b->dcap = ncap;
+    }
+    return b->data + b->dlen;
+}
+
+static int fp_batch_grow(FpBatch *b) {
+    size_t ncap = b->cap * 2;
+    FpRec *nr = realloc(b->recs, ncap * sizeof *nr);
+    if (!nr) return -1;
+    b->recs = nr;
+    uint32_t *ns = realloc(b->sel, ncap * sizeof *ns);
+    if (!ns) return -1;
+    b->sel = ns;
+    b->cap = ncap;
+    return 0;
+}
+
+int fp_batch_add(FpBatch *b, char *ptr, size_t len) {
+    if (b->n == b->cap && fp_batch_grow(b) < 0) return -1;
+    b->recs[b->n].ptr = ptr;
+    b->recs[b->n].len = len;
+    b->n++;
+    return 0;
+}
+
+int fp_batch_split(FpBatch *b) {
+    char *p = b->blk, *end = p + b->blen;
+    b->blk = NULL; b->blen = 0;
+    while (p < end) {
+        if (b->n == b->cap && fp_batch_grow(b) < 0) return -1;
+        size_t used = 0;
+        size_t k = fp_split_lines(p, (size_t)(end - p), '\n', b->recs + b->n, b->cap - b->n, &used);
+        if (k == 0) {   /* unterminated last line */
+            b->recs[b->n].ptr = p;
+            b->recs[b->n].len = used = (size_t)(end - p);
+            k = 1;
+        }
+        b->n += k;
+        p += used;
+    }
+    for (size_t k = 0; k < b->n; k++) b->sel[k] = (uint32_t)k;
+    b->nsel = b->n;
+    return 0;
+}
+
+// A new generation of field views, for delim: every older one goes stale.
+static void fp_batch_fields_begin(FpBatch *b, char delim) {
+    if (++b->fvseq == 0) {      // wrapped: clear the stamps that could match again
+        if (b->fv) memset(b->fv, 0, b->fvcap * sizeof *b->fv);
+        b->fvseq = 1;
+    }
+    b->fvgen = b->fvseq;
+    b->fvdelim = delim;
+    b->fvlen = 0;
+}
+
+static int fp_batch_fvpos_reserve(FpBatch *b, size_t need) {
+    if (b->fvlen + need <= b->fvposcap) return 0;
+    size_t ncap = b->fvposcap ? b->fvposcap : 4096;
+    while (ncap < b->fvlen + need) ncap *= 2;
+    uint32_t *np = realloc(b->fvpos, ncap * sizeof *np);
+    if (!np) return -1;
+    b->fvpos = np; b->fvposcap = ncap;
+    return 0;
+}
+
+// A record's offsets are a run of fvpos. One asked for more fields than
+// it has indexed goes on from its last delimiter, in place if its run is
+// the last one, else after copying the run to the end.
+const uint32_t *fp_batch_fields(FpBatch *b, size_t i, char delim, size_t upto,
+                                size_t *nd, int *all) {
+    const FpRec *r = &b->recs[i];
+    size_t n = r->len;
+    if (n && r->ptr[n-1] == '\n') n--;
+    if (n >= UINT32_MAX) return NULL;
+    if (!b->fvgen || b->fvdelim != delim) fp_batch_fields_begin(b, delim);
+    if (i >= b->fvcap) {
+        size_t ncap = b->fvcap ? b->fvcap : b->cap;
+        while (ncap <= i) ncap *= 2;
+        FpFieldIdx *nf = realloc(b->fv, ncap * sizeof *nf);
+        if (!nf) return NULL;
+        memset(nf + b->fvcap, 0, (ncap - b->fvcap) * sizeof *nf);
+        b->fv = nf; b->fvcap = ncap;
+    }
+    FpFieldIdx *x = &b->fv[i];
+    if (x->gen != b->fvgen || (!x->all && x->nd < upto)) {
+        size_t have = x->gen == b->fvgen ? x->nd : 0, off = b->fvlen;
+        if (fp_batch_fvpos_reserve(b, have + 1) < 0) return NULL;
+        if (have && x->off + have == b->fvlen) off = x->off;
+        else if (have) memcpy(b->fvpos + off, b->fvpos + x->off, have * sizeof *b->fvpos);
+        b->fvlen = off + have;
+        const char *s = r->ptr, *p = s + (have ? b->fvpos[off + have - 1] + 1 : 0), *end = s + n;
+        int whole = 0;
+        for (; have < upto; have++) {
+            const char *d = memchr(p, delim, (size_t)(end - p));
+            if (!d) { whole = 1; break; }
+            if (fp_batch_fvpos_reserve(b, 1) < 0) return NULL;
+            b->fvpos[b->fvlen++] = (uint32_t)(d - s);
+            p = d + 1;
+        }
+        *x = (FpFieldIdx){ b->fvgen, (uint32_t)off, (uint32_t)have, (uint32_t)whole };
+    }
+    *nd = x->nd;
+    *all = (int)x->all;
+    return b->fvpos + x->off;
+}
+
+int fp_batch_field(FpBatch *b, size_t i, char delim, size_t f, const char **p, size_t *n) {
+    const FpRec *r = &b->recs[i];
+    size_t len = r->len;
+    if (len && r->ptr[len-1] == '\n') len--;
+    size_t lo, hi;
+    if (len >= UINT32_MAX) {    // too long to index: scan it
+        const char *s = r->ptr, *end = s + len, *fs = s;
+        if (f > 1) {
+            size_t left = f - 1;
+            const char *d = fp_memchr_nth(s, len, delim, &left);
+            if (!d) return 0;
+            fs = d + 1;
+        }
+        const char *e = memchr(fs, delim, (size_t)(end - fs));
+        lo = (size_t)(fs - s);
+        hi = (size_t)((e ? e : end) - s);
+    } else {
+        size_t nd; int all;
+        const uint32_t *d = fp_batch_fields(b, i, delim, f, &nd, &all);
+        if (!d) return -1;
+        if (nd + 1 < f) return 0;
+        lo = f > 1 ? d[f-2] + 1 : 0;
+        hi = nd >= f ? d[f-1] : len;
+    }
+    *p = r->ptr + lo;
+    *n = hi - lo;
+    return 1;
+}
+
+int fp_batch_push_copy(FpBatch *b, const char *line, size_t len) {
+    if (b->n >= b->cap) return -1;
+    char *dst = fp_batch_reserve(b, len);
+    if (!dst) return -1;
+    memcpy(dst, line, len);
+    b->recs[b->n].ptr = dst;
+    b->recs[b->n].len = len;
+    b->n++;
+    b->dlen += len;
+    return 0;
+}
+
 /*** plan helpers ***/
 int engine_add_default_stdio_source_sink_if_needed(Plan *p) {
     // Ensure first is SRC; last may be SINK (optional; stdout otherwise).
     int have_src = (p->nsteps > 0 && p->steps[0].spec->kind == OP_SRC);
     if (!have_src) {
-        p->steps = realloc(p->steps, sizeof(PlanStep)*(p->nsteps+1));
-        if (!p->steps) return -1;
+        StdioSrcCfg *sc = calloc(1, sizeof *sc);
+        if (!sc) return -1;
+        PlanStep *ns = realloc(p->steps, sizeof(PlanStep)*(p->nsteps+1));
+        if (!ns) { free(sc); return -1; }
+        p->steps = ns;
         memmove(&p->steps[1], &p->steps[0], sizeof(PlanStep)*p->nsteps);
         p->steps[0].spec = engine_stdio_source();
-        p->steps[0].cfg = NULL;
+        p->steps[0].cfg = sc;
         p->nsteps++;
     }
     // SINK is optional; we'll use stdout when no sink op at tail.
@@ -94,88 +332,527 @@ void engine_free_plan(Plan *p) {
         p->steps[i].cfg = NULL;
     }
     free(p->steps); p->steps = NULL; p->nsteps = 0;
+    free(p->stats); p->stats = NULL;
 }
 
-/*** main streaming loop with multi-SOURCE support ***/
-int engine_run_plan(Plan *p) {
-    // Big stdio buffers
-    static char inbuf[FP_BUF_1M], outbuf[FP_BUF_1M];
-    setvbuf(stdin,  inbuf,  _IOFBF, sizeof inbuf);
-    setvbuf(stdout, outbuf, _IOFBF, sizeof outbuf);
+/*** fx --stats ***/
 
-    if (p->nsteps == 0) return 0;
+static uint64_t engine_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
 
-    // init hooks
-    for (int i = 0; i < p->nsteps; i++) {
-        if (p->steps[i].spec->init) {
-            if (p->steps[i].spec->init(p->steps[i].cfg) < 0) {
-                return 2;
+static uint64_t engine_sel_bytes(const FpBatch *b) {
+    uint64_t n = 0;
+    for (size_t k = 0; k < b->nsel; k++) n += b->recs[b->sel[k]].len;
+    return n;
+}
+
+// An unsplit block counts as the lines it holds.
+static uint64_t engine_block_lines(const FpBatch *b) {
+    uint64_t n = 0;
+    const char *p = b->blk, *end = p + b->blen;
+    for (const char *nl; p < end && (nl = memchr(p, '\n', (size_t)(end - p))); p = nl + 1) n++;
+    return n + (p < end);
+}
+
+static void engine_stats_in(FpStepStats *ss, const FpBatch *b) {
+    ss->batches++;
+    ss->rec_in += b->blk ? engine_block_lines(b) : b->nsel;
+    ss->bytes_in += b->blk ? b->blen : engine_sel_bytes(b);
+}
+
+static void engine_stats_out(FpStepStats *ss, const FpBatch *b) {
+    ss->rec_out += b->blk ? engine_block_lines(b) : b->nsel;
+    ss->bytes_out += b->blk ? b->blen : engine_sel_bytes(b);
+}
+
+static const char *engine_kind_name(OpKind k) {
+    switch (k) {
+    case OP_SRC:    return "SRC";
+    case OP_MAP:    return "MAP";
+    case OP_FILTER: return "FILTER";
+    case OP_SINK:   return "SINK";
+    }
+    return "?";
+}
+
+void engine_print_stats(const Plan *p, FILE *out) {
+    if (!p->stats) return;
+    fprintf(out, "%-2s %-10s %-6s %8s %10s %10s %10s %12s %12s %10s\n", "#", "op", "kind",
+            "batches", "rec_in", "rec_out", "drops", "bytes_in", "bytes_out", "ms");
+    for (int i = 0; i <= p->nsteps; i++) {
+        const FpStepStats *ss = &p->stats[i];
+        const char *name = i < p->nsteps ? p->steps[i].spec->name : "(output)";
+        const char *kind = i < p->nsteps ? engine_kind_name(p->steps[i].spec->kind) : "-";
+        fprintf(out, "%-2d %-10s %-6s %8llu %10llu %10llu %10llu %12llu %12llu %10.3f\n",
+                i, name, kind, (unsigned long long)ss->batches,
+                (unsigned long long)ss->rec_in, (unsigned long long)ss->rec_out,
+                (unsigned long long)fp_stats_drops(ss),
+                (unsigned long long)ss->bytes_in, (unsigned long long)ss->bytes_out,
+                (double)ss->ns / 1e6);
+    }
+}
+
+/*** batch stages ***/
+
+// Fill b from one SOURCE step: native produce_batch when available, else
+// repeated produce() with each line copied into the batch's own storage.
+static int engine_fill_batch(const PlanStep *st, FpBatch *b) {
+    const OpSpec *sp = st->spec;
+    if (sp->produce_batch) return sp->produce_batch(st->cfg, b);
+    while (!fp_batch_full(b)) {
+        char *line = NULL; size_t len = 0;
+        int pr = sp->produce(st->cfg, &line, &len);
+        if (pr < 0) return -1;
+        if (pr == 0) break;
+        if (fp_batch_push_copy(b, line, len) < 0) return -1;
+    }
+    return b->n > 0;
+}
+
+// Per-line fallback for ops without consume_batch. Honors should_stop() at the
+// record that trips it, so later records in the batch are not consumed.
+static int engine_consume_lines(const PlanStep *st, FpBatch *b, int *early_stop) {
+    const OpSpec *sp = st->spec;
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        FpRec *r = &b->recs[b->sel[k]];
+        int cr = sp->consume(st->cfg, &r->ptr, &r->len);
+        if (cr < 0) return -1;
+        if (cr > 0) continue;
+        b->sel[w++] = b->sel[k];
+        if (sp->should_stop && sp->should_stop(st->cfg)) { *early_stop = 1; break; }
+    }
+    b->nsel = w;
+    return 0;
+}
+
+// Run MAP/FILTER steps [from, to) over the batch selection, counting into
+// stats[i] when stats is non-NULL (each worker passes its own array).
+// Returns 0 ok, <0 error; when an op asks to end the stream, sets *early_stop
+// to one past the last such step (the first one still allowed to drain).
+static int engine_run_ops(Plan *p, int from, int to, FpBatch *b, int *early_stop,
+                          FpStepStats *stats) {
+    for (int i = from; i < to && (b->nsel > 0 || b->blk); i++) {
+        const PlanStep *st = &p->steps[i];
+        const OpSpec *sp = st->spec;
+        if (sp->kind != OP_MAP && sp->kind != OP_FILTER) continue;
+        uint64_t t0 = 0;
+        int stop = 0;
+        if (stats) { engine_stats_in(&stats[i], b); t0 = engine_now_ns(); }
+        if (b->blk && !sp->consume_block && fp_batch_split(b) < 0) return -1;
+        if (b->blk) {
+            if (sp->consume_block(st->cfg, b) < 0) return -1;
+            if (sp->should_stop && sp->should_stop(st->cfg)) stop = 1;
+        } else if (sp->consume_batch) {
+            if (sp->consume_batch(st->cfg, b) < 0) return -1;
+            if (sp->should_stop && sp->should_stop(st->cfg)) stop = 1;
+        } else {
+            if (engine_consume_lines(st, b, &stop) < 0) return -1;
+        }
+        if (sp->kind == OP_MAP) fp_batch_fields_invalidate(b);
+        if (stop) *early_stop = i + 1;
+        if (stats) { stats[i].ns += engine_now_ns() - t0; engine_stats_out(&stats[i], b); }
+    }
+    return 0;
+}
+
+// Hand the selected records to the sink and/or stdout.
+// Returns 1 continue, 0 sink requested stop, <0 error.
+static int engine_emit_batch(EngineState *es, FpBatch *b) {
+    FpStepStats *stats = es->p->stats;
+    int ret = 1;
+    uint64_t t0 = 0;
+    if (es->tail_is_sink) {
+        int si = es->p->nsteps - 1;
+        const PlanStep *st = &es->p->steps[si];
+        if (stats) { engine_stats_in(&stats[si], b); t0 = engine_now_ns(); }
+        if (!st->spec->accept_batch) {
+            es->emitted = 1;
+            size_t k = 0;
+            for (; k < b->nsel; k++) {
+                const FpRec *r = &b->recs[b->sel[k]];
+                ret = st->spec->accept(st->cfg, r->ptr, r->len);
+                if (ret <= 0) break;
+            }
+            if (stats) {
+                stats[si].ns += engine_now_ns() - t0;
+                stats[si].rec_out += k + (ret == 0); // 0 => took this one, then stop
             }
+            return ret > 0 ? 1 : ret;
         }
+        ret = st->spec->accept_batch(st->cfg, b);
+        if (stats) { stats[si].ns += engine_now_ns() - t0; engine_stats_out(&stats[si], b); }
+        if (ret < 0) return -1;
     }
+    if (b->nsel == 0) return ret;
+    es->emitted = 1;
+    FpStepStats *os = stats ? &stats[es->p->nsteps] : NULL;
+    if (os) { engine_stats_in(os, b); t0 = engine_now_ns(); }
+    for (size_t k = 0; k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        if (fp_writer_add(&es->out, r->ptr, r->len) < 0) return -1;
+    }
+    // views die with the batch, so its output goes out now
+    if (fp_writer_flush(&es->out) < 0) return -1;
+    if (os) { os->ns += engine_now_ns() - t0; engine_stats_out(os, b); }
+    return ret;
+}
 
-    // Determine explicit sink and the range of sources
-    int tail_is_sink = (p->steps[p->nsteps-1].spec->kind == OP_SINK);
+// Pull the next batch from the current/next source and select all of it.
+// Returns 1 produced, 0 all sources exhausted, <0 error.
+static int engine_next_batch(EngineState *es, FpBatch *b) {
+    fp_batch_reset(b);
+    if (es->left == 0) return 0;
+    while (es->cur_src < es->src_end) {
+        // under a source limit, ask for no more records than remain
+        size_t cap = b->cap;
+        if (es->left > 0 && (size_t)es->left < cap) b->cap = (size_t)es->left;
+        FpStepStats *ss = es->p->stats ? &es->p->stats[es->cur_src] : NULL;
+        uint64_t t0 = ss ? engine_now_ns() : 0;
+        b->blocks = es->blocks;
+        int pr = engine_fill_batch(&es->p->steps[es->cur_src], b);
+        if (ss) ss->ns += engine_now_ns() - t0;
+        b->cap = cap;
+        if (pr < 0) return -1;
+        if (pr > 0) {
+            if (es->left > 0) es->left -= (long)b->n;
+            for (size_t k = 0; k < b->n; k++) b->sel[k] = (uint32_t)k;
+            b->nsel = b->n;
+            if (ss) { ss->batches++; engine_stats_out(ss, b); }
+            return 1;
+        }
+        // pr == 0 => EOF for this source, advance to next
+        es->cur_src++;
+    }
+    return 0;
+}
 
-    int src_end = 0;
-    while (src_end < p->nsteps && p->steps[src_end].spec->kind == OP_SRC) src_end++;
-    if (src_end == 0) {
-        // Shouldn't happen because engine_add_default... ensures at least one SRC.
-        // But if it does, treat as stdin.
-        src_end = 1;
+// Serial tail of a batch: remaining ops, then sink/stdout.
+// Returns 1 continue, 0 stop streaming, <0 error.
+static int engine_finish_batch(EngineState *es, FpBatch *b, int early_stop) {
+    if (engine_run_ops(es->p, es->par_end, es->ops_end, b, &early_stop, es->p->stats) < 0) return -1;
+    if (b->nsel > 0) {
+        int er = engine_emit_batch(es, b);
+        if (er < 0) return -1;
+        if (er == 0) { es->drain_from = es->p->nsteps; return 0; } // sink requested stop
     }
+    if (!early_stop) return 1;
+    es->drain_from = early_stop;   // stop whole stream after handling this batch
+    return 0;
+}
 
-    // streaming
-    char *line = NULL;
-    size_t len = 0;
+// End of stream: records held back by ops with flush_batch (uniq -c, sort)
+// go through the ops after them and out, on this thread once any workers
+// are joined. An op that stops the stream while draining cuts off the
+// drains before it, as it does during streaming.
+static int engine_drain(EngineState *es) {
+    Plan *p = es->p;
+    int i = es->drain_from > es->src_end ? es->drain_from : es->src_end;
+    for (; i < es->ops_end; i++) {
+        const PlanStep *st = &p->steps[i];
+        if (!st->spec->flush_batch) continue;
+        FpBatch b;
+        if (fp_batch_init(&b, FP_BATCH_MAX) < 0) return -1;
+        int rc = 0;
+        for (;;) {
+            FpStepStats *ss = p->stats ? &p->stats[i] : NULL;
+            uint64_t t0 = ss ? engine_now_ns() : 0;
+            fp_batch_reset(&b);
+            int r = st->spec->flush_batch(st->cfg, &b);
+            if (r < 0) { rc = -1; break; }
+            if (r == 0) break;
+            for (size_t k = 0; k < b.n; k++) b.sel[k] = (uint32_t)k;
+            b.nsel = b.n;
+            if (ss) { ss->ns += engine_now_ns() - t0; engine_stats_out(ss, &b); }
+
+            int early_stop = 0;
+            if (engine_run_ops(p, i + 1, es->ops_end, &b, &early_stop, p->stats) < 0) { rc = -1; break; }
+            if (b.nsel > 0) {
+                int er = engine_emit_batch(es, &b);
+                if (er < 0) { rc = -1; break; }
+                if (er == 0) { rc = 1; break; }
+            }
+            if (early_stop) { i = early_stop - 1; break; }
+        }
+        fp_batch_free(&b);
+        if (rc) return rc < 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+static int engine_stream_serial(EngineState *es) {
+    FpBatch b;
+    if (fp_batch_init(&b, FP_BATCH_MAX) < 0) return 2;
     int rc = 0;
-    int any_emitted = 0;
+    for (;;) {
+        int nr = engine_next_batch(es, &b);
+        if (nr < 0) { rc = 2; break; }
+        if (nr == 0) break; // no more sources => stream done
 
-    int cur_src = 0;
+        int early_stop = 0;
+        if (engine_run_ops(es->p, es->src_end, es->par_end, &b, &early_stop, es->p->stats) < 0) { rc = 2; break; }
+        int fr = engine_finish_batch(es, &b, early_stop);
+        if (fr < 0) { rc = 2; break; }
+        if (fr == 0) break;
+    }
+    fp_batch_free(&b);
+    return rc;
+}
+
+/*** parallel stage: reader/writer on the calling thread, MAP/FILTER workers ***/
+
+enum { SLOT_FREE = 0, SLOT_QUEUED, SLOT_DONE };
+
+typedef struct {
+    FpBatch b;
+    int     state;
+    long    seq;        // input order of the batch
+    int     early_stop;
+    int     err;
+} ParSlot;
+
+typedef struct {
+    EngineState    *es;
+    ParSlot        *slots;
+    int             nslots;
+    int            *queue;  // FIFO of queued slot indices
+    int             qhead, qlen;
+    int             quit;
+    pthread_mutex_t mu;
+    pthread_cond_t  work_cv;
+    pthread_cond_t  done_cv;
+} ParPool;
+
+typedef struct {
+    ParPool     *pool;
+    int          id;
+    FpStepStats *stats;  // fx --stats: this worker's counters, merged after join
+} ParWorker;
+
+static void *engine_worker_main(void *arg) {
+    ParWorker *w = arg;
+    ParPool *pp = w->pool;
     for (;;) {
-        // Pull from current/next source
-        int produced = -1;
-        while (cur_src < src_end) {
-            const OpSpec *sps = p->steps[cur_src].spec;
-            int pr = sps->produce(p->steps[cur_src].cfg, &line, &len);
-            if (pr > 0) { produced = 1; break; }
-            if (pr < 0) { rc = 2; goto end_stream; }
-            // pr == 0 => EOF for this source, advance to next
-            cur_src++;
-        }
-        if (produced <= 0) break; // no more sources => stream done
-
-        // Apply non-source ops in order
-        int drop = 0;
+        pthread_mutex_lock(&pp->mu);
+        while (!pp->quit && pp->qlen == 0) pthread_cond_wait(&pp->work_cv, &pp->mu);
+        if (pp->qlen == 0) { pthread_mutex_unlock(&pp->mu); break; }
+        ParSlot *sl = &pp->slots[pp->queue[pp->qhead]];
+        pp->qhead = (pp->qhead + 1) % pp->nslots;
+        pp->qlen--;
+        pthread_mutex_unlock(&pp->mu);
+
+        sl->b.worker = w->id;
         int early_stop = 0;
-        for (int i = src_end; i < p->nsteps; i++) {
-            const OpSpec *sp = p->steps[i].spec;
-            if (sp->kind == OP_MAP || sp->kind == OP_FILTER) {
-                int cr = sp->consume(p->steps[i].cfg, &line, &len);
-                if (cr < 0) { rc = 2; goto end_stream; }
-                if (cr > 0) { drop = 1; break; }
-                if (sp->should_stop && sp->should_stop(p->steps[i].cfg)) {
-                    early_stop = 1;
-                }
+        int r = engine_run_ops(pp->es->p, pp->es->src_end, pp->es->par_end, &sl->b, &early_stop,
+                               w->stats);
+
+        pthread_mutex_lock(&pp->mu);
+        sl->err = (r < 0);
+        sl->early_stop = early_stop;
+        sl->state = SLOT_DONE;
+        pthread_cond_broadcast(&pp->done_cv);
+        pthread_mutex_unlock(&pp->mu);
+    }
+    return NULL;
+}
+
+// Finished slot to hand to the writer: the next in input order, or any done
+// slot in unordered mode. Caller holds pp->mu.
+static ParSlot *engine_pick_done(ParPool *pp, long next_out, int unordered) {
+    for (int k = 0; k < pp->nslots; k++) {
+        ParSlot *sl = &pp->slots[k];
+        if (sl->state != SLOT_DONE) continue;
+        if (unordered || sl->seq == next_out) return sl;
+    }
+    return NULL;
+}
+
+static int engine_stream_parallel(EngineState *es, int nworkers, int unordered) {
+    ParPool pp;
+    memset(&pp, 0, sizeof pp);
+    pp.es = es;
+    pp.nslots = 2 * nworkers + 2;
+    pp.slots = calloc((size_t)pp.nslots, sizeof *pp.slots);
+    pp.queue = calloc((size_t)pp.nslots, sizeof *pp.queue);
+    ParWorker *ws = calloc((size_t)nworkers, sizeof *ws);
+    pthread_t *tids = calloc((size_t)nworkers, sizeof *tids);
+    int rc = 0, nstarted = 0, nslots_ok = 0;
+    if (!pp.slots || !pp.queue || !ws || !tids) { rc = 2; goto out; }
+    for (; nslots_ok < pp.nslots; nslots_ok++)
+        if (fp_batch_init(&pp.slots[nslots_ok].b, FP_BATCH_MAX) < 0) { rc = 2; goto out; }
+
+    pthread_mutex_init(&pp.mu, NULL);
+    pthread_cond_init(&pp.work_cv, NULL);
+    pthread_cond_init(&pp.done_cv, NULL);
+    for (; nstarted < nworkers; nstarted++) {
+        ws[nstarted].pool = &pp; ws[nstarted].id = nstarted;
+        if (es->p->stats &&
+            !(ws[nstarted].stats = calloc((size_t)es->p->nsteps + 1, sizeof(FpStepStats)))) {
+            rc = 2; break;
+        }
+        if (pthread_create(&tids[nstarted], NULL, engine_worker_main, &ws[nstarted]) != 0) {
+            rc = 2; break;
+        }
+    }
+
+    long next_in = 0, next_out = 0;
+    int inflight = 0, src_done = (rc != 0), stop = (rc != 0);
+    for (;;) {
+        // Reader: keep every free slot filled and queued for the workers
+        if (!src_done && !stop) {
+            // slot states change under pp.mu (workers mark them done)
+            ParSlot *sl = NULL;
+            pthread_mutex_lock(&pp.mu);
+            for (int k = 0; k < pp.nslots && !sl; k++)
+                if (pp.slots[k].state == SLOT_FREE) sl = &pp.slots[k];
+            pthread_mutex_unlock(&pp.mu);
+            if (sl) {
+                int nr = engine_next_batch(es, &sl->b);
+                if (nr < 0) { rc = 2; stop = 1; continue; }
+                if (nr == 0) { src_done = 1; continue; }
+                pthread_mutex_lock(&pp.mu);
+                sl->seq = next_in++;
+                sl->state = SLOT_QUEUED;
+                sl->early_stop = 0; sl->err = 0;
+                pp.queue[(pp.qhead + pp.qlen) % pp.nslots] = (int)(sl - pp.slots);
+                pp.qlen++;
+                pthread_cond_signal(&pp.work_cv);
+                pthread_mutex_unlock(&pp.mu);
+                inflight++;
+                continue;
             }
         }
+        if (inflight == 0) break;
+
+        // Writer: serial tail + output, in input order unless unordered
+        pthread_mutex_lock(&pp.mu);
+        ParSlot *sl;
+        while (!(sl = engine_pick_done(&pp, next_out, unordered)))
+            pthread_cond_wait(&pp.done_cv, &pp.mu);
+        pthread_mutex_unlock(&pp.mu);
 
-        if (!drop) {
-            if (tail_is_sink) {
-                int ar = p->steps[p->nsteps-1].spec->accept(p->steps[p->nsteps-1].cfg, line, len);
-                if (ar < 0) { rc = 2; goto end_stream; }
-                if (ar == 0) { any_emitted = 1; goto end_stream; } // sink requested stop
-                any_emitted = 1;
-            } else {
-                if (fwrite(line, 1, len, stdout) < len) { rc = 2; goto end_stream; }
-                any_emitted = 1;
+        if (!unordered) next_out++;
+        if (!stop) {
+            if (sl->err) { rc = 2; stop = 1; }
+            else {
+                int fr = engine_finish_batch(es, &sl->b, sl->early_stop);
+                if (fr < 0) { rc = 2; stop = 1; }
+                else if (fr == 0) stop = 1;
             }
         }
+        pthread_mutex_lock(&pp.mu);
+        sl->state = SLOT_FREE;
+        pthread_mutex_unlock(&pp.mu);
+        inflight--;
+    }
+
+    pthread_mutex_lock(&pp.mu);
+    pp.quit = 1;
+    pthread_cond_broadcast(&pp.work_cv);
+    pthread_mutex_unlock(&pp.mu);
+    for (int k = 0; k < nstarted; k++) pthread_join(tids[k], NULL);
+    for (int k = 0; k < nworkers && ws[k].stats; k++) {
+        for (int i = es->src_end; i < es->par_end; i++) {
+            FpStepStats *d = &es->p->stats[i], *s = &ws[k].stats[i];
+            d->batches += s->batches;
+            d->rec_in += s->rec_in;     d->rec_out += s->rec_out;
+            d->bytes_in += s->bytes_in; d->bytes_out += s->bytes_out;
+            d->ns += s->ns;
+        }
+    }
+    pthread_cond_destroy(&pp.done_cv);
+    pthread_cond_destroy(&pp.work_cv);
+    pthread_mutex_destroy(&pp.mu);
+
+out:
+    for (int k = 0; k < nslots_ok; k++) fp_batch_free(&pp.slots[k].b);
+    for (int k = 0; ws && k < nworkers; k++) free(ws[k].stats);
+    free(pp.slots); free(pp.queue); free(ws); free(tids);
+    return rc;
+}
+
+// Identity plan: only sources, each able to copy its input verbatim.
+static int engine_is_identity(const EngineState *es) {
+    if (es->tail_is_sink || es->ops_end != es->src_end || es->left >= 0) return 0;
+    for (int i = 0; i < es->src_end; i++)
+        if (!es->p->steps[i].spec->passthrough) return 0;
+    return 1;
+}
+
+/*** main streaming loop with multi-SOURCE support ***/
+int engine_run_plan(Plan *p) {
+    // Big stdout buffer (sources read fds directly)
+    static char outbuf[FP_BUF_1M];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof outbuf);
+
+    if (p->nsteps == 0) return 0;
+
+    EngineState es;
+    memset(&es, 0, sizeof es);
+    es.p = p;
+    es.left = p->limit > 0 ? p->limit : -1;
 
-        if (early_stop) break; // stop whole stream after handling this record
+    // Determine explicit sink and the range of sources
+    es.tail_is_sink = (p->steps[p->nsteps-1].spec->kind == OP_SINK);
+    es.ops_end = es.tail_is_sink ? p->nsteps - 1 : p->nsteps;
+
+    while (es.src_end < p->nsteps && p->steps[es.src_end].spec->kind == OP_SRC) es.src_end++;
+    if (es.src_end == 0) {
+        // Shouldn't happen because engine_add_default... ensures at least one SRC.
+        // But if it does, treat as stdin.
+        es.src_end = 1;
+    }
+
+    // Parallel prefix: leading MAP/FILTER ops that agree to run in workers
+    es.par_end = es.src_end;
+    if (p->nthreads > 1) {
+        while (es.par_end < es.ops_end) {
+            const PlanStep *st = &p->steps[es.par_end];
+            if (!st->spec->parallel || !st->spec->parallel(st->cfg, p->nthreads)) break;
+            es.par_end++;
+        }
+    }
+
+    // A block-aware first op sees whole read blocks (not under a source
+    // limit, which counts records as they are produced)
+    es.blocks = es.src_end < es.ops_end && p->steps[es.src_end].spec->consume_block && es.left < 0;
+
+    // init hooks
+    for (int i = 0; i < p->nsteps; i++) {
+        if (p->steps[i].spec->init) {
+            if (p->steps[i].spec->init(p->steps[i].cfg) < 0) {
+                return 2;
+            }
+        }
+    }
+
+    // Output goes straight to fd 1; push out anything bash already buffered
+    fflush(stdout);
+    if (fp_writer_init(&es.out, STDOUT_FILENO) < 0) return 2;
+
+    int rc;
+    if (engine_is_identity(&es)) {
+        // cat-like plan: no line splitting at all
+        rc = 0;
+        for (int i = 0; i < es.src_end && rc == 0; i++) {
+            uint64_t t0 = p->stats ? engine_now_ns() : 0;
+            int r = p->steps[i].spec->passthrough(p->steps[i].cfg, STDOUT_FILENO);
+            if (p->stats) p->stats[i].ns += engine_now_ns() - t0;
+            if (r < 0) rc = 2;
+            if (r > 0) es.emitted = 1;
+        }
+    } else if (es.par_end > es.src_end) {
+        rc = engine_stream_parallel(&es, p->nthreads, p->unordered);
+    } else {
+        rc = engine_stream_serial(&es);
     }
+    if (rc == 0 && engine_drain(&es) < 0) rc = 2;
+    fp_writer_free(&es.out);
+    if (fflush(stdout) != 0) rc = 2; // per-record sinks write through stdio
 
-end_stream:
     // flush hooks
     for (int i = 0; i < p->nsteps; i++) {
         if (p->steps[i].spec->flush) {
@@ -184,5 +861,5 @@ end_stream:
     }
     // exit code policy: 0 if any emitted, 1 if none (grep-like), else 2 on error
     if (rc >= 2) return rc;
-    return any_emitted ? 0 : 1;
+    return es.emitted ? 0 : 1;
 }
@@ -1,6 +1,7 @@
 // src/fx.c
 #include "engine.h"
 #include "ops.h"
+#include "speccache.h"
 #include "util.h"
 
 #include <builtins.h>
@@ -10,13 +11,57 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int fx_build_plan(int argc, char **argv, Plan *plan, const char *who) {
+// fx-only switches that are not part of the Plan itself.
+typedef struct {
+    int explain;  // --explain: print the (optimized) plan instead of running it
+    int no_opt;   // --no-opt: run ops exactly as typed
+    int stats;    // --stats: per-step counters to stderr and FX_STATS
+    int cache;    // --cache / --cache-clear / --cache-max given
+    int list;     // --cache: list the entries once the whole plan has parsed
+    int no_ops;   // ... and nothing else to run
+} FxOpts;
+
+static int fx_build_plan(int argc, char **argv, Plan *plan, FxOpts *o, const char *who) {
     // argv[0] == "fx"; subsequent tokens are op names with args
     plan->steps = NULL; plan->nsteps = 0;
     
     // bash builtins' WORD_LIST omits the builtin name; argv[0] is the first token (e.g., "cut")
     int i = 0;
 
+    // Leading fx options (before the first op token)
+    while (i < argc && argv[i][0] == '-' && lookup_op(argv[i]) == NULL) {
+        const char *a = argv[i];
+        if (strcmp(a, "-j") == 0 || (strncmp(a, "-j", 2) == 0 && a[2] != '\0')) {
+            const char *v = a[2] ? a + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            long n = 0;
+            if (!v || fp_parse_long(v, &n) < 0 || n < 1 || n > 256) {
+                fp_errf(who, -1, "", "-j wants a thread count in 1..256\n");
+                return -1;
+            }
+            plan->nthreads = (int)n;
+            i++; continue;
+        }
+        if (strcmp(a, "-u") == 0 || strcmp(a, "--unordered") == 0) { plan->unordered = 1; i++; continue; }
+        if (strcmp(a, "--explain") == 0) { o->explain = 1; i++; continue; }
+        if (strcmp(a, "--no-opt") == 0)  { o->no_opt = 1; i++; continue; }
+        if (strcmp(a, "--stats") == 0)   { o->stats = 1; i++; continue; }
+        // compiled-spec cache: list, empty, or set the entry cap (0 = off)
+        if (strcmp(a, "--cache") == 0)       { o->list = o->cache = 1; i++; continue; }
+        if (strcmp(a, "--cache-clear") == 0) { fp_speccache_clear(); o->cache = 1; i++; continue; }
+        if (strcmp(a, "--cache-max") == 0) {
+            long n = 0;
+            if (i + 1 >= argc || fp_parse_long(argv[i+1], &n) < 0 || n < 0) {
+                fp_errf(who, -1, "", "--cache-max wants an entry count >= 0\n");
+                return -1;
+            }
+            fp_speccache_set_max((size_t)n);
+            o->cache = 1; i += 2; continue;
+        }
+        fp_errf(who, -1, "", "unknown option '%s'\n", a);
+        return -1;
+    }
+    if (o->cache && i == argc) { o->no_ops = 1; return 0; }
+
     while (i < argc) {
         const char *tok = argv[i];
         const OpSpec *op = lookup_op(tok);
@@ -42,14 +87,64 @@ static int fx_build_plan(int argc, char **argv, Plan *plan, const char *who) {
     return 0;
 }
 
+// fx --stats: expose the counters as FX_STATS[<step>.<counter>] (e.g.
+// ${FX_STATS[1.rec_out]}, ${FX_STATS[2.ns]}); step nsteps is the output.
+static void fx_export_stats(const Plan *p) {
+    static char name[] = "FX_STATS";
+    unbind_variable(name);
+    SHELL_VAR *v = find_or_make_array_variable(name, 2);
+    if (!v || !assoc_p(v)) return;
+
+    char key[64], val[64];
+    snprintf(val, sizeof val, "%d", p->nsteps);
+    bind_assoc_variable(v, name, savestring("steps"), val, 0);
+    for (int i = 0; i <= p->nsteps; i++) {
+        const FpStepStats *ss = &p->stats[i];
+        const char *op = i < p->nsteps ? p->steps[i].spec->name : "output";
+        const struct { const char *k; uint64_t n; } f[] = {
+            { "batches", ss->batches },
+            { "rec_in", ss->rec_in },     { "rec_out", ss->rec_out },
+            { "drops", fp_stats_drops(ss) },
+            { "bytes_in", ss->bytes_in }, { "bytes_out", ss->bytes_out },
+            { "ns", ss->ns },
+        };
+        snprintf(key, sizeof key, "%d.op", i);
+        snprintf(val, sizeof val, "%s", op);
+        bind_assoc_variable(v, name, savestring(key), val, 0);
+        for (size_t k = 0; k < sizeof f / sizeof f[0]; k++) {
+            snprintf(key, sizeof key, "%d.%s", i, f[k].k);
+            snprintf(val, sizeof val, "%llu", (unsigned long long)f[k].n);
+            bind_assoc_variable(v, name, savestring(key), val, 0);
+        }
+    }
+}
+
 /*** Builtin glue for fx ***/
 static int fx_entry(int argc, char **argv) {
     Plan plan = {0};
-    if (fx_build_plan(argc, argv, &plan, "fx") < 0) {
+    FxOpts o = {0};
+    if (fx_build_plan(argc, argv, &plan, &o, "fx") < 0) {
         engine_free_plan(&plan);
         return EXECUTION_FAILURE; // Bash builtin failure
     }
+    if (o.list) { fp_speccache_print(stdout); fflush(stdout); }
+    if (o.no_ops) return EXECUTION_SUCCESS;   // fx --cache...: nothing to stream
+    if (!o.no_opt) engine_optimize_plan(&plan, o.explain ? stdout : NULL);
+    if (o.explain) {
+        engine_explain_plan(&plan, stdout);
+        fflush(stdout);
+        engine_free_plan(&plan);
+        return EXECUTION_SUCCESS;
+    }
+    if (o.stats && !(plan.stats = calloc((size_t)plan.nsteps + 1, sizeof *plan.stats))) {
+        engine_free_plan(&plan);
+        return EXECUTION_FAILURE;
+    }
     int rc = engine_run_plan(&plan);
+    if (plan.stats) {
+        engine_print_stats(&plan, stderr);
+        fx_export_stats(&plan);
+    }
     engine_free_plan(&plan);
     // Map engine exit status to builtin return:
     // 0 -> EXECUTION_SUCCESS, 1 -> 1, >=2 -> 2
@@ -97,8 +192,17 @@ int fx_builtin(WORD_LIST *list) {
 }
 
 static char *fx_doc[] = {
-    "fx: fused pipeline of ops (cut/tr/grep/take/find-stub)",
-    "Usage: fx <op args>...",
+    "fx: fused pipeline of ops (cut/tr/grep/sub/uniq/sort/top/agg/join/take/find)",
+    "Usage: fx [-j N] [-u] [--explain] [--no-opt] [--stats] [--cache...] <op args>...",
+    "  -j N  run leading stateless MAP/FILTER ops in N worker threads",
+    "  -u    with -j, emit records in completion order (--unordered)",
+    "  --explain  print the plan after rewrites (fusion, filter hoisting,",
+    "             take => source limit) and exit without running it",
+    "  --no-opt   run ops exactly in the order typed",
+    "  --stats    print per-step records/bytes in and out, drops and time",
+    "             to stderr and store them in the assoc array FX_STATS",
+    "  --cache    list the compiled grep/tr/cut specs kept between calls",
+    "  --cache-clear  drop them; --cache-max N  keep at most N (0: none)",
     NULL
 };
 
@@ -107,7 +211,7 @@ struct builtin fx_struct = {
     .function = fx_builtin,
     .flags = BUILTIN_ENABLED,
     .long_doc = fx_doc,
-    .short_doc = "fx <ops...>",
+    .short_doc = "fx [-j N] [-u] [--explain] [--no-opt] [--stats] <ops...>",
     .handle = 0
 };
 
@@ -147,6 +251,55 @@ int fp_find_builtin(WORD_LIST *list) {
     int rc = run_singleton(op_find_spec(), argc, argv, "fp_find");
     free(argv); return rc;
 }
+int fp_sub_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_sub_spec(), argc, argv, "fp_sub");
+    free(argv); return rc;
+}
+int fp_gsub_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_gsub_spec(), argc, argv, "fp_gsub");
+    free(argv); return rc;
+}
+int fp_uniq_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_uniq_spec(), argc, argv, "fp_uniq");
+    free(argv); return rc;
+}
+int fp_sort_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_sort_spec(), argc, argv, "fp_sort");
+    free(argv); return rc;
+}
+int fp_top_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_top_spec(), argc, argv, "fp_top");
+    free(argv); return rc;
+}
+int fp_agg_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_agg_spec(), argc, argv, "fp_agg");
+    free(argv); return rc;
+}
+int fp_join_builtin(WORD_LIST *list) {
+    int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
+    char **argv = calloc(argc+1, sizeof(char*));
+    int i = 0; for (WORD_LIST *w = list; w; w = w->next) argv[i++] = w->word->word;
+    int rc = run_singleton(op_join_spec(), argc, argv, "fp_join");
+    free(argv); return rc;
+}
 
 int fp_emit_builtin(WORD_LIST *list) {
     int argc = 0; for (WORD_LIST *w = list; w; w = w->next) argc++;
@@ -171,7 +324,14 @@ static char *cut_doc[]  = { "fp_cut: cut-like filter", NULL };
 static char *tr_doc[]   = { "fp_tr: tr-like transliteration", NULL };
 static char *grep_doc[] = { "fp_grep: grep-like filter", NULL };
 static char *take_doc[] = { "fp_take: head -n N sink", NULL };
-static char *find_doc[] = { "fp_find: SOURCE stub", NULL };
+static char *find_doc[] = { "fp_find: find-like source (-type, -name, -maxdepth, -print0), walked on -j N threads", NULL };
+static char *sub_doc[]  = { "fp_sub: sed s/PAT/REPL/ (first match)", NULL };
+static char *gsub_doc[] = { "fp_gsub: sed s/PAT/REPL/g (every match)", NULL };
+static char *uniq_doc[] = { "fp_uniq: distinct lines or keys, -c counts (no sort needed)", NULL };
+static char *sort_doc[] = { "fp_sort: sort lines by field keys (-n, -r), spilling runs past -S SIZE", NULL };
+static char *top_doc[]  = { "fp_top: the K smallest (-r: largest) lines by key, like sort -n | head", NULL };
+static char *agg_doc[]  = { "fp_agg: count/sum:N/min:N/max:N/avg:N per key (-k LIST)", NULL };
+static char *join_doc[] = { "fp_join: append FILE's line for each key match (--semi: filter, -v: non-matches)", NULL };
 
 struct builtin fp_emit_struct = { "fp_emit", fp_emit_builtin, BUILTIN_ENABLED, emit_doc, "fp_emit STR", 0 };
 struct builtin fp_cat_struct = { "fp_cat", fp_cat_builtin, BUILTIN_ENABLED, cat_doc, "fp_cat [FILE...]", 0 };
@@ -180,6 +340,13 @@ struct builtin fp_tr_struct   = { "fp_tr",   fp_tr_builtin,   BUILTIN_ENABLED, t
 struct builtin fp_grep_struct = { "fp_grep", fp_grep_builtin, BUILTIN_ENABLED, grep_doc, "fp_grep [opts]", 0 };
 struct builtin fp_take_struct = { "fp_take", fp_take_builtin, BUILTIN_ENABLED, take_doc, "fp_take [opts]", 0 };
 struct builtin fp_find_struct = { "fp_find", fp_find_builtin, BUILTIN_ENABLED, find_doc, "fp_find [opts]", 0 };
+struct builtin fp_sub_struct  = { "fp_sub",  fp_sub_builtin,  BUILTIN_ENABLED, sub_doc,  "fp_sub [opts] PAT REPL",  0 };
+struct builtin fp_gsub_struct = { "fp_gsub", fp_gsub_builtin, BUILTIN_ENABLED, gsub_doc, "fp_gsub [opts] PAT REPL", 0 };
+struct builtin fp_uniq_struct = { "fp_uniq", fp_uniq_builtin, BUILTIN_ENABLED, uniq_doc, "fp_uniq [opts]", 0 };
+struct builtin fp_sort_struct = { "fp_sort", fp_sort_builtin, BUILTIN_ENABLED, sort_doc, "fp_sort [opts]", 0 };
+struct builtin fp_top_struct  = { "fp_top",  fp_top_builtin,  BUILTIN_ENABLED, top_doc,  "fp_top [opts]",  0 };
+struct builtin fp_agg_struct  = { "fp_agg",  fp_agg_builtin,  BUILTIN_ENABLED, agg_doc,  "fp_agg [opts] SPEC...", 0 };
+struct builtin fp_join_struct = { "fp_join", fp_join_builtin, BUILTIN_ENABLED, join_doc, "fp_join [opts] FILE",   0 };
 
 /* Export table for all builtins in this module */
 struct builtin *builtins[] = {
@@ -191,5 +358,12 @@ struct builtin *builtins[] = {
     &fp_grep_struct,
     &fp_take_struct,
     &fp_find_struct,
+    &fp_sub_struct,
+    &fp_gsub_struct,
+    &fp_uniq_struct,
+    &fp_sort_struct,
+    &fp_top_struct,
+    &fp_agg_struct,
+    &fp_join_struct,
     0   /* Must be NULL-terminated */
 };
@@ -0,0 +1,168 @@
+// src/htab.c
+#include "htab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- wyhash (final version 4, public domain) ---- */
+static const uint64_t wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 u128;
+    u128 r = (u128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+static inline uint64_t wymix(uint64_t a, uint64_t b) { wymum(&a, &b); return a ^ b; }
+static inline uint64_t wyr8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t wyr4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t fp_hash(const void *key, size_t len, uint64_t seed) {
+    const uint8_t *p = key;
+    uint64_t a, b;
+    seed ^= wymix(seed ^ wyp[0], wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48; i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16; p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+/* ---- table ---- */
+#define HT_MIN_SLOTS 1024
+
+static inline uint64_t ht_tag(uint64_t h) { return h >> 32 << 32; }
+
+int fp_htab_init(fp_htab *t, size_t vsize) {
+    memset(t, 0, sizeof *t);
+    t->vsize = vsize;
+    t->slots = calloc(HT_MIN_SLOTS, sizeof *t->slots);
+    if (!t->slots) return -1;
+    t->mask = HT_MIN_SLOTS - 1;
+    return 0;
+}
+
+// Double the slots and reinsert every entry from its stored hash.
+static int ht_rehash(fp_htab *t) {
+    size_t nslots = (t->mask + 1) * 2;
+    uint64_t *s = calloc(nslots, sizeof *s);
+    if (!s) return -1;
+    for (size_t i = 0; i < t->n; i++) {
+        size_t j = (size_t)t->ents[i].hash & (nslots - 1);
+        while (s[j]) j = (j + 1) & (nslots - 1);
+        s[j] = ht_tag(t->ents[i].hash) | (i + 1);
+    }
+    free(t->slots);
+    t->slots = s;
+    t->mask = nslots - 1;
+    return 0;
+}
+
+static int ht_grow_ents(fp_htab *t) {
+    size_t cap = t->cap ? t->cap * 2 : 256;
+    fp_htent *e = realloc(t->ents, cap * sizeof *e);
+    if (!e) return -1;
+    t->ents = e;
+    if (t->vsize) {
+        char *v = realloc(t->vals, cap * t->vsize);
+        if (!v) return -1;
+        t->vals = v;
+    }
+    t->cap = cap;
+    return 0;
+}
+
+size_t fp_htab_find(const fp_htab *t, const char *k, size_t n) {
+    uint64_t h = fp_hash(k, n, 0), tag = ht_tag(h);
+    for (size_t j = (size_t)h & t->mask; t->slots[j]; j = (j + 1) & t->mask) {
+        uint64_t s = t->slots[j];
+        if (ht_tag(s) != tag) continue;
+        const fp_htent *e = &t->ents[(uint32_t)s - 1];
+        if (e->hash == h && e->klen == n && memcmp(e->key, k, n) == 0) return (uint32_t)s - 1;
+    }
+    return SIZE_MAX;
+}
+
+size_t fp_htab_get(fp_htab *t, const char *k, size_t n, int *isnew) {
+    uint64_t h = fp_hash(k, n, 0), tag = ht_tag(h);
+    size_t j = (size_t)h & t->mask;
+    for (; t->slots[j]; j = (j + 1) & t->mask) {
+        uint64_t s = t->slots[j];
+        if (ht_tag(s) != tag) continue;
+        const fp_htent *e = &t->ents[(uint32_t)s - 1];
+        if (e->hash == h && e->klen == n && memcmp(e->key, k, n) == 0) {
+            *isnew = 0;
+            return (uint32_t)s - 1;
+        }
+    }
+    if (t->n == UINT32_MAX - 1) return SIZE_MAX;   // indices are 32-bit in the slots
+    if (t->n == t->cap && ht_grow_ents(t) < 0) return SIZE_MAX;
+    // keep the load under 3/4 so probe runs stay short
+    if ((t->n + 1) * 4 > (t->mask + 1) * 3) {
+        if (ht_rehash(t) < 0) return SIZE_MAX;
+        for (j = (size_t)h & t->mask; t->slots[j]; j = (j + 1) & t->mask) ;
+    }
+    const char *key = fp_arena_dup(&t->arena, k, n);
+    if (!key) return SIZE_MAX;
+    size_t i = t->n++;
+    t->ents[i] = (fp_htent){ key, n, h };
+    if (t->vsize) memset(fp_htab_val(t, i), 0, t->vsize);
+    t->slots[j] = tag | (i + 1);
+    *isnew = 1;
+    return i;
+}
+
+size_t fp_htab_bytes(const fp_htab *t) {
+    return (t->mask + 1) * sizeof *t->slots + t->cap * (sizeof *t->ents + t->vsize) + t->arena.held;
+}
+
+void fp_htab_free(fp_htab *t) {
+    free(t->slots);
+    free(t->ents);
+    free(t->vals);
+    fp_arena_free(&t->arena);
+    memset(t, 0, sizeof *t);
+}
@@ -0,0 +1,708 @@
+// src/lineio.c
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "lineio.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FP_X86 1
+#endif
+
+/* ---------------- line splitting ---------------- */
+
+static size_t split_scalar(char *s, size_t n, int delim, FpRec *out, size_t max, size_t *used) {
+    char *p = s, *end = s + n;
+    size_t k = 0;
+    while (k < max) {
+        char *q = memchr(p, delim, (size_t)(end - p));
+        if (!q) break;
+        out[k].ptr = p;
+        out[k].len = (size_t)(q - p) + 1;
+        k++;
+        p = q + 1;
+    }
+    *used = (size_t)(p - s);
+    return k;
+}
+
+#ifdef FP_X86
+/* Emit a view for every set bit of mask (bit i => delimiter at base[i]). */
+#define SPLIT_EMIT(mask, base)                                   \
+    while ((mask) && k < max) {                                  \
+        char *e_ = (base) + __builtin_ctzll(mask);               \
+        out[k].ptr = start;                                      \
+        out[k].len = (size_t)(e_ - start) + 1;                   \
+        k++;                                                     \
+        start = e_ + 1;                                          \
+        (mask) &= (mask) - 1;                                    \
+    }
+
+__attribute__((target("sse2")))
+static size_t split_sse2(char *s, size_t n, int delim, FpRec *out, size_t max, size_t *used) {
+    const __m128i d = _mm_set1_epi8((char)delim);
+    char *start = s;
+    size_t k = 0, i = 0;
+    for (; i + 16 <= n && k < max; i += 16) {
+        unsigned long long m = (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), d));
+        SPLIT_EMIT(m, s + i);
+    }
+    if (k < max) {
+        size_t u;
+        k += split_scalar(start, (size_t)(s + n - start), delim, out + k, max - k, &u);
+        start += u;
+    }
+    *used = (size_t)(start - s);
+    return k;
+}
+
+__attribute__((target("avx2")))
+static size_t split_avx2(char *s, size_t n, int delim, FpRec *out, size_t max, size_t *used) {
+    const __m256i d = _mm256_set1_epi8((char)delim);
+    char *start = s;
+    size_t k = 0, i = 0;
+    for (; i + 64 <= n && k < max; i += 64) {
+        unsigned long long lo = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)), d));
+        unsigned long long hi = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i + 32)), d));
+        unsigned long long m = lo | (hi << 32);
+        SPLIT_EMIT(m, s + i);
+    }
+    if (k < max) {
+        size_t u;
+        k += split_scalar(start, (size_t)(s + n - start), delim, out + k, max - k, &u);
+        start += u;
+    }
+    *used = (size_t)(start - s);
+    return k;
+}
+#endif
+
+typedef size_t (*split_fn)(char *, size_t, int, FpRec *, size_t, size_t *);
+static split_fn split_impl = split_scalar;
+static const char *split_name = "scalar";
+
+__attribute__((constructor))
+static void split_pick_kernel(void) {
+#ifdef FP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))      { split_impl = split_avx2; split_name = "avx2"; }
+    else if (__builtin_cpu_supports("sse2")) { split_impl = split_sse2; split_name = "sse2"; }
+#endif
+}
+
+size_t fp_split_lines(char *s, size_t n, int delim, FpRec *out, size_t max, size_t *used) {
+    return split_impl(s, n, delim, out, max, used);
+}
+
+const char *fp_split_kernel(void) { return split_name; }
+
+/* ---------------- field skipping ---------------- */
+
+static const char *nth_scalar(const char *s, size_t n, int c, size_t *nth) {
+    const char *p = s, *end = s + n;
+    while (*nth > 0) {
+        const char *q = memchr(p, c, (size_t)(end - p));
+        if (!q) return NULL;
+        if (--*nth == 0) return q;
+        p = q + 1;
+    }
+    return NULL;
+}
+
+#ifdef FP_X86
+/* Drop the lowest *nth - 1 set bits of m and return the position of the
+   next one, or count m against *nth when it has too few. */
+#define NTH_PICK(m, base)                                        \
+    do {                                                         \
+        size_t pc_ = (size_t)__builtin_popcountll(m);            \
+        if (pc_ >= *nth) {                                       \
+            while (--*nth) (m) &= (m) - 1;                       \
+            return (base) + __builtin_ctzll(m);                  \
+        }                                                        \
+        *nth -= pc_;                                             \
+    } while (0)
+
+__attribute__((target("sse2")))
+static const char *nth_sse2(const char *s, size_t n, int c, size_t *nth) {
+    const __m128i d = _mm_set1_epi8((char)c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned long long m = (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), d));
+        if (m) NTH_PICK(m, s + i);
+    }
+    return nth_scalar(s + i, n - i, c, nth);
+}
+
+__attribute__((target("avx2,popcnt")))
+static const char *nth_avx2(const char *s, size_t n, int c, size_t *nth) {
+    const __m256i d = _mm256_set1_epi8((char)c);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        unsigned long long lo = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)), d));
+        unsigned long long hi = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i + 32)), d));
+        unsigned long long m = lo | (hi << 32);
+        if (m) NTH_PICK(m, s + i);
+    }
+    return nth_sse2(s + i, n - i, c, nth);
+}
+#endif
+
+typedef const char *(*nth_fn)(const char *, size_t, int, size_t *);
+static nth_fn nth_impl = nth_scalar;
+
+__attribute__((constructor))
+static void nth_pick_kernel(void) {
+#ifdef FP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) nth_impl = nth_avx2;
+    else if (__builtin_cpu_supports("sse2")) nth_impl = nth_sse2;
+#endif
+}
+
+const char *fp_memchr_nth(const char *s, size_t n, int c, size_t *nth) {
+    if (*nth == 0) return NULL;
+    if (*nth == 1) {   /* libc memchr is as fast for the next one */
+        const char *q = memchr(s, c, n);
+        if (q) *nth = 0;
+        return q;
+    }
+    return nth_impl(s, n, c, nth);
+}
+
+/* ---------------- CSV structure ---------------- */
+
+static size_t csv_scalar(const char *s, size_t n, int delim, int *inq, uint32_t *out, size_t max) {
+    size_t k = 0;
+    int q = *inq;
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '"') q ^= 1;
+        else if (s[i] == (char)delim && !q && k < max) out[k++] = (uint32_t)i;
+    }
+    *inq = q;
+    return k;
+}
+
+#ifdef FP_X86
+/* Delimiters of a 64-byte block outside quotes, given its quote and
+   delimiter bits: clmul(quotes, ~0) sets bit i to the parity of quotes at
+   or before i, flipped when the block starts inside quotes; the carry is
+   the state after bit 63. */
+#define CSV_BLOCK(qm, dm, i)                                               \
+    do {                                                                   \
+        uint64_t in_ = (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(   \
+            _mm_set_epi64x(0, (long long)(qm)), _mm_set1_epi8(-1), 0)) ^ carry; \
+        carry = (uint64_t)((int64_t)in_ >> 63);                            \
+        uint64_t d_ = (dm) & ~in_;                                         \
+        while (d_ && k < max) {                                            \
+            out[k++] = (uint32_t)((i) + (size_t)__builtin_ctzll(d_));      \
+            d_ &= d_ - 1;                                                  \
+        }                                                                  \
+    } while (0)
+
+__attribute__((target("sse2,pclmul")))
+static size_t csv_sse2(const char *s, size_t n, int delim, int *inq, uint32_t *out, size_t max) {
+    const __m128i dq = _mm_set1_epi8('"'), dd = _mm_set1_epi8((char)delim);
+    uint64_t carry = *inq ? ~0ull : 0;
+    size_t k = 0, i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint64_t qm = 0, dm = 0;
+        for (int j = 0; j < 4; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i + 16 * j));
+            qm |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) << (16 * j);
+            dm |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dd)) << (16 * j);
+        }
+        CSV_BLOCK(qm, dm, i);
+    }
+    if (i < n) {   /* the tail as one zero-padded block: short records are all tail */
+        char tail[64] = {0};
+        memcpy(tail, s + i, n - i);
+        uint64_t qm = 0, dm = 0, live = ~0ull >> (64 - (n - i));
+        for (int j = 0; j < 4; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(tail + 16 * j));
+            qm |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) << (16 * j);
+            dm |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dd)) << (16 * j);
+        }
+        qm &= live; dm &= live;
+        CSV_BLOCK(qm, dm, i);   /* no quote bits past the tail: bit 63 is its end state */
+    }
+    *inq = carry != 0;
+    return k;
+}
+
+__attribute__((target("avx2,pclmul")))
+static size_t csv_avx2(const char *s, size_t n, int delim, int *inq, uint32_t *out, size_t max) {
+    const __m256i dq = _mm256_set1_epi8('"'), dd = _mm256_set1_epi8((char)delim);
+    uint64_t carry = *inq ? ~0ull : 0;
+    size_t k = 0, i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+        uint64_t qm = (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dq)) |
+                      (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dq)) << 32;
+        uint64_t dm = (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dd)) |
+                      (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dd)) << 32;
+        CSV_BLOCK(qm, dm, i);
+    }
+    if (i < n) {
+        char tail[64] = {0};
+        memcpy(tail, s + i, n - i);
+        __m256i lo = _mm256_loadu_si256((const __m256i *)tail);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(tail + 32));
+        uint64_t live = ~0ull >> (64 - (n - i));
+        uint64_t qm = ((uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dq)) |
+                       (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dq)) << 32) & live;
+        uint64_t dm = ((uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dd)) |
+                       (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dd)) << 32) & live;
+        CSV_BLOCK(qm, dm, i);
+    }
+    *inq = carry != 0;
+    return k;
+}
+#endif
+
+typedef size_t (*csv_fn)(const char *, size_t, int, int *, uint32_t *, size_t);
+static csv_fn csv_impl = csv_scalar;
+static const char *csv_name = "scalar";
+
+__attribute__((constructor))
+static void csv_pick_kernel(void) {
+#ifdef FP_X86
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("pclmul")) return;
+    if (__builtin_cpu_supports("avx2"))      { csv_impl = csv_avx2; csv_name = "avx2+pclmul"; }
+    else if (__builtin_cpu_supports("sse2")) { csv_impl = csv_sse2; csv_name = "sse2+pclmul"; }
+#endif
+}
+
+size_t fp_csv_delims(const char *s, size_t n, int delim, int *inq, uint32_t *out, size_t max) {
+    return csv_impl(s, n, delim, inq, out, max);
+}
+
+const char *fp_csv_kernel(void) { return csv_name; }
+
+/* ---------------- block line reader ---------------- */
+
+void fp_linereader_init(fp_linereader *r, int fd) {
+    memset(r, 0, sizeof *r);
+    r->fd = fd;
+}
+
+void fp_linereader_free(fp_linereader *r) {
+    free(r->carry);
+    r->carry = NULL; r->carry_len = r->carry_cap = 0;
+}
+
+/* Keep the bytes after a block's last used line for the next fill (two
+   copies: out here, back in at the start of the next block). */
+static int linereader_carry(fp_linereader *r, const char *p, size_t n) {
+    r->carry_len = 0;
+    if (n == 0) return 0;
+    if (n > r->carry_cap) {
+        size_t ncap = r->carry_cap ? r->carry_cap : FP_READ_MIN;
+        while (ncap < n) ncap *= 2;
+        char *nc = realloc(r->carry, ncap);
+        if (!nc) return -1;
+        r->carry = nc; r->carry_cap = ncap;
+    }
+    memcpy(r->carry, p, n);
+    r->carry_len = n;
+    return 0;
+}
+
+int fp_linereader_fill(fp_linereader *r, FpBatch *b) {
+    size_t room = b->cap - b->n;
+    if (room == 0) return b->n > 0;
+    int block = b->blocks && b->n == 0;
+
+    /* size the read so one block holds about one batch of lines; leftovers
+       beyond the record cap are carried (copied) into the next batch. An
+       unsplit block has no record cap and is read at full size. */
+    size_t want = r->avg_len && !block ? r->avg_len * room : FP_READ_MAX;
+    if (want < FP_READ_MIN) want = FP_READ_MIN;
+    if (want > FP_READ_MAX) want = FP_READ_MAX;
+
+    size_t base = b->dlen;
+    char *dst = fp_batch_reserve(b, r->carry_len + want);
+    if (!dst) return -1;
+    memcpy(dst, r->carry, r->carry_len);
+    size_t have = r->carry_len;
+    r->carry_len = 0;
+
+    for (;;) {
+        if (!r->eof) {
+            ssize_t got = read(r->fd, dst + have, want);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (got == 0) r->eof = 1;
+            have += (size_t)got;
+        }
+
+        if (block) {
+            /* everything up to the last newline (all of it at EOF) */
+            const char *nl = have ? memrchr(dst, '\n', have) : NULL;
+            size_t used = nl ? (size_t)(nl + 1 - dst) : r->eof ? have : 0;
+            if (used) {
+                b->blk = dst;
+                b->blen = used;
+                b->dlen = base + used;
+                return linereader_carry(r, dst + used, have - used) < 0 ? -1 : 1;
+            }
+        } else {
+            size_t used = 0;
+            size_t k = fp_split_lines(dst, have, '\n', b->recs + b->n, room, &used);
+            if (k == 0 && r->eof && have > 0) {
+                /* unterminated last line */
+                b->recs[b->n].ptr = dst;
+                b->recs[b->n].len = have;
+                k = 1; used = have;
+            }
+            if (k > 0) {
+                r->avg_len = (r->avg_len + used / k + 1) / 2;
+                b->n += k;
+                b->dlen = base + used;
+                return linereader_carry(r, dst + used, have - used) < 0 ? -1 : 1;
+            }
+        }
+        if (r->eof) return 0;
+
+        /* no complete line yet: keep reading into a larger block */
+        b->dlen = base + have;
+        dst = fp_batch_reserve(b, want);
+        b->dlen = base;
+        if (!dst) return -1;
+        dst = b->data + base;
+    }
+}
+
+struct fp_mapwin {
+    char  *base;
+    size_t len;
+    off_t  off;     /* file offset of base[0] */
+    int    refs;    /* source + every batch holding views into it */
+    int    slot;    /* in mapwin_live */
+};
+
+/* A file that shrinks under its mapping (logrotate's copytruncate) makes
+   reads of the pages past its new end fault with SIGBUS, which would kill
+   the shell fx runs in. While windows are mapped, a handler puts a zero
+   page over a faulting window page and notes it; the source then takes
+   the file's new size as its end. Records already handed out from the cut
+   pages read as NUL bytes: their data is gone from the file. Windows are
+   mapped and unmapped on the shell thread; the handler may run on any. */
+#define MAPWIN_MAX 256
+static struct { char *base; size_t len; } mapwin_live[MAPWIN_MAX];
+static int mapwin_nlive;
+static int mapwin_faulted;             /* atomic */
+static struct sigaction mapwin_oldbus;
+static long pagesz;
+
+static void mapwin_sigbus(int sig, siginfo_t *si, void *uctx) {
+    (void)sig; (void)uctx;
+    char *a = si->si_addr;
+    for (int k = 0; k < MAPWIN_MAX; k++) {
+        char *base = __atomic_load_n(&mapwin_live[k].base, __ATOMIC_ACQUIRE);
+        if (!base || a < base || a >= base + mapwin_live[k].len) continue;
+        char *pg = base + ((size_t)(a - base) & ~(size_t)(pagesz - 1));
+        if (mmap(pg, (size_t)pagesz, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED)
+            break;
+        __atomic_store_n(&mapwin_faulted, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    sigaction(SIGBUS, &mapwin_oldbus, NULL);   /* not ours: fault again as before */
+}
+
+static int mapwin_track(fp_mapwin *w) {
+    int k = 0;
+    while (k < MAPWIN_MAX && mapwin_live[k].base) k++;
+    if (k == MAPWIN_MAX) return -1;
+    if (mapwin_nlive++ == 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof sa);
+        sa.sa_sigaction = mapwin_sigbus;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGBUS, &sa, &mapwin_oldbus);
+    }
+    mapwin_live[k].len = w->len;
+    __atomic_store_n(&mapwin_live[k].base, w->base, __ATOMIC_RELEASE);
+    w->slot = k;
+    return 0;
+}
+
+static void mapwin_untrack(fp_mapwin *w) {
+    __atomic_store_n(&mapwin_live[w->slot].base, NULL, __ATOMIC_RELEASE);
+    if (--mapwin_nlive == 0) sigaction(SIGBUS, &mapwin_oldbus, NULL);
+}
+
+static void mapwin_unref(void *ctx) {
+    fp_mapwin *w = ctx;
+    if (!w || --w->refs > 0) return;
+    mapwin_untrack(w);
+    munmap(w->base, w->len);
+    free(w);
+}
+
+/* Map [pos, pos+want) page-aligned. When the address space refuses it,
+   windows of FP_MMAP_WINDOW are used, halved down to FP_READ_MAX while
+   they are refused too. */
+static fp_mapwin *mapwin_new(fp_mapsrc *m, off_t pos, size_t want) {
+    if (!pagesz) pagesz = sysconf(_SC_PAGESIZE);
+    off_t off = pos - (pos % pagesz);
+    fp_mapwin *w = calloc(1, sizeof *w);
+    if (!w) return NULL;
+    for (;;) {
+        size_t len = want + (size_t)(pos - off);
+        if ((off_t)len > m->end - off) len = (size_t)(m->end - off);
+        void *p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE, m->fd, off);
+        if (p != MAP_FAILED) {
+            madvise(p, len, MADV_SEQUENTIAL);
+            w->base = p; w->len = len; w->off = off; w->refs = 1;
+            if (mapwin_track(w) == 0) return w;
+            munmap(p, len);
+            break;
+        }
+        if (errno != ENOMEM || want <= FP_READ_MAX) break;
+        /* address space refused the range: fall back to smaller windows */
+        m->winsz = want = want > FP_MMAP_WINDOW ? FP_MMAP_WINDOW : want / 2;
+    }
+    free(w);
+    return NULL;
+}
+
+/* A window page faulted: the file shrank, and what is past its new size
+   is not read. */
+static void mapsrc_truncated(fp_mapsrc *m) {
+    struct stat st;
+    if (fstat(m->fd, &st) != 0 || st.st_size >= m->end) return;
+    m->end = st.st_size > m->pos ? st.st_size : m->pos;
+}
+
+int fp_mapsrc_open(fp_mapsrc *m, int fd) {
+    memset(m, 0, sizeof *m);
+    m->fd = fd;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    off_t cur = lseek(fd, 0, SEEK_CUR);
+    m->pos = cur > 0 ? cur : 0;
+    m->end = st.st_size;
+    if ((uintmax_t)st.st_size > (uintmax_t)SIZE_MAX / 2) m->winsz = FP_MMAP_WINDOW;
+    return 1;
+}
+
+int fp_mapsrc_fill(fp_mapsrc *m, FpBatch *b) {
+    int block = b->blocks && b->n == 0;
+    while (b->n < b->cap && m->pos < m->end) {
+        if (__atomic_exchange_n(&mapwin_faulted, 0, __ATOMIC_ACQ_REL)) {
+            mapsrc_truncated(m);
+            continue;
+        }
+        fp_mapwin *w = m->win;
+        off_t wend = w ? w->off + (off_t)w->len : 0;
+        if (wend > m->end) wend = m->end;
+        if (!w || m->pos >= wend) {
+            if (b->n > 0) break;               /* a batch holds one window */
+            size_t want = m->winsz ? m->winsz : (size_t)(m->end - m->pos);
+            fp_mapwin *nw = mapwin_new(m, m->pos, want);
+            if (!nw) return -1;
+            mapwin_unref(m->win);
+            m->win = w = nw;
+            wend = w->off + (off_t)w->len;
+            if (wend > m->end) wend = m->end;
+        }
+
+        char  *p     = w->base + (m->pos - w->off);
+        size_t avail = (size_t)(wend - m->pos);
+        size_t used  = 0, k = 0;
+        if (block) {
+            /* whole lines, about FP_READ_MAX bytes of them (or one longer line) */
+            size_t lim = avail < FP_READ_MAX ? avail : FP_READ_MAX;
+            char *nl = memrchr(p, '\n', lim);
+            if (!nl && lim < avail) nl = memchr(p + lim, '\n', avail - lim);
+            if (nl) used = (size_t)(nl + 1 - p);
+        } else {
+            k = fp_split_lines(p, avail, '\n', b->recs + b->n, b->cap - b->n, &used);
+        }
+        if (__atomic_load_n(&mapwin_faulted, __ATOMIC_ACQUIRE)) continue;   /* cut under the scan */
+        size_t len;
+        if (used > 0) {
+            len = used;
+        } else if (wend >= m->end) {
+            len = avail;                        /* last line, no newline */
+        } else {
+            /* line crosses the window end: remap from its start, growing the
+               window when a single line does not fit */
+            if (b->n > 0) break;
+            if (avail * 2 > m->winsz) m->winsz = avail * 2;
+            fp_mapwin *nw = mapwin_new(m, m->pos, m->winsz);
+            if (!nw) return -1;
+            if (nw->off + (off_t)nw->len <= wend) {   /* shrunk back: the line cannot be mapped */
+                mapwin_unref(nw);
+                errno = ENOMEM;
+                return -1;
+            }
+            mapwin_unref(m->win);
+            m->win = nw;
+            continue;
+        }
+
+        if (b->n == 0) {
+            /* batch keeps the window mapped until it is reset */
+            w->refs++;
+            b->release = mapwin_unref;
+            b->release_ctx = w;
+        }
+        m->pos += (off_t)len;
+        if (block) {
+            b->blk = p;
+            b->blen = len;
+            return 1;
+        }
+        if (k == 0) {
+            b->recs[b->n].ptr = p;
+            b->recs[b->n].len = len;
+            k = 1;
+        }
+        b->n += k;
+    }
+    return b->n > 0;
+}
+
+off_t fp_mapsrc_close(fp_mapsrc *m) {
+    mapwin_unref(m->win);
+    m->win = NULL;
+    return m->pos;
+}
+
+/* ---------------- vectored writer ---------------- */
+
+int fp_writer_init(fp_writer *w, int fd) {
+    memset(w, 0, sizeof *w);
+    w->fd = fd;
+    w->stage = malloc(FP_WRITER_STAGE);
+    return w->stage ? 0 : -1;
+}
+
+void fp_writer_free(fp_writer *w) {
+    free(w->stage);
+    w->stage = NULL;
+    w->niov = 0; w->slen = 0;
+}
+
+/* wait until a non-blocking fd can take more output */
+static int wait_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    while (poll(&pfd, 1, -1) < 0) if (errno != EINTR) return -1;
+    return 0;
+}
+
+int fp_writer_flush(fp_writer *w) {
+    struct iovec *v = w->iov;
+    int nv = w->niov;
+    while (nv > 0) {
+        ssize_t put = writev(w->fd, v, nv);
+        if (put < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(w->fd) == 0) continue;
+            w->niov = 0; w->slen = 0;
+            return -1;
+        }
+        /* skip fully written iovecs, trim a partially written one */
+        while (nv > 0 && (size_t)put >= v->iov_len) { put -= (ssize_t)v->iov_len; v++; nv--; }
+        if (nv > 0) { v->iov_base = (char *)v->iov_base + put; v->iov_len -= (size_t)put; }
+    }
+    w->niov = 0;
+    w->slen = 0;
+    return 0;
+}
+
+int fp_writer_add(fp_writer *w, const char *p, size_t n) {
+    if (n == 0) return 0;
+    if (w->niov > 0) {
+        struct iovec *last = &w->iov[w->niov - 1];
+        if ((const char *)last->iov_base + last->iov_len == p) { last->iov_len += n; return 0; }
+    }
+    if (n <= FP_WRITER_COPY_MAX) {
+        if (w->slen + n > FP_WRITER_STAGE && fp_writer_flush(w) < 0) return -1;
+        char *dst = w->stage + w->slen;
+        memcpy(dst, p, n);
+        w->slen += n;
+        p = dst;
+        if (w->niov > 0) {
+            struct iovec *last = &w->iov[w->niov - 1];
+            if ((char *)last->iov_base + last->iov_len == dst) { last->iov_len += n; return 0; }
+        }
+    }
+    if (w->niov == FP_WRITER_IOV) {
+        /* p may live in the stage, which flush recycles: copy it back to 0 */
+        int staged = (p >= w->stage && p < w->stage + FP_WRITER_STAGE);
+        char tmp[FP_WRITER_COPY_MAX];
+        if (staged) memcpy(tmp, p, n);
+        if (fp_writer_flush(w) < 0) return -1;
+        if (staged) { memcpy(w->stage, tmp, n); w->slen = n; p = w->stage; }
+    }
+    w->iov[w->niov].iov_base = (void *)p;
+    w->iov[w->niov].iov_len  = n;
+    w->niov++;
+    return 0;
+}
+
+/* ---------------- identity copy ---------------- */
+
+long long fp_copy_fd(int in, int out) {
+    long long total = 0;
+    int how = 0;                      /* 0 copy_file_range, 1 splice, 2 read/write */
+    const size_t chunk = (size_t)1 << 30;
+    char *buf = NULL;
+    for (;;) {
+        ssize_t got;
+        /* both fds use and advance their own offsets, so a method that
+           refuses this fd pair can hand over to the next one mid-stream */
+        if (how == 0) {
+            got = copy_file_range(in, NULL, out, NULL, chunk, 0);   /* file -> file */
+            if (got < 0 && errno != EINTR) { how = 1; continue; }
+        } else if (how == 1) {
+            got = splice(in, NULL, out, NULL, (size_t)1 << 20, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (got < 0 && errno != EINTR) { how = 2; continue; }   /* needs a pipe end */
+        } else {
+            if (!buf && !(buf = malloc(FP_READ_MAX))) return -1;
+            got = read(in, buf, FP_READ_MAX);
+            if (got > 0) {
+                for (ssize_t off = 0; off < got; ) {
+                    ssize_t put = write(out, buf + off, (size_t)(got - off));
+                    if (put < 0) {
+                        if (errno == EINTR) continue;
+                        if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(out) == 0) continue;
+                        free(buf); return -1;
+                    }
+                    off += put;
+                }
+            }
+        }
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            free(buf); return -1;
+        }
+        if (got == 0) break;
+        total += got;
+    }
+    free(buf);
+    return total;
+}
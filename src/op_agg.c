@@ -0,0 +1,455 @@
+// src/op_agg.c
+#include "ops.h"
+#include "htab.h"
+#include "lineio.h"
+#include "sortkey.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+enum { AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX, AGG_AVG };
+static const char *const agg_names[] = { "count", "sum", "min", "max", "avg" };
+
+typedef struct {
+    int    fn;       // AGG_*
+    size_t field;    // 1-based (0 for count)
+    size_t want;     // index of the field in agg_cfg.want
+} agg_spec;
+
+// A number as read from a field: m / 10^scale, kept exact so sums of
+// decimal amounts come out as written; a double once it does not fit
+// (an exponent, more than 18 digits, or an overflowing sum).
+typedef struct {
+    int64_t m;
+    int32_t scale;
+    int32_t isdbl;
+    double  d;
+} agg_num;
+
+// Per spec and key: the values seen (rows, for count) and their sum, min
+// or max.
+typedef struct {
+    uint64_t n;
+    agg_num  v;
+} agg_acc;
+
+typedef struct { const char *p; size_t n; } agg_field;
+
+// One hash table per fx -j worker; flush merges them into the first.
+typedef struct {
+    fp_htab    tab;
+    char      *kbuf;
+    size_t     kcap;
+    agg_field *f;
+} agg_part;
+
+typedef struct {
+    fp_sortkey  key;      // -d CHAR, -k LIST (none: one group)
+    const char *list;
+    agg_spec   *specs;
+    size_t      nspecs;
+    size_t     *want;     // value fields, sorted and unique
+    size_t      nwant;
+
+    agg_part   *parts;
+    int         nparts;
+    const fp_htent **order;   // flush: groups sorted by key
+    size_t      next;
+} agg_cfg;
+
+/* ---- numbers ---- */
+
+static const double agg_p10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double agg_pow10(int e) {
+    double r = 1;
+    int neg = e < 0;
+    if (neg) e = -e;
+    for (; e > 22; e -= 22) r *= 1e22;
+    r *= agg_p10[e];
+    return neg ? 1 / r : r;
+}
+
+static inline int agg_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+// [blanks] [+-] digits [. digits] [e [+-] digits] [blanks], and nothing
+// else; at least one digit. Returns 0 if the field is not a number.
+static int agg_parse(const char *s, size_t n, agg_num *out) {
+    const char *p = s, *e = s + n;
+    while (p < e && (*p == ' ' || *p == '\t')) p++;
+    while (e > p && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+    int neg = 0;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+    uint64_t m = 0;
+    int sig = 0, scale = 0, ndig = 0, big = 0;
+    double d = 0;
+    for (int frac = 0; p < e; p++) {
+        if (*p == '.' && !frac) { frac = 1; continue; }
+        if (!agg_digit(*p)) break;
+        ndig++;
+        if (frac) scale++;
+        if (m == 0 && *p == '0' && !frac) continue;
+        if (++sig > 18) big = 1;
+        m = m * 10 + (uint64_t)(*p - '0');   // wraps once big; d is used then
+        d = d * 10 + (*p - '0');
+    }
+    if (!ndig) return 0;
+    int exp = 0, isexp = 0;
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int eneg = 0;
+        if (q < e && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+        if (q == e || !agg_digit(*q)) return 0;
+        for (; q < e && agg_digit(*q); q++) if (exp < 100000) exp = exp * 10 + (*q - '0');
+        if (eneg) exp = -exp;
+        isexp = 1;
+        p = q;
+    }
+    if (p != e) return 0;
+
+    if (big || isexp || scale > 18) {
+        out->isdbl = 1;
+        out->d = (neg ? -d : d) * agg_pow10(exp - scale);
+        out->m = 0; out->scale = 0;
+    } else {
+        out->isdbl = 0;
+        out->m = neg ? -(int64_t)m : (int64_t)m;
+        out->scale = scale;
+        out->d = 0;
+    }
+    return 1;
+}
+
+static double agg_double(const agg_num *a) {
+    return a->isdbl ? a->d : (double)a->m / agg_pow10(a->scale);
+}
+
+// a->m at scale s (>= a->scale); 0 on overflow.
+static int agg_at_scale(const agg_num *a, int s, int64_t *m) {
+    int64_t v = a->m;
+    for (int k = a->scale; k < s; k++)
+        if (__builtin_mul_overflow(v, 10, &v)) return 0;
+    *m = v;
+    return 1;
+}
+
+static void agg_add(agg_num *acc, const agg_num *x) {
+    if (!acc->isdbl && !x->isdbl) {
+        int s = acc->scale > x->scale ? acc->scale : x->scale;
+        int64_t a, b, r;
+        if (agg_at_scale(acc, s, &a) && agg_at_scale(x, s, &b) && !__builtin_add_overflow(a, b, &r)) {
+            acc->m = r;
+            acc->scale = s;
+            return;
+        }
+    }
+    acc->d = agg_double(acc) + agg_double(x);
+    acc->isdbl = 1;
+}
+
+static int agg_cmp(const agg_num *a, const agg_num *b) {
+    if (!a->isdbl && !b->isdbl) {
+        int s = a->scale > b->scale ? a->scale : b->scale;
+        int64_t x, y;
+        if (agg_at_scale(a, s, &x) && agg_at_scale(b, s, &y)) return (x > y) - (x < y);
+    }
+    double x = agg_double(a), y = agg_double(b);
+    return (x > y) - (x < y);
+}
+
+// Write a number (at most 32 bytes); decimals keep the scale they were
+// read with.
+static size_t agg_fmt(char *w, const agg_num *a) {
+    if (a->isdbl) return (size_t)sprintf(w, "%.15g", a->d);
+    char dig[24];
+    uint64_t u = a->m < 0 ? -(uint64_t)a->m : (uint64_t)a->m;
+    int nd = 0;
+    do { dig[nd++] = (char)('0' + u % 10); u /= 10; } while (u);
+    while (nd <= a->scale) dig[nd++] = '0';
+    size_t o = 0;
+    if (a->m < 0) w[o++] = '-';
+    for (int k = nd - 1; k >= 0; k--) {
+        w[o++] = dig[k];
+        if (k == a->scale && k) w[o++] = '.';
+    }
+    return o;
+}
+
+/* ---- op ---- */
+
+static void agg_free(agg_cfg *c) {
+    for (int w = 0; c->parts && w < c->nparts; w++) {
+        fp_htab_free(&c->parts[w].tab);
+        free(c->parts[w].kbuf);
+        free(c->parts[w].f);
+    }
+    free(c->parts);
+    free(c->specs);
+    free(c->want);
+    free(c->order);
+    fp_sortkey_free(&c->key);
+    free(c);
+}
+
+static int agg_part_init(agg_cfg *c, agg_part *pt) {
+    if (fp_htab_init(&pt->tab, c->nspecs * sizeof(agg_acc)) < 0) return -1;
+    if (c->nwant && !(pt->f = calloc(c->nwant, sizeof *pt->f))) return -1;
+    return 0;
+}
+
+// count | sum:N | min:N | max:N | avg:N
+static int agg_spec_parse(const char *a, agg_spec *sp) {
+    const char *colon = strchr(a, ':');
+    size_t nl = colon ? (size_t)(colon - a) : strlen(a);
+    for (int fn = AGG_COUNT; fn <= AGG_AVG; fn++) {
+        if (strlen(agg_names[fn]) != nl || strncmp(a, agg_names[fn], nl) != 0) continue;
+        long n = 0;
+        if ((fn == AGG_COUNT) != !colon) return -1;
+        if (colon && (fp_parse_long(colon + 1, &n) < 0 || n < 1)) return -1;
+        *sp = (agg_spec){ fn, (size_t)n, 0 };
+        return 0;
+    }
+    return -1;
+}
+
+static int agg_size_cmp(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+// agg [-d CHAR] [-k LIST] SPEC...
+static int agg_parse_op(int argc, char **argv, int i, void **cfg_out) {
+    agg_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->key.delim = '\t';
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "agg") == 0 || strcmp(argv[j], "fp_agg") == 0)) j++;
+
+    for (; j < argc; j++) {
+        const char *a = argv[j], *v;
+        agg_spec sp;
+
+        if (lookup_op(a) != NULL) break;        // fx boundary
+        if (a[0] == '-' && (a[1] == 'd' || a[1] == 'k')) {
+            if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+            if (a[1] == 'd') { c->key.delim = v[0]; continue; }
+            if (fp_sortkey_fields(&c->key, v) < 0) {
+                fp_errf("fp_agg", -1, "", "invalid field list: %s\n", v);
+                goto bad;
+            }
+            c->list = v;
+            continue;
+        }
+        if (agg_spec_parse(a, &sp) < 0) break;
+        agg_spec *s = realloc(c->specs, (c->nspecs + 1) * sizeof *s);
+        if (!s) goto bad;
+        c->specs = s;
+        c->specs[c->nspecs++] = sp;
+    }
+    if (!c->nspecs) {
+        fp_errf("fp_agg", -1, "", "usage: agg [-d CHAR] [-k LIST] count|sum:N|min:N|max:N|avg:N...\n");
+        goto bad;
+    }
+
+    // the value fields, in the order a line is walked
+    if (!(c->want = malloc(c->nspecs * sizeof *c->want))) goto bad;
+    for (size_t k = 0; k < c->nspecs; k++)
+        if (c->specs[k].fn != AGG_COUNT) c->want[c->nwant++] = c->specs[k].field;
+    qsort(c->want, c->nwant, sizeof *c->want, agg_size_cmp);
+    size_t u = 0;
+    for (size_t k = 0; k < c->nwant; k++)
+        if (!u || c->want[u-1] != c->want[k]) c->want[u++] = c->want[k];
+    c->nwant = u;
+    for (size_t k = 0; k < c->nspecs; k++)
+        for (size_t w = 0; c->specs[k].fn != AGG_COUNT && w < c->nwant; w++)
+            if (c->want[w] == c->specs[k].field) c->specs[k].want = w;
+
+    if (!(c->parts = calloc(1, sizeof *c->parts))) goto bad;
+    c->nparts = 1;
+    if (agg_part_init(c, &c->parts[0]) < 0) goto bad;
+    *cfg_out = c;
+    return j;
+bad:
+    agg_free(c);
+    return -1;
+}
+
+static int agg_parallel(void *vcfg, int nworkers) {
+    agg_cfg *c = vcfg;
+    agg_part *p = realloc(c->parts, (size_t)nworkers * sizeof *p);
+    if (!p) return 0;
+    c->parts = p;
+    for (; c->nparts < nworkers; c->nparts++) {
+        memset(&p[c->nparts], 0, sizeof *p);
+        if (agg_part_init(c, &p[c->nparts]) < 0) { c->nparts++; return 0; }
+    }
+    return 1;
+}
+
+// Find the value fields of [s, s+n) (missing ones empty), jumping from one
+// to the next as cut does.
+static void agg_fields(const agg_cfg *c, const char *s, size_t n, agg_field *f) {
+    const char *p = s, *end = s + n;
+    size_t field = 1, w = 0;
+    for (; w < c->nwant; w++) {
+        if (field < c->want[w]) {
+            size_t left = c->want[w] - field;
+            const char *d = fp_memchr_nth(p, (size_t)(end - p), c->key.delim, &left);
+            if (!d) break;
+            p = d + 1; field = c->want[w];
+        }
+        const char *q = memchr(p, c->key.delim, (size_t)(end - p));
+        f[w] = (agg_field){ p, (size_t)((q ? q : end) - p) };
+        if (!q) { w++; break; }
+        p = q + 1; field++;
+    }
+    for (; w < c->nwant; w++) f[w] = (agg_field){ end, 0 };
+}
+
+static void agg_update(const agg_spec *sp, agg_acc *a, const agg_num *x) {
+    if (sp->fn == AGG_SUM || sp->fn == AGG_AVG) agg_add(&a->v, x);
+    else if (!a->n || agg_cmp(x, &a->v) == (sp->fn == AGG_MIN ? -1 : 1)) a->v = *x;
+    a->n++;
+}
+
+// Fold every record into its group; nothing is passed on.
+static int agg_consume_batch(void *vcfg, FpBatch *b) {
+    agg_cfg *c = vcfg;
+    agg_part *pt = &c->parts[b->worker > 0 && b->worker < c->nparts ? b->worker : 0];
+    for (size_t k = 0; k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        if (n && r->ptr[n-1] == '\n') n--;
+
+        const char *key = r->ptr;
+        size_t kn = 0;
+        if (c->key.fields) {
+            if (fp_sortkey_copies(&c->key) && pt->kcap < n) {
+                char *kb = realloc(pt->kbuf, n);
+                if (!kb) return -1;
+                pt->kbuf = kb; pt->kcap = n;
+            }
+            key = fp_sortkey_key(&c->key, r->ptr, n, pt->kbuf, &kn);
+        }
+        int isnew;
+        size_t e = fp_htab_get(&pt->tab, key, kn, &isnew);
+        if (e == SIZE_MAX) { fp_errf("fp_agg", -1, "", "out of memory\n"); return -1; }
+        agg_acc *acc = fp_htab_val(&pt->tab, e);
+
+        if (c->nwant) agg_fields(c, r->ptr, n, pt->f);
+        for (size_t s = 0; s < c->nspecs; s++) {
+            const agg_spec *sp = &c->specs[s];
+            agg_num x;
+            if (sp->fn == AGG_COUNT) acc[s].n++;
+            else if (agg_parse(pt->f[sp->want].p, pt->f[sp->want].n, &x)) agg_update(sp, &acc[s], &x);
+        }
+    }
+    b->nsel = 0;
+    return 0;
+}
+
+// Fold the workers' tables into the first.
+static int agg_merge(agg_cfg *c) {
+    fp_htab *dst = &c->parts[0].tab;
+    for (int w = 1; w < c->nparts; w++) {
+        const fp_htab *src = &c->parts[w].tab;
+        for (size_t i = 0; i < src->n; i++) {
+            int isnew;
+            size_t e = fp_htab_get(dst, src->ents[i].key, src->ents[i].klen, &isnew);
+            if (e == SIZE_MAX) return -1;
+            agg_acc *d = fp_htab_val(dst, e);
+            const agg_acc *s = fp_htab_val(src, i);
+            for (size_t k = 0; k < c->nspecs; k++) {
+                const agg_spec *sp = &c->specs[k];
+                if (!s[k].n) continue;
+                if (sp->fn == AGG_COUNT) d[k].n += s[k].n;
+                else if (sp->fn == AGG_SUM || sp->fn == AGG_AVG) { agg_add(&d[k].v, &s[k].v); d[k].n += s[k].n; }
+                else { uint64_t n = d[k].n + s[k].n; agg_update(sp, &d[k], &s[k].v); d[k].n = n; }
+            }
+        }
+    }
+    return 0;
+}
+
+static int agg_key_cmp(const void *pa, const void *pb) {
+    const fp_htent *a = *(const fp_htent *const *)pa, *b = *(const fp_htent *const *)pb;
+    int d = memcmp(a->key, b->key, a->klen < b->klen ? a->klen : b->klen);
+    if (d) return d;
+    return a->klen < b->klen ? -1 : a->klen > b->klen;
+}
+
+// One line per group, in key byte order: the key, then each aggregate,
+// joined by the delimiter. min, max and avg are empty for a group with
+// no numbers in the field.
+static int agg_flush_batch(void *vcfg, FpBatch *b) {
+    agg_cfg *c = vcfg;
+    fp_htab *t = &c->parts[0].tab;
+    if (!c->order) {
+        int isnew;   // without -k there is one group, even for no input
+        if (agg_merge(c) < 0 || (!c->key.fields && fp_htab_get(t, "", 0, &isnew) == SIZE_MAX)) {
+            fp_errf("fp_agg", -1, "", "out of memory\n");
+            return -1;
+        }
+        if (!(c->order = malloc((t->n ? t->n : 1) * sizeof *c->order))) return -1;
+        for (size_t i = 0; i < t->n; i++) c->order[i] = &t->ents[i];
+        qsort(c->order, t->n, sizeof *c->order, agg_key_cmp);
+    }
+    while (c->next < t->n && !fp_batch_full(b)) {
+        const fp_htent *en = c->order[c->next];
+        const agg_acc *acc = fp_htab_val(t, (size_t)(en - t->ents));
+        char *w = fp_batch_reserve(b, en->klen + c->nspecs * 33 + 1);
+        if (!w) return -1;
+        size_t o = 0;
+        if (c->key.fields) { memcpy(w, en->key, en->klen); o = en->klen; }
+        for (size_t k = 0; k < c->nspecs; k++) {
+            if (c->key.fields || k) w[o++] = c->key.delim;
+            switch (c->specs[k].fn) {
+            case AGG_COUNT: o += (size_t)sprintf(w + o, "%" PRIu64, acc[k].n); break;
+            case AGG_SUM:   o += agg_fmt(w + o, &acc[k].v); break;
+            case AGG_AVG:
+                if (acc[k].n) o += (size_t)sprintf(w + o, "%.15g", agg_double(&acc[k].v) / (double)acc[k].n);
+                break;
+            default:
+                if (acc[k].n) o += agg_fmt(w + o, &acc[k].v);
+                break;
+            }
+        }
+        w[o++] = '\n';
+        b->dlen += o;
+        if (fp_batch_add(b, w, o) < 0) return -1;
+        c->next++;
+    }
+    return b->n > 0;
+}
+
+static void agg_destroy(void *vcfg) {
+    if (vcfg) agg_free(vcfg);
+}
+
+static void agg_explain(void *vcfg, FILE *out) {
+    agg_cfg *c = vcfg;
+    if (c->key.fields) fprintf(out, "-d '%c' -k %s ", c->key.delim, c->list);
+    for (size_t k = 0; k < c->nspecs; k++) {
+        fputs(agg_names[c->specs[k].fn], out);
+        if (c->specs[k].fn != AGG_COUNT) fprintf(out, ":%zu", c->specs[k].field);
+        fputc(' ', out);
+    }
+    fputs(c->key.fields ? "[hash groups, sorted at end]" : "[one group]", out);
+}
+
+static const OpSpec SPEC = {
+    .name="fp_agg", .kind=OP_MAP,
+    .parse=agg_parse_op, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=agg_destroy, .should_stop=NULL,
+    .consume_batch=agg_consume_batch, .flush_batch=agg_flush_batch,
+    .parallel=agg_parallel, .explain=agg_explain
+};
+
+const OpSpec *op_agg_spec(){ return &SPEC; }
@@ -7,24 +7,30 @@
 #endif
 #include <sys/types.h>
 #include "ops.h"
+#include "lineio.h"
 #include "util.h"
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 typedef struct {
     char  **paths;      // argv slices
     int     n;          // number of paths
     int     i;          // current path index
 
-    FILE   *cur;        // current open stream
+    int     fd;         // current input, -1 when none is open
     int     is_stdin;   // reading from stdin?
 
-    char   *buf;        // reusable getline buffer we hand to engine
-    size_t  cap;
+    // regular files are mmap'd and handed out as zero-copy views,
+    // anything else goes through the block line reader
+    int           mapped;
+    fp_mapsrc     map;
+    fp_linereader rd;
 
-    // big file buffer for current FILE*
-    char   *fbuf;
-    size_t  fbuf_sz;
+    // per-line produce() drains a private batch
+    FpBatch line;
+    size_t  next;
 } cat_cfg;
 
 // Parse: cat [FILE ...]
@@ -33,6 +39,7 @@ typedef struct {
 static int cat_parse(int argc, char **argv, int i, void **cfg_out) {
     cat_cfg *c = calloc(1, sizeof *c);
     if (!c) return -1;
+    c->fd = -1;
 
     int j = i;
     if (j < argc && (strcmp(argv[j], "cat") == 0 || strcmp(argv[j], "fp_cat") == 0)) j++;
@@ -49,65 +56,114 @@ static int cat_parse(int argc, char **argv, int i, void **cfg_out) {
     return j;
 }
 
+static void cat_close_cur(cat_cfg *c) {
+    if (c->fd < 0) return;
+    if (c->mapped) {
+        off_t pos = fp_mapsrc_close(&c->map);
+        if (c->is_stdin) lseek(STDIN_FILENO, pos, SEEK_SET);
+        c->mapped = 0;
+    } else {
+        fp_linereader_free(&c->rd);
+    }
+    if (!c->is_stdin) close(c->fd);
+    c->fd = -1;
+    c->is_stdin = 0;
+}
+
 static int cat_open_next(cat_cfg *c) {
-    if (c->cur) { if (!c->is_stdin) fclose(c->cur); c->cur = NULL; c->is_stdin = 0; }
+    cat_close_cur(c);
     if (c->i >= c->n) return 0; // nothing to open
 
     const char *p = c->paths[c->i++];
     if (strcmp(p, "-") == 0) {
-        c->cur = stdin;
+        c->fd = STDIN_FILENO;
         c->is_stdin = 1;
     } else {
-        c->cur = fopen(p, "rb");
+        c->fd = open(p, O_RDONLY | O_CLOEXEC);
         c->is_stdin = 0;
-        if (!c->cur) return -1;
+        if (c->fd < 0) return -1;
     }
-    // big buffered IO
-    if (!c->fbuf) { c->fbuf_sz = FP_BUF_1M; c->fbuf = malloc(c->fbuf_sz); }
-    if (c->cur) setvbuf(c->cur, c->fbuf, _IOFBF, c->fbuf_sz);
+    c->mapped = fp_mapsrc_open(&c->map, c->fd);
+    if (!c->mapped) fp_linereader_init(&c->rd, c->fd);
     return 1;
 }
 
-static int cat_produce(void *vcfg, char **linep, size_t *lenp) {
+static int cat_produce_batch(void *vcfg, FpBatch *b) {
     cat_cfg *c = vcfg;
 
-    for (;;) {
-        if (!c->cur) {
+    while (b->n < b->cap) {
+        if (c->fd < 0) {
             int o = cat_open_next(c);
-            if (o <= 0) return 0;      // EOF across all files or error on open?
             if (o < 0) return -1;      // open failure
+            if (o == 0) break;         // EOF across all files
         }
-        ssize_t n = getline(&c->buf, &c->cap, c->cur);
-        if (n >= 0) {
-            *linep = c->buf; *lenp = (size_t)n;
-            return 1;
+        int r = c->mapped ? fp_mapsrc_fill(&c->map, b) : fp_linereader_fill(&c->rd, b);
+        if (r < 0) return -1;
+        if (r > 0) {
+            // stay on this file unless it just ran dry; a batch never holds
+            // views into two files' mappings
+            if (!c->mapped || c->map.pos < c->map.end) break;
+            cat_close_cur(c);
+            break;
         }
-        if (feof(c->cur)) {
-            if (!c->is_stdin) { fclose(c->cur); }
-            c->cur = NULL;
-            // loop to next file
-            continue;
-        }
-        // read error
-        return -1;
+        cat_close_cur(c);
     }
+    return b->n > 0 || b->blk;
+}
+
+static int cat_produce(void *vcfg, char **linep, size_t *lenp) {
+    cat_cfg *c = vcfg;
+    if (!c->line.recs && fp_batch_init(&c->line, FP_BATCH_MAX) < 0) return -1;
+    if (c->next >= c->line.n) {
+        fp_batch_reset(&c->line);
+        c->next = 0;
+        int r = cat_produce_batch(c, &c->line);
+        if (r <= 0) return r;
+    }
+    *linep = c->line.recs[c->next].ptr;
+    *lenp  = c->line.recs[c->next].len;
+    c->next++;
+    return 1;
+}
+
+// Identity plan: copy each file whole (copy_file_range/splice when possible)
+static int cat_passthrough(void *vcfg, int outfd) {
+    cat_cfg *c = vcfg;
+    int any = 0;
+    while (c->i < c->n) {
+        const char *p = c->paths[c->i++];
+        int is_stdin = (strcmp(p, "-") == 0);
+        int fd = is_stdin ? STDIN_FILENO : open(p, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        long long n = fp_copy_fd(fd, outfd);
+        if (!is_stdin) close(fd);
+        if (n < 0) return -1;
+        if (n > 0) any = 1;
+    }
+    return any;
 }
 
 static void cat_destroy(void *vcfg) {
     cat_cfg *c = vcfg;
     if (!c) return;
-    if (c->cur && !c->is_stdin) fclose(c->cur);
-    free(c->buf);
+    fp_batch_free(&c->line);
+    cat_close_cur(c);
     // don't free c->paths; they point into argv or static "-"
-    free(c->fbuf);
     free(c);
 }
 
+static void cat_explain(void *vcfg, FILE *out) {
+    cat_cfg *c = vcfg;
+    for (int k = 0; k < c->n; k++) fprintf(out, "%s%s", k ? " " : "", c->paths[k]);
+}
+
 static const OpSpec SPEC = {
     .name="fp_cat", .kind=OP_SRC,
     .parse=cat_parse, .init=NULL,
     .consume=NULL, .produce=cat_produce, .accept=NULL,
-    .flush=NULL, .destroy=cat_destroy, .should_stop=NULL
+    .flush=NULL, .destroy=cat_destroy, .should_stop=NULL,
+    .produce_batch=cat_produce_batch, .passthrough=cat_passthrough,
+    .explain=cat_explain
 };
 
 const OpSpec *op_cat_spec(){ return &SPEC; }
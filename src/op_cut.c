@@ -1,16 +1,57 @@
 // src/op_cut.c
 #include "ops.h"
+#include "speccache.h"
+#include "lineio.h"
 #include "util.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
 typedef struct {
     char delim;              // -d <char>
-    fp_fieldset fields;      // -f LIST
+    fp_fieldset *fields;     // -f LIST, parsed once per session (spec cache)
+    fp_specent  *fent;
     char *outdelim;          // --output-delimiter=STR (default: delim)
+    size_t odl;
+    int same_delim;          // outdelim is delim: selected runs copy as they are
+    int grow;                // outdelim is longer: output may outgrow the line
+    size_t max_out_delims;   // delimiters an output line can hold (fields - 1)
+    size_t upto;             // delimiters to find to place every span (and see one)
     int suppress_no_delim;   // -s
+    const char *list;        // -f LIST as typed, for --explain
+
+    // --csv: fields may be quoted (RFC 4180), so delimiters and line breaks
+    // inside quotes are data and a record may span lines
+    int csv;
+    size_t csv_upto;         // delimiters to find: all of them to requote for another delimiter
+    unsigned char csvq[256]; // bytes a field must be quoted for in the output
+    uint32_t *pos;           // the current record's delimiter offsets
+    size_t poscap;
+    char *pend;              // lines of a record whose quotes are still open
+    size_t plen, pcap;
+    int pinq;                // quote state at the end of pend
 } cut_cfg;
 
+static void cut_fields_free(void *fs) {
+    fp_fieldset_free(fs);
+    free(fs);
+}
+
+// The parsed LIST, shared with every cut given the same one.
+static int cut_fields(cut_cfg *c, const char *list) {
+    fp_speccache_release(c->fent);   // -f given again: the last one wins
+    c->fent = fp_speccache_get("cut", list, strlen(list));
+    if (!c->fent) {
+        fp_fieldset *fs = calloc(1, sizeof *fs);
+        if (fs && fp_fieldset_parse(list, fs) < 0) { free(fs); fs = NULL; }
+        if (fs) c->fent = fp_speccache_put("cut", list, strlen(list), fs, cut_fields_free);
+    }
+    if (!c->fent) { c->fields = NULL; return -1; }
+    c->fields = fp_specent_obj(c->fent);
+    c->list = list;
+    return 0;
+}
+
 static int cut_parse(int argc, char **argv, int i, void **cfg_out) {
     cut_cfg *c = calloc(1, sizeof *c);
     if (!c) return -1;
@@ -27,7 +68,7 @@ static int cut_parse(int argc, char **argv, int i, void **cfg_out) {
 
         // -d CHAR or -d, (attached)
         if (strcmp(a, "-d") == 0) {
-            if (++j >= argc) { free(c); return -1; }
+            if (++j >= argc) goto bad;
             c->delim = argv[j][0];
             continue;
         }
@@ -35,90 +76,375 @@ static int cut_parse(int argc, char **argv, int i, void **cfg_out) {
 
         // -f LIST or -fLIST (supports ranges 1,3-5,7-)
         if (strcmp(a, "-f") == 0) {
-            if (++j >= argc) { free(c); return -1; }
-            if (fp_fieldset_parse(argv[j], &c->fields) < 0) { free(c); return -1; }
+            if (++j >= argc || cut_fields(c, argv[j]) < 0) goto bad;
             continue;
         }
         if (strncmp(a, "-f", 2) == 0 && a[2] != '\0') {
-            if (fp_fieldset_parse(a+2, &c->fields) < 0) { free(c); return -1; }
+            if (cut_fields(c, a+2) < 0) goto bad;
             continue;
         }
 
         if (strcmp(a, "-s") == 0) { c->suppress_no_delim = 1; continue; }
+        if (strcmp(a, "--csv") == 0) { c->csv = 1; continue; }
 
-        if (strncmp(a, "--output-delimiter=", 20) == 0) {
-            c->outdelim = fp_xstrdup(a+20);
+        if (strncmp(a, "--output-delimiter=", 19) == 0) {
+            free(c->outdelim);
+            c->outdelim = fp_xstrdup(a+19);
             continue;
         }
 
         break; // unknown -> let fx see next token
     }
 
-    if (c->fields.bits == NULL) { free(c); return -1; }
+    if (!c->fields) goto bad;
 
     if (!c->outdelim) {
         c->outdelim = malloc(2);
-        if (!c->outdelim) { fp_fieldset_free(&c->fields); free(c); return -1; }
+        if (!c->outdelim) goto bad;
         c->outdelim[0]=c->delim; c->outdelim[1]='\0';
     }
+    c->odl = strlen(c->outdelim);
+    if (c->odl == 0) c->odl = 1;   // like cut: an empty one is a NUL byte
+    c->same_delim = (c->odl == 1 && c->outdelim[0] == c->delim);
+    c->grow = c->odl > 1;
+    c->max_out_delims = c->fields->to_end ? SIZE_MAX : 0;
+    for (size_t k = 0; !c->fields->to_end && k < c->fields->nspans; k++)
+        c->max_out_delims += c->fields->spans[k].hi - c->fields->spans[k].lo + 1;
+    if (c->max_out_delims && c->max_out_delims != SIZE_MAX) c->max_out_delims--;
+    c->upto = c->fields->to_end ? c->fields->spans[c->fields->nspans-1].lo - 1 : c->fields->max_field;
+    if (c->upto < 1) c->upto = 1;
+    c->csv_upto = c->same_delim ? c->upto : SIZE_MAX;
+    c->csvq['"'] = c->csvq['\n'] = c->csvq['\r'] = 1;
+    for (size_t k = 0; k < c->odl; k++) c->csvq[(unsigned char)c->outdelim[k]] = 1;
 
     *cfg_out = c;
     return j;
+bad:
+    fp_speccache_release(c->fent);
+    free(c->outdelim);
+    free(c);
+    return -1;
+}
+
+// Copy fields [p, q) to wp, delimiters swapped for the output delimiter.
+static char *cut_copy(const cut_cfg *c, char *wp, const char *p, const char *q) {
+    if (c->same_delim) {
+        memmove(wp, p, (size_t)(q - p));
+        return wp + (q - p);
+    }
+    for (;;) {
+        const char *d = memchr(p, c->delim, (size_t)(q - p));
+        const char *fe = d ? d : q;
+        memmove(wp, p, (size_t)(fe - p)); wp += fe - p;
+        if (!d) return wp;
+        memcpy(wp, c->outdelim, c->odl); wp += c->odl;
+        p = d + 1;
+    }
+}
+
+enum { CUT_WHOLE = 2 };   // cut_line: the line passes unchanged
+
+// Selected fields of [s, s+n) (without its '\n') to out, which may be s
+// itself when the output delimiter is no longer than the input one.
+static int cut_line(const cut_cfg *c, char *s, size_t n, char *out, size_t *outlen) {
+    const fp_fieldset *fs = c->fields;
+
+    // Walk the spans left to right: count delimiters to a span's first field,
+    // copy through its last one, and stop after the last span rather than
+    // reading the rest of the line.
+    char *p = s, *end = s + n, *wp = out;
+    size_t field = 1;          // the field starting at p
+    int seen = 0, wrote = 0;   // a delimiter was found / a field was copied
+    for (size_t k = 0; k < fs->nspans; k++) {
+        size_t lo = fs->spans[k].lo, hi = fs->spans[k].hi;
+        if (field < lo) {
+            size_t want = lo - field, left = want;
+            const char *d = fp_memchr_nth(p, (size_t)(end - p), c->delim, &left);
+            if (left < want) seen = 1;
+            if (!d) break;                      // the line ends before this span
+            p = (char *)d + 1; field = lo;
+        }
+        char *q = end;
+        if (hi != SIZE_MAX) {
+            size_t want = hi - field + 1, left = want;
+            const char *d = fp_memchr_nth(p, (size_t)(end - p), c->delim, &left);
+            if (left < want) seen = 1;
+            if (d) q = (char *)d;
+        } else if (!seen) {
+            seen = memchr(p, c->delim, (size_t)(end - p)) != NULL;
+        }
+        if (!seen) break;
+        if (wrote && c->odl) { memcpy(wp, c->outdelim, c->odl); wp += c->odl; }
+        wp = cut_copy(c, wp, p, q);
+        wrote = 1;
+        if (q == end) break;
+        p = q + 1; field = hi + 1;
+    }
+
+    // Like cut, a line without the delimiter passes whole (or goes, with -s).
+    if (!seen) return c->suppress_no_delim ? ENG_DROP : CUT_WHOLE;
+    *outlen = (size_t)(wp - out);
+    return ENG_OK;
+}
+
+// cut_line from the record's field view (delimiter offsets d[0..nd), at
+// least c->upto of them unless they are all the line has): no scanning.
+static int cut_line_view(const cut_cfg *c, const uint32_t *d, size_t nd,
+                         char *s, size_t n, char *out, size_t *outlen) {
+    const fp_fieldset *fs = c->fields;
+    if (!nd) return c->suppress_no_delim ? ENG_DROP : CUT_WHOLE;
+    char *end = s + n, *wp = out;
+    int wrote = 0;
+    for (size_t k = 0; k < fs->nspans; k++) {
+        size_t lo = fs->spans[k].lo, hi = fs->spans[k].hi;
+        if (lo > nd + 1) break;                 // the line ends before this span
+        char *p = lo > 1 ? s + d[lo-2] + 1 : s;
+        char *q = hi <= nd ? s + d[hi-1] : end;
+        if (wrote && c->odl) { memcpy(wp, c->outdelim, c->odl); wp += c->odl; }
+        wp = cut_copy(c, wp, p, q);
+        wrote = 1;
+        if (q == end) break;
+    }
+    *outlen = (size_t)(wp - out);
+    return ENG_OK;
+}
+
+/* ---- --csv ---- */
+
+// Field [p, q) quoted as CSV needs for the output delimiter: only when it
+// holds that delimiter, a quote or a line break (then with its quotes
+// doubled). A quoted field has them doubled already: it keeps its quotes
+// if it needs them and loses them if not.
+static char *cut_csv_put(const cut_cfg *c, char *wp, const char *p, const char *q) {
+    int quoted = q - p >= 2 && p[0] == '"' && q[-1] == '"';
+    const char *v = p + quoted, *ve = q - quoted, *t = v;
+    while (t < ve && !c->csvq[(unsigned char)*t]) t++;
+    if (t == ve) {
+        memcpy(wp, v, (size_t)(ve - v));
+        return wp + (ve - v);
+    }
+    if (quoted) {
+        memcpy(wp, p, (size_t)(q - p));
+        return wp + (q - p);
+    }
+    *wp++ = '"';
+    for (t = p; t < q; t++) {
+        if (*t == '"') *wp++ = '"';
+        *wp++ = *t;
+    }
+    *wp++ = '"';
+    return wp;
+}
+
+// cut_line_view over a CSV record's delimiters d[0..nd). With the input
+// delimiter as output delimiter the spans copy as they are; another one
+// takes every field on its own, requoted for it.
+static int cut_line_csv(const cut_cfg *c, const uint32_t *d, size_t nd,
+                        char *s, size_t n, char *out, size_t *outlen) {
+    if (c->same_delim) return cut_line_view(c, d, nd, s, n, out, outlen);
+    const fp_fieldset *fs = c->fields;
+    if (!nd) return c->suppress_no_delim ? ENG_DROP : CUT_WHOLE;
+    char *wp = out;
+    int wrote = 0;
+    for (size_t k = 0; k < fs->nspans; k++) {
+        size_t lo = fs->spans[k].lo, hi = fs->spans[k].hi;
+        for (size_t f = lo; f <= hi && f <= nd + 1; f++) {
+            const char *p = f > 1 ? s + d[f-2] + 1 : s, *q = f <= nd ? s + d[f-1] : s + n;
+            if (wrote && c->odl) { memcpy(wp, c->outdelim, c->odl); wp += c->odl; }
+            wp = cut_csv_put(c, wp, p, q);
+            wrote = 1;
+        }
+        if (hi > nd) break;
+    }
+    *outlen = (size_t)(wp - out);
+    return ENG_OK;
+}
+
+static int cut_pend_add(cut_cfg *c, const char *s, size_t n) {
+    if (c->plen + n > c->pcap) {
+        size_t ncap = c->pcap ? c->pcap : 4096;
+        while (ncap < c->plen + n) ncap *= 2;
+        char *np = realloc(c->pend, ncap);
+        if (!np) return -1;
+        c->pend = np; c->pcap = ncap;
+    }
+    memcpy(c->pend + c->plen, s, n);
+    c->plen += n;
+    return 0;
+}
+
+// Cut the CSV record r. One whose line ends inside quotes goes to pend and
+// is dropped (returns 0) unless it is whole already (joined: the lines of
+// pend, or the last of the input); its cut comes out with its last line.
+// Returns 1 to keep r, 0 to drop it, <0 on error.
+static int cut_csv_record(cut_cfg *c, FpBatch *b, FpRec *r, int joined) {
+    char *s = r->ptr;
+    size_t n = r->len;
+    int nl = n && s[n-1] == '\n'; if (nl) n--;
+    int cr = n && s[n-1] == '\r'; if (cr) n--;   // kept as the line break, not data
+    if (n >= UINT32_MAX) { fp_errf("fp_cut", -1, "", "line too long\n"); return -1; }
+    size_t want = c->csv_upto < n ? c->csv_upto : n;
+    if (want > c->poscap) {
+        uint32_t *np = realloc(c->pos, want * sizeof *np);
+        if (!np) return -1;
+        c->pos = np; c->poscap = want;
+    }
+    int inq = 0;
+    size_t nd = fp_csv_delims(s, n, c->delim, &inq, c->pos, want);
+    if (inq && nl && !joined) {
+        if (cut_pend_add(c, r->ptr, r->len) < 0) return -1;
+        c->pinq = 1;
+        return 0;
+    }
+
+    // Output no longer than the record goes in place, unless the record is
+    // pend's, which the next one overwrites. Requoting can double a field
+    // and add its quotes.
+    char *out = s;
+    if (joined || !c->same_delim) {
+        out = fp_arena_reserve(&b->arena, c->same_delim ? n + 2 : 2 * n + (nd + 1) * (2 + c->odl) + 2);
+        if (!out) return -1;
+    }
+    size_t len;
+    int rc = cut_line_csv(c, c->pos, nd, s, n, out, &len);
+    if (rc == ENG_DROP) return 0;
+    if (rc == CUT_WHOLE) {
+        if (out == s || !joined) return 1;
+        memcpy(out, s, n);
+        len = n;
+    }
+    if (cr) out[len++] = '\r';
+    if (nl) out[len++] = '\n';
+    if (out != s) fp_arena_commit(&b->arena, len);
+    r->ptr = out;
+    r->len = len;
+    return 1;
+}
+
+// The lines of a record with quotes open are held back until the one that
+// closes them, which carries the record's cut.
+static int cut_consume_csv(cut_cfg *c, FpBatch *b) {
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        FpRec *r = &b->recs[b->sel[k]];
+        int joined = 0;
+        if (c->plen) {
+            if (cut_pend_add(c, r->ptr, r->len) < 0) return -1;
+            fp_csv_delims(r->ptr, r->len, c->delim, &c->pinq, NULL, 0);
+            if (c->pinq && r->len && r->ptr[r->len-1] == '\n') continue;
+            r->ptr = c->pend;
+            r->len = c->plen;
+            c->plen = 0;
+            joined = 1;
+        }
+        int rc = cut_csv_record(c, b, r, joined);
+        if (rc < 0) return -1;
+        if (rc) b->sel[w++] = b->sel[k];
+    }
+    b->nsel = w;
+    return 0;
+}
+
+// Input that ends inside quotes: what is held back is cut as it is.
+static int cut_flush_batch(void *vcfg, FpBatch *b) {
+    cut_cfg *c = vcfg;
+    if (!c->plen) return 0;
+    size_t n = c->plen;
+    c->plen = 0;
+    if (fp_batch_push_copy(b, c->pend, n) < 0) return -1;
+    int rc = cut_csv_record(c, b, &b->recs[0], 1);
+    if (rc <= 0) b->n = 0;
+    return rc;
 }
 
 static int cut_consume(void *vcfg, char **linep, size_t *lenp) {
     cut_cfg *c = vcfg;
-    char *s = *linep; size_t n = *lenp;
-    // Keep newline strip+restore for easier joining
-    int had_nl = (n && s[n-1] == '\n'); if (had_nl) { s[--n] = '\0'; }
-
-    // Detect delimiter presence
-    int has_delim = (memchr(s, c->delim, n) != NULL);
-    if (!has_delim && c->suppress_no_delim) {
-        if (had_nl) s[n++] = '\n';
-        *lenp = n; return ENG_DROP;
-    }
-
-    // In-place selection: write pointer wp
-    char *wp = s;
-    size_t field = 1;
-    const char *od = c->outdelim; size_t odl = strlen(od);
-    int wrote_any = 0;
-
-    char *p = s; char *end = s + n;
-    while (p <= end) {
-        char *q = (p == end) ? end : memchr(p, c->delim, (size_t)(end - p));
-        if (!q) q = end;
-        int take = fp_fieldset_has(&c->fields, field);
-        if (take) {
-            if (wrote_any && odl) { memmove(wp, od, odl); wp += odl; }
-            memmove(wp, p, (size_t)(q - p)); wp += (size_t)(q - p);
-            wrote_any = 1;
+    if (c->grow || c->csv) return ENG_ERR;   // needs the batch arena: cut_consume_batch
+    char *s = *linep; size_t n = *lenp, len;
+    int had_nl = (n && s[n-1] == '\n'); if (had_nl) n--;
+    int rc = cut_line(c, s, n, s, &len);
+    if (rc == CUT_WHOLE) return ENG_OK;
+    if (rc != ENG_OK) return rc;
+    if (had_nl) s[len++] = '\n';
+    *lenp = len;
+    return ENG_OK;
+}
+
+// In place, or with a longer output delimiter, into the batch arena: the
+// output is at most the line plus the extra delimiter bytes. A record an
+// earlier filter split on the same delimiter (grep --field) is cut from
+// that field view; building one just for cut would cost more than
+// cut_line's jumps to the spans.
+static int cut_consume_batch(void *vcfg, FpBatch *b) {
+    cut_cfg *c = vcfg;
+    if (c->csv) return cut_consume_csv(c, b);
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        size_t idx = b->sel[k];
+        FpRec *r = &b->recs[idx];
+        char *s = r->ptr, *out = s;
+        size_t n = r->len, len;
+        int had_nl = (n && s[n-1] == '\n'); if (had_nl) n--;
+        if (c->grow) {
+            size_t nd = c->max_out_delims < n ? c->max_out_delims : n;
+            out = fp_arena_reserve(&b->arena, n + 1 + nd * (c->odl - 1));
+            if (!out) return -1;
         }
-        if (q == end) break;
-        p = q + 1;
-        field++;
+        const uint32_t *d = NULL;
+        size_t nd = 0;
+        int all;
+        if (fp_batch_has_fields(b, idx, c->delim)) d = fp_batch_fields(b, idx, c->delim, c->upto, &nd, &all);
+        int rc = d ? cut_line_view(c, d, nd, s, n, out, &len) : cut_line(c, s, n, out, &len);
+        if (rc == ENG_DROP) continue;
+        if (rc == ENG_OK) {
+            if (had_nl) out[len++] = '\n';
+            if (c->grow) fp_arena_commit(&b->arena, len);
+            r->ptr = out;
+            r->len = len;
+        }
+        b->sel[w++] = b->sel[k];
     }
-    
-    // restore newline
-    if (had_nl) *wp++ = '\n';
-    *lenp = (size_t)(wp - s);
-    return wrote_any ? ENG_OK : ENG_DROP;
+    b->nsel = w;
+    return 0;
+}
+
+// --csv carries a record's open quotes from one batch to the next.
+static int cut_parallel(void *vcfg, int nworkers) {
+    cut_cfg *c = vcfg;
+    (void)nworkers;
+    return !c->csv;
 }
 
 static void cut_destroy(void *vcfg) {
     cut_cfg *c = vcfg;
     if (!c) return;
-    fp_fieldset_free(&c->fields);
+    fp_speccache_release(c->fent);
     free(c->outdelim);
+    free(c->pos);
+    free(c->pend);
     free(c);
 }
 
+// One output record per input record unless -s drops delimiter-less lines
+// (or --csv joins lines).
+static unsigned cut_props(void *vcfg) {
+    cut_cfg *c = vcfg;
+    return c->suppress_no_delim || c->csv ? 0 : FP_PROP_1TO1;
+}
+static void cut_explain(void *vcfg, FILE *out) {
+    cut_cfg *c = vcfg;
+    fprintf(out, "-d '%c' -f %s%s", c->delim, c->list, c->suppress_no_delim ? " -s" : "");
+    if (c->csv) fprintf(out, " --csv [%s]", fp_csv_kernel());
+}
+
 static const OpSpec SPEC = {
     .name="fp_cut", .kind=OP_MAP,
     .parse=cut_parse, .init=NULL,
     .consume=cut_consume, .produce=NULL, .accept=NULL,
-    .flush=NULL, .destroy=cut_destroy, .should_stop=NULL
+    .flush=NULL, .destroy=cut_destroy, .should_stop=NULL,
+    .consume_batch=cut_consume_batch, .flush_batch=cut_flush_batch,
+    .parallel=cut_parallel,
+    .props=cut_props, .explain=cut_explain
 };
 
 const OpSpec *op_cut_spec(){ return &SPEC; }
@@ -1,99 +1,385 @@
 // src/op_find.c
 #include "ops.h"
+#include "lineio.h"
 #include "util.h"
 
-#include <string.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
-#include <fnmatch.h>
-#include <limits.h>
 
+#ifndef FP_FIND_DENTS
+#define FP_FIND_DENTS ((size_t)128 << 10)   // getdents64 buffer per worker
+#endif
+#ifndef FP_FIND_CHUNK
+#define FP_FIND_CHUNK ((size_t)64 << 10)    // output handed to the engine at once
+#endif
+#define FIND_QUEUED_MAX 64                  // chunks waiting before workers block
+
+// A directory to scan, its path being the prefix of its entries. It is
+// opened relative to its parent's fd, which stays open while any child
+// directory is still queued (refs), so no path is resolved from the root.
+typedef struct find_dir {
+    struct find_dir *parent;   // until opened
+    int      fd;
+    int      depth;
+    int      refs;             // atomic: its own scan + children not yet opened
+    size_t   nameoff;          // its name within path
+    size_t   plen;
+    char     path[];
+} find_dir;
+
+// Output: paths with their terminators, back to back. Held by the op while
+// it is being handed out and by every batch pointing into it (refs).
+typedef struct find_chunk {
+    struct find_chunk *next;
+    int    refs;
+    size_t len, cap;
+    char   data[];
+} find_chunk;
+
+// A worker's directories: the owner pushes and pops at the tail, others
+// steal from the head (the oldest ones, nearest the start: the largest
+// subtrees).
 typedef struct {
-    char *path;
-    DIR  *dir;
-    int   depth;
-} Frame;
+    pthread_mutex_t mu;
+    find_dir      **q;
+    size_t          head, tail, cap;
+} find_deque;
+
+typedef struct find_cfg find_cfg;
 
 typedef struct {
+    find_cfg   *c;
+    int         id;
+    find_deque  dq;
+    find_chunk *out;           // being filled
+    find_dir  **kids;          // subdirectories of the directory being scanned
+    size_t      nkids, kcap;
+    char       *dents;         // getdents64 buffer
+} find_worker;
+
+struct find_cfg {
     char *start;     // default "."
     char  type;      // 0, 'f', 'd'
     char *namepat;   // glob pattern (fnmatch on basename)
     int   maxdepth;  // -1 => unlimited
     int   print0;    // -print0
+    int   nthreads;  // -j N
+
+    find_worker    *w;
+    pthread_t      *tids;
+    int             nstarted;
+    pthread_mutex_t mu;        // idle workers and the chunk queue
+    pthread_cond_t  work_cv, data_cv, space_cv;
+    size_t          pending;   // atomic: directories queued or being scanned
+    size_t          queued;    // atomic: directories in the deques
+    int             idle;      // atomic, changed under mu: workers waiting for work
+    int             live;      // workers still running (under mu)
+    int             stop;      // atomic: the engine is done with the walk
+    find_chunk     *ohead, *otail;
+    int             oqlen;
+    int             started;
+    find_chunk     *cur;       // being handed out, from coff on
+    size_t          coff;
+
+    // per-line produce() drains a private batch
+    FpBatch line;
+    size_t  next;
+};
 
-    // traversal stack (LIFO), iterative to avoid recursion
-    Frame *stk;
-    int    top;      // points to next free slot
-    int    cap;
+static void find_destroy(void *vcfg);
 
-    // output buffer reused
-    char  *obuf;
-    size_t ocap;
+/* ---- directories ---- */
+
+static find_dir *find_dir_new(find_dir *parent, const char *name, size_t nlen, int depth) {
+    size_t pl = parent ? parent->plen : 0;
+    int slash = parent && pl && parent->path[pl-1] != '/';
+    find_dir *d = malloc(sizeof *d + pl + slash + nlen + 1);
+    if (!d) return NULL;
+    if (pl) memcpy(d->path, parent->path, pl);
+    if (slash) d->path[pl] = '/';
+    memcpy(d->path + pl + slash, name, nlen);
+    d->plen = pl + slash + nlen;
+    d->path[d->plen] = '\0';
+    d->nameoff = pl + slash;
+    d->parent = parent;
+    d->fd = -1;
+    d->depth = depth;
+    d->refs = 1;
+    if (parent) __atomic_add_fetch(&parent->refs, 1, __ATOMIC_RELAXED);
+    return d;
+}
 
-    // initial node processed?
-    int    started;
-    int    done;
-} find_cfg;
+static void find_dir_release(find_dir *d) {
+    if (__atomic_sub_fetch(&d->refs, 1, __ATOMIC_ACQ_REL)) return;
+    if (d->fd >= 0) close(d->fd);
+    free(d);
+}
 
-static void find_destroy(void *vcfg);
+// A directory that will not be scanned after all.
+static void find_dir_drop(find_dir *d) {
+    if (d->parent) find_dir_release(d->parent);
+    d->parent = NULL;
+    find_dir_release(d);
+}
 
-static int push(find_cfg *c, const char *path, int depth, DIR *opendir_now) {
-    if (c->top == c->cap) {
-        int ncap = c->cap ? c->cap * 2 : 32;
-        Frame *n = realloc(c->stk, ncap * sizeof *n);
-        if (!n) return -1;
-        c->stk = n; c->cap = ncap;
+static int find_push(find_deque *q, find_dir *d) {
+    pthread_mutex_lock(&q->mu);
+    if (q->tail == q->cap) {
+        if (q->head) {
+            memmove(q->q, q->q + q->head, (q->tail - q->head) * sizeof *q->q);
+            q->tail -= q->head; q->head = 0;
+        } else {
+            size_t ncap = q->cap ? q->cap * 2 : 256;
+            find_dir **nq = realloc(q->q, ncap * sizeof *nq);
+            if (!nq) { pthread_mutex_unlock(&q->mu); return -1; }
+            q->q = nq; q->cap = ncap;
+        }
     }
-    c->stk[c->top].path = fp_xstrdup(path);
-    c->stk[c->top].depth = depth;
-    c->stk[c->top].dir = NULL;
-    if (opendir_now) c->stk[c->top].dir = opendir_now; // (unused path)
-    c->top++;
+    q->q[q->tail++] = d;
+    pthread_mutex_unlock(&q->mu);
     return 0;
 }
 
-static void pop(find_cfg *c) {
-    if (c->top == 0) return;
-    c->top--;
-    if (c->stk[c->top].dir) closedir(c->stk[c->top].dir);
-    free(c->stk[c->top].path);
-    c->stk[c->top].path = NULL;
-    c->stk[c->top].dir = NULL;
+static find_dir *find_pop(find_deque *q, int steal) {
+    find_dir *d = NULL;
+    pthread_mutex_lock(&q->mu);
+    if (q->head < q->tail) d = steal ? q->q[q->head++] : q->q[--q->tail];
+    pthread_mutex_unlock(&q->mu);
+    return d;
 }
 
-static inline const char *basename_c(const char *p) {
-    const char *slash = strrchr(p, '/');
-    return slash ? slash + 1 : p;
+/* ---- output ---- */
+
+static void find_chunk_unref(void *vch) {
+    find_chunk *ch = vch;
+    if (!__atomic_sub_fetch(&ch->refs, 1, __ATOMIC_ACQ_REL)) free(ch);
 }
 
-static int match_filters(find_cfg *c, const char *path, const struct stat *st, int is_dir) {
-    if (c->type == 'f' && S_ISREG(st->st_mode) == 0) return 0;
-    if (c->type == 'd' && S_ISDIR(st->st_mode) == 0) return 0;
-    if (c->namepat) {
-        const char *base = basename_c(path);
-        if (fnmatch(c->namepat, base, 0) != 0) return 0;
+// Queue a chunk for the engine, waiting while FIND_QUEUED_MAX are queued.
+static void find_emit(find_cfg *c, find_chunk *ch) {
+    pthread_mutex_lock(&c->mu);
+    while (c->oqlen >= FIND_QUEUED_MAX && !__atomic_load_n(&c->stop, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&c->space_cv, &c->mu);
+    if (__atomic_load_n(&c->stop, __ATOMIC_SEQ_CST)) {
+        free(ch);
+    } else {
+        ch->next = NULL;
+        if (c->otail) c->otail->next = ch; else c->ohead = ch;
+        c->otail = ch;
+        c->oqlen++;
+        pthread_cond_signal(&c->data_cv);
     }
-    (void)is_dir;
-    return 1;
+    pthread_mutex_unlock(&c->mu);
+}
+
+static void find_flush(find_cfg *c, find_worker *w) {
+    if (w->out && w->out->len) find_emit(c, w->out);
+    else free(w->out);
+    w->out = NULL;
+}
+
+// Room for need more bytes in the worker's chunk.
+static char *find_out(find_cfg *c, find_worker *w, size_t need) {
+    if (w->out && w->out->len + need > w->out->cap) find_flush(c, w);
+    if (!w->out) {
+        size_t cap = need > FP_FIND_CHUNK ? need : FP_FIND_CHUNK;
+        if (!(w->out = malloc(sizeof *w->out + cap))) return NULL;
+        w->out->len = 0;
+        w->out->cap = cap;
+    }
+    return w->out->data + w->out->len;
+}
+
+/* ---- the walk ---- */
+
+static int find_match(const find_cfg *c, const char *name, int isreg, int isdir) {
+    if (c->type == 'f' && !isreg) return 0;
+    if (c->type == 'd' && !isdir) return 0;
+    return !c->namepat || fnmatch(c->namepat, name, 0) == 0;
 }
 
-static int ensure_obuf(find_cfg *c, size_t need) {
-    if (need > c->ocap) {
-        size_t cap = c->ocap ? c->ocap : 256;
-        while (cap < need) cap *= 2;
-        char *nb = realloc(c->obuf, cap);
-        if (!nb) return -1;
-        c->obuf = nb; c->ocap = cap;
+// One entry of d: printed if it matches, queued if it is a directory to
+// descend into. d_type answers both unless the file system leaves it
+// unknown; only then, and only if it matters, is there a stat call.
+static int find_entry(find_cfg *c, find_worker *w, find_dir *d, const char *name, unsigned char dtype) {
+    int descend = c->maxdepth < 0 || d->depth + 1 < c->maxdepth;
+    int isdir = dtype == DT_DIR, isreg = dtype == DT_REG;
+    if (dtype == DT_UNKNOWN && (c->type || descend)) {
+        struct stat st;
+        if (fstatat(d->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return 0;   // gone since
+        isdir = S_ISDIR(st.st_mode);
+        isreg = S_ISREG(st.st_mode);
+    }
+    size_t nlen = strlen(name);
+    if (find_match(c, name, isreg, isdir)) {
+        int slash = d->plen && d->path[d->plen-1] != '/';
+        size_t len = d->plen + slash + nlen;
+        char *o = find_out(c, w, len + 1);
+        if (!o) return -1;
+        memcpy(o, d->path, d->plen);
+        if (slash) o[d->plen] = '/';
+        memcpy(o + d->plen + slash, name, nlen);
+        o[len] = c->print0 ? '\0' : '\n';
+        w->out->len += len + 1;
     }
+    if (!isdir || !descend) return 0;
+    if (w->nkids == w->kcap) {
+        size_t ncap = w->kcap ? w->kcap * 2 : 64;
+        find_dir **nk = realloc(w->kids, ncap * sizeof *nk);
+        if (!nk) return -1;
+        w->kids = nk; w->kcap = ncap;
+    }
+    if (!(w->kids[w->nkids] = find_dir_new(d, name, nlen, d->depth + 1))) return -1;
+    w->nkids++;
     return 0;
 }
 
+#ifdef SYS_getdents64
+struct find_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+// The entries of d, read with getdents64 in FP_FIND_DENTS-byte gulps.
+static int find_read(find_cfg *c, find_worker *w, find_dir *d) {
+    for (;;) {
+        long n = syscall(SYS_getdents64, d->fd, w->dents, FP_FIND_DENTS);
+        if (n <= 0) return 0;   // end, or unreadable: skipped like an unopenable one
+        for (long off = 0; off < n; ) {
+            const struct find_dirent64 *e = (const void *)(w->dents + off);
+            off += e->d_reclen;
+            const char *nm = e->d_name;
+            if (nm[0] == '.' && (nm[1] == '\0' || (nm[1] == '.' && nm[2] == '\0'))) continue;
+            if (find_entry(c, w, d, nm, e->d_type) < 0) return -1;
+        }
+        if (__atomic_load_n(&c->stop, __ATOMIC_RELAXED)) return 0;
+    }
+}
+#else
+static int find_read(find_cfg *c, find_worker *w, find_dir *d) {
+    int fd = dup(d->fd);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) { if (fd >= 0) close(fd); return 0; }
+    int rc = 0;
+    for (struct dirent *e; rc == 0 && (e = readdir(dir)); ) {
+        const char *nm = e->d_name;
+        if (nm[0] == '.' && (nm[1] == '\0' || (nm[1] == '.' && nm[2] == '\0'))) continue;
+        rc = find_entry(c, w, d, nm, e->d_type);
+    }
+    closedir(dir);
+    return rc;
+}
+#endif
+
+// Open d relative to its parent and read it, then hand over its
+// subdirectories. With other workers about, the chunk holding d's entries
+// goes out first, so a directory is always printed before its contents.
+static int find_scan(find_cfg *c, find_worker *w, find_dir *d) {
+    if (d->parent) {
+        d->fd = openat(d->parent->fd, d->path + d->nameoff, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        find_dir_release(d->parent);
+        d->parent = NULL;
+    } else {
+        d->fd = open(d->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    }
+    int rc = d->fd >= 0 ? find_read(c, w, d) : 0;
+
+    if (w->nkids) {
+        if (c->nthreads > 1) find_flush(c, w);
+        __atomic_add_fetch(&c->pending, w->nkids, __ATOMIC_SEQ_CST);
+        // pushed in reverse, so the owner pops them in directory order
+        for (size_t k = w->nkids; k-- > 0; ) {
+            if (find_push(&w->dq, w->kids[k]) < 0) {
+                rc = -1;
+                find_dir_drop(w->kids[k]);
+                __atomic_sub_fetch(&c->pending, 1, __ATOMIC_SEQ_CST);
+                continue;
+            }
+            __atomic_add_fetch(&c->queued, 1, __ATOMIC_SEQ_CST);
+        }
+        w->nkids = 0;
+        if (__atomic_load_n(&c->idle, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&c->mu);
+            pthread_cond_broadcast(&c->work_cv);
+            pthread_mutex_unlock(&c->mu);
+        }
+    }
+    find_dir_release(d);
+    if (__atomic_sub_fetch(&c->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&c->mu);
+        pthread_cond_broadcast(&c->work_cv);
+        pthread_mutex_unlock(&c->mu);
+    }
+    return rc;
+}
+
+// The next directory: the worker's own newest, else one stolen from
+// another worker, else wait until one is queued or the walk is over.
+static find_dir *find_take(find_cfg *c, find_worker *w) {
+    for (;;) {
+        if (__atomic_load_n(&c->stop, __ATOMIC_SEQ_CST)) return NULL;
+        find_dir *d = find_pop(&w->dq, 0);
+        for (int k = 1; !d && k < c->nthreads; k++) d = find_pop(&c->w[(w->id + k) % c->nthreads].dq, 1);
+        if (d) {
+            __atomic_sub_fetch(&c->queued, 1, __ATOMIC_SEQ_CST);
+            return d;
+        }
+        pthread_mutex_lock(&c->mu);
+        __atomic_add_fetch(&c->idle, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&c->stop, __ATOMIC_SEQ_CST) && !__atomic_load_n(&c->queued, __ATOMIC_SEQ_CST) &&
+               __atomic_load_n(&c->pending, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&c->work_cv, &c->mu);
+        __atomic_sub_fetch(&c->idle, 1, __ATOMIC_SEQ_CST);
+        int over = !__atomic_load_n(&c->pending, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&c->mu);
+        if (over) return NULL;
+    }
+}
+
+static void *find_worker_main(void *arg) {
+    find_worker *w = arg;
+    find_cfg *c = w->c;
+    for (find_dir *d; (d = find_take(c, w)); ) {
+        if (find_scan(c, w, d) < 0) {
+            fp_errf("fp_find", -1, "", "out of memory\n");
+            __atomic_store_n(&c->stop, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    find_flush(c, w);
+    pthread_mutex_lock(&c->mu);
+    c->live--;
+    pthread_cond_broadcast(&c->data_cv);
+    pthread_cond_broadcast(&c->work_cv);
+    pthread_mutex_unlock(&c->mu);
+    return NULL;
+}
+
+/* ---- the op ---- */
+
+// find [PATH] [-type f|d] [-name GLOB] [-maxdepth N] [-print0] [-j N]
 static int find_parse(int argc, char **argv, int i, void **cfg_out) {
     find_cfg *c = calloc(1, sizeof *c);
     if (!c) return -1;
     c->start = fp_xstrdup(".");
     c->maxdepth = -1;
+    long np = sysconf(_SC_NPROCESSORS_ONLN);
+    c->nthreads = np < 1 ? 1 : np > 8 ? 8 : (int)np;
+    pthread_mutex_init(&c->mu, NULL);
+    pthread_cond_init(&c->work_cv, NULL);
+    pthread_cond_init(&c->data_cv, NULL);
+    pthread_cond_init(&c->space_cv, NULL);
 
     int j = i;
     if (j < argc && (strcmp(argv[j], "find") == 0 || strcmp(argv[j], "fp_find") == 0)) j++;
@@ -113,6 +399,7 @@ static int find_parse(int argc, char **argv, int i, void **cfg_out) {
         }
         if (strcmp(a, "-name") == 0) {
             if (++j >= argc) { find_destroy((void *)c); return -1; }
+            free(c->namepat);
             c->namepat = fp_xstrdup(argv[j++]); continue;
         }
         if (strcmp(a, "-maxdepth") == 0) {
@@ -120,6 +407,16 @@ static int find_parse(int argc, char **argv, int i, void **cfg_out) {
             long md=0; if (fp_parse_long(argv[j], &md)==0 && md>=0) c->maxdepth=(int)md; j++; continue;
         }
         if (strcmp(a, "-print0") == 0) { c->print0 = 1; j++; continue; }
+        if (strcmp(a, "-j") == 0) {
+            long n = 0;
+            if (++j >= argc || fp_parse_long(argv[j], &n) < 0 || n < 1) {
+                fp_errf("fp_find", -1, "", "invalid thread count: %s\n", j < argc ? argv[j] : "");
+                find_destroy((void *)c);
+                return -1;
+            }
+            c->nthreads = n > 64 ? 64 : (int)n;
+            j++; continue;
+        }
 
         break; // unknown -> let fx see it
     }
@@ -127,164 +424,167 @@ static int find_parse(int argc, char **argv, int i, void **cfg_out) {
     return j;
 }
 
-static int find_init_node(find_cfg *c) {
-    // lstat to decide whether start is file or dir
+// The start path (printed first if it matches), then, if it is a directory
+// to descend into, the workers.
+static int find_start(find_cfg *c) {
+    c->started = 1;
     struct stat st;
-    if (lstat(c->start, &st) != 0) { c->done = 1; return -1; }
-
-    // Emit the start node itself if it matches and depth constraints allow.
-    // find(1) typically considers depth 0 for the starting path.
-    if (S_ISDIR(st.st_mode)) {
-        // push directory frame for iteration
-        if (c->maxdepth == 0) {
-            // only the start path is considered; still may emit it if -type d etc.
-            if (match_filters(c, c->start, &st, 1)) {
-                size_t n = strlen(c->start);
-                size_t need = n + 1; // suffix
-                if (ensure_obuf(c, need+1) < 0) return -1;
-                memcpy(c->obuf, c->start, n);
-                c->obuf[n] = c->print0 ? '\0' : '\n';
-                c->started = 1; c->done = 1;
-                return 1; // produced
-            }
-            c->done = 1;
-            return 0;
-        }
-        // If the dir itself matches filters, we should emit it before traversing (pre-order).
-        if (match_filters(c, c->start, &st, 1)) {
-            size_t n = strlen(c->start);
-            size_t need = n + 1;
-            if (ensure_obuf(c, need+1) < 0) return -1;
-            memcpy(c->obuf, c->start, n);
-            c->obuf[n] = c->print0 ? '\0' : '\n';
-            // but still traverse it; mark started and fall through to push
-            c->started = 1;
-            // push for traversal
-            if (push(c, c->start, 0, NULL) < 0) { c->done=1; return -1; }
-            return 1; // produced the dir path first
-        } else {
-            // doesn't match type/name, but still traverse it
-            if (push(c, c->start, 0, NULL) < 0) { c->done=1; return -1; }
-            c->started = 1;
-            return 0; // not produced yet
-        }
-    } else {
-        // start is a file (or symlink, device — we’ll treat as file unless user set -type)
-        if (match_filters(c, c->start, &st, 0)) {
-            size_t n = strlen(c->start);
-            size_t need = n + 1;
-            if (ensure_obuf(c, need+1) < 0) return -1;
-            memcpy(c->obuf, c->start, n);
-            c->obuf[n] = c->print0 ? '\0' : '\n';
-            c->started = 1; c->done = 1;
-            return 1;
-        }
-        c->started = 1; c->done = 1;
-        return 0;
+    if (lstat(c->start, &st) != 0) {
+        fp_errf("fp_find", -1, "", "%s: %s\n", c->start, strerror(errno));
+        return -1;
     }
+    const char *slash = strrchr(c->start, '/');
+    if (find_match(c, slash && slash[1] ? slash + 1 : c->start, S_ISREG(st.st_mode), S_ISDIR(st.st_mode))) {
+        size_t n = strlen(c->start);
+        find_chunk *ch = malloc(sizeof *ch + n + 1);
+        if (!ch) return -1;
+        memcpy(ch->data, c->start, n);
+        ch->data[n] = c->print0 ? '\0' : '\n';
+        ch->len = ch->cap = n + 1;
+        ch->next = NULL;
+        c->ohead = c->otail = ch;
+        c->oqlen = 1;
+    }
+    if (!S_ISDIR(st.st_mode) || c->maxdepth == 0) return 0;
+
+    find_dir *root = find_dir_new(NULL, c->start, strlen(c->start), 0);
+    c->w = calloc((size_t)c->nthreads, sizeof *c->w);
+    c->tids = calloc((size_t)c->nthreads, sizeof *c->tids);
+    if (!root || !c->w || !c->tids) { free(root); return -1; }
+    for (int k = 0; k < c->nthreads; k++) {
+        c->w[k].c = c;
+        c->w[k].id = k;
+        pthread_mutex_init(&c->w[k].dq.mu, NULL);
+        if (!(c->w[k].dents = malloc(FP_FIND_DENTS))) { free(root); return -1; }
+    }
+    if (find_push(&c->w[0].dq, root) < 0) { free(root); return -1; }
+    c->pending = c->queued = 1;
+    c->live = c->nthreads;
+    for (; c->nstarted < c->nthreads; c->nstarted++)
+        if (pthread_create(&c->tids[c->nstarted], NULL, find_worker_main, &c->w[c->nstarted]) != 0) break;
+    if (c->nstarted == 0) return -1;
+    pthread_mutex_lock(&c->mu);
+    c->live -= c->nthreads - c->nstarted;   // those not started: their deques stay empty
+    pthread_mutex_unlock(&c->mu);
+    return 0;
 }
 
-static int find_produce(void *vcfg, char **linep, size_t *lenp) {
+// Paths out of the current chunk, the batch's records pointing into it: as
+// many as the batch holds (a source limit lowers its cap), or the rest of
+// the chunk as one block.
+static int find_produce_batch(void *vcfg, FpBatch *b) {
     find_cfg *c = vcfg;
-    if (c->done) return 0;
-
-    // First call: handle start node
-    if (!c->started) {
-        int r = find_init_node(c);
-        if (r != 0) {
-            if (r < 0) return -1;
-            if (r > 0) { *linep = c->obuf; *lenp = (c->print0 ? strlen(c->obuf) : (strlen(c->obuf))); // len recomputed below anyway
-                size_t L = strlen(c->obuf) + 1; // includes suffix
-                *lenp = L;
-                return 1;
-            }
+    if (!c->started && find_start(c) < 0) return -1;
+    if (!c->cur) {
+        pthread_mutex_lock(&c->mu);
+        while (!c->ohead && c->live > 0) pthread_cond_wait(&c->data_cv, &c->mu);
+        find_chunk *ch = c->ohead;
+        if (ch) {
+            if (!(c->ohead = ch->next)) c->otail = NULL;
+            c->oqlen--;
+            pthread_cond_signal(&c->space_cv);
         }
+        pthread_mutex_unlock(&c->mu);
+        if (!ch) return 0;
+        ch->refs = 1;
+        c->cur = ch;
+        c->coff = 0;
     }
-
-    // DFS using our own stack
-    while (c->top > 0) {
-        Frame *fr = &c->stk[c->top - 1];
-
-        // Open directory if not opened yet
-        if (!fr->dir) {
-            fr->dir = opendir(fr->path);
-            if (!fr->dir) {
-                pop(c); // unreadable; just skip
-                continue;
-            }
-        }
-
-        struct dirent *de = readdir(fr->dir);
-        if (!de) {
-            // directory exhausted
-            pop(c);
-            continue;
-        }
-        // skip . and ..
-        if (de->d_name[0]=='.' && (de->d_name[1]=='\0' || (de->d_name[1]=='.' && de->d_name[2]=='\0')))
-            continue;
-
-        // Build child path
-        size_t pn = strlen(fr->path);
-        size_t dn = strlen(de->d_name);
-        int need_slash = (pn && fr->path[pn-1] != '/');
-        size_t clen = pn + (need_slash?1:0) + dn;
-        char *child = malloc(clen + 1);
-        if (!child) { c->done=1; return -1; }
-        memcpy(child, fr->path, pn);
-        if (need_slash) child[pn] = '/', pn++;
-        memcpy(child + pn, de->d_name, dn);
-        child[clen] = '\0';
-
-        // lstat it
-        struct stat st;
-        if (lstat(child, &st) != 0) { free(child); continue; }
-
-        int is_dir = S_ISDIR(st.st_mode);
-        int depth_next = fr->depth + 1;
-
-        // Emit child if it matches filters (find is pre-order)
-        int emit_ok = match_filters(c, child, &st, is_dir);
-        if (emit_ok) {
-            size_t need = clen + 1; // suffix
-            if (ensure_obuf(c, need+1) < 0) { free(child); c->done=1; return -1; }
-            memcpy(c->obuf, child, clen);
-            c->obuf[clen] = c->print0 ? '\0' : '\n';
-            // If directory and we still may descend, push it AFTER emitting
-            int can_descend = is_dir && (c->maxdepth < 0 || depth_next <= c->maxdepth);
-            if (can_descend) { if (push(c, child, depth_next, NULL) < 0) { free(child); c->done=1; return -1; } }
-            free(child);
-            *linep = c->obuf;
-            *lenp = c->print0 ? (clen + 1) : (clen + 1); // include suffix
-            return 1;
-        }
-
-        // No emit; still descend if directory and within depth
-        if (is_dir && (c->maxdepth < 0 || depth_next <= c->maxdepth)) {
-            if (push(c, child, depth_next, NULL) < 0) { free(child); c->done=1; return -1; }
-        }
-        free(child);
+    find_chunk *ch = c->cur;
+    char *p = ch->data + c->coff, *end = ch->data + ch->len;
+    if (b->blocks && !c->print0) {
+        b->blk = p;
+        b->blen = (size_t)(end - p);
+        p = end;
+    } else {
+        size_t used = 0;
+        b->n += fp_split_lines(p, (size_t)(end - p), c->print0 ? '\0' : '\n',
+                               b->recs + b->n, b->cap - b->n, &used);
+        p += used;
+        for (size_t k = 0; k < b->n; k++) b->sel[k] = (uint32_t)k;
+        b->nsel = b->n;
     }
+    __atomic_add_fetch(&ch->refs, 1, __ATOMIC_RELAXED);
+    b->release = find_chunk_unref;
+    b->release_ctx = ch;
+    c->coff = (size_t)(p - ch->data);
+    if (p == end) {
+        c->cur = NULL;
+        find_chunk_unref(ch);
+    }
+    return 1;
+}
 
-    c->done = 1;
-    return 0;
+static int find_produce(void *vcfg, char **linep, size_t *lenp) {
+    find_cfg *c = vcfg;
+    if (!c->line.recs && fp_batch_init(&c->line, FP_BATCH_MAX) < 0) return -1;
+    if (c->next >= c->line.n) {
+        fp_batch_reset(&c->line);
+        c->next = 0;
+        int r;
+        while ((r = find_produce_batch(c, &c->line)) > 0 && c->line.n == 0) {}
+        if (r <= 0) return r;
+    }
+    *linep = c->line.recs[c->next].ptr;
+    *lenp  = c->line.recs[c->next].len;
+    c->next++;
+    return 1;
 }
 
+// Stop the workers (the engine may be done early, as with take N) and free
+// what is still queued.
 static void find_destroy(void *vcfg) {
     find_cfg *c = vcfg;
     if (!c) return;
-    for (; c->top > 0; ) pop(c);
+    __atomic_store_n(&c->stop, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&c->mu);
+    pthread_cond_broadcast(&c->work_cv);
+    pthread_cond_broadcast(&c->space_cv);
+    pthread_mutex_unlock(&c->mu);
+    for (int k = 0; k < c->nstarted; k++) pthread_join(c->tids[k], NULL);
+    fp_batch_free(&c->line);
+    if (c->cur) find_chunk_unref(c->cur);
+    while (c->ohead) {
+        find_chunk *n = c->ohead->next;
+        free(c->ohead);
+        c->ohead = n;
+    }
+    for (int k = 0; c->w && k < c->nthreads; k++) {
+        find_worker *w = &c->w[k];
+        for (find_dir *d; (d = find_pop(&w->dq, 0)); ) find_dir_drop(d);
+        for (size_t i = 0; i < w->nkids; i++) find_dir_drop(w->kids[i]);
+        pthread_mutex_destroy(&w->dq.mu);
+        free(w->dq.q);
+        free(w->kids);
+        free(w->dents);
+        free(w->out);
+    }
+    pthread_mutex_destroy(&c->mu);
+    pthread_cond_destroy(&c->work_cv);
+    pthread_cond_destroy(&c->data_cv);
+    pthread_cond_destroy(&c->space_cv);
+    free(c->w);
+    free(c->tids);
     free(c->start);
     free(c->namepat);
-    free(c->stk);
-    free(c->obuf);
     free(c);
 }
 
+static void find_explain(void *vcfg, FILE *out) {
+    find_cfg *c = vcfg;
+    fprintf(out, "%s", c->start);
+    if (c->type) fprintf(out, " -type %c", c->type);
+    if (c->namepat) fprintf(out, " -name '%s'", c->namepat);
+    if (c->maxdepth >= 0) fprintf(out, " -maxdepth %d", c->maxdepth);
+    if (c->print0) fputs(" -print0", out);
+    fprintf(out, " [%d threads, getdents64]", c->nthreads);
+}
+
 static const OpSpec SPEC = {
     .name="fp_find", .kind=OP_SRC,
     .parse=find_parse, .init=NULL,
     .consume=NULL, .produce=find_produce, .accept=NULL,
-    .flush=NULL, .destroy=find_destroy, .should_stop=NULL
+    .flush=NULL, .destroy=find_destroy, .should_stop=NULL,
+    .produce_batch=find_produce_batch, .explain=find_explain
 };
 const OpSpec *op_find_spec(){ return &SPEC; }
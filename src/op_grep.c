@@ -1,12 +1,141 @@
 // src/op_grep.c
 #include "ops.h"
+#include "speccache.h"
+#include "lineio.h"
 #include "util.h"
+#include <errno.h>
+#include <locale.h>
+#include <stdio.h>
 #include <string.h>
 
+// One pattern set with its own -v (the step's own, or a fused one)
 typedef struct {
-    fp_grepspec g;
+    fp_grepspec *g;
+    fp_specent  *ent;
+    int          invert;
+} grep_term;
+
+typedef struct {
+    // Compiled patterns, shared through the spec cache with earlier steps
+    // that have the same patterns and flags; -v and -m live here, not in
+    // the shared spec. A regex matcher another step holds (the DFA fills
+    // its state cache while matching, and the other step may run on a
+    // worker thread) is not shared: this step compiles a private one.
+    fp_grepspec *g;
+    fp_specent  *ent;
+    int          invert;
+    long         max_matches;
+    long         matched;
+
+    // --field N, -d CHAR: match field N only (empty if the line is short),
+    // read from the batch's field view so later ops splitting on the same
+    // delimiter reuse it.
+    size_t       field;
+    char         delim;
+
+    // Patterns as given (-e, -f lines, or the positional one), split at
+    // newlines like grep does. Kept so fx -j can compile worker copies:
+    // a regex matcher is not shared (the DFA fills its state cache while
+    // matching, regexec serializes on a regex_t), so workers 1..n-1 get their own.
+    char       **pats;
+    size_t       npats;
+    int          ext, fixed, icase;
+    fp_grepspec *wg;
+    int          nwg;
+
+    // Plan optimizer: later grep -F steps fused into this one; a record
+    // passes only if it also passes every term here (each keeps its -v).
+    grep_term   *and;
+    int          nand;
 } grep_cfg;
 
+static void grep_spec_free(void *g) {
+    fp_grepspec_free(g);
+    free(g);
+}
+
+// The compiled form of c's patterns: from the spec cache if an earlier call
+// compiled the same ones (flags and locale included, as regcomp and the DFA
+// depend on LC_CTYPE), else compiled now and cached. A cached regex matcher
+// still held by another step of the plan is left to it and compiled again,
+// outside the cache.
+static int grep_compile_cached(grep_cfg *c) {
+    const char *loc = setlocale(LC_CTYPE, NULL);
+    size_t klen = 8 + strlen(loc ? loc : "");
+    for (size_t k = 0; k < c->npats; k++) klen += strlen(c->pats[k]) + 1;
+    char *key = malloc(klen + 1);
+    if (!key) return -1;
+    size_t n = (size_t)snprintf(key, klen + 1, "%c%c%c %s: ", c->ext ? 'E' : '-',
+                                c->fixed ? 'F' : '-', c->icase ? 'i' : '-', loc ? loc : "");
+    for (size_t k = 0; k < c->npats; k++) {   // '\n' ends each pattern, as in -f
+        size_t l = strlen(c->pats[k]);
+        memcpy(key + n, c->pats[k], l);
+        key[n + l] = '\n';
+        n += l + 1;
+    }
+    c->ent = fp_speccache_get("grep", key, n);
+    int taken = 0;
+    if (c->ent && fp_specent_refs(c->ent) > 1 && ((fp_grepspec *)fp_specent_obj(c->ent))->use_regex) {
+        fp_speccache_release(c->ent);
+        c->ent = NULL;
+        taken = 1;
+    }
+    if (!c->ent) {
+        fp_grepspec *g = malloc(sizeof *g);
+        if (g && fp_grepspec_compile_multi(g, c->ext, c->fixed, c->icase,
+                                           (const char *const *)c->pats, c->npats) != 0) {
+            free(g);
+            g = NULL;
+        }
+        if (g) c->ent = taken ? fp_speccache_private("grep", key, n, g, grep_spec_free)
+                              : fp_speccache_put("grep", key, n, g, grep_spec_free);
+    }
+    free(key);
+    if (!c->ent) return -1;
+    c->g = fp_specent_obj(c->ent);
+    return 0;
+}
+
+static void grep_free_pats(grep_cfg *c) {
+    for (size_t k = 0; k < c->npats; k++) free(c->pats[k]);
+    free(c->pats);
+    c->pats = NULL; c->npats = 0;
+}
+
+// Append s[0..n) as one pattern per newline-separated piece.
+static int grep_add_pats(grep_cfg *c, const char *s, size_t n) {
+    for (;;) {
+        const char *nl = memchr(s, '\n', n);
+        size_t len = nl ? (size_t)(nl - s) : n;
+        char **np = realloc(c->pats, (c->npats + 1) * sizeof *np);
+        if (!np) return -1;
+        c->pats = np;
+        if (!(c->pats[c->npats] = malloc(len + 1))) return -1;
+        memcpy(c->pats[c->npats], s, len);
+        c->pats[c->npats++][len] = '\0';
+        if (!nl) return 0;
+        s = nl + 1; n -= len + 1;
+    }
+}
+
+// -f FILE: one pattern per line; an empty file gives no patterns (no match).
+static int grep_add_pat_file(grep_cfg *c, const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) { fp_errf("fp_grep", -1, "", "%s: %s\n", path, strerror(errno)); return -1; }
+    char *line = NULL; size_t cap = 0; ssize_t n;
+    int rc = 0;
+    while (rc == 0 && (n = getline(&line, &cap, f)) > 0) {
+        if (line[n-1] == '\n') n--;
+        rc = grep_add_pats(c, line, (size_t)n);
+    }
+    if (ferror(f)) rc = -1;
+    free(line);
+    if (f != stdin) fclose(f);
+    return rc;
+}
+
+// grep [-E|-F] [-i] [-v] [-m N] [--field N [-d CHAR]] (PATTERN | -e PAT... | -f FILE...)
+// Options may also follow the pattern; parsing stops at the next op token.
 static int grep_parse(int argc, char **argv, int i, void **cfg_out) {
     grep_cfg *c = calloc(1, sizeof *c);
     if (!c) return -1;
@@ -14,53 +143,237 @@ static int grep_parse(int argc, char **argv, int i, void **cfg_out) {
 
     if (j < argc && (strcmp(argv[j], "grep") == 0 || strcmp(argv[j], "fp_grep") == 0)) j++;
 
-    int ext=0, fixed=0, icase=0, invert=0; long maxm=0;
-    while (j < argc && argv[j][0] == '-') {
-        if (lookup_op(argv[j]) != NULL) break;
-        if (strcmp(argv[j], "-E") == 0) { ext=1; j++; continue; }
-        if (strcmp(argv[j], "-F") == 0) { fixed=1; j++; continue; }
-        if (strcmp(argv[j], "-i") == 0) { icase=1; j++; continue; }
-        if (strcmp(argv[j], "-v") == 0) { invert=1; j++; continue; }
-        if (strcmp(argv[j], "-m") == 0) {
-            if (++j >= argc) { free(c); return -1; }
-            if (fp_parse_long(argv[j], &maxm) < 0) { free(c); return -1; }
+    int ext=0, fixed=0, icase=0, invert=0, have_e=0, have_pos=0; long maxm=0, field=0;
+    c->delim = '\t';
+    while (j < argc && lookup_op(argv[j]) == NULL) {
+        const char *a = argv[j];
+        if (strcmp(a, "-E") == 0) { ext=1; j++; continue; }
+        if (strcmp(a, "-F") == 0) { fixed=1; j++; continue; }
+        if (strcmp(a, "-i") == 0) { icase=1; j++; continue; }
+        if (strcmp(a, "-v") == 0) { invert=1; j++; continue; }
+        if (strncmp(a, "--field=", 8) == 0 || strcmp(a, "--field") == 0) {
+            const char *v = a[7] ? a + 8 : (++j < argc ? argv[j] : NULL);
+            if (!v || fp_parse_long(v, &field) < 0 || field < 1) {
+                fp_errf("fp_grep", -1, "", "invalid field number: %s\n", v ? v : "");
+                goto bad;
+            }
             j++; continue;
         }
-        break;
+        if (strcmp(a, "-d") == 0 || (a[0] == '-' && a[1] == 'd' && a[2] && !a[3])) {
+            const char *v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL);
+            if (!v) goto bad;
+            c->delim = v[0];
+            j++; continue;
+        }
+        if (strcmp(a, "-m") == 0 || strcmp(a, "-e") == 0 || strcmp(a, "-f") == 0) {
+            if (++j >= argc) goto bad;
+            if (a[1] == 'm' && fp_parse_long(argv[j], &maxm) < 0) goto bad;
+            if (a[1] == 'e' && grep_add_pats(c, argv[j], strlen(argv[j])) < 0) goto bad;
+            if (a[1] == 'f' && grep_add_pat_file(c, argv[j]) < 0) goto bad;
+            if (a[1] != 'm') have_e = 1;
+            j++; continue;
+        }
+        // first other token is the pattern (even if it starts with '-');
+        // after that, or with -e/-f, anything unknown ends this op
+        if (have_pos || have_e) break;
+        if (grep_add_pats(c, a, strlen(a)) < 0) goto bad;
+        have_pos = 1;
+        j++;
     }
+    if (!have_pos && !have_e) goto bad;
 
-    if (j >= argc || lookup_op(argv[j]) != NULL) { free(c); return -1; }
-    const char *pattern = argv[j++];
-
-    if (fp_grepspec_compile(&c->g, ext, fixed, icase, pattern) < 0) { free(c); return -1; }
-    c->g.invert = invert;
-    c->g.max_matches = maxm;
+    c->ext = ext; c->fixed = fixed; c->icase = icase;
+    if (grep_compile_cached(c) < 0) goto bad;
+    c->invert = invert;
+    c->max_matches = maxm;
+    c->field = (size_t)field;
     *cfg_out = c;
     return j;
+bad:
+    grep_free_pats(c);
+    free(c);
+    return -1;
+}
+
+static int grep_and_terms(grep_cfg *c, const char *s, size_t len) {
+    for (int k = 0; k < c->nand; k++)
+        if (fp_grepspec_match_line(c->and[k].g, s, len) == c->and[k].invert) return 0;
+    return 1;
+}
+
+// Field c->field of [s, s+n) for a line outside a batch.
+static void grep_line_field(const grep_cfg *c, const char **s, size_t *n) {
+    const char *p = *s, *end = p + *n;
+    if (*n && end[-1] == '\n') end--;
+    if (c->field > 1) {
+        size_t left = c->field - 1;
+        const char *d = fp_memchr_nth(p, (size_t)(end - p), c->delim, &left);
+        if (!d) { *n = 0; return; }
+        p = d + 1;
+    }
+    const char *e = memchr(p, c->delim, (size_t)(end - p));
+    *s = p;
+    *n = (size_t)((e ? e : end) - p);
 }
 
 static int grep_consume(void *vcfg, char **linep, size_t *lenp) {
     grep_cfg *c = vcfg;
-    int m = fp_grepspec_match_line(&c->g, *linep, *lenp);
-    if (c->g.invert) m = !m;
+    const char *s = *linep;
+    size_t len = *lenp;
+    if (c->field) grep_line_field(c, &s, &len);
+    int m = fp_grepspec_match_line(c->g, s, len);
+    if (c->invert) m = !m;
+    if (m && c->nand) m = grep_and_terms(c, s, len);
     if (m) {
-        if (c->g.max_matches > 0 && ++c->g.matched >= c->g.max_matches) {
+        if (c->max_matches > 0 && ++c->matched >= c->max_matches) {
             // emit this line, then engine will see should_stop() and end
         }
         return ENG_OK;
     }
     return ENG_DROP;
 }
+// Batch kernel: keeps matching records; with -m N, stops selecting once the
+// N-th match is kept so the engine ends the stream after this batch.
+static int grep_consume_batch(void *vcfg, FpBatch *b) {
+    grep_cfg *c = vcfg;
+    fp_grepspec *mg = (b->worker > 0 && b->worker <= c->nwg) ? &c->wg[b->worker-1] : c->g;
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        const char *s = r->ptr;
+        size_t len = r->len;
+        if (c->field) {
+            int fr = fp_batch_field(b, b->sel[k], c->delim, c->field, &s, &len);
+            if (fr < 0) return -1;
+            if (fr == 0) len = 0;
+        }
+        int m = fp_grepspec_match_line(mg, s, len);
+        if (m == c->invert) continue;
+        if (c->nand && !grep_and_terms(c, s, len)) continue;
+        b->sel[w++] = b->sel[k];
+        if (c->max_matches > 0 && ++c->matched >= c->max_matches) break;
+    }
+    b->nsel = w;
+    return 0;
+}
+// Block kernel, when grep is the first filter after a block source: the
+// matcher runs over the whole block and only the lines around its hits
+// become records; text between hits costs no per-line work. -v keeps
+// nearly every line, so it splits the block and filters per record; so
+// does --field, as a hit elsewhere in the line says nothing.
+static int grep_consume_block(void *vcfg, FpBatch *b) {
+    grep_cfg *c = vcfg;
+    if (c->invert || c->field) {
+        if (fp_batch_split(b) < 0) return -1;
+        return grep_consume_batch(c, b);
+    }
+    fp_grepspec *mg = (b->worker > 0 && b->worker <= c->nwg) ? &c->wg[b->worker-1] : c->g;
+    char *p = b->blk, *end = p + b->blen;
+    b->blk = NULL; b->blen = 0;
+    while (p < end) {
+        char *hit = (char *)fp_grepspec_find(mg, p, (size_t)(end - p));
+        if (!hit) break;
+        char *ls = memrchr(p, '\n', (size_t)(hit - p));
+        char *le = memchr(hit, '\n', (size_t)(end - hit));
+        ls = ls ? ls + 1 : p;
+        p = le = le ? le + 1 : end;
+        if (c->nand && !grep_and_terms(c, ls, (size_t)(le - ls))) continue;
+        if (fp_batch_add(b, ls, (size_t)(le - ls)) < 0) return -1;
+        if (c->max_matches > 0 && ++c->matched >= c->max_matches) break;
+    }
+    for (size_t k = 0; k < b->n; k++) b->sel[k] = (uint32_t)k;
+    b->nsel = b->n;
+    return 0;
+}
 static int grep_should_stop(void *vcfg) {
     grep_cfg *c = vcfg;
-    return (c->g.max_matches > 0 && c->g.matched >= c->g.max_matches);
+    return (c->max_matches > 0 && c->matched >= c->max_matches);
+}
+// Stateless unless -m N is counting matches.
+static int grep_parallel(void *vcfg, int nworkers) {
+    grep_cfg *c = vcfg;
+    if (c->max_matches > 0) return 0;
+    if (!c->g->use_regex || nworkers <= 1) return 1;
+    c->wg = calloc((size_t)nworkers - 1, sizeof *c->wg);
+    if (!c->wg) return 0;
+    for (; c->nwg < nworkers - 1; c->nwg++) {
+        if (fp_grepspec_compile_multi(&c->wg[c->nwg], c->ext, c->fixed, c->icase,
+                                      (const char *const *)c->pats, c->npats) != 0) return 0;
+    }
+    return 1;
+}
+/* ---- optimizer hooks ---- */
+// Verdict ignores ASCII case: -i with literal patterns, or regexes with no
+// bracket expressions or escapes to second-guess.
+static unsigned grep_props(void *vcfg) {
+    grep_cfg *c = vcfg;
+    if (!c->icase) return 0;
+    if (c->field && ((c->delim|32) >= 'a' && (c->delim|32) <= 'z')) return 0;   // tr could move the fields
+    if (!c->g->use_regex) return FP_PROP_CASE_BLIND;
+    for (size_t k = 0; k < c->npats; k++)
+        if (strpbrk(c->pats[k], "[\\")) return 0;
+    return FP_PROP_CASE_BLIND;
+}
+
+// grep -F a then grep -F b: one step checking both. Only literal matchers
+// fuse (they are shared by -j workers as is). -m counts matches of the
+// whole step, so it stays a separate filter. --field steps fuse only
+// with ones testing the same field.
+static int grep_fuse(void *vcfg, void *vnext) {
+    grep_cfg *c = vcfg, *n = vnext;
+    if (c->g->use_regex || n->g->use_regex || c->max_matches > 0 || n->max_matches > 0) return 0;
+    if (c->field != n->field || (c->field && c->delim != n->delim)) return 0;
+    grep_term *a = realloc(c->and, sizeof *a * (size_t)(c->nand + 1 + n->nand));
+    if (!a) return 0;
+    c->and = a;
+    c->and[c->nand++] = (grep_term){ n->g, n->ent, n->invert };
+    for (int k = 0; k < n->nand; k++) c->and[c->nand++] = n->and[k];
+    n->ent = NULL;   // references moved; destroy releases nothing
+    n->nand = 0;
+    return 1;
+}
+
+static void grep_explain1(const fp_grepspec *g, int invert, const char *pat, FILE *out) {
+    fprintf(out, "%s%s", invert ? "-v " : "", g->ignore_case ? "-i " : "");
+    if (g->npats == 1) {
+        fprintf(out, "'%s'", pat ? pat : g->fixed ? g->fixed : "");
+        if (g->use_regex) fprintf(out, " [%s]", g->rewrap.dfa ? fp_rx_describe(g->rewrap.dfa) : "regcomp");
+    }
+    else fprintf(out, "{%zu patterns, %s}", g->npats,
+                 g->match_all ? "match-all" : g->lits ? fp_multilit_kind(g->lits) : "regex");
+}
+
+static void grep_explain(void *vcfg, FILE *out) {
+    grep_cfg *c = vcfg;
+    if (c->ext) fputs("-E ", out);
+    if (c->fixed) fputs("-F ", out);
+    grep_explain1(c->g, c->invert, c->npats == 1 ? c->pats[0] : NULL, out);
+    for (int k = 0; k < c->nand; k++) {
+        fputs(" && ", out);
+        grep_explain1(c->and[k].g, c->and[k].invert, NULL, out);
+    }
+    if (c->max_matches > 0) fprintf(out, " -m %ld", c->max_matches);
+    if (c->field) fprintf(out, " --field %zu -d '%c'", c->field, c->delim);
+}
+
+static void grep_destroy(void *vcfg) {
+    grep_cfg *c = vcfg;
+    for (int k = 0; k < c->nand; k++) fp_speccache_release(c->and[k].ent);
+    free(c->and);
+    for (int k = 0; k < c->nwg; k++) fp_grepspec_free(&c->wg[k]);
+    free(c->wg);
+    fp_speccache_release(c->ent);
+    grep_free_pats(c);
+    free(c);
 }
-static void grep_destroy(void *vcfg){ fp_grepspec_free(&((grep_cfg*)vcfg)->g); free(vcfg); }
 
 static const OpSpec SPEC = {
     .name="fp_grep", .kind=OP_FILTER,
     .parse=grep_parse, .init=NULL,
     .consume=grep_consume, .produce=NULL, .accept=NULL,
-    .flush=NULL, .destroy=grep_destroy, .should_stop=grep_should_stop
+    .flush=NULL, .destroy=grep_destroy, .should_stop=grep_should_stop,
+    .consume_batch=grep_consume_batch, .parallel=grep_parallel,
+    .props=grep_props, .fuse=grep_fuse, .explain=grep_explain,
+    .consume_block=grep_consume_block
 };
 const OpSpec *op_grep_spec(){ return &SPEC; }
@@ -0,0 +1,269 @@
+// src/op_join.c
+#include "ops.h"
+#include "htab.h"
+#include "lineio.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { JOIN_AUGMENT, JOIN_SEMI, JOIN_ANTI };
+
+// A line of FILE and its key, as offsets into the file's bytes: nothing is
+// copied out of it.
+typedef struct {
+    uint64_t line, key;
+    uint32_t len, klen;   // len without the '\n'
+} join_ent;
+
+typedef struct {
+    const char *path;
+    char        delim;      // -d CHAR
+    size_t      field;      // -f N: key field of the stream
+    size_t      field2;     // -2 M: key field of FILE
+    int         mode;       // JOIN_*: --semi, -v
+
+    // FILE: mapped read-only when it is a regular file, else read in whole
+    char       *data;
+    size_t      dlen;
+    int         mapped;
+    // The table: slots and entries carved out of one anonymous mapping
+    // sized from FILE's line count, so it never grows or moves.
+    void       *region;
+    size_t      rlen;
+    uint64_t   *slots;      // 0 empty, else hash >> 32 << 32 | (index + 1)
+    size_t      mask;
+    join_ent   *ents;
+    size_t      n;
+} join_cfg;
+
+// Field f of [s, s+n), in place. Returns 0 if the line has fewer fields:
+// such lines never match.
+static inline int join_field(const char *s, size_t n, char delim, size_t f,
+                             const char **k, size_t *kn) {
+    const char *p = s, *end = s + n;
+    if (f > 1) {
+        size_t left = f - 1;
+        const char *d = fp_memchr_nth(s, n, delim, &left);
+        if (!d) return 0;
+        p = d + 1;
+    }
+    const char *e = memchr(p, delim, (size_t)(end - p));
+    *k = p;
+    *kn = (size_t)((e ? e : end) - p);
+    return 1;
+}
+
+static inline uint64_t join_tag(uint64_t h) { return h >> 32 << 32; }
+
+static const join_ent *join_find(const join_cfg *c, const char *k, size_t n) {
+    if (!c->slots) return NULL;
+    uint64_t h = fp_hash(k, n, 0), tag = join_tag(h);
+    for (size_t j = (size_t)h & c->mask; c->slots[j]; j = (j + 1) & c->mask) {
+        uint64_t s = c->slots[j];
+        if (join_tag(s) != tag) continue;
+        const join_ent *e = &c->ents[(uint32_t)s - 1];
+        if (e->klen == n && memcmp(c->data + e->key, k, n) == 0) return e;
+    }
+    return NULL;
+}
+
+// join [-d CHAR] [-f N] [-2 M] [--semi | -v] FILE
+static int join_parse(int argc, char **argv, int i, void **cfg_out) {
+    join_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->delim = '\t';
+    c->field = c->field2 = 1;
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "join") == 0 || strcmp(argv[j], "fp_join") == 0)) j++;
+
+    for (; j < argc && argv[j][0] == '-' && argv[j][1]; j++) {
+        const char *a = argv[j], *v;
+        long n;
+        if (strcmp(a, "--semi") == 0) { c->mode = JOIN_SEMI; continue; }
+        if (strcmp(a, "-v") == 0) { c->mode = JOIN_ANTI; continue; }
+        if (a[1] != 'd' && a[1] != 'f' && a[1] != '2') goto usage;
+        if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto usage;
+        if (a[1] == 'd') { c->delim = v[0]; continue; }
+        if (fp_parse_long(v, &n) < 0 || n < 1) {
+            fp_errf("fp_join", -1, "", "invalid field number: %s\n", v);
+            goto bad;
+        }
+        if (a[1] == 'f') c->field = (size_t)n;
+        else c->field2 = (size_t)n;
+    }
+    if (j >= argc || lookup_op(argv[j]) != NULL) goto usage;
+    c->path = argv[j++];
+
+    *cfg_out = c;
+    return j;
+usage:
+    fp_errf("fp_join", -1, "", "usage: join [-d CHAR] [-f N] [-2 M] [--semi | -v] FILE\n");
+bad:
+    free(c);
+    return -1;
+}
+
+// FILE's bytes: mapped if it is a regular file, else (a pipe, <(...)) read.
+static int join_load_file(join_cfg *c) {
+    int fd = strcmp(c->path, "-") == 0 ? dup(STDIN_FILENO) : open(c->path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    int rc = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (uintmax_t)st.st_size < SIZE_MAX) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            c->data = p;
+            c->dlen = (size_t)st.st_size;
+            c->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+    size_t cap = 0;
+    for (;;) {
+        if (c->dlen == cap) {
+            char *d = realloc(c->data, cap ? cap * 2 : 1 << 16);
+            if (!d) { rc = -1; break; }
+            c->data = d;
+            cap = cap ? cap * 2 : 1 << 16;
+        }
+        ssize_t r = read(fd, c->data + c->dlen, cap - c->dlen);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) { rc = (int)r; break; }
+        c->dlen += (size_t)r;
+    }
+    close(fd);
+    return rc;
+}
+
+// Load FILE and index the first line with each key (empty lines skipped).
+static int join_init(void *vcfg) {
+    join_cfg *c = vcfg;
+    if (join_load_file(c) < 0) {
+        fp_errf("fp_join", -1, "", "%s: %s\n", c->path, strerror(errno));
+        return -1;
+    }
+    const char *s = c->data, *end = s + c->dlen;
+    size_t lines = 0;
+    for (const char *p = s; p < end; lines++) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    if (!lines) return 0;
+    if (lines >= UINT32_MAX) { fp_errf("fp_join", -1, "", "%s: too many lines\n", c->path); return -1; }
+
+    size_t nslots = 1024;
+    while (nslots / 4 * 3 < lines) nslots *= 2;     // load under 3/4
+    c->rlen = nslots * sizeof *c->slots + lines * sizeof *c->ents;
+    c->region = mmap(NULL, c->rlen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (c->region == MAP_FAILED) {
+        c->region = NULL;
+        fp_errf("fp_join", -1, "", "%s: out of memory for %zu lines\n", c->path, lines);
+        return -1;
+    }
+    c->slots = c->region;                            // zero-filled
+    c->ents = (join_ent *)(c->slots + nslots);
+    c->mask = nslots - 1;
+
+    for (const char *p = s; p < end; ) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t len = (size_t)((nl ? nl : end) - p);
+        const char *k; size_t kn;
+        if (len >= UINT32_MAX) { fp_errf("fp_join", -1, "", "%s: line too long\n", c->path); return -1; }
+        // an empty line has no key (not an empty one), like a short line
+        if (!len || !join_field(p, len, c->delim, c->field2, &k, &kn)) { p = nl ? nl + 1 : end; continue; }
+
+        uint64_t h = fp_hash(k, kn, 0), tag = join_tag(h);
+        size_t j = (size_t)h & c->mask;
+        for (; c->slots[j]; j = (j + 1) & c->mask) {
+            uint64_t sl = c->slots[j];
+            if (join_tag(sl) != tag) continue;
+            const join_ent *e = &c->ents[(uint32_t)sl - 1];
+            if (e->klen == kn && memcmp(s + e->key, k, kn) == 0) break;
+        }
+        if (!c->slots[j]) {                          // a later duplicate is ignored
+            c->ents[c->n] = (join_ent){ (uint64_t)(p - s), (uint64_t)(k - s), (uint32_t)len, (uint32_t)kn };
+            c->slots[j] = tag | (++c->n);
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return 0;
+}
+
+// Probe each record's key field in place. --semi keeps the records with a
+// match, -v those without; by default a match is kept with the rest of
+// its FILE line (the key field taken out) appended, written to the batch
+// arena.
+static int join_consume_batch(void *vcfg, FpBatch *b) {
+    join_cfg *c = vcfg;
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        int had_nl = (n && r->ptr[n-1] == '\n'); if (had_nl) n--;
+        const char *key; size_t kn;
+        const join_ent *e = join_field(r->ptr, n, c->delim, c->field, &key, &kn) ? join_find(c, key, kn) : NULL;
+
+        if (c->mode != JOIN_AUGMENT) {
+            if (!e == (c->mode == JOIN_ANTI)) b->sel[w++] = b->sel[k];
+            continue;
+        }
+        if (!e) continue;
+        const char *line = c->data + e->line;
+        size_t before = (size_t)(e->key - e->line), after = e->len - before - e->klen;
+        char *out = fp_arena_reserve(&b->arena, n + e->len + 2);
+        if (!out) return -1;
+        size_t o = n;
+        memcpy(out, r->ptr, n);
+        if (before) {                       // fields ahead of the key, and their delimiter
+            out[o++] = c->delim;
+            memcpy(out + o, line, before - 1); o += before - 1;
+        }
+        if (after) {                        // the delimiter after the key, and the rest
+            memcpy(out + o, line + before + e->klen, after); o += after;
+        }
+        if (had_nl) out[o++] = '\n';
+        fp_arena_commit(&b->arena, o);
+        r->ptr = out;
+        r->len = o;
+        b->sel[w++] = b->sel[k];
+    }
+    b->nsel = w;
+    return 0;
+}
+
+// The table is read-only once loaded: workers share it.
+static int join_parallel(void *vcfg, int nworkers) { (void)vcfg; (void)nworkers; return 1; }
+
+static void join_destroy(void *vcfg) {
+    join_cfg *c = vcfg;
+    if (!c) return;
+    if (c->region) munmap(c->region, c->rlen);
+    if (c->mapped) munmap(c->data, c->dlen);
+    else free(c->data);
+    free(c);
+}
+
+static void join_explain(void *vcfg, FILE *out) {
+    join_cfg *c = vcfg;
+    fprintf(out, "-d '%c' -f %zu -2 %zu %s%s", c->delim, c->field, c->field2,
+            c->mode == JOIN_SEMI ? "--semi " : c->mode == JOIN_ANTI ? "-v " : "", c->path);
+}
+
+static const OpSpec SPEC = {
+    .name="fp_join", .kind=OP_MAP,
+    .parse=join_parse, .init=join_init,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=join_destroy, .should_stop=NULL,
+    .consume_batch=join_consume_batch, .parallel=join_parallel,
+    .explain=join_explain
+};
+
+const OpSpec *op_join_spec(){ return &SPEC; }
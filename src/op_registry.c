@@ -13,11 +13,18 @@ static const Alias ALIASES[] = {
     {"fp_grep", op_grep_spec}, {"grep", op_grep_spec},
     {"fp_take", op_take_spec}, {"take", op_take_spec},
     {"fp_find", op_find_spec}, {"find", op_find_spec},
+    {"fp_sub",  op_sub_spec }, {"sub",  op_sub_spec },
+    {"fp_gsub", op_gsub_spec}, {"gsub", op_gsub_spec},
+    {"fp_uniq", op_uniq_spec}, {"uniq", op_uniq_spec},
+    {"fp_sort", op_sort_spec}, {"sort", op_sort_spec},
+    {"fp_top",  op_top_spec }, {"top",  op_top_spec },
+    {"fp_agg",  op_agg_spec }, {"agg",  op_agg_spec },
+    {"fp_join", op_join_spec}, {"join", op_join_spec},
     {NULL, NULL}
 };
 
 const OpSpec *lookup_op(const char *token) {
-    for (size_t i = 0; i < sizeof(ALIASES)/sizeof(ALIASES[0]); i++) {
+    for (size_t i = 0; ALIASES[i].alias; i++) {
         if (strcmp(token, ALIASES[i].alias) == 0) return ALIASES[i].spec();
     }
     return NULL;
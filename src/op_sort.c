@@ -0,0 +1,470 @@
+// src/op_sort.c
+#include "ops.h"
+#include "lineio.h"
+#include "sortkey.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifndef FP_SORT_BUDGET
+#define FP_SORT_BUDGET ((size_t)1 << 30)   // -S default: 1 GiB
+#endif
+#define SORT_MAX_RUNS   64      // open runs before they are merged into one
+#define SORT_PAR_MIN    65536   // records worth splitting across threads
+#define RS_SMALL        48      // radix buckets below this go to qsort
+#define RS_LEVELS       64      // radix recursion cap (stack: 4 KiB a level)
+
+typedef fp_sortrec srec;
+
+typedef struct sort_cfg sort_cfg;
+
+// Where merged records come from: a run file, or the sorted records still
+// in memory.
+typedef struct {
+    FILE       *f;
+    const srec *mem;
+    size_t      mi, mn;
+    srec        cur;
+    char       *buf, *kbuf;
+    size_t      bcap, kcap;
+} sort_cursor;
+
+typedef struct {
+    sort_cursor *cur;
+    size_t      *heap;   // cursor indices, smallest current record first
+    size_t       n, ncur;
+} sort_merge;
+
+struct sort_cfg {
+    fp_sortkey   key;        // -d CHAR, -f LIST, -n
+    const char  *list;
+    int          reverse;    // -r
+    size_t       budget;     // -S SIZE
+    const char  *budget_arg;
+    int          nthreads;   // --parallel=N
+    const char  *tmpdir;     // -T DIR, $TMPDIR, /tmp
+
+    FpArena      arena;      // lines (and copied keys) since the last spill
+    srec        *recs, *tmp;
+    size_t       n, cap;
+    FILE       **runs;       // sorted runs spilled to tmpdir (already unlinked)
+    size_t       nruns;
+
+    int          sorted;     // flush: records sorted, merge set up if runs
+    sort_merge  *m;
+    size_t       next;
+};
+
+/* ---- order ---- */
+
+static int sort_qcmp(const void *a, const void *b, void *c) {
+    return fp_sortrec_cmp(&((const sort_cfg *)c)->key, a, b);
+}
+
+// The order runs are written and merged in (-r reverses the whole compare).
+static inline int sort_outcmp(const sort_cfg *c, const srec *a, const srec *b) {
+    int r = fp_sortrec_cmp(&c->key, a, b);
+    return c->reverse ? -r : r;
+}
+
+/* ---- MSD radix sort (lexical keys) ---- */
+
+static inline unsigned rs_byte(const srec *r, size_t depth) {
+    return depth < r->klen ? (unsigned char)r->key[depth] + 1u : 0u;
+}
+
+// Sort a[0..n) whose keys agree on their first depth bytes: one counting
+// pass and scatter per byte position, 257 buckets (0: the key ended there).
+// Keys that ended are equal, so only the whole-line tiebreak orders them.
+static void rs_sort(const sort_cfg *c, srec *a, size_t n, size_t depth, srec *tmp, int level) {
+    while (n > 1) {
+        if (n < RS_SMALL || level >= RS_LEVELS) {
+            qsort_r(a, n, sizeof *a, sort_qcmp, (void *)c);
+            return;
+        }
+        size_t cnt[257] = {0};
+        for (size_t i = 0; i < n; i++) cnt[rs_byte(&a[i], depth)]++;
+        unsigned b0 = rs_byte(&a[0], depth);
+        if (cnt[b0] == n) {              // a shared byte: nothing to move
+            if (b0 == 0) {
+                if (c->key.fields) qsort_r(a, n, sizeof *a, sort_qcmp, (void *)c);
+                return;
+            }
+            depth++;
+            continue;
+        }
+        size_t off[257], o = 0;
+        for (int b = 0; b < 257; b++) { off[b] = o; o += cnt[b]; }
+        for (size_t i = 0; i < n; i++) tmp[off[rs_byte(&a[i], depth)]++] = a[i];
+        memcpy(a, tmp, n * sizeof *a);
+        o = cnt[0];
+        if (cnt[0] > 1 && c->key.fields) qsort_r(a, cnt[0], sizeof *a, sort_qcmp, (void *)c);
+        for (int b = 1; b < 257; b++) {
+            if (cnt[b] > 1) rs_sort(c, a + o, cnt[b], depth + 1, tmp + o, level + 1);
+            o += cnt[b];
+        }
+        return;
+    }
+}
+
+static void sort_slice(const sort_cfg *c, srec *a, size_t n, srec *tmp) {
+    if (c->key.numeric) qsort_r(a, n, sizeof *a, sort_qcmp, (void *)c);
+    else rs_sort(c, a, n, 0, tmp, 0);
+}
+
+/* ---- parallel sort: slices sorted in threads, then merged pairwise ---- */
+
+typedef struct {
+    const sort_cfg *c;
+    srec *a, *tmp, *out;   // merge: a[0..n1) and a[n1..n1+n2) into out
+    size_t n, n1;
+} sort_job;
+
+static void *sort_slice_main(void *arg) {
+    sort_job *j = arg;
+    sort_slice(j->c, j->a, j->n, j->tmp);
+    return NULL;
+}
+
+static void *sort_merge_main(void *arg) {
+    sort_job *j = arg;
+    const srec *x = j->a, *xe = j->a + j->n1, *y = xe, *ye = j->a + j->n;
+    srec *o = j->out;
+    while (x < xe && y < ye) *o++ = fp_sortrec_cmp(&j->c->key, y, x) < 0 ? *y++ : *x++;
+    while (x < xe) *o++ = *x++;
+    while (y < ye) *o++ = *y++;
+    return NULL;
+}
+
+// Run jobs[0..n) on threads, the last on this one; a job whose thread could
+// not be started also runs here.
+static void sort_run_jobs(sort_job *jobs, int n, void *(*fn)(void *)) {
+    pthread_t tid[64];
+    int started[64] = {0};
+    for (int k = 0; k < n - 1; k++)
+        started[k] = pthread_create(&tid[k], NULL, fn, &jobs[k]) == 0;
+    fn(&jobs[n - 1]);
+    for (int k = 0; k < n - 1; k++) {
+        if (started[k]) pthread_join(tid[k], NULL);
+        else fn(&jobs[k]);
+    }
+}
+
+// Sort c->recs[0..n) ascending, then reverse for -r.
+static void sort_records(sort_cfg *c) {
+    size_t n = c->n;
+    int p = c->nthreads;
+    if (n < SORT_PAR_MIN || p <= 1) {
+        sort_slice(c, c->recs, n, c->tmp);
+    } else {
+        size_t bound[65];
+        sort_job jobs[64];
+        for (int k = 0; k <= p; k++) bound[k] = n * (size_t)k / (size_t)p;
+        for (int k = 0; k < p; k++)
+            jobs[k] = (sort_job){ c, c->recs + bound[k], c->tmp + bound[k], NULL, bound[k+1] - bound[k], 0 };
+        sort_run_jobs(jobs, p, sort_slice_main);
+
+        srec *src = c->recs, *dst = c->tmp;
+        for (int width = 1; width < p; width *= 2) {
+            int nj = 0;
+            for (int k = 0; k < p; k += 2 * width) {
+                size_t lo = bound[k], mid = bound[k + width < p ? k + width : p];
+                size_t hi = bound[k + 2 * width < p ? k + 2 * width : p];
+                jobs[nj++] = (sort_job){ c, src + lo, NULL, dst + lo, hi - lo, mid - lo };
+            }
+            sort_run_jobs(jobs, nj, sort_merge_main);
+            srec *t = src; src = dst; dst = t;
+        }
+        if (src != c->recs) memcpy(c->recs, src, n * sizeof *src);
+    }
+    if (c->reverse)
+        for (size_t i = 0, j = n; i + 1 < j; i++, j--) { srec t = c->recs[i]; c->recs[i] = c->recs[j-1]; c->recs[j-1] = t; }
+}
+
+/* ---- runs and merging ---- */
+
+static int sort_cursor_next(const sort_cfg *c, sort_cursor *cu) {
+    if (!cu->f) {
+        if (cu->mi == cu->mn) return 0;
+        cu->cur = cu->mem[cu->mi++];
+        return 1;
+    }
+    ssize_t n = getline(&cu->buf, &cu->bcap, cu->f);
+    if (n < 0) return ferror(cu->f) ? -1 : 0;
+    if (cu->kcap < (size_t)n) {
+        char *k = realloc(cu->kbuf, (size_t)n);
+        if (!k) return -1;
+        cu->kbuf = k; cu->kcap = (size_t)n;
+    }
+    fp_sortrec_fill(&c->key, &cu->cur, cu->buf, (size_t)n, cu->kbuf);
+    return 1;
+}
+
+static void sort_heap_down(const sort_cfg *c, sort_merge *m, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, s = i;
+        if (l < m->n && sort_outcmp(c, &m->cur[m->heap[l]].cur, &m->cur[m->heap[s]].cur) < 0) s = l;
+        if (l + 1 < m->n && sort_outcmp(c, &m->cur[m->heap[l+1]].cur, &m->cur[m->heap[s]].cur) < 0) s = l + 1;
+        if (s == i) return;
+        size_t t = m->heap[i]; m->heap[i] = m->heap[s]; m->heap[s] = t;
+        i = s;
+    }
+}
+
+static void sort_merge_free(sort_merge *m) {
+    if (!m) return;
+    for (size_t k = 0; m->cur && k < m->ncur; k++) { free(m->cur[k].buf); free(m->cur[k].kbuf); }
+    free(m->cur); free(m->heap); free(m);
+}
+
+// A merge of the given runs (and mem[0..mn) if any), each read from the start.
+static sort_merge *sort_merge_open(const sort_cfg *c, FILE **runs, size_t nruns,
+                                   const srec *mem, size_t mn) {
+    sort_merge *m = calloc(1, sizeof *m);
+    size_t nc = nruns + (mn > 0);
+    if (!m || !(m->cur = calloc(nc ? nc : 1, sizeof *m->cur)) || !(m->heap = calloc(nc ? nc : 1, sizeof *m->heap))) {
+        sort_merge_free(m);
+        return NULL;
+    }
+    for (size_t k = 0; k < nc; k++) {
+        sort_cursor *cu = &m->cur[m->ncur++];
+        if (k < nruns) { cu->f = runs[k]; rewind(cu->f); }
+        else { cu->mem = mem; cu->mn = mn; }
+        int r = sort_cursor_next(c, cu);
+        if (r < 0) { sort_merge_free(m); return NULL; }
+        if (r > 0) m->heap[m->n++] = k;
+    }
+    for (size_t i = m->n / 2; i-- > 0; ) sort_heap_down(c, m, i);
+    return m;
+}
+
+// The smallest current record (valid until the next pop), or NULL when
+// the merge is done.
+static const srec *sort_merge_peek(sort_merge *m) {
+    return m->n ? &m->cur[m->heap[0]].cur : NULL;
+}
+static int sort_merge_pop(const sort_cfg *c, sort_merge *m) {
+    sort_cursor *cu = &m->cur[m->heap[0]];
+    int r = sort_cursor_next(c, cu);
+    if (r < 0) return -1;
+    if (r == 0) m->heap[0] = m->heap[--m->n];
+    if (m->n) sort_heap_down(c, m, 0);
+    return 0;
+}
+
+static FILE *sort_tmpfile(const sort_cfg *c) {
+    size_t l = strlen(c->tmpdir);
+    char *path = malloc(l + 20);
+    if (!path) return NULL;
+    memcpy(path, c->tmpdir, l);
+    memcpy(path + l, "/fxsort.XXXXXX", 15);
+    int fd = mkstemp(path);
+    FILE *f = NULL;
+    if (fd >= 0) {
+        unlink(path);     // gone when closed, however fx ends
+        if (!(f = fdopen(fd, "w+"))) close(fd);
+    }
+    if (!f) fp_errf("fp_sort", -1, "", "cannot create a run in %s: %s\n", c->tmpdir, strerror(errno));
+    free(path);
+    return f;
+}
+
+static int sort_add_run(sort_cfg *c, FILE *f) {
+    if (fflush(f) != 0 || ferror(f)) {
+        fp_errf("fp_sort", -1, "", "writing a run in %s: %s\n", c->tmpdir, strerror(errno));
+        fclose(f);
+        return -1;
+    }
+    FILE **r = realloc(c->runs, (c->nruns + 1) * sizeof *r);
+    if (!r) { fclose(f); return -1; }
+    c->runs = r;
+    c->runs[c->nruns++] = f;
+    return 0;
+}
+
+// Too many runs to keep open: merge them all into one.
+static int sort_merge_runs(sort_cfg *c) {
+    FILE *f = sort_tmpfile(c);
+    if (!f) return -1;
+    sort_merge *m = sort_merge_open(c, c->runs, c->nruns, NULL, 0);
+    int rc = m ? 0 : -1;
+    for (const srec *r; rc == 0 && (r = sort_merge_peek(m)); ) {
+        if (fwrite(r->line, 1, r->len, f) != r->len) rc = -1;
+        else rc = sort_merge_pop(c, m);
+    }
+    sort_merge_free(m);
+    for (size_t k = 0; k < c->nruns; k++) fclose(c->runs[k]);
+    c->nruns = 0;
+    if (rc < 0) { fclose(f); return -1; }
+    return sort_add_run(c, f);
+}
+
+// Sort what is buffered and write it out as a run.
+static int sort_spill(sort_cfg *c) {
+    if (c->nruns >= SORT_MAX_RUNS && sort_merge_runs(c) < 0) return -1;
+    FILE *f = sort_tmpfile(c);
+    if (!f) return -1;
+    sort_records(c);
+    for (size_t i = 0; i < c->n; i++) {
+        if (fwrite(c->recs[i].line, 1, c->recs[i].len, f) != c->recs[i].len) break;
+    }
+    c->n = 0;
+    fp_arena_reset(&c->arena);
+    return sort_add_run(c, f);
+}
+
+/* ---- op hooks ---- */
+
+// sort [-n] [-r] [-d CHAR] [-f LIST] [-S SIZE] [-T DIR] [--parallel=N]
+static int sort_parse(int argc, char **argv, int i, void **cfg_out) {
+    sort_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->key.delim = '\t';
+    c->budget = FP_SORT_BUDGET;
+    long np = sysconf(_SC_NPROCESSORS_ONLN);
+    c->nthreads = np < 1 ? 1 : np > 8 ? 8 : (int)np;   // as sort: at most 8 by default
+    c->tmpdir = getenv("TMPDIR");
+    if (!c->tmpdir || !*c->tmpdir) c->tmpdir = "/tmp";
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "sort") == 0 || strcmp(argv[j], "fp_sort") == 0)) j++;
+
+    for (; j < argc; j++) {
+        const char *a = argv[j], *v;
+        long n;
+
+        if (lookup_op(a) != NULL) break;        // fx boundary
+        if (a[0] != '-') break;
+
+        if (strcmp(a, "-n") == 0) { c->key.numeric = 1; continue; }
+        if (strcmp(a, "-r") == 0) { c->reverse = 1; continue; }
+        if (strcmp(a, "-nr") == 0 || strcmp(a, "-rn") == 0) { c->key.numeric = c->reverse = 1; continue; }
+        if (strncmp(a, "--parallel=", 11) == 0) {
+            if (fp_parse_long(a + 11, &n) < 0 || n < 1) goto bad;
+            c->nthreads = n > 64 ? 64 : (int)n;
+            continue;
+        }
+        if (a[1] != 'd' && a[1] != 'f' && a[1] != 'S' && a[1] != 'T') break;
+        if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+        switch (a[1]) {
+        case 'd': c->key.delim = v[0]; break;
+        case 'f':
+            if (fp_sortkey_fields(&c->key, v) < 0) {
+                fp_errf("fp_sort", -1, "", "invalid field list: %s\n", v);
+                goto bad;
+            }
+            c->list = v;
+            break;
+        case 'S':
+            if (fp_parse_size(v, &c->budget) < 0) {
+                fp_errf("fp_sort", -1, "", "invalid size: %s\n", v);
+                goto bad;
+            }
+            c->budget_arg = v;
+            break;
+        case 'T': c->tmpdir = v; break;
+        }
+    }
+
+    *cfg_out = c;
+    return j;
+bad:
+    fp_sortkey_free(&c->key);
+    free(c);
+    return -1;
+}
+
+static size_t sort_held(const sort_cfg *c) {
+    return c->arena.held + c->cap * 2 * sizeof(srec);
+}
+
+// Buffer every record (a copy of the line, and of its key if that is not a
+// slice of it); spill a sorted run when the budget is used up.
+static int sort_consume_batch(void *vcfg, FpBatch *b) {
+    sort_cfg *c = vcfg;
+    for (size_t k = 0; k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        if (n && r->ptr[n-1] == '\n') n--;
+        if (n >= UINT32_MAX) { fp_errf("fp_sort", -1, "", "line too long\n"); return -1; }
+        if (c->n == c->cap) {
+            size_t cap = c->cap ? c->cap * 2 : 4096;
+            srec *rs = realloc(c->recs, cap * sizeof *rs);
+            if (!rs) return -1;
+            c->recs = rs;
+            srec *t = realloc(c->tmp, cap * sizeof *t);
+            if (!t) return -1;
+            c->tmp = t;
+            c->cap = cap;
+        }
+        int copy_key = fp_sortkey_copies(&c->key);
+        char *line = fp_arena_alloc(&c->arena, n + 1 + (copy_key ? n : 0));
+        if (!line) return -1;
+        memcpy(line, r->ptr, n);
+        line[n] = '\n';
+        fp_sortrec_fill(&c->key, &c->recs[c->n++], line, n + 1, line + n + 1);
+    }
+    b->nsel = 0;
+    if (sort_held(c) > c->budget && c->n) return sort_spill(c);
+    return 0;
+}
+
+// Sorted output: straight from memory when nothing was spilled, else a
+// k-way merge of the runs and the records still in memory.
+static int sort_flush_batch(void *vcfg, FpBatch *b) {
+    sort_cfg *c = vcfg;
+    if (!c->sorted) {
+        c->sorted = 1;
+        sort_records(c);
+        if (c->nruns && !(c->m = sort_merge_open(c, c->runs, c->nruns, c->recs, c->n))) return -1;
+    }
+    if (!c->m) {
+        for (; c->next < c->n && b->n < b->cap; c->next++)
+            if (fp_batch_add(b, (char *)c->recs[c->next].line, c->recs[c->next].len) < 0) return -1;
+        return b->n > 0;
+    }
+    for (const srec *r; !fp_batch_full(b) && (r = sort_merge_peek(c->m)); ) {
+        if (fp_batch_push_copy(b, r->line, r->len) < 0) return -1;
+        if (sort_merge_pop(c, c->m) < 0) {
+            fp_errf("fp_sort", -1, "", "reading a run: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return b->n > 0;
+}
+
+static void sort_destroy(void *vcfg) {
+    sort_cfg *c = vcfg;
+    if (!c) return;
+    sort_merge_free(c->m);
+    for (size_t k = 0; k < c->nruns; k++) fclose(c->runs[k]);
+    free(c->runs);
+    free(c->recs);
+    free(c->tmp);
+    fp_arena_free(&c->arena);
+    fp_sortkey_free(&c->key);
+    free(c);
+}
+
+static void sort_explain(void *vcfg, FILE *out) {
+    sort_cfg *c = vcfg;
+    if (c->key.fields) fprintf(out, "-d '%c' -f %s ", c->key.delim, c->list);
+    fprintf(out, "%s%s[%s, %d threads", c->key.numeric ? "-n " : "", c->reverse ? "-r " : "",
+            c->key.numeric ? "numeric" : "radix", c->nthreads);
+    if (c->budget_arg) fprintf(out, ", -S %s", c->budget_arg);
+    fputc(']', out);
+}
+
+static const OpSpec SPEC = {
+    .name="fp_sort", .kind=OP_MAP,
+    .parse=sort_parse, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=sort_destroy, .should_stop=NULL,
+    .consume_batch=sort_consume_batch, .flush_batch=sort_flush_batch,
+    .explain=sort_explain
+};
+
+const OpSpec *op_sort_spec(){ return &SPEC; }
@@ -0,0 +1,245 @@
+// src/op_sub.c
+#include "ops.h"
+#include "util.h"
+
+#include <regex.h>
+#include <stdio.h>
+#include <string.h>
+
+// Groups a replacement can name: & and \1..\9
+#define SUB_NM 10
+
+// The replacement, split once into literal runs and group references.
+typedef struct {
+    int    group;     // -1: literal text[off, off+len)
+    size_t off, len;
+} sub_piece;
+
+typedef struct {
+    fp_regex   rx;
+    int        ext, fixed, icase;
+    int        global;       // gsub, or -g: every match, not just the first
+    const char *pat;
+    const char *repl;        // as typed, for --explain
+    char       *text;        // literal runs of the replacement, unescaped
+    sub_piece  *pieces;
+    size_t      npieces;
+    size_t      nm;          // regmatch_t slots used: highest group + 1
+
+    // fx -j: like grep, workers 1..n-1 match with their own copy (the DFA
+    // fills its state cache as it goes, regexec serializes on a regex_t).
+    fp_regex   *wrx;
+    int         nwrx;
+} sub_cfg;
+
+// & is the match, \N group N, \& \\ a literal & or \, \n \t newline and tab.
+static int sub_compile_repl(sub_cfg *c, const char *r) {
+    size_t n = strlen(r);
+    c->text = malloc(n + 1);
+    c->pieces = malloc((n + 1) * sizeof *c->pieces);
+    if (!c->text || !c->pieces) return -1;
+    size_t t = 0;
+    for (const char *p = r; *p; p++) {
+        int g = -1;
+        char ch = *p;
+        if (ch == '&') g = 0;
+        else if (ch == '\\' && p[1]) {
+            ch = *++p;
+            if (ch >= '0' && ch <= '9') g = ch - '0';
+            else if (ch == 'n') ch = '\n';
+            else if (ch == 't') ch = '\t';
+        }
+        if (g >= 0) {
+            c->pieces[c->npieces++] = (sub_piece){ g, 0, 0 };
+            if ((size_t)g + 1 > c->nm) c->nm = (size_t)g + 1;
+            continue;
+        }
+        sub_piece *last = c->npieces ? &c->pieces[c->npieces - 1] : NULL;
+        if (!last || last->group >= 0)
+            c->pieces[c->npieces++] = (sub_piece){ -1, t, 0 };
+        c->text[t++] = ch;
+        c->pieces[c->npieces - 1].len++;
+    }
+    if (c->nm == 0) c->nm = 1;
+    return 0;
+}
+
+static void sub_free(sub_cfg *c) {
+    for (int k = 0; k < c->nwrx; k++) fp_regex_free(&c->wrx[k]);
+    free(c->wrx);
+    if (c->pat) fp_regex_free(&c->rx);
+    free(c->text);
+    free(c->pieces);
+    free(c);
+}
+
+// sub [-E] [-F] [-i] [-g] PATTERN REPLACEMENT (gsub: -g implied)
+static int sub_parse_as(int argc, char **argv, int i, void **cfg_out, int global) {
+    sub_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->global = global;
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "sub") == 0 || strcmp(argv[j], "fp_sub") == 0 ||
+                     strcmp(argv[j], "gsub") == 0 || strcmp(argv[j], "fp_gsub") == 0)) j++;
+
+    for (; j < argc && argv[j][0] == '-' && argv[j][1]; j++) {
+        const char *a = argv[j];
+        if (strcmp(a, "--") == 0) { j++; break; }
+        if (strspn(a + 1, "EFig") != strlen(a + 1)) break;   // not ours: the pattern
+        for (const char *f = a + 1; *f; f++) {
+            if (*f == 'E') c->ext = 1;
+            else if (*f == 'F') c->fixed = 1;
+            else if (*f == 'i') c->icase = 1;
+            else c->global = 1;
+        }
+    }
+    if (j + 2 > argc) {
+        fp_errf("fp_sub", -1, "", "usage: sub [-E] [-F] [-i] [-g] PATTERN REPLACEMENT\n");
+        goto bad;
+    }
+    const char *pat = argv[j++], *repl = argv[j++];
+    if (!pat[0]) { fp_errf("fp_sub", -1, "", "empty pattern\n"); goto bad; }
+    if (fp_regex_compile_subs(&c->rx, pat, c->ext, c->icase, c->fixed) != 0) {
+        fp_errf("fp_sub", -1, "", "bad pattern: %s\n", pat);
+        goto bad;
+    }
+    c->pat = pat;
+    c->repl = repl;
+    if (sub_compile_repl(c, repl) < 0) goto bad;
+    if (c->nm > fp_regex_nsub(&c->rx) + 1) {
+        fp_errf("fp_sub", -1, "", "invalid reference \\%zu in replacement\n", c->nm - 1);
+        goto bad;
+    }
+
+    *cfg_out = c;
+    return j;
+bad:
+    sub_free(c);
+    return -1;
+}
+
+static int sub_parse(int argc, char **argv, int i, void **cfg_out) {
+    return sub_parse_as(argc, argv, i, cfg_out, 0);
+}
+static int gsub_parse(int argc, char **argv, int i, void **cfg_out) {
+    return sub_parse_as(argc, argv, i, cfg_out, 1);
+}
+
+// Append [p, p+n) at *wp if it fits before end.
+static int sub_put(char **wp, char *end, const char *p, size_t n) {
+    if ((size_t)(end - *wp) < n) return -1;
+    memcpy(*wp, p, n);
+    *wp += n;
+    return 0;
+}
+
+// Rewrite [s, s+n) (without its '\n') into [out, out+cap), starting from
+// its first match m. Global replacement follows sed: an empty match right
+// after the previous match is skipped, and the scan steps over one byte
+// after an empty match. Returns the output length, or -1 if it did not fit.
+static long sub_line(const sub_cfg *c, fp_regex *rx, const char *s, size_t n,
+                     regmatch_t *m, char *out, size_t cap) {
+    char *wp = out, *end = out + cap;
+    size_t copied = 0, prev_end = (size_t)-1;
+    for (;;) {
+        size_t so = (size_t)m[0].rm_so, eo = (size_t)m[0].rm_eo, pos;
+        if (so == eo && so == prev_end) {
+            pos = so + 1;
+        } else {
+            if (sub_put(&wp, end, s + copied, so - copied) < 0) return -1;
+            for (size_t k = 0; k < c->npieces; k++) {
+                const sub_piece *pc = &c->pieces[k];
+                if (pc->group < 0) {
+                    if (sub_put(&wp, end, c->text + pc->off, pc->len) < 0) return -1;
+                } else if (m[pc->group].rm_so >= 0) {
+                    const regmatch_t *g = &m[pc->group];
+                    if (sub_put(&wp, end, s + g->rm_so, (size_t)(g->rm_eo - g->rm_so)) < 0) return -1;
+                }
+            }
+            copied = prev_end = eo;
+            if (!c->global) break;
+            pos = so == eo ? eo + 1 : eo;
+        }
+        if (pos > n || !fp_regex_exec(rx, s, n, pos, m, c->nm)) break;
+    }
+    if (sub_put(&wp, end, s + copied, n - copied) < 0) return -1;
+    return (long)(wp - out);
+}
+
+// Lines without a match keep their view (no copy); rewritten ones go to the
+// batch arena. The output bound is not known up front (every match may grow
+// the line): reserve twice the line and retry larger if it does not fit.
+static int sub_consume_batch(void *vcfg, FpBatch *b) {
+    sub_cfg *c = vcfg;
+    fp_regex *rx = (b->worker > 0 && b->worker <= c->nwrx) ? &c->wrx[b->worker-1] : &c->rx;
+    regmatch_t m[SUB_NM];
+    for (size_t k = 0; k < b->nsel; k++) {
+        FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        int had_nl = (n && r->ptr[n-1] == '\n'); if (had_nl) n--;
+        if (!fp_regex_exec(rx, r->ptr, n, 0, m, c->nm)) continue;
+
+        regmatch_t first[SUB_NM];
+        memcpy(first, m, c->nm * sizeof *m);
+        long len;
+        char *out;
+        for (size_t cap = 2 * n + 64; ; cap *= 2) {
+            if (!(out = fp_arena_reserve(&b->arena, cap + 1))) return -1;
+            if ((len = sub_line(c, rx, r->ptr, n, m, out, cap)) >= 0) break;
+            memcpy(m, first, c->nm * sizeof *m);
+        }
+        if (had_nl) out[len++] = '\n';
+        fp_arena_commit(&b->arena, (size_t)len);
+        r->ptr = out;
+        r->len = (size_t)len;
+    }
+    return 0;
+}
+
+static int sub_parallel(void *vcfg, int nworkers) {
+    sub_cfg *c = vcfg;
+    if (c->rx.is_fixed || nworkers <= 1) return 1;
+    c->wrx = calloc((size_t)nworkers - 1, sizeof *c->wrx);
+    if (!c->wrx) return 0;
+    for (; c->nwrx < nworkers - 1; c->nwrx++) {
+        if (fp_regex_compile_subs(&c->wrx[c->nwrx], c->pat, c->ext, c->icase, c->fixed) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void sub_destroy(void *vcfg) {
+    if (vcfg) sub_free(vcfg);
+}
+
+static unsigned sub_props(void *vcfg) { (void)vcfg; return FP_PROP_1TO1; }
+
+static void sub_explain(void *vcfg, FILE *out) {
+    sub_cfg *c = vcfg;
+    fprintf(out, "%s%s%s'%s' -> '%s'%s [%s]", c->ext ? "-E " : "", c->fixed ? "-F " : "",
+            c->icase ? "-i " : "", c->pat, c->repl, c->global ? " global" : "",
+            c->rx.is_fixed ? "literal" : c->rx.dfa ? "dfa + regexec" : "regexec");
+}
+
+// The line count never changes, but the bytes of a line may grow, so there
+// is no per-line consume(): everything goes through consume_batch.
+static const OpSpec SPEC = {
+    .name="fp_sub", .kind=OP_MAP,
+    .parse=sub_parse, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=sub_destroy, .should_stop=NULL,
+    .consume_batch=sub_consume_batch, .parallel=sub_parallel,
+    .props=sub_props, .explain=sub_explain
+};
+static const OpSpec GSPEC = {
+    .name="fp_gsub", .kind=OP_MAP,
+    .parse=gsub_parse, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=sub_destroy, .should_stop=NULL,
+    .consume_batch=sub_consume_batch, .parallel=sub_parallel,
+    .props=sub_props, .explain=sub_explain
+};
+
+const OpSpec *op_sub_spec(){ return &SPEC; }
+const OpSpec *op_gsub_spec(){ return &GSPEC; }
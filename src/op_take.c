@@ -34,12 +34,25 @@ static int take_accept(void *vcfg, const char *line, size_t len) {
     c->seen++;
     return (c->seen >= c->n) ? 0 : 1; // 0 => stop
 }
+// Batch form: keep the first (n - seen) selected records for the engine's
+// vectored writer, and stop once n have gone out.
+static int take_accept_batch(void *vcfg, FpBatch *b) {
+    take_cfg *c = vcfg;
+    long left = c->n - c->seen;
+    if (left <= 0) { b->nsel = 0; return 0; }
+    if ((long)b->nsel > left) b->nsel = (size_t)left;
+    c->seen += (long)b->nsel;
+    return (c->seen >= c->n) ? 0 : 1; // 0 => stop
+}
+static long take_limit(void *vcfg) { return ((take_cfg *)vcfg)->n; }
+static void take_explain(void *vcfg, FILE *out) { fprintf(out, "-n %ld", ((take_cfg *)vcfg)->n); }
 static void take_destroy(void *vcfg){ free(vcfg); }
 
 static const OpSpec SPEC = {
     .name="fp_take", .kind=OP_SINK,
     .parse=take_parse, .init=NULL,
     .consume=NULL, .produce=NULL, .accept=take_accept,
-    .flush=NULL, .destroy=take_destroy, .should_stop=NULL
+    .flush=NULL, .destroy=take_destroy, .should_stop=NULL,
+    .accept_batch=take_accept_batch, .limit=take_limit, .explain=take_explain
 };
 const OpSpec *op_take_spec(){ return &SPEC; }
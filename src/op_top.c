@@ -0,0 +1,242 @@
+// src/op_top.c
+#include "ops.h"
+#include "sortkey.h"
+#include "util.h"
+
+#include <stdio.h>
+
+// The K records kept so far: a heap ordered so that the one that would be
+// printed last is at h[0], and a new record only has to beat that one.
+// Kept lines (and copied keys) live in the arena; replaced ones are dead
+// bytes there until it is compacted.
+typedef struct {
+    fp_sortrec *h;
+    size_t      n;
+    FpArena     arena;
+    size_t      live;       // arena bytes still used by kept records
+    char       *kbuf;       // key of the candidate, when it has to be copied
+    size_t      kcap;
+} top_heap;
+
+typedef struct {
+    fp_sortkey  key;        // -k LIST, -d CHAR; numeric unless -l
+    const char *list;
+    size_t      k;          // -n K
+    int         reverse;    // -r: the largest K, largest first
+
+    top_heap   *heaps;      // one per fx -j worker, else one
+    int         nheaps;
+    fp_sortrec *out;        // flush: every heap's records, in output order
+    size_t      nout, next;
+} top_cfg;
+
+static inline int top_cmp(const top_cfg *c, const fp_sortrec *a, const fp_sortrec *b) {
+    int r = fp_sortrec_cmp(&c->key, a, b);
+    return c->reverse ? -r : r;
+}
+
+static int top_qcmp(const void *a, const void *b, void *c) { return top_cmp(c, a, b); }
+
+static void top_heap_up(const top_cfg *c, top_heap *t, size_t i) {
+    fp_sortrec r = t->h[i];
+    while (i > 0) {
+        size_t p = (i - 1) / 2;
+        if (top_cmp(c, &t->h[p], &r) >= 0) break;
+        t->h[i] = t->h[p];
+        i = p;
+    }
+    t->h[i] = r;
+}
+
+static void top_heap_down(const top_cfg *c, top_heap *t, size_t i) {
+    fp_sortrec r = t->h[i];
+    for (;;) {
+        size_t l = 2 * i + 1, s = l;
+        if (l >= t->n) break;
+        if (l + 1 < t->n && top_cmp(c, &t->h[l+1], &t->h[l]) > 0) s = l + 1;
+        if (top_cmp(c, &t->h[s], &r) <= 0) break;
+        t->h[i] = t->h[s];
+        i = s;
+    }
+    t->h[i] = r;
+}
+
+static size_t top_size(const top_cfg *c, size_t len) {
+    return fp_sortkey_copies(&c->key) ? 2 * len : len;
+}
+
+// Copy the line [s, s+n) (no '\n') into the arena and key the copy.
+static int top_copy(const top_cfg *c, FpArena *a, fp_sortrec *r, const char *s, size_t n) {
+    char *line = fp_arena_alloc(a, top_size(c, n + 1));
+    if (!line) return -1;
+    memcpy(line, s, n);
+    line[n] = '\n';
+    fp_sortrec_fill(&c->key, r, line, n + 1, line + n + 1);
+    return 0;
+}
+
+// Move the kept records to a fresh arena once replaced ones take up more
+// than half of it, so memory stays proportional to K.
+static int top_compact(const top_cfg *c, top_heap *t) {
+    if (t->arena.held <= 2 * (t->live + FP_ARENA_CHUNK)) return 0;
+    FpArena fresh = {0};
+    for (size_t i = 0; i < t->n; i++) {
+        if (top_copy(c, &fresh, &t->h[i], t->h[i].line, t->h[i].len - 1) < 0) {
+            fp_arena_free(&fresh);
+            return -1;
+        }
+    }
+    fp_arena_free(&t->arena);
+    t->arena = fresh;
+    return 0;
+}
+
+// top [-n K] [-r] [-l] [-d CHAR] [-k LIST]
+static int top_parse(int argc, char **argv, int i, void **cfg_out) {
+    top_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->key.delim = '\t';
+    c->key.numeric = 1;
+    c->k = 10;
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "top") == 0 || strcmp(argv[j], "fp_top") == 0)) j++;
+
+    for (; j < argc; j++) {
+        const char *a = argv[j], *v;
+        long n;
+
+        if (lookup_op(a) != NULL) break;        // fx boundary
+        if (a[0] != '-') break;
+
+        if (strcmp(a, "-r") == 0) { c->reverse = 1; continue; }
+        if (strcmp(a, "-l") == 0) { c->key.numeric = 0; continue; }
+        if (a[1] != 'n' && a[1] != 'd' && a[1] != 'k') break;
+        if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+        switch (a[1]) {
+        case 'n':
+            if (fp_parse_long(v, &n) < 0 || n < 0) {
+                fp_errf("fp_top", -1, "", "invalid count: %s\n", v);
+                goto bad;
+            }
+            c->k = (size_t)n;
+            break;
+        case 'd': c->key.delim = v[0]; break;
+        case 'k':
+            if (fp_sortkey_fields(&c->key, v) < 0) {
+                fp_errf("fp_top", -1, "", "invalid field list: %s\n", v);
+                goto bad;
+            }
+            c->list = v;
+            break;
+        }
+    }
+
+    if (!(c->heaps = calloc(1, sizeof *c->heaps))) goto bad;
+    c->nheaps = 1;
+    *cfg_out = c;
+    return j;
+bad:
+    fp_sortkey_free(&c->key);
+    free(c);
+    return -1;
+}
+
+// Each worker keeps its own K; flush merges them.
+static int top_parallel(void *vcfg, int nworkers) {
+    top_cfg *c = vcfg;
+    top_heap *h = calloc((size_t)nworkers, sizeof *h);
+    if (!h) return 0;
+    free(c->heaps);
+    c->heaps = h;
+    c->nheaps = nworkers;
+    return 1;
+}
+
+// Offer every record to the heap; a record is only copied if it is kept.
+// Nothing is passed on until the input ends.
+static int top_consume_batch(void *vcfg, FpBatch *b) {
+    top_cfg *c = vcfg;
+    top_heap *t = &c->heaps[b->worker > 0 && b->worker < c->nheaps ? b->worker : 0];
+    if (c->k && !t->h && !(t->h = malloc(c->k * sizeof *t->h))) return -1;
+    for (size_t k = 0; c->k && k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        if (n && r->ptr[n-1] == '\n') n--;
+        if (n >= UINT32_MAX) { fp_errf("fp_top", -1, "", "line too long\n"); return -1; }
+
+        if (t->n == c->k) {
+            if (fp_sortkey_copies(&c->key) && t->kcap < n + 1) {
+                char *kb = realloc(t->kbuf, n + 1);
+                if (!kb) return -1;
+                t->kbuf = kb; t->kcap = n + 1;
+            }
+            fp_sortrec cand;   // fill only reads the line before its '\n'
+            fp_sortrec_fill(&c->key, &cand, r->ptr, n + 1, t->kbuf);
+            if (top_cmp(c, &cand, &t->h[0]) >= 0) continue;
+            t->live -= top_size(c, t->h[0].len);
+            if (top_copy(c, &t->arena, &t->h[0], r->ptr, n) < 0) return -1;
+            top_heap_down(c, t, 0);
+        } else {
+            if (top_copy(c, &t->arena, &t->h[t->n], r->ptr, n) < 0) return -1;
+            top_heap_up(c, t, t->n++);
+        }
+        t->live += top_size(c, n + 1);
+    }
+    b->nsel = 0;
+    return top_compact(c, t);
+}
+
+// The kept records of every heap, sorted, the first K of them emitted.
+static int top_flush_batch(void *vcfg, FpBatch *b) {
+    top_cfg *c = vcfg;
+    if (!c->out) {
+        size_t total = 0;
+        for (int w = 0; w < c->nheaps; w++) total += c->heaps[w].n;
+        if (!(c->out = malloc((total ? total : 1) * sizeof *c->out))) return -1;
+        for (int w = 0; w < c->nheaps; w++) {
+            memcpy(c->out + c->nout, c->heaps[w].h, c->heaps[w].n * sizeof *c->out);
+            c->nout += c->heaps[w].n;
+        }
+        qsort_r(c->out, c->nout, sizeof *c->out, top_qcmp, c);
+        if (c->nout > c->k) c->nout = c->k;
+    }
+    for (; c->next < c->nout && !fp_batch_full(b); c->next++)
+        if (fp_batch_add(b, (char *)c->out[c->next].line, c->out[c->next].len) < 0) return -1;
+    return b->n > 0;
+}
+
+static void top_destroy(void *vcfg) {
+    top_cfg *c = vcfg;
+    if (!c) return;
+    for (int w = 0; c->heaps && w < c->nheaps; w++) {
+        free(c->heaps[w].h);
+        free(c->heaps[w].kbuf);
+        fp_arena_free(&c->heaps[w].arena);
+    }
+    free(c->heaps);
+    free(c->out);
+    fp_sortkey_free(&c->key);
+    free(c);
+}
+
+static void top_explain(void *vcfg, FILE *out) {
+    top_cfg *c = vcfg;
+    fprintf(out, "-n %zu ", c->k);
+    if (c->key.fields) fprintf(out, "-d '%c' -k %s ", c->key.delim, c->list);
+    fprintf(out, "[%s, %s first", c->key.numeric ? "numeric" : "bytes",
+            c->reverse ? "largest" : "smallest");
+    if (c->nheaps > 1) fprintf(out, ", %d heaps", c->nheaps);
+    fputc(']', out);
+}
+
+static const OpSpec SPEC = {
+    .name="fp_top", .kind=OP_MAP,
+    .parse=top_parse, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=top_destroy, .should_stop=NULL,
+    .consume_batch=top_consume_batch, .flush_batch=top_flush_batch,
+    .parallel=top_parallel, .explain=top_explain
+};
+
+const OpSpec *op_top_spec(){ return &SPEC; }
@@ -1,6 +1,7 @@
 // src/op_tr.c
 #define _POSIX_C_SOURCE 200809L
 #include "ops.h"
+#include "speccache.h"
 #include "util.h"
 
 #include <stdio.h>
@@ -8,11 +9,17 @@
 
 typedef struct {
     fp_trspec t;
+    char     *desc;   /* normalized args for --explain; fused steps join with " | " */
 } tr_cfg;
 
 /* ---- forward decls so SPEC can reference them ---- */
 static int  tr_parse(int argc, char **argv, int i, void **cfg_out);
 static int  tr_consume(void *cfg, char **linep, size_t *lenp);
+static int  tr_consume_batch(void *cfg, FpBatch *b);
+static int  tr_parallel(void *cfg, int nworkers);
+static unsigned tr_props(void *cfg);
+static int  tr_fuse(void *cfg, void *next_cfg);
+static void tr_explain(void *cfg, FILE *out);
 static void tr_destroy(void *cfg);
 
 /* ---- OpSpec ---- */
@@ -20,10 +27,36 @@ static const OpSpec SPEC = {
     .name="fp_tr", .kind=OP_MAP,
     .parse=tr_parse, .init=NULL,
     .consume=tr_consume, .produce=NULL, .accept=NULL,
-    .flush=NULL, .destroy=tr_destroy, .should_stop=NULL
+    .flush=NULL, .destroy=tr_destroy, .should_stop=NULL,
+    .consume_batch=tr_consume_batch, .parallel=tr_parallel,
+    .props=tr_props, .fuse=tr_fuse, .explain=tr_explain
 };
 const OpSpec *op_tr_spec(void){ return &SPEC; }
 
+/* Table for (flags, SET1, SET2), built once per session: cached tables are
+   copied out, as fusion rewrites c->t in place. */
+static int tr_build_cached(fp_trspec *t, const char *set1, const char *set2) {
+    size_t l1 = strlen(set1), l2 = strlen(set2), klen = 2 + l1 + 1 + l2;
+    char *key = malloc(klen);
+    if (!key) return -1;
+    key[0] = t->delete_mode ? 'd' : '-';
+    key[1] = t->squeeze_mode ? 's' : '-';
+    memcpy(key + 2, set1, l1 + 1);   /* NUL between the sets */
+    memcpy(key + 3 + l1, set2, l2);
+    fp_specent *e = fp_speccache_get("tr", key, klen);
+    if (!e) {
+        fp_trspec *nt = malloc(sizeof *nt);
+        if (nt) *nt = *t;
+        if (nt && fp_trspec_build(nt, set1, set2) < 0) { free(nt); nt = NULL; }
+        if (nt) e = fp_speccache_put("tr", key, klen, nt, free);
+    }
+    free(key);
+    if (!e) return -1;
+    *t = *(const fp_trspec *)fp_specent_obj(e);
+    fp_speccache_release(e);
+    return 0;
+}
+
 /* ---- parser: works in standalone and inside fx ---- */
 static int tr_parse(int argc, char **argv, int i, void **cfg_out) {
     tr_cfg *c = calloc(1, sizeof *c);
@@ -46,7 +79,14 @@ static int tr_parse(int argc, char **argv, int i, void **cfg_out) {
     const char *set2 = c->t.delete_mode ? "" :
                        (j < argc && lookup_op(argv[j]) == NULL ? argv[j++] : "");
 
-    if (fp_trspec_build(&c->t, set1, set2) < 0) { free(c); return -1; }
+    if (tr_build_cached(&c->t, set1, set2) < 0) { free(c); return -1; }
+
+    size_t dn = strlen(set1) + strlen(set2) + 16;
+    c->desc = malloc(dn);
+    if (!c->desc) { free(c); return -1; }
+    snprintf(c->desc, dn, "%s%s'%s'%s%s%s", c->t.delete_mode ? "-d " : "",
+             c->t.squeeze_mode ? "-s " : "", set1,
+             *set2 ? " '" : "", set2, *set2 ? "'" : "");
     *cfg_out = c;
     return j;
 }
@@ -58,7 +98,49 @@ static int tr_consume(void *vcfg, char **linep, size_t *lenp) {
     return 0; /* emit */
 }
 
+/* ---- consume_batch: same transform over every selected record ---- */
+static int tr_consume_batch(void *vcfg, FpBatch *b) {
+    tr_cfg *c = vcfg;
+    for (size_t k = 0; k < b->nsel; k++) {
+        FpRec *r = &b->recs[b->sel[k]];
+        fp_tr_inplace(&r->ptr, &r->len, &c->t);
+    }
+    return 0;
+}
+
+/* ---- stateless: safe in any number of workers ---- */
+static int tr_parallel(void *vcfg, int nworkers) { (void)vcfg; (void)nworkers; return 1; }
+
+/* ---- optimizer hooks ---- */
+static unsigned tr_props(void *vcfg) {
+    tr_cfg *c = vcfg;
+    return FP_PROP_1TO1 | (fp_trspec_case_only(&c->t) ? FP_PROP_CASE_ONLY : 0);
+}
+
+/* tr A then tr B == one tr with the composed table (not with -s) */
+static int tr_fuse(void *vcfg, void *vnext) {
+    tr_cfg *c = vcfg, *n = vnext;
+    fp_trspec t;
+    if (fp_trspec_compose(&t, &c->t, &n->t) < 0) return 0;
+    size_t dn = strlen(c->desc) + strlen(n->desc) + 4;
+    char *d = malloc(dn);
+    if (!d) return 0;
+    snprintf(d, dn, "%s | %s", c->desc, n->desc);
+    free(c->desc);
+    c->desc = d;
+    c->t = t;
+    return 1;
+}
+
+static void tr_explain(void *vcfg, FILE *out) {
+    tr_cfg *c = vcfg;
+    char kd[32];
+    fprintf(out, "%s [%s]", c->desc, c->t.squeeze_mode ? "scalar, squeeze" :
+            fp_xlate_describe(&c->t.xl, kd, sizeof kd));
+}
+
 static void tr_destroy(void *vcfg) {
     tr_cfg *c = vcfg;
+    free(c->desc);
     free(c);
 }
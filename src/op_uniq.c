@@ -0,0 +1,195 @@
+// src/op_uniq.c
+#include "ops.h"
+#include "htab.h"
+#include "lineio.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+// Per distinct key (not kept for a plain --first, which only needs the key)
+typedef struct {
+    uint64_t    count;
+    const char *line;     // the first line with this key, without its '\n'
+    size_t      len;
+} uniq_val;
+
+typedef struct {
+    int         count;       // -c
+    int         first;       // --first: first-seen order (streamed unless -c)
+    char        delim;       // -d CHAR
+    size_t      field;       // -f N: key on field N (0: the whole line)
+    size_t      max_bytes;   // -S SIZE: cap on the table (0: none)
+    const char *max_arg;
+
+    fp_htab     tab;
+    int         keep_lines;  // entries carry a uniq_val
+    const fp_htent **order;  // flush: entries sorted by key
+    size_t      next;        // flush: next entry to emit
+} uniq_cfg;
+
+// uniq [-c] [-d CHAR] [-f N] [--first] [-S SIZE]
+static int uniq_parse(int argc, char **argv, int i, void **cfg_out) {
+    uniq_cfg *c = calloc(1, sizeof *c);
+    if (!c) return -1;
+    c->delim = '\t';
+
+    int j = i;
+    if (j < argc && (strcmp(argv[j], "uniq") == 0 || strcmp(argv[j], "fp_uniq") == 0)) j++;
+
+    for (; j < argc; j++) {
+        const char *a = argv[j], *v = NULL;
+        long n;
+
+        if (lookup_op(a) != NULL) break;        // fx boundary
+        if (a[0] != '-') break;
+
+        if (strcmp(a, "-c") == 0) { c->count = 1; continue; }
+        if (strcmp(a, "--first") == 0) { c->first = 1; continue; }
+        if (strncmp(a, "-d", 2) == 0) {
+            if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+            c->delim = v[0];
+            continue;
+        }
+        if (strncmp(a, "-f", 2) == 0) {
+            if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+            if (fp_parse_long(v, &n) < 0 || n < 1) {
+                fp_errf("fp_uniq", -1, "", "invalid field number: %s\n", v);
+                goto bad;
+            }
+            c->field = (size_t)n;
+            continue;
+        }
+        if (strncmp(a, "-S", 2) == 0) {
+            if (!(v = a[2] ? a + 2 : (++j < argc ? argv[j] : NULL))) goto bad;
+            if (fp_parse_size(v, &c->max_bytes) < 0) {
+                fp_errf("fp_uniq", -1, "", "invalid size: %s\n", v);
+                goto bad;
+            }
+            c->max_arg = v;
+            continue;
+        }
+        break;
+    }
+
+    c->keep_lines = c->count || !c->first;
+    if (fp_htab_init(&c->tab, c->keep_lines ? sizeof(uniq_val) : 0) < 0) goto bad;
+    *cfg_out = c;
+    return j;
+bad:
+    free(c);
+    return -1;
+}
+
+// Field c->field of [s, s+n) (empty when the line has fewer fields).
+static void uniq_key(const uniq_cfg *c, const char *s, size_t n, const char **k, size_t *kn) {
+    if (!c->field) { *k = s; *kn = n; return; }
+    const char *p = s, *end = s + n;
+    if (c->field > 1) {
+        size_t left = c->field - 1;
+        const char *d = fp_memchr_nth(s, n, c->delim, &left);
+        if (!d) { *k = end; *kn = 0; return; }
+        p = d + 1;
+    }
+    const char *e = memchr(p, c->delim, (size_t)(end - p));
+    *k = p;
+    *kn = (size_t)((e ? e : end) - p);
+}
+
+// Count every record into the table. A plain --first passes the records
+// whose key is new; otherwise all are held back for uniq_flush_batch.
+static int uniq_consume_batch(void *vcfg, FpBatch *b) {
+    uniq_cfg *c = vcfg;
+    int stream = c->first && !c->count;
+    size_t w = 0;
+    for (size_t k = 0; k < b->nsel; k++) {
+        const FpRec *r = &b->recs[b->sel[k]];
+        size_t n = r->len;
+        if (n && r->ptr[n-1] == '\n') n--;
+        const char *key; size_t kn;
+        uniq_key(c, r->ptr, n, &key, &kn);
+
+        int isnew;
+        size_t e = fp_htab_get(&c->tab, key, kn, &isnew);
+        if (e == SIZE_MAX) { fp_errf("fp_uniq", -1, "", "out of memory\n"); return -1; }
+        if (c->keep_lines) {
+            uniq_val *v = fp_htab_val(&c->tab, e);
+            if (isnew) {
+                // with no -f the key is the line, already interned
+                v->line = c->field ? fp_arena_dup(&c->tab.arena, r->ptr, n) : c->tab.ents[e].key;
+                v->len = n;
+                if (!v->line) return -1;
+            }
+            v->count++;
+        }
+        if (!isnew) continue;
+        if (c->max_bytes && fp_htab_bytes(&c->tab) > c->max_bytes) {
+            fp_errf("fp_uniq", -1, "", "%zu distinct keys exceed -S %s\n", c->tab.n, c->max_arg);
+            return -1;
+        }
+        if (stream) b->sel[w++] = b->sel[k];
+    }
+    b->nsel = w;
+    return 0;
+}
+
+// Byte order, shorter first on a tie: what LC_ALL=C sort gives.
+static int uniq_key_cmp(const void *pa, const void *pb) {
+    const fp_htent *a = *(const fp_htent *const *)pa, *b = *(const fp_htent *const *)pb;
+    int d = memcmp(a->key, b->key, a->klen < b->klen ? a->klen : b->klen);
+    if (d) return d;
+    return a->klen < b->klen ? -1 : a->klen > b->klen;
+}
+
+// One record per distinct key: sorted by key, or in first-seen order with
+// --first, each behind its count with -c (as uniq -c prints it).
+static int uniq_flush_batch(void *vcfg, FpBatch *b) {
+    uniq_cfg *c = vcfg;
+    if (!c->keep_lines) return 0;
+    if (!c->first && !c->order && c->tab.n) {
+        if (!(c->order = malloc(c->tab.n * sizeof *c->order))) return -1;
+        for (size_t i = 0; i < c->tab.n; i++) c->order[i] = &c->tab.ents[i];
+        qsort(c->order, c->tab.n, sizeof *c->order, uniq_key_cmp);
+    }
+    while (c->next < c->tab.n && !fp_batch_full(b)) {
+        size_t e = c->order ? (size_t)(c->order[c->next] - c->tab.ents) : c->next;
+        const uniq_val *v = fp_htab_val(&c->tab, e);
+        char *w = fp_batch_reserve(b, v->len + 32);
+        if (!w) return -1;
+        size_t o = c->count ? (size_t)sprintf(w, "%7" PRIu64 " ", v->count) : 0;
+        memcpy(w + o, v->line, v->len);
+        o += v->len;
+        w[o++] = '\n';
+        b->dlen += o;
+        if (fp_batch_add(b, w, o) < 0) return -1;
+        c->next++;
+    }
+    return b->n > 0;
+}
+
+static void uniq_destroy(void *vcfg) {
+    uniq_cfg *c = vcfg;
+    if (!c) return;
+    fp_htab_free(&c->tab);
+    free(c->order);
+    free(c);
+}
+
+static void uniq_explain(void *vcfg, FILE *out) {
+    uniq_cfg *c = vcfg;
+    fputs(c->count ? "-c " : "", out);
+    if (c->field) fprintf(out, "-d '%c' -f %zu ", c->delim, c->field);
+    fputs(!c->first ? "[sorted at end]" : c->count ? "[first seen, at end]" : "[first seen, streamed]", out);
+    if (c->max_bytes) fprintf(out, " -S %s", c->max_arg);
+}
+
+static const OpSpec SPEC = {
+    .name="fp_uniq", .kind=OP_MAP,
+    .parse=uniq_parse, .init=NULL,
+    .consume=NULL, .produce=NULL, .accept=NULL,
+    .flush=NULL, .destroy=uniq_destroy, .should_stop=NULL,
+    .consume_batch=uniq_consume_batch, .flush_batch=uniq_flush_batch,
+    .explain=uniq_explain
+};
+
+const OpSpec *op_uniq_spec(){ return &SPEC; }
@@ -0,0 +1,110 @@
+// src/plan_opt.c
+// Plan optimizer: rewrites run between fx_build_plan() and engine_run_plan().
+// Rules only use what ops report through OpSpec.props/fuse, so any op can opt in.
+#include "engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned step_props(const PlanStep *st) {
+    return st->spec->props ? st->spec->props(st->cfg) : 0;
+}
+
+static const char *kind_name(OpKind k) {
+    switch (k) {
+    case OP_SRC:    return "SRC";
+    case OP_MAP:    return "MAP";
+    case OP_FILTER: return "FILTER";
+    case OP_SINK:   return "SINK";
+    }
+    return "?";
+}
+
+static void remove_step(Plan *p, int i) {
+    memmove(&p->steps[i], &p->steps[i+1], sizeof(PlanStep) * (size_t)(p->nsteps - i - 1));
+    p->nsteps--;
+}
+
+// Rule 1: a case-blind FILTER runs before a case-only MAP (e.g. tr a-z A-Z
+// then grep -i): same verdicts, and dropped records skip the map.
+static int hoist_filters(Plan *p, FILE *log) {
+    int n = 0;
+    for (int moved = 1; moved; ) {
+        moved = 0;
+        for (int i = 0; i + 1 < p->nsteps; i++) {
+            PlanStep *m = &p->steps[i], *f = &p->steps[i+1];
+            if (m->spec->kind != OP_MAP || f->spec->kind != OP_FILTER) continue;
+            if (!(step_props(m) & FP_PROP_CASE_ONLY) || !(step_props(f) & FP_PROP_CASE_BLIND)) continue;
+            PlanStep t = *m; *m = *f; *f = t;
+            if (log) fprintf(log, "rewrite: hoist %s ahead of %s\n", m->spec->name, f->spec->name);
+            moved = 1; n++;
+        }
+    }
+    return n;
+}
+
+// Rule 2: adjacent steps of the same op merge when the op knows how
+// (consecutive tr tables compose, chained grep -F filters conjoin).
+static int fuse_adjacent(Plan *p, FILE *log) {
+    int n = 0;
+    for (int i = 0; i + 1 < p->nsteps; ) {
+        PlanStep *a = &p->steps[i], *b = &p->steps[i+1];
+        if (a->spec == b->spec && a->spec->kind != OP_SRC && a->spec->fuse &&
+            a->spec->fuse(a->cfg, b->cfg)) {
+            if (log) fprintf(log, "rewrite: fuse %s into previous %s\n", b->spec->name, a->spec->name);
+            if (b->spec->destroy && b->cfg) b->spec->destroy(b->cfg);
+            remove_step(p, i+1);
+            n++;
+            continue;
+        }
+        i++;
+    }
+    return n;
+}
+
+// Rule 3: a trailing take N behind only 1:1 maps becomes a record limit on
+// the sources, so they stop reading after N records.
+static int take_to_limit(Plan *p, FILE *log) {
+    if (p->nsteps < 2 || p->limit > 0) return 0;
+    PlanStep *tail = &p->steps[p->nsteps-1];
+    if (tail->spec->kind != OP_SINK || !tail->spec->limit) return 0;
+    for (int i = 0; i < p->nsteps - 1; i++) {
+        const PlanStep *st = &p->steps[i];
+        if (st->spec->kind == OP_SRC) continue;
+        if (st->spec->kind != OP_MAP || !(step_props(st) & FP_PROP_1TO1)) return 0;
+    }
+    long n = tail->spec->limit(tail->cfg);
+    if (n <= 0) return 0;
+    if (log) fprintf(log, "rewrite: %s %ld => source limit\n", tail->spec->name, n);
+    if (tail->spec->destroy && tail->cfg) tail->spec->destroy(tail->cfg);
+    p->nsteps--;
+    p->limit = n;
+    return 1;
+}
+
+int engine_optimize_plan(Plan *p, FILE *log) {
+    if (!p || p->nsteps < 2) return 0;
+    int n = hoist_filters(p, log);
+    n += fuse_adjacent(p, log);
+    n += take_to_limit(p, log);
+    return n;
+}
+
+void engine_explain_plan(const Plan *p, FILE *out) {
+    fprintf(out, "plan: %d step%s", p->nsteps, p->nsteps == 1 ? "" : "s");
+    if (p->limit > 0) fprintf(out, ", source limit %ld", p->limit);
+    if (p->nthreads > 1) fprintf(out, ", %d workers%s", p->nthreads, p->unordered ? " (unordered)" : "");
+    fputc('\n', out);
+    for (int i = 0; i < p->nsteps; i++) {
+        const PlanStep *st = &p->steps[i];
+        fprintf(out, "  %d %-6s %s", i, kind_name(st->spec->kind), st->spec->name);
+        if (st->spec->explain) {
+            fprintf(out, "%*s", (int)(9 - strlen(st->spec->name) % 9), "");
+            st->spec->explain(st->cfg, out);
+        }
+        fputc('\n', out);
+    }
+    if (p->nsteps == 0 || p->steps[p->nsteps-1].spec->kind != OP_SINK)
+        fprintf(out, "  -> stdout\n");
+}
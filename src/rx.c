@@ -0,0 +1,930 @@
+// src/rx.c
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "rx.h"
+#include "search.h"
+
+#include <ctype.h>
+#include <langinfo.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RX_MAX_NFA   8192   /* bigger expansions ({m,n} copies) go to regcomp */
+#define RX_DUP_MAX   255    /* ditto for interval bounds */
+#define RX_MAX_DEPTH 200    /* group nesting */
+#define RX_LIT_MAX   64     /* required-literal buffers */
+
+/* ---------------- parse: pattern -> syntax tree ---------------- */
+
+typedef struct { uint64_t w[4]; } rx_bits;
+
+static inline void bits_set(rx_bits *b, int c) { b->w[c >> 6] |= 1ull << (c & 63); }
+static inline void bits_clr(rx_bits *b, int c) { b->w[c >> 6] &= ~(1ull << (c & 63)); }
+static inline int  bits_has(const rx_bits *b, int c) { return (int)((b->w[c >> 6] >> (c & 63)) & 1); }
+static void bits_range(rx_bits *b, int lo, int hi) { for (int c = lo; c <= hi; c++) bits_set(b, c); }
+
+enum { A_SET, A_CAT, A_ALT, A_REP, A_BOL, A_EOL, A_EMPTY };
+
+typedef struct {
+    int op;
+    int set;           /* A_SET: index into sets */
+    int min, max;      /* A_REP: max < 0 is unbounded */
+    int kid, nkid;     /* A_CAT/A_ALT: kids[kid..kid+nkid); A_REP: operand node in kid */
+} rx_ast;
+
+typedef struct {
+    const char *p;     /* cursor */
+    int ext, icase, utf8, ranges;
+    rx_ast  *n;    int nn, capn;
+    rx_bits *sets; int nsets, capsets;
+    int     *kids; int nkids, capkids;
+    int      fail;     /* unsupported or malformed: leave it to regcomp */
+} rx_parser;
+
+static int grow(void *pp, int *cap, int need, size_t sz) {
+    if (need <= *cap) return 0;
+    int nc = *cap ? *cap * 2 : 16;
+    while (nc < need) nc *= 2;
+    void *np = realloc(*(void **)pp, (size_t)nc * sz);
+    if (!np) return -1;
+    *(void **)pp = np;
+    *cap = nc;
+    return 0;
+}
+
+static int node(rx_parser *ps, int op) {
+    if (ps->fail || grow(&ps->n, &ps->capn, ps->nn + 1, sizeof *ps->n) < 0) { ps->fail = 1; return -1; }
+    ps->n[ps->nn] = (rx_ast){ .op = op, .set = -1, .kid = -1 };
+    return ps->nn++;
+}
+
+static int set_node(rx_parser *ps, const rx_bits *b) {
+    int a = node(ps, A_SET);
+    if (a < 0 || grow(&ps->sets, &ps->capsets, ps->nsets + 1, sizeof *ps->sets) < 0) { ps->fail = 1; return -1; }
+    ps->sets[ps->nsets] = *b;
+    ps->n[a].set = ps->nsets++;
+    return a;
+}
+
+// CAT or ALT over k[0..nk); a single operand stands for itself.
+static int list_node(rx_parser *ps, int op, const int *k, int nk) {
+    if (nk == 1) return k[0];
+    int a = node(ps, op);
+    if (a < 0 || grow(&ps->kids, &ps->capkids, ps->nkids + nk, sizeof *ps->kids) < 0) { ps->fail = 1; return -1; }
+    memcpy(ps->kids + ps->nkids, k, (size_t)nk * sizeof *k);
+    ps->n[a].kid = ps->nkids;
+    ps->n[a].nkid = nk;
+    ps->nkids += nk;
+    return a;
+}
+
+static void fold_case(rx_bits *b) {
+    for (int c = 0; c < 256; c++)
+        if (bits_has(b, c)) { bits_set(b, tolower(c)); bits_set(b, toupper(c)); }
+}
+
+static int lit_node(rx_parser *ps, unsigned char c) {
+    rx_bits b = {{0}};
+    bits_set(&b, c);
+    if (ps->icase) fold_case(&b);
+    return set_node(ps, &b);
+}
+
+// In a UTF-8 locale '.' and negated brackets match one whole character, so
+// they become: the allowed ASCII bytes, or a well-formed multibyte sequence
+// (invalid bytes match neither, as with glibc).
+static int utf8_any(rx_parser *ps, const rx_bits *ascii) {
+    static const unsigned char seqs[][4][2] = {
+        { {0xC2,0xDF}, {0x80,0xBF} },
+        { {0xE0,0xE0}, {0xA0,0xBF}, {0x80,0xBF} },
+        { {0xE1,0xEF}, {0x80,0xBF}, {0x80,0xBF} },
+        { {0xF0,0xF0}, {0x90,0xBF}, {0x80,0xBF}, {0x80,0xBF} },
+        { {0xF1,0xF3}, {0x80,0xBF}, {0x80,0xBF}, {0x80,0xBF} },
+        { {0xF4,0xF4}, {0x80,0x8F}, {0x80,0xBF}, {0x80,0xBF} },
+    };
+    static const int seqlen[] = { 2, 3, 3, 4, 4, 4 };
+    int alts[7], na = 0;
+    alts[na++] = set_node(ps, ascii);
+    for (int s = 0; s < 6; s++) {
+        int k[4];
+        for (int j = 0; j < seqlen[s]; j++) {
+            rx_bits b = {{0}};
+            bits_range(&b, seqs[s][j][0], seqs[s][j][1]);
+            k[j] = set_node(ps, &b);
+        }
+        alts[na++] = list_node(ps, A_CAT, k, seqlen[s]);
+    }
+    return list_node(ps, A_ALT, alts, na);
+}
+
+static int dot_node(rx_parser *ps) {
+    rx_bits b = {{0}};
+    bits_range(&b, 0, ps->utf8 ? 0x7f : 0xff);
+    bits_clr(&b, '\n');
+    return ps->utf8 ? utf8_any(ps, &b) : set_node(ps, &b);
+}
+
+// [:name:] members. Multibyte locales only get the classes that are pure
+// ASCII there; [:alpha:] and friends also cover non-ASCII letters.
+static int class_bits(const rx_parser *ps, const char *name, size_t len, rx_bits *b) {
+    static const struct { const char *name; int (*is)(int); int ascii; } tab[] = {
+        { "alpha", isalpha, 0 }, { "digit", isdigit, 1 }, { "alnum", isalnum, 0 },
+        { "upper", isupper, 0 }, { "lower", islower, 0 }, { "space", isspace, 0 },
+        { "blank", isblank, 0 }, { "punct", ispunct, 0 }, { "print", isprint, 0 },
+        { "graph", isgraph, 0 }, { "cntrl", iscntrl, 0 }, { "xdigit", isxdigit, 1 },
+    };
+    for (size_t k = 0; k < sizeof tab / sizeof tab[0]; k++) {
+        if (strlen(tab[k].name) != len || memcmp(tab[k].name, name, len) != 0) continue;
+        if (ps->utf8 && !tab[k].ascii) return -1;
+        for (int c = 0; c < 256; c++) if (tab[k].is(c)) bits_set(b, c);
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_bracket(rx_parser *ps) {
+    const char *p = ps->p;   /* just past '[' */
+    rx_bits b = {{0}};
+    int neg = 0, first = 1;
+    if (*p == '^') { neg = 1; p++; }
+    for (;;) {
+        unsigned char c = (unsigned char)*p;
+        if (!c) { ps->fail = 1; return -1; }
+        if (c == ']' && !first) { p++; break; }
+        first = 0;
+        if (c == '[' && (p[1] == '.' || p[1] == '=')) { ps->fail = 1; return -1; }
+        if (c == '[' && p[1] == ':') {
+            const char *e = strstr(p + 2, ":]");
+            if (!e || class_bits(ps, p + 2, (size_t)(e - p - 2), &b) < 0) { ps->fail = 1; return -1; }
+            p = e + 2;
+            continue;
+        }
+        p++;
+        if (*p == '-' && p[1] && p[1] != ']') {
+            unsigned char hi = (unsigned char)p[1];
+            if (!ps->ranges || hi < c || (hi == '[' && strchr(".=:", p[2]))) { ps->fail = 1; return -1; }
+            bits_range(&b, c, hi);
+            p += 2;
+            continue;
+        }
+        bits_set(&b, c);
+    }
+    ps->p = p;
+    if (ps->icase) fold_case(&b);
+    if (!neg) return set_node(ps, &b);
+    for (int w = 0; w < 4; w++) b.w[w] = ~b.w[w];
+    bits_clr(&b, '\n');
+    if (!ps->utf8) return set_node(ps, &b);
+    b.w[2] = b.w[3] = 0;
+    return utf8_any(ps, &b);
+}
+
+// {m}, {m,}, {m,n} after the opening brace; close is "}" or "\}".
+static int parse_interval(rx_parser *ps, int *min, int *max) {
+    const char *p = ps->p;
+    char *e;
+    if (*p < '0' || *p > '9') return -1;
+    long m = strtol(p, &e, 10), n = m;
+    p = e;
+    if (*p == ',') {
+        p++;
+        n = -1;
+        if (*p >= '0' && *p <= '9') { n = strtol(p, &e, 10); p = e; }
+    }
+    if (!ps->ext && *p++ != '\\') return -1;
+    if (*p++ != '}') return -1;
+    if (m > RX_DUP_MAX || n > RX_DUP_MAX || (n >= 0 && n < m)) return -1;
+    ps->p = p;
+    *min = (int)m; *max = (int)n;
+    return 0;
+}
+
+static int parse_alt(rx_parser *ps, int depth);
+
+static int parse_atom(rx_parser *ps, int depth) {
+    const char *p = ps->p;
+    unsigned char c = (unsigned char)*p;
+    if (ps->ext) {
+        switch (c) {
+        case '(': {
+            ps->p = p + 1;
+            if (*ps->p == ')') { ps->fail = 1; return -1; }
+            int a = parse_alt(ps, depth + 1);
+            if (ps->fail || *ps->p != ')') { ps->fail = 1; return -1; }
+            ps->p++;
+            return a;
+        }
+        case '*': case '+': case '?': case '{': case ')':
+            ps->fail = 1; return -1;
+        case '^': ps->p++; return node(ps, A_BOL);
+        case '$': ps->p++; return node(ps, A_EOL);
+        }
+    } else if (c == '\\' && p[1] == '(') {
+        ps->p = p + 2;
+        if (ps->p[0] == '\\' && ps->p[1] == ')') { ps->fail = 1; return -1; }
+        int a = parse_alt(ps, depth + 1);
+        if (ps->fail || ps->p[0] != '\\' || ps->p[1] != ')') { ps->fail = 1; return -1; }
+        ps->p += 2;
+        return a;
+    } else if (c == '$' && (!p[1] || (p[1] == '\\' && (p[2] == ')' || p[2] == '|')))) {
+        ps->p++;
+        return node(ps, A_EOL);
+    }
+    switch (c) {
+    case '.': ps->p++; return dot_node(ps);
+    case '[': ps->p++; return parse_bracket(ps);
+    case '\\':
+        c = (unsigned char)p[1];
+        /* back-references, \w, \<, \{ out of place, ... */
+        if (!c || isalnum(c) || strchr("<>`'", c) || (!ps->ext && strchr("{}()|+?", c))) { ps->fail = 1; return -1; }
+        ps->p += 2;
+        return lit_node(ps, c);
+    }
+    ps->p++;
+    return lit_node(ps, c);
+}
+
+// Postfix operator after an atom, if any.
+static int parse_quant(rx_parser *ps, int a) {
+    while (a >= 0) {
+        const char *p = ps->p;
+        int min, max;
+        if (*p == '*') { ps->p++; min = 0; max = -1; }
+        else if (ps->ext && *p == '+') { ps->p++; min = 1; max = -1; }
+        else if (ps->ext && *p == '?') { ps->p++; min = 0; max = 1; }
+        else if (!ps->ext && p[0] == '\\' && p[1] == '+') { ps->p += 2; min = 1; max = -1; }
+        else if (!ps->ext && p[0] == '\\' && p[1] == '?') { ps->p += 2; min = 0; max = 1; }
+        else if (ps->ext ? *p == '{' : (p[0] == '\\' && p[1] == '{')) {
+            ps->p += ps->ext ? 1 : 2;
+            if (parse_interval(ps, &min, &max) < 0) { ps->fail = 1; return -1; }
+        } else {
+            return a;
+        }
+        /* quantified anchors, and stacked quantifiers (glibc rejects some) */
+        int op = ps->n[a].op;
+        if (op == A_BOL || op == A_EOL || op == A_REP) { ps->fail = 1; return -1; }
+        int r = node(ps, A_REP);
+        if (r < 0) return -1;
+        ps->n[r].kid = a; ps->n[r].min = min; ps->n[r].max = max;
+        a = r;
+    }
+    return -1;
+}
+
+static int at_branch_end(const rx_parser *ps, int depth) {
+    const char *p = ps->p;
+    if (!*p) return 1;
+    if (ps->ext) return *p == '|' || (*p == ')' && depth > 0);
+    return p[0] == '\\' && (p[1] == '|' || (p[1] == ')' && depth > 0));
+}
+
+static int parse_branch(rx_parser *ps, int depth) {
+    int *k = NULL, nk = 0, capk = 0, a;
+    if (!ps->ext && *ps->p == '^') {             /* BRE: anchor only up front */
+        ps->p++;
+        if ((a = node(ps, A_BOL)) < 0 || grow(&k, &capk, nk + 1, sizeof *k) < 0) goto fail;
+        k[nk++] = a;
+        if (*ps->p == '*') {                      /* and a leading '*' is literal */
+            ps->p++;
+            if ((a = parse_quant(ps, lit_node(ps, '*'))) < 0 || grow(&k, &capk, nk + 1, sizeof *k) < 0) goto fail;
+            k[nk++] = a;
+        }
+    } else if (!ps->ext && *ps->p == '*') {
+        ps->p++;
+        if ((a = parse_quant(ps, lit_node(ps, '*'))) < 0 || grow(&k, &capk, nk + 1, sizeof *k) < 0) goto fail;
+        k[nk++] = a;
+    }
+    while (!ps->fail && !at_branch_end(ps, depth)) {
+        if (!ps->ext && ps->p[0] == '^') {        /* mid-branch '^' is literal in a BRE */
+            ps->p++;
+            a = lit_node(ps, '^');
+        } else {
+            a = parse_atom(ps, depth);
+        }
+        if (a < 0 || (a = parse_quant(ps, a)) < 0 || grow(&k, &capk, nk + 1, sizeof *k) < 0) goto fail;
+        k[nk++] = a;
+    }
+    if (ps->fail || nk == 0) goto fail;          /* empty branches: regcomp decides */
+    a = list_node(ps, A_CAT, k, nk);
+    free(k);
+    return a;
+fail:
+    ps->fail = 1;
+    free(k);
+    return -1;
+}
+
+static int parse_alt(rx_parser *ps, int depth) {
+    int *k = NULL, nk = 0, capk = 0;
+    if (depth > RX_MAX_DEPTH) { ps->fail = 1; return -1; }
+    for (;;) {
+        int a = parse_branch(ps, depth);
+        if (a < 0 || grow(&k, &capk, nk + 1, sizeof *k) < 0) { ps->fail = 1; free(k); return -1; }
+        k[nk++] = a;
+        if (ps->ext && *ps->p == '|') ps->p++;
+        else if (!ps->ext && ps->p[0] == '\\' && ps->p[1] == '|') ps->p += 2;
+        else break;
+    }
+    int a = list_node(ps, A_ALT, k, nk);
+    free(k);
+    return a;
+}
+
+/* ---------------- required literals ---------------- */
+
+// What every match of a subtree contains: its exact text when it has only
+// one (ex), a required prefix and suffix, and the longest required infix.
+// Under -i the text is folded to lower case. Buffers are capped; a cut
+// prefix keeps its head, a cut suffix its tail.
+typedef struct {
+    int    ex;
+    size_t exlen, prelen, suflen, mustlen;
+    char   exact[RX_LIT_MAX], pre[RX_LIT_MAX], suf[RX_LIT_MAX], must[RX_LIT_MAX];
+} rx_lits;
+
+static void lits_empty(rx_lits *l, int ex) { l->ex = ex; l->exlen = l->prelen = l->suflen = l->mustlen = 0; }
+
+static size_t join(char *dst, const char *a, size_t al, const char *b, size_t bl, int keep_tail) {
+    char tmp[2 * RX_LIT_MAX];
+    memcpy(tmp, a, al);
+    memcpy(tmp + al, b, bl);
+    size_t n = al + bl, from = 0;
+    if (n > RX_LIT_MAX) { from = keep_tail ? n - RX_LIT_MAX : 0; n = RX_LIT_MAX; }
+    memmove(dst, tmp + from, n);
+    return n;
+}
+
+static void keep_longer(rx_lits *l, const char *s, size_t n) {
+    if (n > l->mustlen) { memcpy(l->must, s, n); l->mustlen = n; }
+}
+
+// The single byte a set stands for, or -1 (under -i, an ASCII letter pair).
+static int set_char(const rx_parser *ps, const rx_bits *b) {
+    int c = -1, n = 0;
+    for (int i = 0; i < 256; i++) if (bits_has(b, i)) { if (n++ == 0) c = i; }
+    if (n == 1) return ps->icase && c >= 0x80 ? -1 : c;
+    if (n == 2 && ps->icase && c >= 'A' && c <= 'Z' && bits_has(b, c + 32)) return c + 32;
+    return -1;
+}
+
+static void lits_of(const rx_parser *ps, int a, rx_lits *out) {
+    const rx_ast *x = &ps->n[a];
+    switch (x->op) {
+    case A_SET: {
+        int c = set_char(ps, &ps->sets[x->set]);
+        lits_empty(out, c >= 0);
+        if (c >= 0) {
+            out->exact[0] = out->pre[0] = out->suf[0] = out->must[0] = (char)c;
+            out->exlen = out->prelen = out->suflen = out->mustlen = 1;
+        }
+        return;
+    }
+    case A_BOL: case A_EOL: case A_EMPTY:
+        lits_empty(out, 1);
+        return;
+    case A_CAT: {
+        rx_lits k;
+        lits_empty(out, 1);
+        for (int i = 0; i < x->nkid; i++) {
+            lits_of(ps, ps->kids[x->kid + i], &k);
+            char junc[RX_LIT_MAX];
+            size_t jl = join(junc, out->suf, out->suflen, k.pre, k.prelen, 0);
+            keep_longer(out, k.must, k.mustlen);
+            keep_longer(out, junc, jl);
+            if (out->ex) out->prelen = join(out->pre, out->exact, out->exlen, k.pre, k.prelen, 0);
+            out->suflen = k.ex ? join(out->suf, out->suf, out->suflen, k.exact, k.exlen, 1)
+                               : (memcpy(out->suf, k.suf, k.suflen), k.suflen);
+            if (out->ex && k.ex && out->exlen + k.exlen <= RX_LIT_MAX)
+                out->exlen = join(out->exact, out->exact, out->exlen, k.exact, k.exlen, 0);
+            else
+                out->ex = 0;
+        }
+        keep_longer(out, out->pre, out->prelen);
+        keep_longer(out, out->suf, out->suflen);
+        return;
+    }
+    case A_ALT: {
+        rx_lits k;
+        lits_of(ps, ps->kids[x->kid], out);
+        for (int i = 1; i < x->nkid; i++) {
+            lits_of(ps, ps->kids[x->kid + i], &k);
+            if (out->ex && !(k.ex && k.exlen == out->exlen && memcmp(k.exact, out->exact, k.exlen) == 0))
+                out->ex = 0;
+            size_t n = 0;
+            while (n < out->prelen && n < k.prelen && out->pre[n] == k.pre[n]) n++;
+            out->prelen = n;
+            n = 0;
+            while (n < out->suflen && n < k.suflen && out->suf[out->suflen-1-n] == k.suf[k.suflen-1-n]) n++;
+            memmove(out->suf, out->suf + out->suflen - n, n);
+            out->suflen = n;
+        }
+        if (!out->ex) {
+            out->mustlen = 0;
+            keep_longer(out, out->pre, out->prelen);
+            keep_longer(out, out->suf, out->suflen);
+        }
+        return;
+    }
+    case A_REP: {
+        if (x->min == 0) { lits_empty(out, x->max == 0); return; }
+        lits_of(ps, x->kid, out);
+        if (x->max != 1) out->ex = 0;   /* prefix, suffix and infix still hold */
+        return;
+    }
+    }
+}
+
+/* ---------------- NFA and lazy DFA ---------------- */
+
+enum { N_SET, N_SPLIT, N_BOL, N_EOL, N_MATCH };
+
+typedef struct {
+    int op;
+    int out, out1;     /* N_SPLIT takes both */
+    int set;
+} rx_nfa;
+
+typedef struct {
+    uint32_t off, n;   /* NFA states, sorted, in pool[off..off+n) */
+    uint32_t hash;
+    int      eol[2];   /* accepts at end of line (not / also at line start): -1 not yet known */
+} rx_dstate;
+
+/* DFA table entries are state * ncls, so the hot loop is one add and one
+   load per byte. Entries into accepting or dead states carry a flag (a
+   match ends the scan, a dead state skips to the next '\n'), so a single
+   compare keeps them and unfilled entries off the fast path. */
+#define RX_UNK  0xFFFFFFFFu
+#define RX_ACC  0x80000000u
+#define RX_DEAD 0x40000000u
+
+enum { PF_NONE, PF_MUST, PF_ALTS };
+
+struct fp_rx {
+    rx_nfa   *nfa;  int nn, capnn;
+    int       start, match;
+    rx_bits  *sets; int nsets;
+    uint8_t   cls[256];
+    uint32_t  ncls;
+
+    rx_dstate *ds;   int nd, capds;
+    uint32_t  *pool; int npool, cappool;
+    uint32_t  *tr;   int ntr, captr;
+    uint32_t  *ht;   uint32_t htcap;   /* open addressing, dstate index + 1 */
+    uint32_t   s0;                      /* start entry */
+    uint32_t   flushes;
+    uint32_t  *start_list, nstart;
+    /* Idle: the state off line start with no match in progress, where the
+       scan spends most of its time. Only bytes in esc leave it, so there
+       the loop skips ahead with a table lookup per byte and no dependency
+       on the state. */
+    uint32_t   idle;                    /* entry (RX_UNK: out of memory) */
+    uint32_t  *idle_list, nidle;
+    int        accel;
+    uint8_t    esc[256];
+    int        empty_ok;
+
+    uint32_t  *mark, gen;      /* closure scratch */
+    uint32_t  *stack, *list;
+
+    int          pf;
+    int          must_is_prefix;
+    fp_finder    must;
+    fp_multilit *alts;
+    char         desc[RX_LIT_MAX + 32];
+};
+
+static int nfa_new(fp_rx *r, int op, int out, int out1, int set) {
+    if (r->nn >= RX_MAX_NFA || grow(&r->nfa, &r->capnn, r->nn + 1, sizeof *r->nfa) < 0) return -1;
+    r->nfa[r->nn] = (rx_nfa){ op, out, out1, set };
+    return r->nn++;
+}
+
+// Thompson construction, back to front: emit(a, next) returns the entry
+// state of a subtree whose exits all lead to next.
+static int emit(fp_rx *r, const rx_parser *ps, int a, int next) {
+    const rx_ast *x = &ps->n[a];
+    int s;
+    switch (x->op) {
+    case A_SET:   return nfa_new(r, N_SET, next, -1, x->set);
+    case A_BOL:   return nfa_new(r, N_BOL, next, -1, -1);
+    case A_EOL:   return nfa_new(r, N_EOL, next, -1, -1);
+    case A_EMPTY: return next;
+    case A_CAT:
+        for (int k = x->nkid - 1; k >= 0 && next >= 0; k--) next = emit(r, ps, ps->kids[x->kid + k], next);
+        return next;
+    case A_ALT:
+        s = emit(r, ps, ps->kids[x->kid + x->nkid - 1], next);
+        for (int k = x->nkid - 2; k >= 0 && s >= 0; k--) {
+            int b = emit(r, ps, ps->kids[x->kid + k], next);
+            s = b < 0 ? -1 : nfa_new(r, N_SPLIT, b, s, -1);
+        }
+        return s;
+    case A_REP:
+        if (x->max < 0) {
+            int l = nfa_new(r, N_SPLIT, -1, next, -1);
+            int body = l < 0 ? -1 : emit(r, ps, x->kid, l);
+            if (body < 0) return -1;
+            r->nfa[l].out = body;
+            if (x->min == 0) return l;
+            s = body;
+            for (int i = 1; i < x->min && s >= 0; i++) s = emit(r, ps, x->kid, s);
+            return s;
+        }
+        s = next;
+        for (int i = x->min; i < x->max && s >= 0; i++) {
+            int b = emit(r, ps, x->kid, s);
+            s = b < 0 ? -1 : nfa_new(r, N_SPLIT, b, next, -1);
+        }
+        for (int i = 0; i < x->min && s >= 0; i++) s = emit(r, ps, x->kid, s);
+        return s;
+    }
+    return -1;
+}
+
+// Add the epsilon closure of s to r->list. ^ and $ are crossed only where
+// they hold; an unsatisfied $ stays in the list to be retried at the end.
+static void closure(fp_rx *r, int s, int bol, int eol, uint32_t *n) {
+    uint32_t sp = 0;
+    r->stack[sp++] = (uint32_t)s;
+    while (sp) {
+        uint32_t x = r->stack[--sp];
+        if (r->mark[x] == r->gen) continue;
+        r->mark[x] = r->gen;
+        const rx_nfa *q = &r->nfa[x];
+        switch (q->op) {
+        case N_SPLIT: r->stack[sp++] = (uint32_t)q->out1; r->stack[sp++] = (uint32_t)q->out; break;
+        case N_BOL:   if (bol) r->stack[sp++] = (uint32_t)q->out; break;
+        case N_EOL:   if (eol) r->stack[sp++] = (uint32_t)q->out; else r->list[(*n)++] = x; break;
+        default:      r->list[(*n)++] = x; break;
+        }
+    }
+}
+
+static void next_gen(fp_rx *r) {
+    if (++r->gen == 0) { memset(r->mark, 0, (size_t)r->nn * sizeof *r->mark); r->gen = 1; }
+}
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t list_hash(const uint32_t *l, uint32_t n) {
+    uint32_t h = 2166136261u ^ n;
+    for (uint32_t i = 0; i < n; i++) h = (h ^ l[i]) * 16777619u;
+    return h;
+}
+
+static void ht_put(fp_rx *r, uint32_t d) {
+    uint32_t m = r->htcap - 1, i = r->ds[d].hash & m;
+    while (r->ht[i]) i = (i + 1) & m;
+    r->ht[i] = d + 1;
+}
+
+static int has_match(const fp_rx *r, const uint32_t *l, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) if (l[i] == (uint32_t)r->match) return 1;
+    return 0;
+}
+
+static void cache_reset(fp_rx *r) {
+    r->nd = r->npool = r->ntr = 0;
+    memset(r->ht, 0, r->htcap * sizeof *r->ht);
+}
+
+static size_t cache_bytes(const fp_rx *r, int nd, int npool) {
+    return (size_t)nd * (r->ncls * sizeof *r->tr + sizeof *r->ds + 2 * sizeof *r->ht)
+         + (size_t)npool * sizeof *r->pool;
+}
+
+static uint32_t intern(fp_rx *r, const uint32_t *l, uint32_t n);
+
+// Drop every cached state; only the start state comes back.
+static void cache_flush(fp_rx *r) {
+    cache_reset(r);
+    r->flushes++;
+    r->s0 = intern(r, r->start_list, r->nstart);
+    r->idle = intern(r, r->idle_list, r->nidle);
+}
+
+// Table entry for the state holding NFA states l[0..n), adding it if new.
+static uint32_t intern(fp_rx *r, const uint32_t *l, uint32_t n) {
+    uint32_t h = list_hash(l, n), m = r->htcap - 1;
+    for (uint32_t i = h & m; r->ht[i]; i = (i + 1) & m) {
+        const rx_dstate *d = &r->ds[r->ht[i] - 1];
+        if (d->hash == h && d->n == n && memcmp(r->pool + d->off, l, n * sizeof *l) == 0) {
+            uint32_t e = (r->ht[i] - 1) * r->ncls;
+            return e | (has_match(r, l, n) ? RX_ACC : 0) | (n == 0 ? RX_DEAD : 0);
+        }
+    }
+    if (r->nd >= 2 && (cache_bytes(r, r->nd + 1, r->npool + (int)n) > FP_RX_CACHE_BYTES
+                       || (size_t)(r->nd + 1) * r->ncls >= RX_DEAD)) {
+        /* l may be the start list itself: copy before the flush re-adds it */
+        uint32_t *keep = malloc((n ? n : 1) * sizeof *keep);
+        if (!keep) return RX_UNK;
+        memcpy(keep, l, n * sizeof *l);
+        cache_flush(r);
+        uint32_t e = r->s0 == RX_UNK ? RX_UNK : intern(r, keep, n);
+        free(keep);
+        return e;
+    }
+    if (grow(&r->ds, &r->capds, r->nd + 1, sizeof *r->ds) < 0
+        || grow(&r->pool, &r->cappool, r->npool + (int)n, sizeof *r->pool) < 0
+        || grow(&r->tr, &r->captr, r->ntr + (int)r->ncls, sizeof *r->tr) < 0)
+        return RX_UNK;
+    if ((uint32_t)(r->nd + 1) * 2 > r->htcap) {
+        uint32_t *nh = calloc(r->htcap * 2, sizeof *nh);
+        if (!nh) return RX_UNK;
+        free(r->ht);
+        r->ht = nh;
+        r->htcap *= 2;
+        for (int d = 0; d < r->nd; d++) ht_put(r, (uint32_t)d);
+    }
+    rx_dstate *d = &r->ds[r->nd];
+    d->off = (uint32_t)r->npool;
+    d->n = n;
+    d->hash = h;
+    d->eol[0] = d->eol[1] = -1;
+    memcpy(r->pool + r->npool, l, n * sizeof *l);
+    r->npool += (int)n;
+    for (uint32_t c = 0; c < r->ncls; c++) r->tr[r->ntr + (int)c] = RX_UNK;
+    r->ntr += (int)r->ncls;
+    ht_put(r, (uint32_t)r->nd);
+    uint32_t e = (uint32_t)r->nd++ * r->ncls;
+    return e | (has_match(r, l, n) ? RX_ACC : 0) | (n == 0 ? RX_DEAD : 0);
+}
+
+// Fill the table entry for state e on byte c. The start state is re-entered
+// at every position, which makes the search unanchored.
+static uint32_t step(fp_rx *r, uint32_t e, unsigned char c) {
+    const rx_dstate *d = &r->ds[e / r->ncls];
+    uint32_t n = 0;
+    next_gen(r);
+    for (uint32_t i = 0; i < d->n; i++) {
+        const rx_nfa *q = &r->nfa[r->pool[d->off + i]];
+        if (q->op == N_SET && bits_has(&r->sets[q->set], c)) closure(r, q->out, 0, 0, &n);
+    }
+    closure(r, r->start, 0, 0, &n);
+    qsort(r->list, n, sizeof *r->list, u32_cmp);
+    uint32_t flushes = r->flushes;
+    uint32_t x = intern(r, r->list, n);
+    if (x != RX_UNK && r->flushes == flushes) r->tr[e + r->cls[c]] = x;   /* e is gone after a flush */
+    return x;
+}
+
+static int at_eol(fp_rx *r, uint32_t e, int bol) {
+    rx_dstate *d = &r->ds[e / r->ncls];
+    if (d->eol[bol] < 0) {
+        uint32_t n = 0;
+        next_gen(r);
+        for (uint32_t i = 0; i < d->n; i++) {
+            const rx_nfa *q = &r->nfa[r->pool[d->off + i]];
+            if (q->op == N_EOL) closure(r, q->out, bol, 1, &n);
+        }
+        d->eol[bol] = has_match(r, r->list, n);
+    }
+    return d->eol[bol];
+}
+
+// Run the automaton from state e at p over whole lines up to end; line is
+// where p's line starts (for ^ at a '\n'). Returns a pointer into the first
+// line with a match, or NULL.
+static const char *scan(fp_rx *r, const unsigned char *line, const unsigned char *p,
+                        const unsigned char *end, uint32_t e) {
+    if (e & RX_ACC) return (const char *)p;
+    if (e & RX_DEAD) return NULL;
+    const uint8_t *cls = r->cls, *esc = r->esc;
+    const uint32_t *tr = r->tr;
+    uint32_t idle = r->accel ? r->idle : RX_UNK;
+    for (; p < end; p++) {
+        if (e == idle) {
+            while (p < end && !esc[*p]) p++;
+            if (p == end) break;
+        }
+        uint32_t x = tr[e + cls[*p]];
+        if (x >= RX_DEAD) {
+            if (x == RX_UNK && *p == '\n') {
+                /* REG_NEWLINE: $ holds before it, ^ after it */
+                if (at_eol(r, e, p == line || p[-1] == '\n')) return (const char *)p;
+                if (p + 1 == end) return NULL;   /* no line after the last '\n' */
+                x = r->s0;
+                if (x & RX_ACC) return (const char *)p + 1;
+            } else if (x == RX_UNK) {
+                x = step(r, e, *p);
+                if (x == RX_UNK) return NULL;   /* out of memory */
+                tr = r->tr;
+                idle = r->accel ? r->idle : RX_UNK;
+            }
+            if (x & RX_ACC) return (const char *)p;
+            if (x & RX_DEAD) {   /* nothing more on this line; try the next one */
+                const unsigned char *nl = memchr(p + 1, '\n', (size_t)(end - p - 1));
+                if (!nl) return NULL;
+                p = nl - 1;
+                x &= ~RX_DEAD;
+            }
+        }
+        e = x;
+    }
+    /* an unterminated last line ends the text: $ holds there too */
+    return end[-1] != '\n' && at_eol(r, e, 0) ? (const char *)end - 1 : NULL;
+}
+
+const char *fp_rx_find(fp_rx *r, const char *s, size_t len) {
+    if (len == 0) return r->empty_ok ? s : NULL;
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    if (r->pf == PF_NONE) return scan(r, p, p, end, r->s0);
+
+    /* only lines holding a required literal can match: run the automaton
+       over those alone */
+    while (p < end) {
+        const char *hit = r->pf == PF_MUST ? fp_finder_find(&r->must, (const char *)p, (size_t)(end - p))
+                                           : fp_multilit_find(r->alts, (const char *)p, (size_t)(end - p));
+        if (!hit) return NULL;
+        const unsigned char *h = (const unsigned char *)hit;
+        const unsigned char *ls = memrchr(p, '\n', (size_t)(h - p));
+        const unsigned char *le = memchr(h, '\n', (size_t)(end - h));
+        ls = ls ? ls + 1 : p;
+        le = le ? le + 1 : end;
+        const char *m;
+        if (r->pf == PF_MUST && r->must_is_prefix && h > ls && !(r->idle & RX_DEAD))
+            m = scan(r, ls, h, le, r->idle);   /* no match starts before the prefix */
+        else
+            m = scan(r, ls, ls, le, r->s0);
+        if (m) return m;
+        p = le;
+    }
+    return NULL;
+}
+
+int fp_rx_match(fp_rx *r, const char *s, size_t len) {
+    return fp_rx_find(r, s, len) != NULL;
+}
+
+/* ---------------- compile ---------------- */
+
+// Bytes no set tells apart share a table column. '\n' gets a column of its
+// own that is never filled, so it always takes the slow path in fp_rx_match.
+static void classes(fp_rx *r) {
+    int map[512];
+    rx_bits nl = {{0}};
+    bits_set(&nl, '\n');
+    r->ncls = 1;
+    memset(r->cls, 0, sizeof r->cls);
+    for (int s = -1; s < r->nsets; s++) {
+        const rx_bits *b = s < 0 ? &nl : &r->sets[s];
+        int n = 0;
+        for (int k = 0; k < 512; k++) map[k] = -1;
+        for (int c = 0; c < 256; c++) {
+            int key = r->cls[c] * 2 + bits_has(b, c);
+            if (map[key] < 0) map[key] = n++;
+            r->cls[c] = (uint8_t)map[key];
+        }
+        r->ncls = (uint32_t)n;
+    }
+}
+
+// Shortest of the required literals of alternation a's branches (0 if some
+// branch has none).
+static size_t alt_shortest(const rx_parser *ps, int a) {
+    const rx_ast *x = &ps->n[a];
+    size_t shortest = RX_LIT_MAX;
+    rx_lits l;
+    for (int k = 0; k < x->nkid && shortest; k++) {
+        lits_of(ps, ps->kids[x->kid + k], &l);
+        if (l.mustlen < shortest) shortest = l.mustlen;
+    }
+    return shortest;
+}
+
+static int alt_prefilter(fp_rx *r, const rx_parser *ps, int a) {
+    const rx_ast *x = &ps->n[a];
+    char (*lit)[RX_LIT_MAX] = malloc((size_t)x->nkid * sizeof *lit);
+    const char **pats = malloc((size_t)x->nkid * sizeof *pats);
+    size_t *lens = malloc((size_t)x->nkid * sizeof *lens);
+    rx_lits l;
+    if (lit && pats && lens) {
+        for (int k = 0; k < x->nkid; k++) {
+            lits_of(ps, ps->kids[x->kid + k], &l);
+            memcpy(lit[k], l.must, l.mustlen);
+            pats[k] = lit[k];
+            lens[k] = l.mustlen;
+        }
+        r->alts = fp_multilit_new(pats, lens, (size_t)x->nkid, ps->icase);
+    }
+    free(lit); free(pats); free(lens);
+    if (!r->alts) return -1;
+    r->pf = PF_ALTS;
+    snprintf(r->desc, sizeof r->desc, "dfa, %d required literals (%s)", x->nkid, fp_multilit_kind(r->alts));
+    return 0;
+}
+
+// Candidates: the literal every match contains, or for an alternation at
+// the top (a|b|c, or one term of a concatenation like (a|b)/c), one
+// literal per branch. The one whose shortest literal is longest wins; the
+// single literal on ties, as fp_finder is the cheaper scan.
+static void prefilter(fp_rx *r, const rx_parser *ps, int root) {
+    rx_lits l;
+    lits_of(ps, root, &l);
+    const rx_ast *x = &ps->n[root];
+    const int *terms = x->op == A_CAT ? ps->kids + x->kid : &root;
+    int nterms = x->op == A_CAT ? x->nkid : 1, best_alt = -1;
+    size_t best = l.mustlen;
+    for (int i = 0; i < nterms; i++) {
+        int a = terms[i];
+        while (ps->n[a].op == A_REP && ps->n[a].min > 0) a = ps->n[a].kid;
+        if (ps->n[a].op != A_ALT) continue;
+        size_t shortest = alt_shortest(ps, a);
+        if (shortest > best) { best = shortest; best_alt = a; }
+    }
+    if (best_alt >= 0 && alt_prefilter(r, ps, best_alt) == 0) return;
+    if (l.mustlen == 0 || fp_finder_init(&r->must, l.must, l.mustlen, ps->icase) != 0) return;
+    r->pf = PF_MUST;
+    /* every match starts with it: the scan can start at the first one */
+    r->must_is_prefix = l.prelen == l.mustlen && memcmp(l.pre, l.must, l.mustlen) == 0;
+    snprintf(r->desc, sizeof r->desc, "dfa, %s '%.*s'", r->must_is_prefix ? "prefix" : "must",
+             (int)l.mustlen, l.must);
+}
+
+fp_rx *fp_rx_new(const char *pat, int extended, int icase) {
+    rx_parser ps = { .p = pat, .ext = extended, .icase = icase };
+    if (MB_CUR_MAX > 1) {
+        if (strcmp(nl_langinfo(CODESET), "UTF-8") != 0) return NULL;
+        for (const char *q = pat; *q; q++) if ((unsigned char)*q >= 0x80) return NULL;
+        ps.utf8 = 1;
+    }
+    /* ranges are byte order in C and (for ASCII) in UTF-8 locales */
+    const char *coll = setlocale(LC_COLLATE, NULL);
+    ps.ranges = ps.utf8 || !coll || strcmp(coll, "C") == 0 || strcmp(coll, "POSIX") == 0;
+
+    fp_rx *r = NULL;
+    int root = parse_alt(&ps, 0);
+    if (ps.fail || *ps.p || !(r = calloc(1, sizeof *r))) goto fail;
+
+    r->sets = ps.sets; r->nsets = ps.nsets;   /* r owns them from here */
+    r->match = nfa_new(r, N_MATCH, -1, -1, -1);
+    if ((r->start = emit(r, &ps, root, r->match)) < 0) goto fail;
+    classes(r);
+
+    r->htcap = 64;
+    r->ht = calloc(r->htcap, sizeof *r->ht);
+    r->mark = calloc((size_t)r->nn, sizeof *r->mark);
+    r->stack = malloc((2 * (size_t)r->nn + 2) * sizeof *r->stack);
+    r->list = malloc((size_t)r->nn * sizeof *r->list);
+    if (!r->ht || !r->mark || !r->stack || !r->list) goto fail;
+
+    uint32_t n = 0;
+    next_gen(r);
+    closure(r, r->start, 1, 1, &n);
+    r->empty_ok = has_match(r, r->list, n);
+    n = 0;
+    next_gen(r);
+    closure(r, r->start, 1, 0, &n);
+    qsort(r->list, n, sizeof *r->list, u32_cmp);
+    if (!(r->start_list = malloc((n ? n : 1) * sizeof *r->start_list))) goto fail;
+    memcpy(r->start_list, r->list, n * sizeof *r->list);
+    r->nstart = n;
+    if ((r->s0 = intern(r, r->start_list, n)) == RX_UNK) goto fail;
+
+    n = 0;
+    next_gen(r);
+    closure(r, r->start, 0, 0, &n);
+    qsort(r->list, n, sizeof *r->list, u32_cmp);
+    if (!(r->idle_list = malloc((n ? n : 1) * sizeof *r->idle_list))) goto fail;
+    memcpy(r->idle_list, r->list, n * sizeof *r->list);
+    r->nidle = n;
+    int nesc = 0;
+    r->esc['\n'] = 1;
+    for (uint32_t i = 0; i < n; i++)
+        if (r->nfa[r->list[i]].op == N_SET)
+            for (int c = 0; c < 256; c++) r->esc[c] |= (uint8_t)bits_has(&r->sets[r->nfa[r->list[i]].set], c);
+    for (int c = 0; c < 256; c++) nesc += r->esc[c];
+    r->accel = n > 0 && nesc <= 128;   /* anchored (n == 0) patterns die instead */
+    r->idle = intern(r, r->idle_list, n);
+
+    snprintf(r->desc, sizeof r->desc, "dfa");
+    prefilter(r, &ps, root);
+    free(ps.n); free(ps.kids);
+    return r;
+fail:
+    free(ps.n); free(ps.kids);
+    if (!r) free(ps.sets);
+    fp_rx_free(r);
+    return NULL;
+}
+
+void fp_rx_free(fp_rx *r) {
+    if (!r) return;
+    if (r->pf == PF_MUST) fp_finder_free(&r->must);
+    fp_multilit_free(r->alts);
+    free(r->nfa); free(r->sets);
+    free(r->ds); free(r->pool); free(r->tr); free(r->ht);
+    free(r->start_list); free(r->idle_list);
+    free(r->mark); free(r->stack); free(r->list);
+    free(r);
+}
+
+const char *fp_rx_describe(const fp_rx *r) { return r->desc; }
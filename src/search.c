@@ -0,0 +1,503 @@
+// src/search.c
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "search.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FP_X86 1
+#endif
+
+/* ---------------- fixed-string searcher ---------------- */
+
+static int is_alpha(int c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+int fp_finder_init(fp_finder *f, const char *needle, size_t len, int icase) {
+    memset(f, 0, sizeof *f);
+    f->needle = malloc(len + 1);
+    if (!f->needle) return -1;
+    for (size_t i = 0; i < len; i++)
+        f->needle[i] = icase ? (char)fp_ascii_tolower((unsigned char)needle[i]) : needle[i];
+    f->needle[len] = '\0';
+    f->len = len;
+    f->icase = icase;
+    if (len) {
+        unsigned char a = (unsigned char)f->needle[0], z = (unsigned char)f->needle[len-1];
+        f->fold_first = (icase && is_alpha(a)) ? 0x20 : 0;
+        f->fold_last  = (icase && is_alpha(z)) ? 0x20 : 0;
+        f->first = a | f->fold_first;
+        f->last  = z | f->fold_last;
+    }
+    return 0;
+}
+
+void fp_finder_free(fp_finder *f) {
+    free(f->needle);
+    f->needle = NULL; f->len = 0;
+}
+
+/* p[0..len) equals the needle (anchors included; cheap next to the filter) */
+static inline int finder_verify(const fp_finder *f, const char *p) {
+    if (!f->icase) return memcmp(p, f->needle, f->len) == 0;
+    for (size_t j = 0; j < f->len; j++)
+        if (fp_ascii_tolower((unsigned char)p[j]) != (unsigned char)f->needle[j]) return 0;
+    return 1;
+}
+
+static const char *find_scalar(const fp_finder *f, const char *h, size_t hl) {
+    size_t nl = f->len;
+    if (nl > hl) return NULL;
+    const char *end = h + hl - nl + 1;   /* one past the last start */
+    if (!f->icase) {
+        for (const char *p = h; p < end; p++) {
+            p = memchr(p, f->needle[0], (size_t)(end - p));
+            if (!p) return NULL;
+            if (p[nl-1] == f->needle[nl-1] && memcmp(p, f->needle, nl) == 0) return p;
+        }
+        return NULL;
+    }
+    for (const char *p = h; p < end; p++) {
+        if (((unsigned char)p[0] | f->fold_first) != f->first) continue;
+        if (((unsigned char)p[nl-1] | f->fold_last) != f->last) continue;
+        if (finder_verify(f, p)) return p;
+    }
+    return NULL;
+}
+
+#ifdef FP_X86
+/* Check candidate starts h+i+bit for every set bit of m, lowest first. */
+#define FIND_VERIFY(m, base)                                  \
+    while (m) {                                               \
+        const char *p_ = (base) + __builtin_ctz(m);           \
+        if (finder_verify(f, p_)) return p_;                  \
+        (m) &= (m) - 1;                                       \
+    }
+
+/* The last partial block is redone as one overlapping full-width block with
+   the already-tested starts masked off, so short records (the common case)
+   never drop to the byte loop. */
+__attribute__((target("sse2")))
+static const char *find_sse2(const fp_finder *f, const char *h, size_t hl) {
+    size_t nl = f->len, nstart = hl - nl + 1, i = 0;
+    if (nstart < 16) return find_scalar(f, h, hl);
+    const __m128i a = _mm_set1_epi8((char)f->first), fa = _mm_set1_epi8((char)f->fold_first);
+    const __m128i z = _mm_set1_epi8((char)f->last),  fz = _mm_set1_epi8((char)f->fold_last);
+    for (;;) {
+        size_t skip = 0;
+        if (i + 16 > nstart) { skip = i - (nstart - 16); i = nstart - 16; }
+        __m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + i)), fa);
+        __m128i y = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + i + nl - 1)), fz);
+        unsigned m = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(x, a), _mm_cmpeq_epi8(y, z)));
+        m &= ~0u << skip;
+        FIND_VERIFY(m, h + i);
+        i += 16;
+        if (i >= nstart) return NULL;
+    }
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const fp_finder *f, const char *h, size_t hl) {
+    size_t nl = f->len, nstart = hl - nl + 1, i = 0;
+    if (nstart < 32) return find_sse2(f, h, hl);
+    const __m256i a = _mm256_set1_epi8((char)f->first), fa = _mm256_set1_epi8((char)f->fold_first);
+    const __m256i z = _mm256_set1_epi8((char)f->last),  fz = _mm256_set1_epi8((char)f->fold_last);
+    for (;;) {
+        size_t skip = 0;
+        if (i + 32 > nstart) { skip = i - (nstart - 32); i = nstart - 32; }
+        __m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(h + i)), fa);
+        __m256i y = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(h + i + nl - 1)), fz);
+        unsigned m = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(x, a), _mm256_cmpeq_epi8(y, z)));
+        m &= ~0u << skip;
+        FIND_VERIFY(m, h + i);
+        i += 32;
+        if (i >= nstart) return NULL;
+    }
+}
+#endif
+
+typedef const char *(*find_fn)(const fp_finder *, const char *, size_t);
+static find_fn find_impl = find_scalar;
+static const char *find_name = "scalar";
+
+__attribute__((constructor))
+static void finder_pick_kernel(void) {
+#ifdef FP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))      { find_impl = find_avx2; find_name = "avx2"; }
+    else if (__builtin_cpu_supports("sse2")) { find_impl = find_sse2; find_name = "sse2"; }
+#endif
+}
+
+const char *fp_finder_find(const fp_finder *f, const char *h, size_t hl) {
+    if (f->len == 0) return h;
+    if (f->len > hl) return NULL;
+    return find_impl(f, h, hl);
+}
+
+const char *fp_finder_kernel(void) { return find_name; }
+
+/* ---------------- multi-literal matcher ---------------- */
+
+struct fp_multilit {
+    int      icase;
+    size_t   n;
+    char   **pats;      /* owned copies, folded with icase */
+    size_t  *lens;
+
+    /* Teddy: buckets hold contiguous runs of the sorted patterns */
+    int      teddy;
+    int      m;                     /* window bytes in the masks (1..3) */
+    int      off;                   /* window = pattern bytes [off, off+m) */
+    uint8_t  lo[3][16], hi[3][16];  /* nibble => bucket bits, per prefix byte */
+    uint32_t bstart[9];             /* bucket b = patterns [bstart[b], bstart[b+1]) */
+
+    /* Aho-Corasick: entry = next state * ncls, top bit set if that state accepts */
+    uint8_t   cls[256];
+    uint32_t  ncls;
+    uint32_t *delta;
+    uint32_t *outlen;               /* per state: length of a pattern ending there */
+    uint8_t   start[256];           /* bytes that leave the root state */
+    int       nstart;
+    unsigned char start1;           /* the only such byte when nstart == 1 */
+};
+
+#define AC_ACCEPT 0x80000000u
+
+typedef struct { char *p; size_t len; size_t off; } ml_pat;
+
+// Order by the Teddy window first, so patterns sharing window bytes share
+// a bucket, then by the whole pattern.
+static int ml_cmp(const void *va, const void *vb) {
+    const ml_pat *a = va, *b = vb;
+    size_t al = a->len - a->off, bl = b->len - b->off;
+    int r = memcmp(a->p + a->off, b->p + b->off, al < bl ? al : bl);
+    if (!r) r = (al > bl) - (al < bl);
+    if (!r) r = memcmp(a->p, b->p, a->off);
+    return r;
+}
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Window offset with the most distinct m-byte keys across the set, so sets
+// with a shared prefix ("user=u...") are told apart by the bytes after it.
+static size_t teddy_pick_window(const ml_pat *v, size_t n, size_t m, size_t minlen) {
+    uint32_t keys[FP_TEDDY_MAX];
+    size_t best = 0, best_distinct = 0;
+    for (size_t off = 0; off + m <= minlen; off++) {
+        for (size_t k = 0; k < n; k++) {
+            uint32_t key = 0;
+            for (size_t j = 0; j < m; j++) key = key << 8 | (unsigned char)v[k].p[off + j];
+            keys[k] = key;
+        }
+        qsort(keys, n, sizeof *keys, u32_cmp);
+        size_t distinct = 1;
+        for (size_t k = 1; k < n; k++) distinct += keys[k] != keys[k-1];
+        if (distinct > best_distinct) { best = off; best_distinct = distinct; }
+    }
+    return best;
+}
+
+static inline int ml_eq(const fp_multilit *t, const char *p, const char *pat, size_t len) {
+    if (!t->icase) return memcmp(p, pat, len) == 0;
+    for (size_t j = 0; j < len; j++)
+        if (fp_ascii_tolower((unsigned char)p[j]) != (unsigned char)pat[j]) return 0;
+    return 1;
+}
+
+/* Patterns in the flagged buckets whose window is at w (match ends before end). */
+static inline const char *teddy_verify(const fp_multilit *t, const char *w, const char *end, unsigned bits) {
+    const char *p = w - t->off;
+    while (bits) {
+        int b = __builtin_ctz(bits);
+        bits &= bits - 1;
+        for (uint32_t k = t->bstart[b]; k < t->bstart[b+1]; k++) {
+            size_t len = t->lens[k];
+            if ((size_t)(end - p) >= len && ml_eq(t, p, t->pats[k], len)) return p;
+        }
+    }
+    return NULL;
+}
+
+static const char *teddy_scalar(const fp_multilit *t, const char *h, size_t hl) {
+    size_t m = (size_t)t->m;
+    if (hl < m) return NULL;
+    for (size_t i = 0; i + m <= hl; i++) {
+        unsigned bits = 0xff;
+        for (size_t k = 0; k < m && bits; k++) {
+            unsigned char c = (unsigned char)h[i+k];
+            bits &= t->lo[k][c & 15] & t->hi[k][c >> 4];
+        }
+        const char *r;
+        if (bits && (r = teddy_verify(t, h + i, h + hl, bits))) return r;
+    }
+    return NULL;
+}
+
+#ifdef FP_X86
+#define TEDDY_VERIFY(mask, res, base)                                        \
+    while (mask) {                                                           \
+        int j_ = __builtin_ctz(mask);                                        \
+        const char *r_ = teddy_verify(t, (base) + j_, h + hl, (res)[j_]);    \
+        if (r_) return r_;                                                   \
+        (mask) &= (mask) - 1;                                                \
+    }
+
+__attribute__((target("ssse3")))
+static const char *teddy_ssse3(const fp_multilit *t, const char *h, size_t hl) {
+    size_t m = (size_t)t->m;
+    if (hl < m + 15) return teddy_scalar(t, h, hl);
+    size_t nstart = hl - m + 1, i = 0;
+    const __m128i nib = _mm_set1_epi8(0x0f), zero = _mm_setzero_si128();
+    __m128i lo[3], hi[3];
+    for (size_t k = 0; k < m; k++) {
+        lo[k] = _mm_loadu_si128((const __m128i *)t->lo[k]);
+        hi[k] = _mm_loadu_si128((const __m128i *)t->hi[k]);
+    }
+    for (;;) {
+        size_t skip = 0;
+        if (i + 16 > nstart) { skip = i - (nstart - 16); i = nstart - 16; }
+        __m128i res = _mm_set1_epi8(-1);
+        for (size_t k = 0; k < m; k++) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(h + i + k));
+            __m128i l = _mm_shuffle_epi8(lo[k], _mm_and_si128(x, nib));
+            __m128i u = _mm_shuffle_epi8(hi[k], _mm_and_si128(_mm_srli_epi16(x, 4), nib));
+            res = _mm_and_si128(res, _mm_and_si128(l, u));
+        }
+        unsigned mask = 0xffffu & ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(res, zero));
+        mask &= ~0u << skip;
+        if (mask) {
+            uint8_t r[16];
+            _mm_storeu_si128((__m128i *)r, res);
+            TEDDY_VERIFY(mask, r, h + i);
+        }
+        i += 16;
+        if (i >= nstart) return NULL;
+    }
+}
+
+__attribute__((target("avx2")))
+static const char *teddy_avx2(const fp_multilit *t, const char *h, size_t hl) {
+    size_t m = (size_t)t->m;
+    if (hl < m + 31) return teddy_ssse3(t, h, hl);
+    size_t nstart = hl - m + 1, i = 0;
+    const __m256i nib = _mm256_set1_epi8(0x0f), zero = _mm256_setzero_si256();
+    __m256i lo[3], hi[3];
+    for (size_t k = 0; k < m; k++) {
+        lo[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t->lo[k]));
+        hi[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t->hi[k]));
+    }
+    for (;;) {
+        size_t skip = 0;
+        if (i + 32 > nstart) { skip = i - (nstart - 32); i = nstart - 32; }
+        __m256i res = _mm256_set1_epi8(-1);
+        for (size_t k = 0; k < m; k++) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(h + i + k));
+            __m256i l = _mm256_shuffle_epi8(lo[k], _mm256_and_si256(x, nib));
+            __m256i u = _mm256_shuffle_epi8(hi[k], _mm256_and_si256(_mm256_srli_epi16(x, 4), nib));
+            res = _mm256_and_si256(res, _mm256_and_si256(l, u));
+        }
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(res, zero));
+        mask &= ~0u << skip;
+        if (mask) {
+            uint8_t r[32];
+            _mm256_storeu_si256((__m256i *)r, res);
+            TEDDY_VERIFY(mask, r, h + i);
+        }
+        i += 32;
+        if (i >= nstart) return NULL;
+    }
+}
+#endif
+
+typedef const char *(*teddy_fn)(const fp_multilit *, const char *, size_t);
+static teddy_fn teddy_impl = NULL;   /* NULL => no SIMD Teddy, use Aho-Corasick */
+
+__attribute__((constructor))
+static void teddy_pick_kernel(void) {
+#ifdef FP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))       teddy_impl = teddy_avx2;
+    else if (__builtin_cpu_supports("ssse3")) teddy_impl = teddy_ssse3;
+#endif
+}
+
+static void teddy_build(fp_multilit *t) {
+    for (int b = 0; b <= 8; b++) t->bstart[b] = (uint32_t)((t->n * (size_t)b + 7) / 8);
+    for (int b = 0; b < 8; b++) {
+        for (uint32_t k = t->bstart[b]; k < t->bstart[b+1]; k++) {
+            for (int j = 0; j < t->m; j++) {
+                unsigned char c = (unsigned char)t->pats[k][t->off + j];
+                unsigned char alt = t->icase ? (unsigned char)fp_ascii_toupper(c) : c;
+                t->lo[j][c & 15]   |= (uint8_t)(1u << b);
+                t->hi[j][c >> 4]   |= (uint8_t)(1u << b);
+                t->lo[j][alt & 15] |= (uint8_t)(1u << b);
+                t->hi[j][alt >> 4] |= (uint8_t)(1u << b);
+            }
+        }
+    }
+}
+
+static int ac_build(fp_multilit *t) {
+    /* byte classes: 0 = bytes in no pattern, then one class per distinct byte */
+    uint32_t ncls = 1;
+    for (size_t k = 0; k < t->n; k++) {
+        for (size_t j = 0; j < t->lens[k]; j++) {
+            unsigned char c = (unsigned char)t->pats[k][j];
+            if (t->cls[c]) continue;
+            t->cls[c] = (uint8_t)ncls;
+            if (t->icase) t->cls[fp_ascii_toupper(c)] = (uint8_t)ncls;
+            ncls++;
+        }
+    }
+    t->ncls = ncls;
+
+    size_t maxst = 1;
+    for (size_t k = 0; k < t->n; k++) maxst += t->lens[k];
+    uint32_t *go = calloc(maxst * ncls, sizeof *go);
+    uint32_t *fail = calloc(maxst, sizeof *fail);
+    uint32_t *queue = malloc(maxst * sizeof *queue);
+    t->outlen = calloc(maxst, sizeof *t->outlen);
+    if (!go || !fail || !queue || !t->outlen) { free(go); free(fail); free(queue); return -1; }
+
+    /* trie; go[s*ncls+c] == 0 means no edge (the root is never a child) */
+    uint32_t nst = 1;
+    for (size_t k = 0; k < t->n; k++) {
+        uint32_t s = 0;
+        for (size_t j = 0; j < t->lens[k]; j++) {
+            uint32_t c = t->cls[(unsigned char)t->pats[k][j]];
+            if (!go[s*ncls + c]) go[s*ncls + c] = nst++;
+            s = go[s*ncls + c];
+        }
+        if (!t->outlen[s] || t->lens[k] < t->outlen[s]) t->outlen[s] = (uint32_t)t->lens[k];
+    }
+
+    /* BFS: failure links, then fill missing edges from the failure state */
+    size_t qh = 0, qt = 0;
+    for (uint32_t c = 0; c < ncls; c++)
+        if (go[c]) { fail[go[c]] = 0; queue[qt++] = go[c]; }
+    while (qh < qt) {
+        uint32_t s = queue[qh++];
+        if (!t->outlen[s]) t->outlen[s] = t->outlen[fail[s]];
+        for (uint32_t c = 0; c < ncls; c++) {
+            uint32_t u = go[s*ncls + c];
+            if (u) { fail[u] = go[fail[s]*ncls + c]; queue[qt++] = u; }
+            else go[s*ncls + c] = go[fail[s]*ncls + c];
+        }
+    }
+
+    /* bytes that can begin a match; the scan skips everything else at the root */
+    for (int c = 0; c < 256; c++) {
+        if (!t->cls[c] || !go[t->cls[c]]) continue;
+        t->start[c] = 1;
+        t->start1 = (unsigned char)c;
+        t->nstart++;
+    }
+
+    /* premultiply targets and tag accepting ones */
+    for (size_t e = 0; e < (size_t)nst * ncls; e++) {
+        uint32_t u = go[e];
+        go[e] = u * ncls | (t->outlen[u] ? AC_ACCEPT : 0);
+    }
+    t->delta = go;
+    free(fail); free(queue);
+    return 0;
+}
+
+static const char *ac_find(const fp_multilit *t, const char *h, size_t hl) {
+    const uint32_t *d = t->delta;
+    const uint8_t *cls = t->cls;
+    uint32_t s = 0;
+    for (size_t i = 0; i < hl; i++) {
+        if (s == 0) {
+            // at the root: skip bytes that cannot start a pattern without
+            // walking the table (they would all lead back here)
+            if (t->nstart == 1) {
+                const char *p = memchr(h + i, t->start1, hl - i);
+                if (!p) return NULL;
+                i = (size_t)(p - h);
+            } else {
+                while (i < hl && !t->start[(unsigned char)h[i]]) i++;
+                if (i == hl) return NULL;
+            }
+        }
+        uint32_t e = d[s + cls[(unsigned char)h[i]]];
+        if (e & AC_ACCEPT) return h + i + 1 - t->outlen[(e & ~AC_ACCEPT) / t->ncls];
+        s = e;
+    }
+    return NULL;
+}
+
+fp_multilit *fp_multilit_new(const char *const *pats, const size_t *lens, size_t n, int icase) {
+    if (n == 0) return NULL;
+    fp_multilit *t = calloc(1, sizeof *t);
+    ml_pat *v = calloc(n, sizeof *v);
+    if (!t || !v) { free(t); free(v); return NULL; }
+    t->icase = icase;
+    for (size_t k = 0; k < n; k++) {
+        if (lens[k] == 0 || !(v[k].p = malloc(lens[k] + 1))) goto fail;
+        for (size_t j = 0; j < lens[k]; j++)
+            v[k].p[j] = icase ? (char)fp_ascii_tolower((unsigned char)pats[k][j]) : pats[k][j];
+        v[k].p[lens[k]] = '\0';
+        v[k].len = lens[k];
+    }
+    int teddy = teddy_impl && n <= FP_TEDDY_MAX;
+    if (teddy) {
+        size_t minlen = v[0].len;
+        for (size_t k = 1; k < n; k++) if (v[k].len < minlen) minlen = v[k].len;
+        t->m = minlen < 3 ? (int)minlen : 3;
+        t->off = (int)teddy_pick_window(v, n, (size_t)t->m, minlen);
+        for (size_t k = 0; k < n; k++) v[k].off = (size_t)t->off;
+    }
+    /* sorted, so each Teddy bucket holds patterns with similar windows */
+    qsort(v, n, sizeof *v, ml_cmp);
+
+    t->pats = calloc(n, sizeof *t->pats);
+    t->lens = calloc(n, sizeof *t->lens);
+    if (!t->pats || !t->lens) goto fail;
+    for (size_t k = 0; k < n; k++) { t->pats[k] = v[k].p; t->lens[k] = v[k].len; v[k].p = NULL; }
+    t->n = n;
+    free(v);
+
+    if (teddy) {
+        t->teddy = 1;
+        teddy_build(t);
+        return t;
+    }
+    if (ac_build(t) < 0) { fp_multilit_free(t); return NULL; }
+    return t;
+
+fail:
+    for (size_t k = 0; k < n; k++) free(v[k].p);
+    free(v);
+    fp_multilit_free(t);
+    return NULL;
+}
+
+const char *fp_multilit_find(const fp_multilit *t, const char *h, size_t hl) {
+    if (!t->teddy) return ac_find(t, h, hl);
+    /* the kernels scan window positions; a window at h+i is a start at h+i-off */
+    if (hl < (size_t)t->off) return NULL;
+    return teddy_impl(t, h + t->off, hl - (size_t)t->off);
+}
+
+const char *fp_multilit_kind(const fp_multilit *t) {
+    return t->teddy ? "teddy" : "aho-corasick";
+}
+
+void fp_multilit_free(fp_multilit *t) {
+    if (!t) return;
+    for (size_t k = 0; k < t->n; k++) free(t->pats[k]);
+    free(t->pats); free(t->lens);
+    free(t->delta); free(t->outlen);
+    free(t);
+}
@@ -0,0 +1,137 @@
+// src/sortkey.c
+#include "sortkey.h"
+#include "lineio.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int fp_sortkey_fields(fp_sortkey *k, const char *list) {
+    fp_sortkey_free(k);
+    if (!(k->fields = calloc(1, sizeof *k->fields))) return -1;
+    if (fp_fieldset_parse(list, k->fields) < 0) { free(k->fields); k->fields = NULL; return -1; }
+    return 0;
+}
+
+void fp_sortkey_free(fp_sortkey *k) {
+    if (!k->fields) return;
+    fp_fieldset_free(k->fields);
+    free(k->fields);
+    k->fields = NULL;
+}
+
+// The selected fields joined by the delimiter (one before every span after
+// the first, even when the field before it is empty); spans past the end of
+// the line are left out.
+const char *fp_sortkey_key(const fp_sortkey *k, const char *s, size_t n, char *dst, size_t *klen) {
+    if (!k->fields) { *klen = n; return s; }
+    const fp_fieldset *fs = k->fields;
+    const char *p = s, *end = s + n;
+    char *w = dst;
+    size_t field = 1;
+    for (size_t i = 0; i < fs->nspans; i++) {
+        size_t lo = fs->spans[i].lo, hi = fs->spans[i].hi;
+        if (field < lo) {
+            size_t left = lo - field;
+            const char *d = fp_memchr_nth(p, (size_t)(end - p), k->delim, &left);
+            if (!d) break;
+            p = d + 1; field = lo;
+        }
+        const char *q = end;
+        if (hi != SIZE_MAX) {
+            size_t left = hi - field + 1;
+            const char *d = fp_memchr_nth(p, (size_t)(end - p), k->delim, &left);
+            if (d) q = d;
+        }
+        if (fs->nspans == 1) { *klen = (size_t)(q - p); return p; }
+        if (i > 0) *w++ = k->delim;
+        memcpy(w, p, (size_t)(q - p)); w += q - p;
+        if (q == end) break;
+        p = q + 1; field = hi + 1;
+    }
+    *klen = (size_t)(w - dst);
+    return fs->nspans == 1 ? end : dst;
+}
+
+// The key can hold more than one field (merged spans such as 1,2 included)
+static inline int sk_multi(const fp_sortkey *k) {
+    return k->fields && (k->fields->nspans > 1 || k->fields->spans[0].lo != k->fields->spans[0].hi);
+}
+
+static inline int sk_isdigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+// The leading number of the key as sort -n reads it, kept as digit strings.
+static void sk_num(fp_sortrec *r) {
+    const char *k = r->key, *p = k, *e = k + r->klen;
+    while (p < e && (*p == ' ' || *p == '\t')) p++;
+    int neg = p < e && *p == '-';
+    if (neg) p++;
+    while (p < e && *p == '0') p++;
+    const char *is = p;
+    while (p < e && sk_isdigit(*p)) p++;
+    r->ioff = (uint32_t)(is - k);
+    r->ilen = (uint32_t)(p - is);
+    r->foff = r->flen = 0;
+    if (p < e && *p == '.') {
+        const char *fs = ++p;
+        while (p < e && sk_isdigit(*p)) p++;
+        size_t fl = (size_t)(p - fs);
+        while (fl && fs[fl-1] == '0') fl--;
+        r->foff = (uint32_t)(fs - k);
+        r->flen = (uint32_t)fl;
+    }
+    r->sign = (r->ilen || r->flen) ? (neg ? -1 : 1) : 0;
+}
+
+void fp_sortrec_fill(const fp_sortkey *k, fp_sortrec *r, const char *line, size_t len, char *kdst) {
+    size_t kl;
+    r->line = line;
+    r->len = (uint32_t)len;
+    r->key = fp_sortkey_key(k, line, len - 1, kdst, &kl);
+    r->klen = (uint32_t)kl;
+    if (k->numeric && !sk_multi(k)) sk_num(r);
+}
+
+// Sign, then the number of integer digits, then the digits themselves.
+static int sk_numcmp(const fp_sortrec *a, const fp_sortrec *b) {
+    if (a->sign != b->sign) return a->sign < b->sign ? -1 : 1;
+    if (!a->sign) return 0;
+    int r;
+    if (a->ilen != b->ilen) r = a->ilen < b->ilen ? -1 : 1;
+    else if (!(r = memcmp(a->key + a->ioff, b->key + b->ioff, a->ilen))) {
+        uint32_t m = a->flen < b->flen ? a->flen : b->flen;
+        if (!(r = memcmp(a->key + a->foff, b->key + b->foff, m)))
+            r = (a->flen > b->flen) - (a->flen < b->flen);
+    }
+    return a->sign < 0 ? -r : r;
+}
+
+static inline int sk_bytecmp(const char *a, size_t an, const char *b, size_t bn) {
+    int r = memcmp(a, b, an < bn ? an : bn);
+    return r ? r : (an > bn) - (an < bn);
+}
+
+// -n on several fields: the number each field starts with, field by field
+// (a field missing from the shorter key reads as empty, like sort -k).
+static int sk_fieldnumcmp(char delim, const fp_sortrec *a, const fp_sortrec *b) {
+    const char *pa = a->key, *ea = pa + a->klen, *pb = b->key, *eb = pb + b->klen;
+    for (;;) {
+        const char *qa = pa < ea ? memchr(pa, delim, (size_t)(ea - pa)) : NULL;
+        const char *qb = pb < eb ? memchr(pb, delim, (size_t)(eb - pb)) : NULL;
+        if (!qa) qa = ea;
+        if (!qb) qb = eb;
+        fp_sortrec x = { .key = pa, .klen = (uint32_t)(qa - pa) };
+        fp_sortrec y = { .key = pb, .klen = (uint32_t)(qb - pb) };
+        sk_num(&x); sk_num(&y);
+        int r = sk_numcmp(&x, &y);
+        if (r || (qa == ea && qb == eb)) return r;
+        pa = qa < ea ? qa + 1 : ea;
+        pb = qb < eb ? qb + 1 : eb;
+    }
+}
+
+int fp_sortrec_cmp(const fp_sortkey *k, const fp_sortrec *a, const fp_sortrec *b) {
+    int r = !k->numeric ? sk_bytecmp(a->key, a->klen, b->key, b->klen)
+          : sk_multi(k) ? sk_fieldnumcmp(k->delim, a, b) : sk_numcmp(a, b);
+    if (r || (!k->numeric && !k->fields)) return r;   // the key was the line
+    return sk_bytecmp(a->line, a->len - 1, b->line, b->len - 1);
+}
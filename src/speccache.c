@@ -0,0 +1,145 @@
+// src/speccache.c
+#include "speccache.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fp_specent {
+    fp_specent *prev, *next;    /* recency list, most recent first */
+    const char *kind;           /* static string */
+    char       *key;
+    size_t      klen;
+    uint64_t    hash;
+    void       *obj;
+    void      (*free_obj)(void *);
+    int         refs;
+    int         cached;         /* on the list; 0 => freed on last release */
+    unsigned long hits;
+};
+
+static struct {
+    fp_specent *head, *tail;
+    size_t      n, max;
+} cache = { NULL, NULL, 0, FP_SPECCACHE_MAX };
+
+static uint64_t spec_hash(const char *kind, const char *key, size_t klen) {
+    uint64_t h = 1469598103934665603u;   /* FNV-1a */
+    for (const char *p = kind; *p; p++) h = (h ^ (unsigned char)*p) * 1099511628211u;
+    h = (h ^ 0xff) * 1099511628211u;
+    for (size_t k = 0; k < klen; k++) h = (h ^ (unsigned char)key[k]) * 1099511628211u;
+    return h;
+}
+
+static void ent_free(fp_specent *e) {
+    if (e->free_obj) e->free_obj(e->obj);
+    free(e->key);
+    free(e);
+}
+
+static void ent_unlink(fp_specent *e) {
+    if (e->prev) e->prev->next = e->next; else cache.head = e->next;
+    if (e->next) e->next->prev = e->prev; else cache.tail = e->prev;
+    e->prev = e->next = NULL;
+    e->cached = 0;
+    cache.n--;
+}
+
+static void ent_push_front(fp_specent *e) {
+    e->prev = NULL;
+    e->next = cache.head;
+    if (cache.head) cache.head->prev = e; else cache.tail = e;
+    cache.head = e;
+    e->cached = 1;
+    cache.n++;
+}
+
+/* Drop idle entries from the cold end until the cache fits its cap. */
+static void evict(void) {
+    for (fp_specent *e = cache.tail; e && cache.n > cache.max; ) {
+        fp_specent *prev = e->prev;
+        if (e->refs == 0) { ent_unlink(e); ent_free(e); }
+        e = prev;
+    }
+}
+
+fp_specent *fp_speccache_get(const char *kind, const char *key, size_t klen) {
+    if (cache.max == 0) return NULL;
+    uint64_t h = spec_hash(kind, key, klen);
+    for (fp_specent *e = cache.head; e; e = e->next) {
+        if (e->hash != h || e->klen != klen || strcmp(e->kind, kind) != 0 ||
+            memcmp(e->key, key, klen) != 0) continue;
+        if (e != cache.head) { ent_unlink(e); ent_push_front(e); }
+        e->refs++;
+        e->hits++;
+        return e;
+    }
+    return NULL;
+}
+
+fp_specent *fp_speccache_private(const char *kind, const char *key, size_t klen,
+                                 void *obj, void (*free_obj)(void *)) {
+    fp_specent *e = calloc(1, sizeof *e);
+    if (e) e->key = malloc(klen ? klen : 1);
+    if (!e || !e->key) {
+        free(e);
+        if (free_obj) free_obj(obj);
+        return NULL;
+    }
+    memcpy(e->key, key, klen);
+    e->klen = klen;
+    e->kind = kind;
+    e->hash = spec_hash(kind, key, klen);
+    e->obj = obj;
+    e->free_obj = free_obj;
+    e->refs = 1;
+    return e;
+}
+
+fp_specent *fp_speccache_put(const char *kind, const char *key, size_t klen,
+                             void *obj, void (*free_obj)(void *)) {
+    fp_specent *e = fp_speccache_private(kind, key, klen, obj, free_obj);
+    if (e && cache.max > 0) {   /* else the entry just lives as long as its user */
+        ent_push_front(e);
+        evict();
+    }
+    return e;
+}
+
+void *fp_specent_obj(const fp_specent *e) { return e->obj; }
+int   fp_specent_refs(const fp_specent *e) { return e->refs; }
+
+void fp_speccache_release(fp_specent *e) {
+    if (!e || --e->refs > 0) return;
+    if (!e->cached) ent_free(e);
+    else if (cache.n > cache.max) evict();   /* was pinned past the cap */
+}
+
+void fp_speccache_clear(void) {
+    while (cache.head) {
+        fp_specent *e = cache.head;
+        ent_unlink(e);
+        if (e->refs == 0) ent_free(e);
+    }
+}
+
+void fp_speccache_set_max(size_t n) {
+    cache.max = n;
+    evict();
+}
+
+// Keys are printed as typed, with control bytes (pattern separators) escaped.
+void fp_speccache_print(FILE *out) {
+    fprintf(out, "# %zu/%zu entries\n%-6s %5s %8s  %s\n", cache.n, cache.max,
+            "kind", "refs", "hits", "key");
+    for (const fp_specent *e = cache.head; e; e = e->next) {
+        fprintf(out, "%-6s %5d %8lu  ", e->kind, e->refs, e->hits);
+        for (size_t k = 0; k < e->klen; k++) {
+            unsigned char c = (unsigned char)e->key[k];
+            if (c == '\n') fputs("\\n", out);
+            else if (c < 0x20 || c == 0x7f) fprintf(out, "\\x%02x", c);
+            else fputc(c, out);
+        }
+        fputc('\n', out);
+    }
+}
@@ -2,6 +2,7 @@
 #include "util.h"
 
 #include <sys/types.h>
+#include <unistd.h>
 
 /* printf-like error helper */
 void fp_errf(const char *who, int k, const char *name, const char *fmt, ...) {
@@ -40,70 +41,110 @@ int fp_parse_long(const char *s, long *out) {
     return 0;
 }
 
-/* ---------------- Fieldset (bitset) ---------------- */
-
-static void fs_set(fp_fieldset *fs, size_t idx1) {
-    if (idx1 == 0) return;
-    size_t bit = idx1 - 1;
-    size_t need_bytes = bit/8 + 1;
-    size_t have_bytes = fs->nbits ? (fs->nbits + 7)/8 : 0;
-    if (need_bytes > have_bytes) {
-        size_t new_bytes = have_bytes ? have_bytes : 32;
-        while (new_bytes < need_bytes) new_bytes *= 2;
-        uint8_t *nb = (uint8_t*)realloc(fs->bits, new_bytes);
-        if (!nb) return;
-        if (new_bytes > have_bytes) memset(nb + have_bytes, 0, new_bytes - have_bytes);
-        fs->bits = nb;
-        fs->nbits = new_bytes * 8;
+/* SIZE as sort -S takes it: a count of KiB, or bytes with a b/K/M/G/T
+   suffix, or N% of physical memory */
+int fp_parse_size(const char *s, size_t *out) {
+    char *e = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &e, 10);
+    if (errno || e == s || *s == '-') return -1;
+    unsigned shift = 10;
+    if (*e == '%') {
+        long pages = sysconf(_SC_PHYS_PAGES), psz = sysconf(_SC_PAGESIZE);
+        if (pages <= 0 || psz <= 0 || v > 100 || e[1]) return -1;
+        *out = (size_t)((double)pages * (double)psz * (double)v / 100.0);
+        return 0;
+    }
+    if (*e) {
+        const char *u = strchr("bKMGT", *e == 'k' ? 'K' : *e);
+        if (!u || e[1]) return -1;
+        shift = 10 * (unsigned)(u - "bKMGT");
     }
-    fs->bits[bit/8] |= (uint8_t)(1u << (bit%8));
+    if (v > (SIZE_MAX >> shift)) return -1;
+    *out = (size_t)v << shift;
+    return 0;
+}
+
+/* ---------------- Fieldset (sorted spans) ---------------- */
+
+static int fs_span_cmp(const void *a, const void *b) {
+    const fp_fieldspan *x = a, *y = b;
+    return x->lo < y->lo ? -1 : x->lo > y->lo;
 }
 
 int fp_fieldset_parse(const char *list, fp_fieldset *fs) {
     memset(fs, 0, sizeof *fs);
+    size_t cap = 0;
     const char *p = list;
     while (*p) {
-        char *e = NULL;
-        long a = strtol(p, &e, 10);
-        if (e == p || a <= 0) { fp_fieldset_free(fs); return -1; }
-        long b = a;
+        char *e = (char *)p;
+        size_t lo = 1, hi;
+        if (*p != '-') {   /* "-N" starts at field 1 */
+            long a = strtol(p, &e, 10);
+            if (e == p || a <= 0) goto bad;
+            lo = (size_t)a;
+        }
+        hi = lo;
         p = e;
         if (*p == '-') {
             p++;
-            if (*p == '\0' || *p == ',') { /* open range a- => cap at 4096 for scaffold */
-                b = 4096;
-                fs->has_ranges = 1;
+            fs->has_ranges = 1;
+            if (*p == '\0' || *p == ',') {
+                if (e == list || e[-1] == ',') goto bad;   /* a lone "-" */
+                hi = SIZE_MAX;
             } else {
                 long t = strtol(p, &e, 10);
-                if (e == p || t < a) { fp_fieldset_free(fs); return -1; }
-                b = t; p = e; fs->has_ranges = 1;
+                if (e == p || t <= 0 || (size_t)t < lo) goto bad;
+                hi = (size_t)t; p = e;
             }
         }
-        for (long k = a; k <= b; k++) fs_set(fs, (size_t)k);
+        if (fs->nspans == cap) {
+            size_t nc = cap ? cap * 2 : 8;
+            fp_fieldspan *ns = realloc(fs->spans, nc * sizeof *ns);
+            if (!ns) goto bad;
+            fs->spans = ns; cap = nc;
+        }
+        fs->spans[fs->nspans].lo = lo;
+        fs->spans[fs->nspans].hi = hi;
+        fs->nspans++;
         if (*p == ',') { p++; continue; }
         if (*p == '\0') break;
-        fp_fieldset_free(fs); return -1;
+        goto bad;
     }
-    /* ensure at least some allocation for has() bounds */
-    if (!fs->bits) {
-        fs->bits = (uint8_t*)calloc(1, 32);
-        fs->nbits = 32*8;
+    if (fs->nspans == 0) goto bad;
+
+    /* sort and merge, so cut walks the spans once, left to right */
+    qsort(fs->spans, fs->nspans, sizeof *fs->spans, fs_span_cmp);
+    size_t w = 0;
+    for (size_t k = 1; k < fs->nspans; k++) {
+        fp_fieldspan *cur = &fs->spans[w], *nx = &fs->spans[k];
+        if (cur->hi == SIZE_MAX || nx->lo <= cur->hi + 1) {
+            if (nx->hi > cur->hi) cur->hi = nx->hi;
+        } else {
+            fs->spans[++w] = *nx;
+        }
     }
+    fs->nspans = w + 1;
+    fs->max_field = fs->spans[w].hi;
+    fs->to_end = fs->max_field == SIZE_MAX;
     return 0;
+bad:
+    fp_fieldset_free(fs);
+    return -1;
 }
 
 int fp_fieldset_has(fp_fieldset *fs, size_t idx1) {
-    if (idx1 == 0) return 0;
-    size_t bit = idx1 - 1;
-    if (bit >= fs->nbits) return 0;
-    return !!(fs->bits[bit/8] & (uint8_t)(1u << (bit%8)));
+    size_t a = 0, b = fs->nspans;
+    while (a < b) {   /* first span with hi >= idx1 */
+        size_t m = a + (b - a) / 2;
+        if (fs->spans[m].hi < idx1) a = m + 1; else b = m;
+    }
+    return a < fs->nspans && fs->spans[a].lo <= idx1;
 }
 
 void fp_fieldset_free(fp_fieldset *fs) {
-    free(fs->bits);
-    fs->bits = NULL;
-    fs->nbits = 0;
-    fs->has_ranges = 0;
+    free(fs->spans);
+    memset(fs, 0, sizeof *fs);
 }
 
 /* ---------------- Your field-list (kept) ---------------- */
@@ -149,57 +190,83 @@ int fp_regex_compile(fp_regex *r, const char *pat, int extended, int icase, int
     memset(r, 0, sizeof(*r));
     r->is_fixed = fixed;
     r->icase = icase;
-    if (fixed) {
-        r->fixed_pat = strdup(pat);
-        return r->fixed_pat ? 0 : -1;
-    }
+    if (fixed) return fp_finder_init(&r->finder, pat, strlen(pat), icase);
+    if ((r->dfa = fp_rx_new(pat, extended, icase))) return 0;
     int cflags = REG_NOSUB | REG_NEWLINE;
     if (extended) cflags |= REG_EXTENDED;
     if (icase)    cflags |= REG_ICASE;
     return regcomp(&r->rx, pat, cflags);
 }
 
-/* naive ASCII memmem with optional casefold */
-static int ascii_memmem_case(const char *h, size_t hl, const char *n, size_t nl, int icase) {
-    if (nl == 0) return 1;
-    if (!icase) {
-        const char *p = h;
-        while (1) {
-            const void *q = memchr(p, n[0], (size_t)(h + hl - p));
-            if (!q) return 0;
-            size_t off = (const char*)q - h;
-            if (off + nl <= hl && memcmp(h + off, n, nl) == 0) return 1;
-            p = (const char*)q + 1;
-        }
-    } else {
-        for (size_t i = 0; i + nl <= hl; i++) {
-            size_t j = 0;
-            for (; j < nl; j++) {
-                int a = fp_ascii_tolower((unsigned char)h[i+j]);
-                int b = fp_ascii_tolower((unsigned char)n[j]);
-                if (a != b) break;
-            }
-            if (j == nl) return 1;
-        }
-        return 0;
+int fp_regex_match(fp_regex *r, const char *s, size_t len) {
+    if (r->is_fixed) return fp_finder_find(&r->finder, s, len) != NULL;
+    if (r->dfa) return fp_rx_match(r->dfa, s, len);
+    /* records are views into shared buffers: bound the search by len, and
+       end it before the record's '\n' (or ^$ would match after it) */
+    if (len > 0 && s[len-1] == '\n') len--;
+    regmatch_t m[1];
+    m[0].rm_so = 0;
+    m[0].rm_eo = (regoff_t)len;
+    return regexec(&r->rx, s, 1, m, REG_STARTEND) == 0;
+}
+
+// The literal and the DFA search the span whole (patterns hold no '\n', and
+// the DFA restarts at each one); regexec goes a line at a time.
+const char *fp_regex_find(fp_regex *r, const char *s, size_t len) {
+    if (r->is_fixed) return fp_finder_find(&r->finder, s, len);
+    if (r->dfa) return fp_rx_find(r->dfa, s, len);
+    for (const char *end = s + len; s < end; ) {
+        const char *nl = memchr(s, '\n', (size_t)(end - s));
+        const char *le = nl ? nl + 1 : end;
+        if (fp_regex_match(r, s, (size_t)(le - s))) return s;
+        s = le;
     }
+    return NULL;
 }
 
-int fp_regex_match(fp_regex *r, const char *s, size_t len) {
+void fp_regex_free(fp_regex *r) {
     if (r->is_fixed) {
-        size_t patlen = strlen(r->fixed_pat);
-        return ascii_memmem_case(s, len, r->fixed_pat, patlen, r->icase);
+        fp_finder_free(&r->finder);
+        return;
     }
-    return regexec(&r->rx, s, 0, NULL, 0) == 0;
+    if (r->dfa) fp_rx_free(r->dfa);
+    if (!r->dfa || r->subs) regfree(&r->rx);
 }
 
-void fp_regex_free(fp_regex *r) {
+static int grep_pattern_is_literal(const char *p, int extended, int ignore_case);
+
+int fp_regex_compile_subs(fp_regex *r, const char *pat, int extended, int icase, int fixed) {
+    if (fixed || grep_pattern_is_literal(pat, extended, icase))
+        return fp_regex_compile(r, pat, extended, icase, 1);
+    memset(r, 0, sizeof(*r));
+    r->icase = icase;
+    int cflags = REG_NEWLINE;
+    if (extended) cflags |= REG_EXTENDED;
+    if (icase)    cflags |= REG_ICASE;
+    int rc = regcomp(&r->rx, pat, cflags);
+    if (rc != 0) return rc;
+    r->subs = 1;
+    r->dfa = fp_rx_new(pat, extended, icase);
+    return 0;
+}
+
+int fp_regex_exec(fp_regex *r, const char *s, size_t len, size_t off, regmatch_t *m, size_t nm) {
     if (r->is_fixed) {
-        free(r->fixed_pat);
-        r->fixed_pat = NULL;
-    } else {
-        regfree(&r->rx);
+        const char *p = fp_finder_find(&r->finder, s + off, len - off);
+        if (!p) return 0;
+        m[0].rm_so = (regoff_t)(p - s);
+        m[0].rm_eo = (regoff_t)(p - s + r->finder.len);
+        for (size_t k = 1; k < nm; k++) m[k].rm_so = m[k].rm_eo = -1;
+        return 1;
     }
+    if (off == 0 && r->dfa && !fp_rx_match(r->dfa, s, len)) return 0;
+    m[0].rm_so = (regoff_t)off;
+    m[0].rm_eo = (regoff_t)len;
+    return regexec(&r->rx, s, nm, m, REG_STARTEND | (off ? REG_NOTBOL : 0)) == 0;
+}
+
+size_t fp_regex_nsub(const fp_regex *r) {
+    return r->is_fixed ? 0 : r->rx.re_nsub;
 }
 
 /* ---------------- tr (transliteration) ---------------- */
@@ -249,11 +316,13 @@ int fp_trspec_build(fp_trspec *t, const char *set1, const char *set2) {
     for (int i = 0; i < 256; i++) {
         t->map[i] = (unsigned char)i;
         t->selected[i] = 0;
+        t->squeeze[i] = 0;
     }
 
     if (t->delete_mode) {
         /* deletion: mark membership only */
         for (int i = 0; i < 256; i++) if (s1[i]) t->selected[i] = 1;
+        fp_xlate_plan(&t->xl, t->map, t->selected);
         return 0;
     }
 
@@ -261,6 +330,13 @@ int fp_trspec_build(fp_trspec *t, const char *set1, const char *set2) {
     if (tr_parse_set(s2sel, set2) < 0) return -1;
     unsigned char seq[256]; size_t sn = 0;
     for (int i = 0; i < 256; i++) if (s2sel[i]) seq[sn++] = (unsigned char)i;
+    if (sn == 0 && t->squeeze_mode) {
+        /* -s SET1 alone: squeeze runs of SET1 bytes, no translation */
+        memcpy(t->selected, s1, 256);
+        memcpy(t->squeeze, s1, 256);
+        fp_xlate_plan(&t->xl, t->map, NULL);
+        return 0;
+    }
     if (sn == 0) { seq[0] = 0; sn = 1; } /* degenerate: map to NUL (rare, but defined) */
 
     size_t k = 0;
@@ -271,10 +347,16 @@ int fp_trspec_build(fp_trspec *t, const char *set1, const char *set2) {
             k++;
         }
     }
+    memcpy(t->squeeze, s2sel, 256);   /* -s squeezes SET2 bytes in the output */
+    fp_xlate_plan(&t->xl, t->map, NULL);
     return 0;
 }
 
 void fp_tr_inplace(char **linep, size_t *lenp, const fp_trspec *t) {
+    if (!t->squeeze_mode) {
+        *lenp = fp_xlate_run(&t->xl, *linep, *lenp);
+        return;
+    }
     char  *s  = *linep;
     size_t n  = *lenp;
     char  *wp = s;
@@ -285,37 +367,138 @@ void fp_tr_inplace(char **linep, size_t *lenp, const fp_trspec *t) {
         if (t->delete_mode) {
             if (t->selected[ch]) continue; /* drop */
             if (t->squeeze_mode && wp > s && (unsigned char)*(wp-1) == ch && t->selected[ch]) continue;
-            *wp++ = (char)ch;
+            *wp++ = (char)t->map[ch];      /* identity unless composed */
         } else {
             unsigned char out = t->selected[ch] ? t->map[ch] : ch;
-            if (t->squeeze_mode && wp > s && (unsigned char)*(wp-1) == out && t->selected[ch]) continue;
+            if (wp > s && (unsigned char)*(wp-1) == out && t->squeeze[out]) continue;
             *wp++ = (char)out;
         }
     }
     *lenp = (size_t)(wp - s);
 }
+/* Compose "a then b" into one spec. Deleted bytes are a's set plus every byte
+   that a maps into b's set; survivors map through b(a(c)). Squeeze depends on
+   the previous output byte, so squeezing specs do not compose (-1). */
+int fp_trspec_compose(fp_trspec *out, const fp_trspec *a, const fp_trspec *b) {
+    if (a->squeeze_mode || b->squeeze_mode) return -1;
+    fp_trspec t;
+    memset(&t, 0, sizeof t);
+    for (int c = 0; c < 256; c++) {
+        unsigned char m1 = a->map[c];
+        int del = (a->delete_mode && a->selected[c]) || (b->delete_mode && b->selected[m1]);
+        t.map[c] = b->map[m1];
+        if (del) { t.selected[c] = 1; t.delete_mode = 1; }
+    }
+    if (!t.delete_mode) {
+        for (int c = 0; c < 256; c++) t.selected[c] = (t.map[c] != (unsigned char)c);
+    }
+    fp_xlate_plan(&t.xl, t.map, t.delete_mode ? t.selected : NULL);
+    *out = t;
+    return 0;
+}
+
+/* Only swaps ASCII letter case (a 1:1 map a case-blind filter cannot see). */
+int fp_trspec_case_only(const fp_trspec *t) {
+    if (t->delete_mode || t->squeeze_mode) return 0;
+    for (int c = 0; c < 256; c++) {
+        int m = t->map[c];
+        if (m != c && m != fp_ascii_toupper(c) && m != fp_ascii_tolower(c)) return 0;
+    }
+    return 1;
+}
+
 /* ---------------- Grep-spec shim used by op_grep ---------------- */
 
+/* No regex syntax: the pattern matches exactly its own bytes. */
+static int grep_pattern_is_literal(const char *p, int extended, int ignore_case) {
+    for (; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (strchr(".[]\\*^$", c)) return 0;
+        if (extended && strchr("+?(){}|", c)) return 0;
+        if (c >= 0x80 && ignore_case) return 0;
+    }
+    return 1;
+}
+
 int fp_grepspec_compile(fp_grepspec *g, int extended, int fixed, int ignore_case, const char *pattern) {
+    return fp_grepspec_compile_multi(g, extended, fixed, ignore_case, &pattern, 1);
+}
+
+int fp_grepspec_compile_multi(fp_grepspec *g, int extended, int fixed, int ignore_case,
+                              const char *const *patterns, size_t npats) {
     memset(g, 0, sizeof *g);
-    g->use_regex  = !fixed;
     g->ignore_case = ignore_case;
-    g->fixed = fixed ? fp_xstrdup(pattern) : NULL;
-    g->fixed_len = fixed ? strlen(pattern) : 0;
-    /* compile underlying wrapper */
-    if (fp_regex_compile(&g->rewrap, pattern, extended, ignore_case, fixed) < 0) {
-        free(g->fixed); g->fixed = NULL; g->fixed_len = 0;
-        return -1;
+    g->npats = npats;
+
+    int literal = 1;
+    for (size_t k = 0; k < npats; k++) {
+        if (!patterns[k][0]) g->match_all = 1;
+        if (!fixed && !grep_pattern_is_literal(patterns[k], extended, ignore_case)) literal = 0;
+    }
+    g->use_regex = !literal;
+
+    if (npats == 1) {
+        g->fixed = literal ? fp_xstrdup(patterns[0]) : NULL;
+        g->fixed_len = literal ? strlen(patterns[0]) : 0;
+        /* compile underlying wrapper */
+        if (fp_regex_compile(&g->rewrap, patterns[0], extended, ignore_case, literal) != 0) {
+            free(g->fixed); g->fixed = NULL; g->fixed_len = 0;
+            return -1;
+        }
+        return 0;
+    }
+
+    g->rewrap.is_fixed = 1;   /* unused; frees nothing */
+    if (g->match_all || npats == 0) return 0;   /* -f of an empty file matches nothing */
+    if (literal) {
+        size_t *lens = malloc(npats * sizeof *lens);
+        if (!lens) return -1;
+        for (size_t k = 0; k < npats; k++) lens[k] = strlen(patterns[k]);
+        g->lits = fp_multilit_new(patterns, lens, npats, ignore_case);
+        free(lens);
+        return g->lits ? 0 : -1;
+    }
+    g->rxs = calloc(npats, sizeof *g->rxs);
+    if (!g->rxs) return -1;
+    for (; g->nrx < npats; g->nrx++) {
+        const char *p = patterns[g->nrx];
+        int lit = fixed || grep_pattern_is_literal(p, extended, ignore_case);
+        if (fp_regex_compile(&g->rxs[g->nrx], p, extended, ignore_case, lit) != 0) {
+            fp_grepspec_free(g);
+            return -1;
+        }
     }
     return 0;
 }
 
 int fp_grepspec_match_line(fp_grepspec *g, const char *s, size_t len) {
-    /* Use your wrapper */
-    return fp_regex_match(&g->rewrap, s, len) ? 1 : 0;
+    if (g->npats == 1) return fp_regex_match(&g->rewrap, s, len) ? 1 : 0;
+    if (g->match_all) return 1;
+    if (g->lits) return fp_multilit_find(g->lits, s, len) != NULL;
+    for (size_t k = 0; k < g->nrx; k++)
+        if (fp_regex_match(&g->rxs[k], s, len)) return 1;
+    return 0;
+}
+
+const char *fp_grepspec_find(fp_grepspec *g, const char *s, size_t len) {
+    if (len == 0) return NULL;
+    if (g->npats == 1) return fp_regex_find(&g->rewrap, s, len);
+    if (g->match_all) return s;
+    if (g->lits) return fp_multilit_find(g->lits, s, len);
+    if (g->nrx == 0) return NULL;
+    for (const char *end = s + len; s < end; ) {
+        const char *nl = memchr(s, '\n', (size_t)(end - s));
+        const char *le = nl ? nl + 1 : end;
+        if (fp_grepspec_match_line(g, s, (size_t)(le - s))) return s;
+        s = le;
+    }
+    return NULL;
 }
 
 void fp_grepspec_free(fp_grepspec *g) {
     fp_regex_free(&g->rewrap);
     free(g->fixed); g->fixed = NULL; g->fixed_len = 0;
+    fp_multilit_free(g->lits); g->lits = NULL;
+    for (size_t k = 0; k < g->nrx; k++) fp_regex_free(&g->rxs[k]);
+    free(g->rxs); g->rxs = NULL; g->nrx = 0;
 }
@@ -0,0 +1,304 @@
+// src/xlate.c
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "xlate.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FP_X86 1
+#endif
+
+void fp_xlate_plan(fp_xlate *x, const unsigned char map[256], const unsigned char *del) {
+    memset(x, 0, sizeof *x);
+    memcpy(x->tab, map, 256);
+    int lo = -1, hi = -1;
+    for (int c = 0; c < 256; c++) {
+        if (del && del[c]) {
+            x->dbits[c >> 7][c & 15] |= (unsigned char)(1u << ((c >> 4) & 7));
+            x->del = 1;
+            continue;
+        }
+        if (map[c] == c) continue;
+        x->rows |= (uint16_t)(1u << (c >> 4));
+        if (lo < 0) lo = c;
+        hi = c;
+    }
+    if (lo < 0) return;   /* survivors unchanged */
+
+    /* one range, one shift: deleted bytes inside it may take the shift too */
+    unsigned char add = (unsigned char)(map[lo] - lo);
+    x->map = FP_XL_RANGE;
+    for (int c = lo; c <= hi; c++) {
+        if (del && del[c]) continue;
+        if ((unsigned char)(map[c] - c) != add) { x->map = FP_XL_LUT; break; }
+    }
+    x->lo = (unsigned char)lo;
+    x->span = (unsigned char)(hi - lo);
+    x->add = add;
+}
+
+const char *fp_xlate_describe(const fp_xlate *x, char *buf, size_t cap) {
+    const char *d = x->del ? "delete" : "";
+    const char *sep = x->del && x->map != FP_XL_NONE ? "+" : "";
+    if (x->map == FP_XL_LUT)
+        snprintf(buf, cap, "%s%slut %d rows", d, sep, __builtin_popcount(x->rows));
+    else
+        snprintf(buf, cap, "%s%s%s", d, sep,
+                 x->map == FP_XL_RANGE ? "range" : x->del ? "" : "identity");
+    return buf;
+}
+
+static inline int xl_deleted(const fp_xlate *x, unsigned char c) {
+    return (x->dbits[c >> 7][c & 15] >> ((c >> 4) & 7)) & 1;
+}
+
+/* Bytes [i, n) one at a time, survivors written from w; the new length. */
+static size_t xl_tail(const fp_xlate *x, char *s, size_t i, size_t w, size_t n) {
+    if (!x->del) {
+        for (; i < n; i++) s[i] = (char)x->tab[(unsigned char)s[i]];
+        return n;
+    }
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (!xl_deleted(x, c)) s[w++] = (char)x->tab[c];
+    }
+    return w;
+}
+
+static size_t xl_scalar(const fp_xlate *x, char *s, size_t n) { return xl_tail(x, s, 0, 0, n); }
+
+#ifdef FP_X86
+/* Left-pack: pack_idx[m] lists the set bits of m (the bytes of an 8-byte
+   group to keep), pack_n[m] counts them. */
+static unsigned char pack_idx[256][8];
+static unsigned char pack_n[256];
+
+/* Constants of one table, in registers for the length of a call. The
+   kernels take their address only through always-inline helpers, so stores
+   through s (char *) cannot alias them. */
+typedef struct {
+    int     kind, nrows;
+    __m128i nib, lo, span, add;
+    __m128i tab[16], row[16];
+    __m128i d0, d1, bit;
+} xl_sse;
+
+typedef struct {
+    int     kind, nrows;
+    __m256i nib, lo, span, add;
+    __m256i tab[16], row[16];
+    __m256i d0, d1, bit;
+} xl_avx;
+
+static const unsigned char bit_of_row[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+__attribute__((target("ssse3"), always_inline))
+static inline void sse_init(xl_sse *k, const fp_xlate *x) {
+    k->kind = x->map;
+    k->nib  = _mm_set1_epi8(0x0f);
+    k->lo   = _mm_set1_epi8((char)x->lo);
+    k->span = _mm_set1_epi8((char)x->span);
+    k->add  = _mm_set1_epi8((char)x->add);
+    k->nrows = 0;
+    for (int r = 0; r < 16; r++) {
+        if (!(x->rows >> r & 1)) continue;
+        k->tab[k->nrows] = _mm_loadu_si128((const __m128i *)(x->tab + 16 * r));
+        k->row[k->nrows] = _mm_set1_epi8((char)r);
+        k->nrows++;
+    }
+    k->d0  = _mm_loadu_si128((const __m128i *)x->dbits[0]);
+    k->d1  = _mm_loadu_si128((const __m128i *)x->dbits[1]);
+    k->bit = _mm_loadu_si128((const __m128i *)bit_of_row);
+}
+
+__attribute__((target("ssse3"), always_inline))
+static inline __m128i sse_map(const xl_sse *k, __m128i v) {
+    if (k->kind == FP_XL_RANGE) {
+        __m128i t = _mm_sub_epi8(v, k->lo);
+        __m128i in = _mm_cmpeq_epi8(_mm_min_epu8(t, k->span), t);
+        return _mm_add_epi8(v, _mm_and_si128(in, k->add));
+    }
+    if (k->kind == FP_XL_LUT) {
+        __m128i lo = _mm_and_si128(v, k->nib);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), k->nib);
+        for (int r = 0; r < k->nrows; r++) {
+            __m128i m = _mm_cmpeq_epi8(hi, k->row[r]);
+            __m128i t = _mm_shuffle_epi8(k->tab[r], lo);
+            v = _mm_or_si128(_mm_andnot_si128(m, v), _mm_and_si128(m, t));
+        }
+    }
+    return v;
+}
+
+/* 16-bit mask of the bytes of v to keep */
+__attribute__((target("ssse3"), always_inline))
+static inline unsigned sse_keep(const xl_sse *k, __m128i v) {
+    __m128i lo = _mm_and_si128(v, k->nib);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), k->nib);
+    __m128i top = _mm_cmplt_epi8(v, _mm_setzero_si128());   /* c >= 0x80 */
+    __m128i b = _mm_or_si128(_mm_andnot_si128(top, _mm_shuffle_epi8(k->d0, lo)),
+                             _mm_and_si128(top, _mm_shuffle_epi8(k->d1, lo)));
+    __m128i bit = _mm_shuffle_epi8(k->bit, hi);
+    return ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(b, bit), bit)) & 0xffff;
+}
+
+/* Write the kept bytes of v at s + *w. Each half stores 8 bytes, so with
+   *w <= the input offset of v nothing past v's own 16 bytes is touched. */
+__attribute__((target("ssse3"), always_inline))
+static inline void sse_pack(__m128i v, unsigned keep, char *s, size_t *w) {
+    unsigned m0 = keep & 0xff, m1 = keep >> 8;
+    __m128i i0 = _mm_loadl_epi64((const __m128i *)pack_idx[m0]);
+    __m128i i1 = _mm_loadl_epi64((const __m128i *)pack_idx[m1]);
+    _mm_storel_epi64((__m128i *)(s + *w), _mm_shuffle_epi8(v, i0));
+    *w += pack_n[m0];
+    _mm_storel_epi64((__m128i *)(s + *w), _mm_shuffle_epi8(_mm_srli_si128(v, 8), i1));
+    *w += pack_n[m1];
+}
+
+/* Pure maps finish with one overlapping block at the end, mapped from the
+   original bytes before the loop rewrites them, so lines of 16+ bytes never
+   drop to the byte loop. */
+__attribute__((target("ssse3")))
+static size_t map_ssse3(const fp_xlate *x, char *s, size_t n) {
+    if (n < 16) return xl_tail(x, s, 0, 0, n);
+    xl_sse k;
+    sse_init(&k, x);
+    __m128i last = sse_map(&k, _mm_loadu_si128((const __m128i *)(s + n - 16)));
+    for (size_t i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        _mm_storeu_si128((__m128i *)(s + i), sse_map(&k, v));
+    }
+    _mm_storeu_si128((__m128i *)(s + n - 16), last);
+    return n;
+}
+
+/* Deletes from input offset i, output offset w <= i, to the end. */
+__attribute__((target("ssse3")))
+static size_t del_ssse3_at(const fp_xlate *x, char *s, size_t i, size_t w, size_t n) {
+    xl_sse k;
+    sse_init(&k, x);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned keep = sse_keep(&k, v);
+        if (keep == 0) continue;
+        v = sse_map(&k, v);
+        if (keep == 0xffff) { _mm_storeu_si128((__m128i *)(s + w), v); w += 16; continue; }
+        sse_pack(v, keep, s, &w);
+    }
+    return xl_tail(x, s, i, w, n);
+}
+
+static size_t del_ssse3(const fp_xlate *x, char *s, size_t n) { return del_ssse3_at(x, s, 0, 0, n); }
+
+__attribute__((target("avx2"), always_inline))
+static inline void avx_init(xl_avx *k, const fp_xlate *x) {
+    k->kind = x->map;
+    k->nib  = _mm256_set1_epi8(0x0f);
+    k->lo   = _mm256_set1_epi8((char)x->lo);
+    k->span = _mm256_set1_epi8((char)x->span);
+    k->add  = _mm256_set1_epi8((char)x->add);
+    k->nrows = 0;
+    for (int r = 0; r < 16; r++) {
+        if (!(x->rows >> r & 1)) continue;
+        k->tab[k->nrows] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(x->tab + 16 * r)));
+        k->row[k->nrows] = _mm256_set1_epi8((char)r);
+        k->nrows++;
+    }
+    k->d0  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)x->dbits[0]));
+    k->d1  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)x->dbits[1]));
+    k->bit = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)bit_of_row));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i avx_map(const xl_avx *k, __m256i v) {
+    if (k->kind == FP_XL_RANGE) {
+        __m256i t = _mm256_sub_epi8(v, k->lo);
+        __m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(t, k->span), t);
+        return _mm256_add_epi8(v, _mm256_and_si256(in, k->add));
+    }
+    if (k->kind == FP_XL_LUT) {
+        __m256i lo = _mm256_and_si256(v, k->nib);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), k->nib);
+        for (int r = 0; r < k->nrows; r++)
+            v = _mm256_blendv_epi8(v, _mm256_shuffle_epi8(k->tab[r], lo),
+                                   _mm256_cmpeq_epi8(hi, k->row[r]));
+    }
+    return v;
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline unsigned avx_keep(const xl_avx *k, __m256i v) {
+    __m256i lo = _mm256_and_si256(v, k->nib);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), k->nib);
+    __m256i b = _mm256_blendv_epi8(_mm256_shuffle_epi8(k->d0, lo),
+                                   _mm256_shuffle_epi8(k->d1, lo), v);   /* by bit 7 of c */
+    __m256i bit = _mm256_shuffle_epi8(k->bit, hi);
+    return ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(b, bit), bit));
+}
+
+__attribute__((target("avx2")))
+static size_t map_avx2(const fp_xlate *x, char *s, size_t n) {
+    if (n < 32) return map_ssse3(x, s, n);
+    xl_avx k;
+    avx_init(&k, x);
+    __m256i last = avx_map(&k, _mm256_loadu_si256((const __m256i *)(s + n - 32)));
+    for (size_t i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        _mm256_storeu_si256((__m256i *)(s + i), avx_map(&k, v));
+    }
+    _mm256_storeu_si256((__m256i *)(s + n - 32), last);
+    return n;
+}
+
+__attribute__((target("avx2")))
+static size_t del_avx2(const fp_xlate *x, char *s, size_t n) {
+    if (n < 32) return del_ssse3(x, s, n);
+    xl_avx k;
+    avx_init(&k, x);
+    size_t i = 0, w = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned keep = avx_keep(&k, v);
+        if (keep == 0) continue;
+        v = avx_map(&k, v);
+        if (keep == 0xffffffffu) { _mm256_storeu_si256((__m256i *)(s + w), v); w += 32; continue; }
+        sse_pack(_mm256_castsi256_si128(v), keep & 0xffff, s, &w);
+        sse_pack(_mm256_extracti128_si256(v, 1), keep >> 16, s, &w);
+    }
+    return del_ssse3_at(x, s, i, w, n);   /* a last 16-byte block, then bytes */
+}
+#endif
+
+typedef size_t (*xlate_fn)(const fp_xlate *, char *, size_t);
+static xlate_fn map_impl = xl_scalar, del_impl = xl_scalar;
+static const char *xlate_name = "scalar";
+
+__attribute__((constructor))
+static void xlate_pick_kernel(void) {
+#ifdef FP_X86
+    for (unsigned m = 0; m < 256; m++) {
+        unsigned char k = 0;
+        for (unsigned b = 0; b < 8; b++)
+            if (m >> b & 1) pack_idx[m][k++] = (unsigned char)b;
+        pack_n[m] = k;
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        map_impl = map_avx2; del_impl = del_avx2; xlate_name = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        map_impl = map_ssse3; del_impl = del_ssse3; xlate_name = "ssse3";
+    }
+#endif
+}
+
+size_t fp_xlate_run(const fp_xlate *x, char *s, size_t n) {
+    if (x->del) return del_impl(x, s, n);
+    if (x->map == FP_XL_NONE) return n;
+    return map_impl(x, s, n);
+}
+
+const char *fp_xlate_kernel(void) { return xlate_name; }
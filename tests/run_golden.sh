@@ -10,7 +10,7 @@ BASH_BIN="${BASH:-bash}"
 
 # Load builtins
 $BASH_BIN -c "
-enable -f ./build/fp_prelude.so fx fp_cut fp_tr fp_grep fp_take fp_find
+enable -f ./build/fx_bash.so fx fp_cut fp_tr fp_grep fp_take fp_find
 
 # 1) fx fused pipeline smoke: cut->tr->grep->take
 out=\$(printf 'a,b,c\nb,b,c\n' | fx cut -d , -f2 tr a-z A-Z grep -E '^B' | wc -l)
@@ -29,12 +29,285 @@ out4=\$(seq 1 100 | fp_take 3 | wc -l)
 test \"\$out4\" = \"3\" || { echo 'take failed'; exit 1; }
 
 # 5) multiple sources: emit + cat in one fx plan
-tmpfile=$(mktemp)
-printf 'x,b,c\n' > "$tmpfile"
-out5=$($BASH_BIN -c "enable -f ./build/fp_prelude.so fx fp_cat fp_emit fp_cut fp_tr fp_grep fp_take;
-  fx emit 'a,b,c' cat '$tmpfile' cut -d , -f2 tr a-z A-Z grep -E '^B' | wc -l")
-test "$out5" = "2" || { echo 'multi-source fx failed'; rm -f "$tmpfile"; exit 1; }
-rm -f "$tmpfile"
+tmpfile=\$(mktemp)
+printf 'x,b,c\\n' > \"\$tmpfile\"
+out5=\$(fx emit 'a,b,c' cat \"\$tmpfile\" cut -d , -f2 tr a-z A-Z grep -E '^B' | wc -l)
+test \"\$out5\" = \"2\" || { echo 'multi-source fx failed'; rm -f \"\$tmpfile\"; exit 1; }
+rm -f \"\$tmpfile\"
+
+# 6) inputs spanning many batches keep order and counts
+out6=\$(seq 1 20000 | fx grep -E '7\$' | tail -n 1)
+test \"\$out6\" = \"19997\" || { echo 'batched stream failed'; exit 1; }
+
+# 7) fx -j keeps input order and serial-tail semantics
+out7=\$(seq 1 20000 | fx -j 4 grep -E '7\$' take 3 | tr '\\n' ,)
+test \"\$out7\" = \"7,17,27,\" || { echo 'parallel fx failed'; exit 1; }
+
+# 8) plan rewrites (fusion, hoisting, take => limit) do not change output
+out8a=\$(seq 1 5000 | fx tr 0-9 a-j tr a-j A-J grep -i -F bc take 4 | tr '\\n' ,)
+out8b=\$(seq 1 5000 | fx --no-opt tr 0-9 a-j tr a-j A-J grep -i -F bc take 4 | tr '\\n' ,)
+test \"\$out8a\" = \"BC,BBC,BCA,BCB,\" && test \"\$out8a\" = \"\$out8b\" || { echo 'plan optimizer failed'; exit 1; }
+fx --explain tr a-z A-Z take 2 | grep -q 'source limit 2' || { echo 'fx --explain failed'; exit 1; }
+
+# 9) fx --stats fills FX_STATS (fx runs in this shell, not a pipeline subshell)
+fx --stats grep -F 7 < <(seq 1 100) >/dev/null 2>&1
+test \"\${FX_STATS[1.rec_in]}/\${FX_STATS[1.rec_out]}\" = \"100/19\" || { echo 'fx --stats failed'; exit 1; }
+
+# 10) grep -F -i finds needles in the vector body, the overlapped tail and short lines
+out10=\$(printf '%070d%s\\n%s\\nneedlE\\nneedl\\n' 0 NeEdLe 'xx nEEDLE' | fx grep -F -i needle | wc -l)
+test \"\$out10\" = \"3\" || { echo 'grep -F -i failed'; exit 1; }
+
+# 11) -e / -f pattern sets, small (Teddy) and large (Aho-Corasick)
+pf=\$(mktemp); seq 100 3 900 > \"\$pf\"
+out11a=\$(seq 1 1000 | fx grep -e 17 -e 555 -m 5 | tr '\\n' ,)
+out11b=\$(seq 1 1000 | fx grep -f \"\$pf\" | wc -l)
+rm -f \"\$pf\"
+test \"\$out11a\" = \"17,117,170,171,172,\" || { echo 'grep -e failed'; exit 1; }
+test \"\$out11b\" = \"\$(seq 1 1000 | grep -c -f <(seq 100 3 900))\" || { echo 'grep -f failed'; exit 1; }
+
+# 12) the built-in DFA agrees with grep (ERE and BRE) and --explain names it
+out12a=\$(seq 1 3000 | fx grep -E '^(1|2)[0-9]{2}\$|99\$|^3.*5\$' | wc -l)
+out12b=\$(seq 1 3000 | fx grep '^1\{2\}\|0\$' | wc -l)
+test \"\$out12a\" = \"\$(seq 1 3000 | grep -c -E '^(1|2)[0-9]{2}\$|99\$|^3.*5\$')\" || { echo 'grep -E dfa failed'; exit 1; }
+test \"\$out12b\" = \"\$(seq 1 3000 | grep -c '^1\{2\}\|0\$')\" || { echo 'grep dfa failed'; exit 1; }
+fx --explain grep -E 'ERROR.*timeout' | grep -q \"dfa, must 'timeout'\" || { echo 'grep dfa explain failed'; exit 1; }
+
+# 13) block grep (whole blocks searched at once): thousands of hits per
+#     block, empty lines, -m, mapped file and pipe input
+bf=\$(mktemp); { seq 1 50000; echo; echo; seq 7 7 700; } > \"\$bf\"
+out13a=\$(fx cat \"\$bf\" grep 1 | wc -l)
+out13b=\$(cat \"\$bf\" | fx grep -E '^\$' | wc -l)
+out13c=\$(fx cat \"\$bf\" grep -m 3000 -F 9 | tail -n 1)
+exp13a=\$(grep -c 1 \"\$bf\"); exp13c=\$(grep -m 3000 -F 9 \"\$bf\" | tail -n 1)
+rm -f \"\$bf\"
+test \"\$out13a\" = \"\$exp13a\" || { echo 'block grep failed'; exit 1; }
+test \"\$out13b\" = 2 || { echo 'block grep empty lines failed'; exit 1; }
+test \"\$out13c\" = \"\$exp13c\" || { echo 'block grep -m failed'; exit 1; }
+
+# 14) compiled grep/cut specs are kept between fx calls in the session
+fx --cache-clear
+for i in 1 2 3; do fx emit a,bc cut -d , -f 2 grep -E 'b.' > /dev/null; done
+out14a=\$(fx --cache | awk '\$1 == \"grep\" || \$1 == \"cut\" { printf \"%s=%s,\", \$1, \$3 }')
+fx --cache-clear
+out14b=\$(fx --cache-max 0 emit abc grep -E 'b.'; fx --cache | grep -c '^grep'; fx --cache-max 64)
+test \"\$out14a\" = \"grep=2,cut=2,\" || { echo 'spec cache hits failed'; exit 1; }
+test \"\$out14b\" = \"abc
+0\" || { echo 'spec cache off failed'; exit 1; }
+test \"\$(fx --cache grep -E 'a(' 2>/dev/null | wc -l)\" = 0 || { echo 'spec cache listed on a bad plan'; exit 1; }
+
+# 15) tr kernels (range, table, delete, delete+map) and squeeze agree with
+#     tr on lines shorter and longer than a vector
+tf=\$(mktemp); for n in 1 7 15 16 17 31 33 64 100 257; do head -c \$((n * 40)) /dev/urandom | od -An -c -w80 | head -n 3 | cut -c1-\$n; done > \"\$tf\"
+for a in 'a-z A-Z' 'a-z 0-9' '-d 0-9' '-s a-z A-Z' '-s \\\\ '; do
+  test \"\$(fx tr \$a < \"\$tf\")\" = \"\$(tr \$a < \"\$tf\")\" || { echo \"tr \$a failed\"; exit 1; }
+done
+out15=\$(fx tr a-z A-Z tr -d 0-9 < \"\$tf\"); exp15=\$(tr a-z A-Z < \"\$tf\" | tr -d 0-9)
+rm -f \"\$tf\"
+test \"\$out15\" = \"\$exp15\" || { echo 'fused tr failed'; exit 1; }
+fx --explain tr a-z A-Z | grep -q '\\[range\\]' || { echo 'tr kernel explain failed'; exit 1; }
+
+# 16) cut field spans: overlaps merged, open ranges past field 4096, lines
+#     with too few fields or no delimiter at all
+cf=\$(mktemp); { seq -s , 1 5000; echo a,b; echo nodelim; echo; seq -s , 1 40; } > \"\$cf\"
+for l in 4999- 3,1-2,2 -3 38-39,5 7 1,4097-4098; do
+  test \"\$(fx cut -d , -f \$l < \"\$cf\")\" = \"\$(cut -d , -f \$l < \"\$cf\")\" || { echo \"cut -f \$l failed\"; exit 1; }
+done
+out16=\$(fx cut -d , -s -f 2 < \"\$cf\" | wc -l)
+rm -f \"\$cf\"
+test \"\$out16\" = 3 || { echo 'cut -s failed'; exit 1; }
+
+# 17) MAP output longer than its input (batch arena): cut with a longer
+#     output delimiter, serial and with workers
+exp17=\$(seq 1 30000 | paste -d , - - - | cut -d , -f 1- --output-delimiter=' <> ' | md5sum)
+out17a=\$(seq 1 30000 | paste -d , - - - | fx cut -d , -f 1- --output-delimiter=' <> ' | md5sum)
+out17b=\$(seq 1 30000 | paste -d , - - - | fx -j 4 cut -d , -f 3,1 --output-delimiter=' <> ' | md5sum)
+test \"\$out17a\" = \"\$exp17\" || { echo 'cut --output-delimiter failed'; exit 1; }
+test \"\$out17b\" = \"\$(seq 1 30000 | paste -d , - - - | cut -d , -f 1,3 --output-delimiter=' <> ' | md5sum)\" || { echo 'cut -j --output-delimiter failed'; exit 1; }
+
+# 18) sub/gsub agree with sed: & and groups, first and global, empty
+#     matches, literals with -i, and with workers
+sf=\$(mktemp); { seq 1 3000; printf 'baaac\n\nhello world\nfoo bar foo\n'; } > \"\$sf\"
+chk18() { test \"\$(fx \"\${@:2}\" < \"\$sf\")\" = \"\$(sed \"\$1\" < \"\$sf\")\" || { echo \"sub \$1 failed\"; exit 1; }; }
+chk18 's/x*/-/g' gsub 'x*' -
+chk18 's/a*/x/' sub 'a*' x
+chk18 's/0/<&>/' sub 0 '<&>'
+chk18 's/\\([0-9]\\)\\([0-9]\\)\$/\\2\\1/' sub '\\([0-9]\\)\\([0-9]\\)\$' '\\2\\1'
+chk18 's/O/\\&0/Ig' sub -g -i -F O '\\&0'
+chk18 's/\\<./X/g' gsub '\\<.' X
+out18=\$(fx -j 4 gsub -E '([0-9])([0-9])' '\\2\\1' < \"\$sf\" | md5sum)
+exp18=\$(sed -E 's/([0-9])([0-9])/\\2\\1/g' < \"\$sf\" | md5sum)
+rm -f \"\$sf\"
+test \"\$out18\" = \"\$exp18\" || { echo 'gsub -j failed'; exit 1; }
+
+# 19) uniq against sort | uniq: counts, distinct lines, keyed on a field,
+#     first-seen streaming, and records emitted at the end going on
+#     through later ops
+uf=\$(mktemp); { seq 1 2000; seq 500 1500; printf 'b,x\na,y\nb,z\n'; } > \"\$uf\"
+test \"\$(fx uniq -c < \"\$uf\")\" = \"\$(LC_ALL=C sort \"\$uf\" | uniq -c)\" || { echo 'uniq -c failed'; exit 1; }
+test \"\$(fx uniq < \"\$uf\")\" = \"\$(LC_ALL=C sort -u \"\$uf\")\" || { echo 'uniq failed'; exit 1; }
+out19a=\$(fx uniq --first -d , -f 1 < \"\$uf\" | tail -n 2 | tr '\\n' ' ')
+out19b=\$(fx uniq -c grep -F '      2 ' take 3 < \"\$uf\")
+exp19b=\$(LC_ALL=C sort \"\$uf\" | uniq -c | grep -F '      2 ' | head -n 3)
+rm -f \"\$uf\"
+test \"\$out19a\" = 'b,x a,y ' || { echo 'uniq --first failed'; exit 1; }
+test \"\$out19b\" = \"\$exp19b\" || { echo 'uniq drain failed'; exit 1; }
+
+# 20) sort against LC_ALL=C sort: lines, -n (signs, fractions, junk), -r,
+#     field keys (an empty first field, -n field by field), and a small -S
+#     that spills and merges more than 64 runs
+of=\$(mktemp); { awk 'BEGIN { for (i = 1; i <= 150000; i++) print (i * 7919) % 150001 \",\" i % 7 }'; printf -- '-1,x\\n-0,y\\n.5,z\\n-.5,a\\n007,b\\n7.000,c\\n  3,d\\nabc,e\\n,f\\n'; } > \"\$of\"
+chk20() { test \"\$(fx sort \$1 < \"\$of\" | md5sum)\" = \"\$(LC_ALL=C sort \$2 \"\$of\" | md5sum)\" || { echo \"sort \$1 failed\"; exit 1; }; }
+chk20 '' ''
+chk20 '-n' '-n'
+chk20 '-r -d , -f 2' '-r -t , -k 2,2'
+chk20 '-n -r -d , -f 1 --parallel=3' '-rn -t , -k 1,1'
+chk20 '-S 32K -d , -f 2' '-t , -k 2,2'
+chk20 '-S 32K -T /tmp -n' '-n'
+out20=\$(fx sort -n -d , -f 1 grep -E '^(1|2),' < \"\$of\" | tr '\\n' ' ')
+rm -f \"\$of\"
+test \"\$out20\" = '1,4 2,3 ' || { echo 'sort drain failed'; exit 1; }
+test \"\$(printf 'a,x,a\\n,x,z\\n,y,a\\n' | fx sort -d , -f 1,3)\" = \"\$(printf 'a,x,a\\n,x,z\\n,y,a\\n' | LC_ALL=C sort -t , -k 1,1 -k 3,3)\" || { echo 'sort empty first key field failed'; exit 1; }
+test \"\$(printf '1,x,10\\n1,x,9\\n-2,y,3\\n1,a,9\\n,b,-1\\n1.0,c,09\\n' | fx sort -n -d , -f 1,3)\" = \"\$(printf '1,x,10\\n1,x,9\\n-2,y,3\\n1,a,9\\n,b,-1\\n1.0,c,09\\n' | LC_ALL=C sort -t , -k 1,1n -k 3,3n)\" || { echo 'sort -n on two fields failed'; exit 1; }
+
+# 21) top -n K against sort | head -n K: numeric and byte keys, largest
+#     first, K past the end of the input, per-worker heaps, and a falling
+#     input that replaces the top on every line
+tf=\$(mktemp); awk 'BEGIN { for (i = 1; i <= 60000; i++) print i % 13 \",\" (i * 7919) % 60013 \",k\" i % 101 }' > \"\$tf\"
+chk21() { test \"\$(fx \$1 < \"\$tf\")\" = \"\$(LC_ALL=C sort \$2 \"\$tf\" | head -n \$3)\" || { echo \"\$1 failed\"; exit 1; }; }
+chk21 'top -n 100 -d , -k 2' '-n -t , -k 2,2' 100
+chk21 'top -n 100 -r -d , -k 2' '-rn -t , -k 2,2' 100
+chk21 'top -n 40 -l -d , -k 3,1' '-t , -k 1,1 -k 3,3' 40
+chk21 'top -n 40 -d , -k 1,2' '-t , -k 1,1n -k 2,2n' 40
+test \"\$(printf 'z,1\\n,1,z\\na,1,a\\n' | fx top -n 2 -l -d , -k 1,3 | tr '\\n' '|')\" = ',1,z|a,1,a|' || { echo 'top empty first key field failed'; exit 1; }
+chk21 'top -n 99999 -r -l' '-r' 99999
+chk21 '-j 4 top -n 500 -d , -k 1' '-n -t , -k 1,1' 500
+out21=\$(seq 1 200000 | sort -rn | fx top -n 3 | tr '\\n' ' ')
+rm -f \"\$tf\"
+test \"\$out21\" = '1 2 3 ' || { echo 'top on falling input failed'; exit 1; }
+
+# 22) agg against awk: count, integer sum, min, max per key; exact decimal
+#     sums; non-numbers skipped; one group without -k; workers merged;
+#     an empty key keeps its column, an empty first key field its delimiter
+af=\$(mktemp); awk 'BEGIN { for (i = 1; i <= 40000; i++) print \"k\" i % 37 \",\" (i * 7919) % 1000 - 500 \",\" i % 9 }' > \"\$af\"
+out22a=\$(fx agg -d , -k 1 count sum:2 min:2 max:3 < \"\$af\")
+exp22a=\$(awk -F , '{ n[\$1]++; s[\$1] += \$2; if (!(\$1 in lo) || \$2 < lo[\$1]) lo[\$1] = \$2; if (\$3 > hi[\$1]) hi[\$1] = \$3 }
+  END { for (k in n) print k \",\" n[k] \",\" s[k] \",\" lo[k] \",\" hi[k] }' \"\$af\" | LC_ALL=C sort)
+test \"\$out22a\" = \"\$exp22a\" || { echo 'agg failed'; exit 1; }
+test \"\$(fx -j 4 agg -d , -k 3,1 sum:2 avg:2 < \"\$af\")\" = \"\$(fx agg -d , -k 3,1 sum:2 avg:2 < \"\$af\")\" || { echo 'agg -j failed'; exit 1; }
+rm -f \"\$af\"
+out22b=\$(printf '0.1\\n0.2\\nx\\n\\n-1.25\\n' | fx agg count sum:1 min:1 max:1 avg:1)
+test \"\$out22b\" = \"\$(printf '5\\t-0.95\\t-1.25\\t0.2\\t-0.316666666666667')\" || { echo 'agg decimals failed'; exit 1; }
+test \"\$(printf 'a,1\\n,2\\n,3\\n' | fx agg -d , -k 1 count sum:2 | tr '\\n' '|')\" = ',2,5|a,1,1|' || { echo 'agg empty key failed'; exit 1; }
+test \"\$(printf ',1,z\\nz,1\\n' | fx agg -d , -k 1,3 count | tr '\\n' '|')\" = ',z,1|z,1|' || { echo 'agg empty first key field failed'; exit 1; }
+
+# 23) join against awk hash joins: appended fields (key first and in the
+#     middle of FILE), semi and anti joins with workers, FILE from a pipe,
+#     first duplicate wins, an empty FILE line is no empty key
+jf=\$(mktemp); js=\$(mktemp)
+seq 1 30000 | awk '{ print \"r\" \$1 \",u\" \$1 % 5003 }' > \"\$js\"
+{ seq 1 2 6000 | awk '{ print \"u\" \$1 \",host\" \$1 % 17 \",z\" }'; echo 'u1,dup,z'; } > \"\$jf\"
+out23a=\$(fx join -d , -f 2 \"\$jf\" < \"\$js\" | md5sum)
+exp23a=\$(awk -F , 'NR == FNR { if (!(\$1 in m)) m[\$1] = \$2 \",\" \$3; next } (\$2 in m) { print \$0 \",\" m[\$2] }' \"\$jf\" \"\$js\" | md5sum)
+test \"\$out23a\" = \"\$exp23a\" || { echo 'join failed'; exit 1; }
+test \"\$(fx join -d , -f 2 -2 2 <(awk -F , '{ print \$2 \",\" \$1 \",\" \$3 }' \"\$jf\") < \"\$js\" | md5sum)\" = \"\$out23a\" || { echo 'join -2 failed'; exit 1; }
+out23b=\$(fx -j 4 join -d , -f 2 --semi \"\$jf\" < \"\$js\" | wc -l)
+out23c=\$(fx -j 4 join -d , -f 2 -v \"\$jf\" < \"\$js\" | wc -l)
+exp23b=\$(awk -F , 'NR == FNR { m[\$1]; next } (\$2 in m)' \"\$jf\" \"\$js\" | wc -l)
+rm -f \"\$jf\" \"\$js\"
+test \"\$out23b\" = \"\$exp23b\" && test \$((out23b + out23c)) = 30000 || { echo 'join --semi/-v failed'; exit 1; }
+test \"\$(printf 'a,\\nb,k\\n' | fx join -d , -f 2 <(printf '\\nk,v\\n') | tr '\\n' '|')\" = 'b,k,v|' || { echo 'join empty FILE line failed'; exit 1; }
+test \"\$(printf 'a,\\n' | fx join -d , -f 2 <(printf ',v\\n'))\" = 'a,,v' || { echo 'join empty key failed'; exit 1; }
+
+# 24) grep --field against awk: one column matched, the field view reused
+#     by a following cut and a fused grep, workers, short lines (empty field)
+gf=\$(mktemp)
+{ seq 1 20000 | awk '{ print \$1 \",c\" \$1 % 97 \",\" (\$1 % 3 ? \"x\" : \"y\") \$1 }'; printf 'short\\n,\\n'; } > \"\$gf\"
+test \"\$(fx grep --field 2 -d , -E '^c1' cut -d , -f 3,1 < \"\$gf\" | md5sum)\" = \"\$(awk -F , '\$2 ~ /^c1/ { print \$1 \",\" \$3 }' \"\$gf\" | md5sum)\" || { echo 'grep --field failed'; exit 1; }
+test \"\$(fx -j 4 grep --field=3 -d, -F y1 grep --field 3 -d , -v -F 5 < \"\$gf\" | md5sum)\" = \"\$(awk -F , '\$3 ~ /y1/ && \$3 !~ /5/' \"\$gf\" | md5sum)\" || { echo 'grep --field -j failed'; exit 1; }
+test \"\$(fx grep --field 2 -d , -E '^\$' < \"\$gf\" | tr '\\n' ' ')\" = 'short , ' || { echo 'grep --field short lines failed'; exit 1; }
+rm -f \"\$gf\"
+
+# 25) cut --csv: quoted delimiters and line breaks, records across lines
+#     and batches, requoting for another output delimiter, CRLF, -s
+test \"\$(printf 'a,\"b,c\",d\\n\"x\"\"y\",\"p\\nq\",z\\n' | fx cut --csv -d , -f 2,3 | tr '\\n' '|')\" = '\"b,c\",d|\"p|q\",z|' || { echo 'cut --csv failed'; exit 1; }
+test \"\$(printf 'a,\"b,c\",d\\n\"x\"\"y\",\"p;q\",z\\n' | fx cut --csv -d , -f 1- --output-delimiter=';' | tr '\\n' '|')\" = 'a;b,c;d|\"x\"\"y\";\"p;q\";z|' || { echo 'cut --csv requote failed'; exit 1; }
+test \"\$(printf 'k,\"v\\r\\nw\",1\\r\\nsolo\\n' | fx cut --csv -d , -s -f 2 | od -An -c | tr -s ' ')\" = ' \" v \\r \\n w \" \\r \\n' || { echo 'cut --csv CRLF/-s failed'; exit 1; }
+cf=\$(mktemp)
+seq 1 30000 | awk '{ print \$1 \",\\\"multi\" \$1 \"\\n,line\\\",\" \$1 * 2 }' > \"\$cf\"
+test \"\$(fx cut --csv -d , -f 3 < \"\$cf\" | md5sum)\" = \"\$(seq 1 30000 | awk '{ print \$1 * 2 }' | md5sum)\" || { echo 'cut --csv across lines failed'; exit 1; }
+rm -f \"\$cf\"
+
+# 26) find against find(1) on one and four threads: -type, -name, -maxdepth,
+#     -print0, a symlink not followed, each directory before its contents,
+#     take stopping the walk, a missing start path
+fd=\$(mktemp -d)
+for a in 1 2 3; do mkdir -p \"\$fd/d\$a/e/f\"; for b in \$(seq 1 50); do : > \"\$fd/d\$a/x\$b.c\"; : > \"\$fd/d\$a/e/y\$b.h\"; : > \"\$fd/d\$a/e/f/z\$b.c\"; done; done
+ln -s d1 \"\$fd/lnk\"
+for j in 1 4; do
+  for args in '' '-type f' '-type d' '-maxdepth 1' '-maxdepth 2 -type d'; do
+    test \"\$(fx find \"\$fd\" -j \$j \$args | LC_ALL=C sort)\" = \"\$(find \"\$fd\" \$args | LC_ALL=C sort)\" || { echo \"find -j \$j \$args failed\"; exit 1; }
+  done
+  test \"\$(fx find \"\$fd\" -j \$j -name 'y*' -print0 | tr '\\0' '\\n' | LC_ALL=C sort)\" = \"\$(find \"\$fd\" -name 'y*' | LC_ALL=C sort)\" || { echo 'find -name -print0 failed'; exit 1; }
+  fx find \"\$fd\" -j \$j | awk '{ seen[\$0] = 1; p = \$0; sub(\"/[^/]*\$\", \"\", p); if (NR > 1 && !(p in seen)) bad = 1 } END { exit bad }' || { echo 'find order failed'; exit 1; }
+  test \"\$(fx find \"\$fd\" -j \$j take 3 | wc -l)\" = 3 || { echo 'find take failed'; exit 1; }
+done
+! fx find \"\$fd/none\" 2>/dev/null || { echo 'find missing path failed'; exit 1; }
+rm -rf \"\$fd\"
+
+# 27) mmap'd files: the bytes read(2) gives across files and a last line
+#     without newline, windows under a small address space (lines across
+#     window ends), stdin left after take N, a file cut while it is read
+mf=\$(mktemp); mg=\$(mktemp)
+awk 'BEGIN { for (i = 1; i <= 150000; i++) { s = i; for (j = i % 97; j > 0; j--) s = s \" ab\"; print s } }' > \"\$mf\"
+printf 'tail1\\ntail2' > \"\$mg\"
+test \"\$(fx cat \"\$mf\" \"\$mg\" sub 1 x | md5sum)\" = \"\$(cat \"\$mf\" \"\$mg\" | sed 's/1/x/' | md5sum)\" || { echo 'mmap cat failed'; exit 1; }
+vsz=\$(awk '/VmSize/ { print \$2 }' /proc/\$\$/status)
+test \"\$( (ulimit -v \$((vsz + 16384)); fx cat \"\$mf\" sub 1 x) | md5sum)\" = \"\$(sed 's/1/x/' \"\$mf\" | md5sum)\" || { echo 'mmap windows failed'; exit 1; }
+test \"\$({ fx take 3; head -n 2; } < \"\$mf\" | cut -d ' ' -f 1 | tr '\\n' ,)\" = '1,2,3,4,5,' || { echo 'mmap stdin offset failed'; exit 1; }
+ff=\$(mktemp -u); mkfifo \"\$ff\"
+{ sleep 0.2; truncate -s 100000 \"\$mf\"; wc -l > \"\$mg\"; } < \"\$ff\" &
+fx cat \"\$mf\" sub 1 x > \"\$ff\" || { echo 'mmap truncated file failed'; exit 1; }
+wait
+test \"\$(cat \"\$mg\")\" -lt 150000 || { echo 'mmap truncated file failed'; exit 1; }
+rm -f \"\$mf\" \"\$mg\" \"\$ff\"
+
+# 28) block line reader (pipes, <(...), devices): lines across read
+#     boundaries, a line longer than FP_READ_MAX, no final newline, CRLF,
+#     empty input, through the split (tr) and unsplit block (grep) paths
+lf=\$(mktemp)
+{ seq 1 200000; head -c 3000000 /dev/zero | tr '\\0' a; echo; seq 7 9; } > \"\$lf\"
+test \"\$(cat \"\$lf\" | fx tr 0-9 a-j | md5sum)\" = \"\$(tr 0-9 a-j < \"\$lf\" | md5sum)\" || { echo 'line reader split failed'; exit 1; }
+test \"\$(fx cat <(cat \"\$lf\") grep -v 5 | md5sum)\" = \"\$(grep -v 5 \"\$lf\" | md5sum)\" || { echo 'line reader block failed'; exit 1; }
+test \"\$(cat \"\$lf\" | fx grep aaaa | wc -c)\" = 3000001 || { echo 'line reader long line failed'; exit 1; }
+rm -f \"\$lf\"
+test \"\$(printf 'ab\\ncd' | fx tr a-z A-Z | od -An -c | tr -d ' ')\" = 'AB\\nCD' || { echo 'line reader last line failed'; exit 1; }
+test \"\$(printf 'ab\\ncd' | fx grep c | od -An -c | tr -d ' ')\" = 'cd' || { echo 'line reader last line failed'; exit 1; }
+test \"\$(printf 'a\\r\\nb\\r\\n' | fx grep -E 'b.\$' | od -An -c | tr -d ' ')\" = 'b\\r\\n' || { echo 'line reader CRLF failed'; exit 1; }
+test \"\$(: | fx tr a b | wc -c)/\$(fx cat /dev/null grep a | wc -c)\" = 0/0 || { echo 'line reader empty input failed'; exit 1; }
+
+# 29) writer: fx cat FILE > FILE2 copies the bytes exactly (copy_file_range)
+#     and into a pipe (splice); rewritten records go out with writev to a
+#     full pipe while a trapped signal interrupts it (EINTR), and to a full
+#     non-blocking pipe (short writes, EAGAIN, then poll)
+wf=\$(mktemp); wg=\$(mktemp); ff=\$(mktemp -u); mkfifo \"\$ff\"
+{ seq 1 300000; printf 'x\\0y\\r\\nno newline'; } > \"\$wf\"
+fx cat \"\$wf\" > \"\$wg\" && cmp -s \"\$wf\" \"\$wg\" || { echo 'writer file copy failed'; exit 1; }
+test \"\$(fx cat \"\$wf\" | md5sum)\" = \"\$(md5sum < \"\$wf\")\" || { echo 'writer pipe copy failed'; exit 1; }
+want=\$(sed 's/1/x/' \"\$wf\" | md5sum)
+trap : USR1
+{ sleep 0.2; md5sum > \"\$wg\"; } < \"\$ff\" &
+( while kill -USR1 \$\$; do sleep 0.01; done ) & kp=\$!
+fx cat \"\$wf\" sub 1 x > \"\$ff\" || { echo 'writer EINTR failed'; exit 1; }
+kill \$kp; until wait; do :; done
+trap - USR1
+test \"\$(cat \"\$wg\")\" = \"\$want\" || { echo 'writer EINTR failed'; exit 1; }
+if command -v perl >/dev/null; then
+  { sleep 0.2; md5sum > \"\$wg\"; } < \"\$ff\" &
+  { perl -MFcntl -e 'fcntl(STDOUT, F_SETFL, fcntl(STDOUT, F_GETFL, 0) | O_NONBLOCK) or die'; fx cat \"\$wf\" sub 1 x; } > \"\$ff\" || { echo 'writer EAGAIN failed'; exit 1; }
+  wait
+  test \"\$(cat \"\$wg\")\" = \"\$want\" || { echo 'writer EAGAIN failed'; exit 1; }
+fi
+rm -f \"\$wf\" \"\$wg\" \"\$ff\"
 
 echo 'OK'
 "